@@ -0,0 +1,384 @@
+#include "aabb_tree.h"
+#include <algorithm>
+
+static bool IsLeaf(const AABBTreeNode& node)
+{
+    return node.height == 0;
+}
+
+static u32 AllocateNode(AABBTree& tree)
+{
+    u32 index;
+    if (tree.freeList != AABB_TREE_NULL)
+    {
+        index = tree.freeList;
+        tree.freeList = tree.nodes[index].parent;
+    }
+    else
+    {
+        index = tree.nodes.size();
+        tree.nodes.push_back(AABBTreeNode());
+    }
+
+    AABBTreeNode& node = tree.nodes[index];
+    node.parent = AABB_TREE_NULL;
+    node.children[0] = AABB_TREE_NULL;
+    node.children[1] = AABB_TREE_NULL;
+    node.height = 0;
+    node.categories = 0;
+    node.userData = 0;
+    return index;
+}
+
+static void FreeNode(AABBTree& tree, u32 index)
+{
+    tree.nodes[index].parent = tree.freeList;
+    tree.nodes[index].height = -1;
+    tree.freeList = index;
+}
+
+static void RefitNode(AABBTree& tree, u32 index)
+{
+    AABBTreeNode& node = tree.nodes[index];
+    const AABBTreeNode& child0 = tree.nodes[node.children[0]];
+    const AABBTreeNode& child1 = tree.nodes[node.children[1]];
+    node.aabb = MergeAABB(child0.aabb, child1.aabb);
+    node.height = 1 + glm::max(child0.height, child1.height);
+    node.categories = child0.categories | child1.categories;
+}
+
+// Swaps the child of A at childSlot with the grandchild at grandchildSlot below its sibling
+static void SwapWithGrandchild(AABBTree& tree, u32 indexA, u32 childSlot, u32 grandchildSlot)
+{
+    AABBTreeNode& a = tree.nodes[indexA];
+    const u32 indexX = a.children[childSlot];
+    const u32 indexP = a.children[1 - childSlot];
+    AABBTreeNode& p = tree.nodes[indexP];
+    const u32 indexY = p.children[grandchildSlot];
+
+    a.children[childSlot] = indexY;
+    tree.nodes[indexY].parent = indexA;
+    p.children[grandchildSlot] = indexX;
+    tree.nodes[indexX].parent = indexP;
+
+    RefitNode(tree, indexP);
+}
+
+// Tries the four swaps between a child and a grandchild of A and applies the one that shrinks
+// the surface area of the modified child the most. A's own box does not change.
+static void RotateNode(AABBTree& tree, u32 indexA)
+{
+    const AABBTreeNode& a = tree.nodes[indexA];
+    if (a.height < 2)
+        return;
+
+    f32 bestReduction = 0.0f;
+    u32 bestChildSlot = 0;
+    u32 bestGrandchildSlot = 0;
+
+    for (u32 childSlot = 0; childSlot < 2; ++childSlot)
+    {
+        const AABBTreeNode& x = tree.nodes[a.children[childSlot]];
+        const AABBTreeNode& p = tree.nodes[a.children[1 - childSlot]];
+        if (IsLeaf(p))
+            continue;
+
+        const f32 area = AABBSurfaceArea(p.aabb);
+        for (u32 grandchildSlot = 0; grandchildSlot < 2; ++grandchildSlot)
+        {
+            // X takes the place of the grandchild, next to the one that stays
+            const AABBTreeNode& stays = tree.nodes[p.children[1 - grandchildSlot]];
+            const f32 reduction = area - AABBSurfaceArea(MergeAABB(x.aabb, stays.aabb));
+            if (reduction > bestReduction)
+            {
+                bestReduction = reduction;
+                bestChildSlot = childSlot;
+                bestGrandchildSlot = grandchildSlot;
+            }
+        }
+    }
+
+    if (bestReduction > 0.0f)
+        SwapWithGrandchild(tree, indexA, bestChildSlot, bestGrandchildSlot);
+}
+
+// Walks up to the root rotating and refitting every ancestor
+static void RefitAncestors(AABBTree& tree, u32 index)
+{
+    while (index != AABB_TREE_NULL)
+    {
+        RotateNode(tree, index);
+        RefitNode(tree, index);
+        index = tree.nodes[index].parent;
+    }
+}
+
+static void InsertLeaf(AABBTree& tree, u32 leaf)
+{
+    if (tree.root == AABB_TREE_NULL)
+    {
+        tree.root = leaf;
+        tree.nodes[leaf].parent = AABB_TREE_NULL;
+        return;
+    }
+
+    // Descend while creating the new parent further down is cheaper than doing it here.
+    // The cost of a node is its surface area, plus what its ancestors grow by.
+    const AABB leafAABB = tree.nodes[leaf].aabb;
+    u32 index = tree.root;
+    while (!IsLeaf(tree.nodes[index]))
+    {
+        const AABBTreeNode& node = tree.nodes[index];
+
+        const f32 area = AABBSurfaceArea(node.aabb);
+        const f32 combinedArea = AABBSurfaceArea(MergeAABB(node.aabb, leafAABB));
+
+        const f32 siblingCost = 2.0f * combinedArea;
+        const f32 inheritanceCost = 2.0f * (combinedArea - area);
+
+        f32 childCosts[2];
+        for (u32 i = 0; i < 2; ++i)
+        {
+            const AABBTreeNode& child = tree.nodes[node.children[i]];
+            const f32 mergedArea = AABBSurfaceArea(MergeAABB(child.aabb, leafAABB));
+            childCosts[i] = (IsLeaf(child) ? mergedArea : mergedArea - AABBSurfaceArea(child.aabb)) + inheritanceCost;
+        }
+
+        if (siblingCost < childCosts[0] && siblingCost < childCosts[1])
+            break;
+
+        index = childCosts[0] < childCosts[1] ? node.children[0] : node.children[1];
+    }
+
+    const u32 sibling = index;
+    const u32 oldParent = tree.nodes[sibling].parent;
+    const u32 newParent = AllocateNode(tree);
+
+    tree.nodes[newParent].parent = oldParent;
+    tree.nodes[newParent].children[0] = sibling;
+    tree.nodes[newParent].children[1] = leaf;
+    tree.nodes[sibling].parent = newParent;
+    tree.nodes[leaf].parent = newParent;
+
+    if (oldParent == AABB_TREE_NULL)
+    {
+        tree.root = newParent;
+    }
+    else
+    {
+        AABBTreeNode& parent = tree.nodes[oldParent];
+        parent.children[parent.children[0] == sibling ? 0 : 1] = newParent;
+    }
+
+    RefitAncestors(tree, newParent);
+}
+
+static void RemoveLeaf(AABBTree& tree, u32 leaf)
+{
+    if (leaf == tree.root)
+    {
+        tree.root = AABB_TREE_NULL;
+        return;
+    }
+
+    const u32 parent = tree.nodes[leaf].parent;
+    const u32 grandparent = tree.nodes[parent].parent;
+    const u32 sibling = tree.nodes[parent].children[tree.nodes[parent].children[0] == leaf ? 1 : 0];
+
+    // The sibling takes the place of the parent
+    tree.nodes[sibling].parent = grandparent;
+    FreeNode(tree, parent);
+
+    if (grandparent == AABB_TREE_NULL)
+    {
+        tree.root = sibling;
+    }
+    else
+    {
+        AABBTreeNode& node = tree.nodes[grandparent];
+        node.children[node.children[0] == parent ? 0 : 1] = sibling;
+        RefitAncestors(tree, grandparent);
+    }
+}
+
+static AABB FattenAABB(const AABB& aabb)
+{
+    AABB fat;
+    fat.min = aabb.min - glm::vec3(AABB_TREE_MARGIN);
+    fat.max = aabb.max + glm::vec3(AABB_TREE_MARGIN);
+    return fat;
+}
+
+u32 CreateProxy(AABBTree& tree, const AABB& aabb, u32 category, u32 userData)
+{
+    const u32 proxyId = AllocateNode(tree);
+    AABBTreeNode& node = tree.nodes[proxyId];
+    node.aabb = FattenAABB(aabb);
+    node.categories = category;
+    node.userData = userData;
+
+    InsertLeaf(tree, proxyId);
+    tree.proxyCount++;
+    return proxyId;
+}
+
+void DestroyProxy(AABBTree& tree, u32 proxyId)
+{
+    ASSERT(proxyId < tree.nodes.size() && IsLeaf(tree.nodes[proxyId]), "Invalid proxy");
+
+    RemoveLeaf(tree, proxyId);
+    FreeNode(tree, proxyId);
+    tree.proxyCount--;
+}
+
+bool MoveProxy(AABBTree& tree, u32 proxyId, const AABB& aabb)
+{
+    ASSERT(proxyId < tree.nodes.size() && IsLeaf(tree.nodes[proxyId]), "Invalid proxy");
+
+    if (AABBContains(tree.nodes[proxyId].aabb, aabb))
+        return false;
+
+    RemoveLeaf(tree, proxyId);
+    tree.nodes[proxyId].aabb = FattenAABB(aabb);
+    InsertLeaf(tree, proxyId);
+    return true;
+}
+
+u32 GetProxyUserData(const AABBTree& tree, u32 proxyId)
+{
+    return tree.nodes[proxyId].userData;
+}
+
+const AABB& GetFatAABB(const AABBTree& tree, u32 proxyId)
+{
+    return tree.nodes[proxyId].aabb;
+}
+
+u32 GetAABBTreeHeight(const AABBTree& tree)
+{
+    return tree.root == AABB_TREE_NULL ? 0 : tree.nodes[tree.root].height;
+}
+
+// Depth first walk that only enters the nodes that pass the test
+template <typename TestFunction>
+static void QueryTree(const AABBTree& tree, u32 categoryMask, std::vector<u32>& results, TestFunction test)
+{
+    if (tree.root == AABB_TREE_NULL)
+        return;
+
+    std::vector<u32> stack;
+    stack.reserve(64);
+    stack.push_back(tree.root);
+
+    while (!stack.empty())
+    {
+        const AABBTreeNode& node = tree.nodes[stack.back()];
+        stack.pop_back();
+
+        if (!(node.categories & categoryMask) || !test(node.aabb))
+            continue;
+
+        if (IsLeaf(node))
+        {
+            results.push_back(node.userData);
+        }
+        else
+        {
+            stack.push_back(node.children[0]);
+            stack.push_back(node.children[1]);
+        }
+    }
+}
+
+void QueryFrustum(const AABBTree& tree, const Frustum& frustum, u32 categoryMask, std::vector<u32>& results)
+{
+    if (tree.root == AABB_TREE_NULL)
+        return;
+
+    // Once a node is completely inside, its whole subtree is accepted without more plane tests
+    const u32 insideBit = 0x80000000;
+
+    std::vector<u32> stack;
+    stack.reserve(64);
+    stack.push_back(tree.root);
+
+    while (!stack.empty())
+    {
+        const u32 entry = stack.back();
+        stack.pop_back();
+
+        const AABBTreeNode& node = tree.nodes[entry & ~insideBit];
+        if (!(node.categories & categoryMask))
+            continue;
+
+        u32 inside = entry & insideBit;
+        if (!inside)
+        {
+            if (!FrustumIntersectsAABB(frustum, node.aabb))
+                continue;
+            if (FrustumContainsAABB(frustum, node.aabb))
+                inside = insideBit;
+        }
+
+        if (IsLeaf(node))
+        {
+            results.push_back(node.userData);
+        }
+        else
+        {
+            stack.push_back(node.children[0] | inside);
+            stack.push_back(node.children[1] | inside);
+        }
+    }
+}
+
+void QuerySphere(const AABBTree& tree, const glm::vec3& center, f32 radius, u32 categoryMask, std::vector<u32>& results)
+{
+    QueryTree(tree, categoryMask, results, [&](const AABB& aabb) {
+        return SphereIntersectsAABB(center, radius, aabb);
+    });
+}
+
+void QueryBox(const AABBTree& tree, const AABB& aabb, u32 categoryMask, std::vector<u32>& results)
+{
+    QueryTree(tree, categoryMask, results, [&](const AABB& nodeAABB) {
+        return AABBOverlap(aabb, nodeAABB);
+    });
+}
+
+void QueryRay(const AABBTree& tree, const glm::vec3& origin, const glm::vec3& direction, f32 maxDistance, u32 categoryMask, std::vector<u32>& results)
+{
+    if (tree.root == AABB_TREE_NULL)
+        return;
+
+    const glm::vec3 invDirection = 1.0f / direction;
+
+    std::vector<std::pair<f32, u32>> hits;
+    std::vector<u32> stack;
+    stack.reserve(64);
+    stack.push_back(tree.root);
+
+    while (!stack.empty())
+    {
+        const AABBTreeNode& node = tree.nodes[stack.back()];
+        stack.pop_back();
+
+        f32 tHit;
+        if (!(node.categories & categoryMask) || !RayIntersectsAABB(origin, invDirection, maxDistance, node.aabb, &tHit))
+            continue;
+
+        if (IsLeaf(node))
+        {
+            hits.push_back(std::make_pair(tHit, node.userData));
+        }
+        else
+        {
+            stack.push_back(node.children[0]);
+            stack.push_back(node.children[1]);
+        }
+    }
+
+    std::sort(hits.begin(), hits.end());
+    for (u32 i = 0; i < hits.size(); ++i)
+        results.push_back(hits[i].second);
+}
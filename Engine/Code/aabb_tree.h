@@ -0,0 +1,73 @@
+//
+// aabb_tree.h: Dynamic bounding volume hierarchy used as the scene spatial index. Leaves store
+// a fattened box so small movements do not touch the tree, insertion descends following the
+// surface area heuristic and tree rotations keep it balanced as proxies come and go.
+//
+
+#pragma once
+
+#include "platform.h"
+#include "bounds.h"
+
+#define AABB_TREE_NULL   UINT32_MAX
+#define AABB_TREE_MARGIN 0.1f
+
+// What a proxy stands for, queries take a mask of these
+enum SpatialCategory
+{
+    SpatialCategory_Entity     = 1 << 0, // userData is the entity slot
+    SpatialCategory_PointLight = 1 << 1, // userData is the index in App::lights
+    SpatialCategory_All        = 0xffffffff,
+};
+
+struct AABBTreeNode
+{
+    AABB aabb;        // Fat box for leaves, union of the children otherwise
+    u32  parent;      // Next free node while the node is in the free list
+    u32  children[2]; // AABB_TREE_NULL for leaves
+    i32  height;      // 0 for leaves, -1 for free nodes
+    u32  categories;  // Union of the categories below, so queries can skip whole subtrees
+    u32  userData;
+};
+
+struct AABBTree
+{
+    std::vector<AABBTreeNode> nodes;
+    u32 root = AABB_TREE_NULL;
+    u32 freeList = AABB_TREE_NULL;
+    u32 proxyCount = 0;
+};
+
+/**
+ * Returns the proxy id, which stays valid until the proxy is destroyed.
+ */
+u32 CreateProxy(AABBTree& tree, const AABB& aabb, u32 category, u32 userData);
+
+void DestroyProxy(AABBTree& tree, u32 proxyId);
+
+/**
+ * Reinserts the proxy only when the new box is no longer inside the fat one.
+ * Returns true if the tree changed.
+ */
+bool MoveProxy(AABBTree& tree, u32 proxyId, const AABB& aabb);
+
+u32 GetProxyUserData(const AABBTree& tree, u32 proxyId);
+
+const AABB& GetFatAABB(const AABBTree& tree, u32 proxyId);
+
+u32 GetAABBTreeHeight(const AABBTree& tree);
+
+/**
+ * The queries append the userData of the proxies whose fat box passes the test. Callers that
+ * need exact results test their tight bounds afterwards.
+ */
+void QueryFrustum(const AABBTree& tree, const Frustum& frustum, u32 categoryMask, std::vector<u32>& results);
+
+void QuerySphere(const AABBTree& tree, const glm::vec3& center, f32 radius, u32 categoryMask, std::vector<u32>& results);
+
+void QueryBox(const AABBTree& tree, const AABB& aabb, u32 categoryMask, std::vector<u32>& results);
+
+/**
+ * Results are sorted from the closest hit to the furthest.
+ */
+void QueryRay(const AABBTree& tree, const glm::vec3& origin, const glm::vec3& direction, f32 maxDistance, u32 categoryMask, std::vector<u32>& results);
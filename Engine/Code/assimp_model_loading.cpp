@@ -2,8 +2,16 @@
 #include <assimp/scene.h>
 #include <assimp/postprocess.h>
 #include "engine.h"
+#include "job_system.h"
 
-void ProcessAssimpMesh(const aiScene* scene, aiMesh *mesh, Mesh *myMesh, u32 baseMeshMaterialIndex, std::vector<u32>& submeshMaterialIndices)
+// Texture files referenced by the materials, decoded all together once every material is known
+struct TextureRequest
+{
+    std::string filepath;
+    u32*        textureIdx;
+};
+
+void ProcessAssimpMesh(const aiScene* scene, aiMesh *mesh, Submesh& submesh)
 {
     std::vector<float> vertices;
     std::vector<u32> indices;
@@ -59,9 +67,6 @@ void ProcessAssimpMesh(const aiScene* scene, aiMesh *mesh, Mesh *myMesh, u32 bas
         }
     }
 
-    // store the proper (previously proceessed) material for this mesh
-    submeshMaterialIndices.push_back(baseMeshMaterialIndex + mesh->mMaterialIndex);
-
     // create the vertex format
     VertexBufferLayout vertexBufferLayout = {};
     vertexBufferLayout.attributes.push_back( VertexBufferAttribute{ 0, 3, 0 } );
@@ -81,15 +86,24 @@ void ProcessAssimpMesh(const aiScene* scene, aiMesh *mesh, Mesh *myMesh, u32 bas
         vertexBufferLayout.stride += 3 * sizeof(float);
     }
 
-    // add the submesh into the mesh
-    Submesh submesh = {};
+    // bounds in the space of the node(s) referencing the mesh
+    submesh.aabb = MakeEmptyAABB();
+    for(unsigned int i = 0; i < mesh->mNumVertices; i++)
+    {
+        const vec3 position(mesh->mVertices[i].x, mesh->mVertices[i].y, mesh->mVertices[i].z);
+        submesh.aabb.min = glm::min(submesh.aabb.min, position);
+        submesh.aabb.max = glm::max(submesh.aabb.max, position);
+    }
+
+    SimplifyOccluder(vertices.data(), vertexBufferLayout.stride / sizeof(float), mesh->mNumVertices, indices.data(), indices.size(), SOFTWARE_OCCLUSION_OCCLUDER_TRIANGLES, submesh.occluder);
+
+    // fill the submesh slot reserved for this mesh
     submesh.vertexBufferLayout = vertexBufferLayout;
     submesh.vertices.swap(vertices);
     submesh.indices.swap(indices);
-    myMesh->submeshes.push_back( submesh );
 }
 
-void ProcessAssimpMaterial(App* app, aiMaterial *material, Material& myMaterial, String directory)
+void ProcessAssimpMaterial(aiMaterial *material, Material& myMaterial, String directory, std::vector<TextureRequest>& textureRequests)
 {
     aiString name;
     aiColor3D diffuseColor;
@@ -106,6 +120,11 @@ void ProcessAssimpMaterial(App* app, aiMaterial *material, Material& myMaterial,
     myMaterial.albedo = vec3(diffuseColor.r, diffuseColor.g, diffuseColor.b);
     myMaterial.emissive = vec3(emissiveColor.r, emissiveColor.g, emissiveColor.b);
     myMaterial.smoothness = shininess / 256.0f;
+    myMaterial.albedoTextureIdx = UINT32_MAX;
+    myMaterial.emissiveTextureIdx = UINT32_MAX;
+    myMaterial.specularTextureIdx = UINT32_MAX;
+    myMaterial.normalsTextureIdx = UINT32_MAX;
+    myMaterial.bumpTextureIdx = UINT32_MAX;
 
     aiString aiFilename;
     if (material->GetTextureCount(aiTextureType_DIFFUSE) > 0)
@@ -113,53 +132,68 @@ void ProcessAssimpMaterial(App* app, aiMaterial *material, Material& myMaterial,
         material->GetTexture(aiTextureType_DIFFUSE, 0, &aiFilename);
         String filename = MakeString(aiFilename.C_Str());
         String filepath = MakePath(directory, filename);
-        myMaterial.albedoTextureIdx = LoadTexture2D(app, filepath.str);
+        textureRequests.push_back({ filepath.str, &myMaterial.albedoTextureIdx });
     }
     if (material->GetTextureCount(aiTextureType_EMISSIVE) > 0)
     {
         material->GetTexture(aiTextureType_EMISSIVE, 0, &aiFilename);
         String filename = MakeString(aiFilename.C_Str());
         String filepath = MakePath(directory, filename);
-        myMaterial.emissiveTextureIdx = LoadTexture2D(app, filepath.str);
+        textureRequests.push_back({ filepath.str, &myMaterial.emissiveTextureIdx });
     }
     if (material->GetTextureCount(aiTextureType_SPECULAR) > 0)
     {
         material->GetTexture(aiTextureType_SPECULAR, 0, &aiFilename);
         String filename = MakeString(aiFilename.C_Str());
         String filepath = MakePath(directory, filename);
-        myMaterial.specularTextureIdx = LoadTexture2D(app, filepath.str);
+        textureRequests.push_back({ filepath.str, &myMaterial.specularTextureIdx });
     }
     if (material->GetTextureCount(aiTextureType_NORMALS) > 0)
     {
         material->GetTexture(aiTextureType_NORMALS, 0, &aiFilename);
         String filename = MakeString(aiFilename.C_Str());
         String filepath = MakePath(directory, filename);
-        myMaterial.normalsTextureIdx = LoadTexture2D(app, filepath.str);
+        textureRequests.push_back({ filepath.str, &myMaterial.normalsTextureIdx });
     }
     if (material->GetTextureCount(aiTextureType_HEIGHT) > 0)
     {
         material->GetTexture(aiTextureType_HEIGHT, 0, &aiFilename);
         String filename = MakeString(aiFilename.C_Str());
         String filepath = MakePath(directory, filename);
-        myMaterial.bumpTextureIdx = LoadTexture2D(app, filepath.str);
+        textureRequests.push_back({ filepath.str, &myMaterial.bumpTextureIdx });
     }
 
     //myMaterial.createNormalFromBump();
 }
 
-void ProcessAssimpNode(const aiScene* scene, aiNode *node, Mesh *myMesh, u32 baseMeshMaterialIndex, std::vector<u32>& submeshMaterialIndices)
+// Keeps the scene graph: every node stores its local transform and the meshes it references,
+// so a mesh used by several nodes ends up drawn several times instead of duplicated
+void ProcessAssimpNode(const aiScene* scene, aiNode *node, u32 parent, Model& model)
 {
+    aiVector3D scaling;
+    aiQuaternion rotation;
+    aiVector3D position;
+    node->mTransformation.Decompose(scaling, rotation, position);
+
+    ModelNode myNode = {};
+    myNode.position = vec3(position.x, position.y, position.z);
+    myNode.rotation = glm::quat(rotation.w, rotation.x, rotation.y, rotation.z);
+    myNode.scale = vec3(scaling.x, scaling.y, scaling.z);
+    myNode.parent = parent;
+
     // process all the node's meshes (if any)
     for(unsigned int i = 0; i < node->mNumMeshes; i++)
     {
-        aiMesh *mesh = scene->mMeshes[node->mMeshes[i]];
-        ProcessAssimpMesh(scene, mesh, myMesh, baseMeshMaterialIndex, submeshMaterialIndices);
+        myNode.submeshes.push_back(node->mMeshes[i]);
     }
 
+    u32 nodeIdx = model.nodes.size();
+    model.nodes.push_back(myNode);
+
     // then do the same for each of its children
     for(unsigned int i = 0; i < node->mNumChildren; i++)
     {
-        ProcessAssimpNode(scene, node->mChildren[i], myMesh, baseMeshMaterialIndex, submeshMaterialIndices);
+        ProcessAssimpNode(scene, node->mChildren[i], nodeIdx, model);
     }
 }
 
@@ -170,7 +204,6 @@ u32 LoadModel(App* app, const char* filename)
                                         aiProcess_GenSmoothNormals      |
                                         aiProcess_CalcTangentSpace      |
                                         aiProcess_JoinIdenticalVertices |
-                                        aiProcess_PreTransformVertices  |
                                         aiProcess_ImproveCacheLocality  |
                                         aiProcess_OptimizeMeshes        |
                                         aiProcess_SortByPType);
@@ -192,26 +225,64 @@ u32 LoadModel(App* app, const char* filename)
 
     String directory = GetDirectoryPart(MakeString(filename));
 
-    // Create a list of materials
+    // Create a list of materials. The vector is resized up front so the texture requests can
+    // point straight at the material slots.
     u32 baseMeshMaterialIndex = (u32)app->materials.size();
+    app->materials.resize(baseMeshMaterialIndex + scene->mNumMaterials);
+
+    std::vector<TextureRequest> textureRequests;
     for (unsigned int i = 0; i < scene->mNumMaterials; ++i)
     {
-        app->materials.push_back(Material{});
-        Material& material = app->materials.back();
-        ProcessAssimpMaterial(app, scene->mMaterials[i], material, directory);
+        Material& material = app->materials[baseMeshMaterialIndex + i];
+        ProcessAssimpMaterial(scene->mMaterials[i], material, directory, textureRequests);
     }
 
-    ProcessAssimpNode(scene, scene->mRootNode, &mesh, baseMeshMaterialIndex, model.materialIdx);
+    std::vector<const char*> texturePaths(textureRequests.size());
+    std::vector<u32> textureIndices(textureRequests.size());
+    for (u32 i = 0; i < textureRequests.size(); ++i)
+        texturePaths[i] = textureRequests[i].filepath.c_str();
+
+    LoadTextures2D(app, texturePaths.data(), texturePaths.size(), textureIndices.data());
+
+    for (u32 i = 0; i < textureRequests.size(); ++i)
+        *textureRequests[i].textureIdx = textureIndices[i];
+
+    // One submesh per Assimp mesh, the nodes reference them by index
+    mesh.submeshes.resize(scene->mNumMeshes);
+    model.materialIdx.resize(scene->mNumMeshes);
+
+    ParallelFor(scene->mNumMeshes, 1, [&](u32 begin, u32 end) {
+        for (u32 i = begin; i < end; ++i)
+        {
+            ProcessAssimpMesh(scene, scene->mMeshes[i], mesh.submeshes[i]);
+
+            // store the proper (previously proceessed) material for this mesh
+            model.materialIdx[i] = baseMeshMaterialIndex + scene->mMeshes[i]->mMaterialIndex;
+        }
+    });
+
+    ProcessAssimpNode(scene, scene->mRootNode, UINT32_MAX, model);
 
     aiReleaseImport(scene);
 
+    for (u32 i = 0; i < model.nodes.size(); ++i)
+    {
+        ModelNode& node = model.nodes[i];
+        node.localBounds = MakeEmptyAABB();
+        for (u32 j = 0; j < node.submeshes.size(); ++j)
+            node.localBounds = MergeAABB(node.localBounds, mesh.submeshes[node.submeshes[j]].aabb);
+    }
+
     u32 vertexBufferSize = 0;
     u32 indexBufferSize = 0;
+    u32 positionBufferSize = 0;
 
     for (u32 i = 0; i < mesh.submeshes.size(); ++i)
     {
-        vertexBufferSize += mesh.submeshes[i].vertices.size() * sizeof(float);
-        indexBufferSize  += mesh.submeshes[i].indices.size()  * sizeof(u32);
+        const u32 floatStride = mesh.submeshes[i].vertexBufferLayout.stride / sizeof(float);
+        vertexBufferSize   += mesh.submeshes[i].vertices.size() * sizeof(float);
+        indexBufferSize    += mesh.submeshes[i].indices.size()  * sizeof(u32);
+        positionBufferSize += mesh.submeshes[i].vertices.size() / floatStride * sizeof(glm::vec3);
     }
 
     glGenBuffers(1, &mesh.vertexBufferHandle);
@@ -240,6 +311,36 @@ u32 LoadModel(App* app, const char* filename)
         indicesOffset += indicesSize;
     }
 
+    // Depth only passes fetch just the positions, packed in a buffer of their own
+    glGenBuffers(1, &mesh.positionBufferHandle);
+    glBindBuffer(GL_ARRAY_BUFFER, mesh.positionBufferHandle);
+    glBufferData(GL_ARRAY_BUFFER, positionBufferSize, NULL, GL_STATIC_DRAW);
+
+    u32 positionsOffset = 0;
+
+    for (u32 i = 0; i < mesh.submeshes.size(); ++i)
+    {
+        Submesh& submesh = mesh.submeshes[i];
+        const u32 floatStride = submesh.vertexBufferLayout.stride / sizeof(float);
+        const u32 vertexCount = submesh.vertices.size() / floatStride;
+
+        std::vector<glm::vec3> positions(vertexCount);
+        for (u32 j = 0; j < vertexCount; ++j)
+            positions[j] = glm::vec3(submesh.vertices[j * floatStride], submesh.vertices[j * floatStride + 1], submesh.vertices[j * floatStride + 2]);
+
+        glBindBuffer(GL_ARRAY_BUFFER, mesh.positionBufferHandle);
+        glBufferSubData(GL_ARRAY_BUFFER, positionsOffset, vertexCount * sizeof(glm::vec3), positions.data());
+        submesh.positionOffset = positionsOffset;
+        positionsOffset += vertexCount * sizeof(glm::vec3);
+
+        glGenVertexArrays(1, &submesh.depthVao);
+        glBindVertexArray(submesh.depthVao);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh.indexBufferHandle);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), (void*)(u64)submesh.positionOffset);
+        glEnableVertexAttribArray(0);
+        glBindVertexArray(0);
+    }
+
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
     glBindBuffer(GL_ARRAY_BUFFER, 0);
 
@@ -0,0 +1,36 @@
+#include "block_layout.h"
+
+bool VerifyBlockLayout(GLuint program, const char* blockName, u32 size, const BlockMember* members, u32 memberCount)
+{
+    const GLuint blockIndex = glGetUniformBlockIndex(program, blockName);
+    if (blockIndex == GL_INVALID_INDEX)
+        return true;
+
+    bool matches = true;
+
+    GLint dataSize = 0;
+    glGetActiveUniformBlockiv(program, blockIndex, GL_UNIFORM_BLOCK_DATA_SIZE, &dataSize);
+    if ((u32)dataSize != size)
+    {
+        ELOG("Block %s is %d bytes in the shader and %u in C++", blockName, dataSize, size);
+        matches = false;
+    }
+
+    for (u32 i = 0; i < memberCount; ++i)
+    {
+        GLuint uniformIndex;
+        glGetUniformIndices(program, 1, &members[i].name, &uniformIndex);
+        if (uniformIndex == GL_INVALID_INDEX)
+            continue;
+
+        GLint offset = 0;
+        glGetActiveUniformsiv(program, 1, &uniformIndex, GL_UNIFORM_OFFSET, &offset);
+        if ((u32)offset != members[i].offset)
+        {
+            ELOG("%s.%s is at offset %d in the shader and %u in C++", blockName, members[i].name, offset, members[i].offset);
+            matches = false;
+        }
+    }
+
+    return matches;
+}
@@ -0,0 +1,104 @@
+//
+// block_layout.h: C++ mirrors of the std140 and std430 blocks of the shaders. Members are declared
+// with STD140() or STD430(), which give them the base alignment their GLSL type has in that layout,
+// so the compiler places them where GL does. The blocks static_assert their offsets, the programs
+// are checked against them with VerifyBlockLayout() once linked, and a whole block goes into a
+// buffer with a single copy.
+//
+
+#pragma once
+
+#include "platform.h"
+#include <glad/glad.h>
+#include <cstddef>
+
+enum BlockLayout
+{
+    BlockLayout_Std140,
+    BlockLayout_Std430
+};
+
+// Base alignment of a member of type T. Structs take the largest alignment of their members,
+// which std140 rounds up to a vec4.
+template <BlockLayout Layout, typename T>
+struct BlockAlignment { static constexpr u32 value = (Layout == BlockLayout_Std140 && alignof(T) < 16) ? 16 : alignof(T); };
+
+template <BlockLayout Layout> struct BlockAlignment<Layout, u32>        { static constexpr u32 value = 4; };
+template <BlockLayout Layout> struct BlockAlignment<Layout, i32>        { static constexpr u32 value = 4; };
+template <BlockLayout Layout> struct BlockAlignment<Layout, f32>        { static constexpr u32 value = 4; };
+template <BlockLayout Layout> struct BlockAlignment<Layout, glm::vec2>  { static constexpr u32 value = 8; };
+template <BlockLayout Layout> struct BlockAlignment<Layout, glm::ivec2> { static constexpr u32 value = 8; };
+template <BlockLayout Layout> struct BlockAlignment<Layout, glm::vec3>  { static constexpr u32 value = 16; };
+template <BlockLayout Layout> struct BlockAlignment<Layout, glm::vec4>  { static constexpr u32 value = 16; };
+template <BlockLayout Layout> struct BlockAlignment<Layout, glm::ivec4> { static constexpr u32 value = 16; };
+template <BlockLayout Layout> struct BlockAlignment<Layout, glm::mat4>  { static constexpr u32 value = 16; };
+
+#define STD140(...) alignas(BlockAlignment<BlockLayout_Std140, __VA_ARGS__>::value) __VA_ARGS__
+#define STD430(...) alignas(BlockAlignment<BlockLayout_Std430, __VA_ARGS__>::value) __VA_ARGS__
+
+template <typename T, u32 Padding>
+struct BlockArrayElement
+{
+    T  value;
+    u8 padding[Padding];
+};
+
+template <typename T>
+struct BlockArrayElement<T, 0>
+{
+    T value;
+};
+
+// std140 rounds the alignment and the stride of every array up to a vec4, std430 keeps the ones
+// of the element
+template <BlockLayout Layout, typename T>
+struct BlockArrayAlignment { static constexpr u32 value = (Layout == BlockLayout_Std140 && BlockAlignment<Layout, T>::value < 16) ? 16 : BlockAlignment<Layout, T>::value; };
+
+template <BlockLayout Layout, typename T, u32 Count>
+struct alignas(BlockArrayAlignment<Layout, T>::value) BlockArray
+{
+    static constexpr u32 stride = (sizeof(T) + BlockArrayAlignment<Layout, T>::value - 1) / BlockArrayAlignment<Layout, T>::value * BlockArrayAlignment<Layout, T>::value;
+
+    BlockArrayElement<T, stride - sizeof(T)> elements[Count];
+
+    T&       operator[](u32 i)       { return elements[i].value; }
+    const T& operator[](u32 i) const { return elements[i].value; }
+};
+
+template <typename T, u32 Count> using Std140Array = BlockArray<BlockLayout_Std140, T, Count>;
+template <typename T, u32 Count> using Std430Array = BlockArray<BlockLayout_Std430, T, Count>;
+
+template <BlockLayout Layout, typename T, u32 Count>
+struct BlockAlignment<Layout, BlockArray<Layout, T, Count>> { static constexpr u32 value = BlockArrayAlignment<Layout, T>::value; };
+
+// A mat3 is three vec4 columns in both layouts
+struct alignas(16) BlockMat3
+{
+    glm::vec4 columns[3];
+
+    BlockMat3& operator=(const glm::mat3& m)
+    {
+        for (u32 i = 0; i < 3; ++i)
+            columns[i] = glm::vec4(m[i], 0.0f);
+        return *this;
+    }
+};
+
+#define ASSERT_BLOCK_OFFSET(type, member, offset) static_assert(offsetof(type, member) == (offset), #type "::" #member " is not where the shaders expect it")
+
+// GLSL name of a block member, array elements and struct members included ("uLight[1].color"),
+// and the offset of its C++ counterpart
+struct BlockMember
+{
+    const char* name;
+    u32         offset;
+};
+
+/**
+ * Compares the uniform block blockName of a linked program with its C++ mirror, the size and the
+ * offset of every member listed. Members the program does not have are skipped, and programs
+ * without the block pass. Logs every mismatch, returns false if there was any.
+ */
+bool VerifyBlockLayout(GLuint program, const char* blockName, u32 size, const BlockMember* members, u32 memberCount);
+
+#define VERIFY_BLOCK_LAYOUT(program, blockName, type, members) VerifyBlockLayout(program, blockName, sizeof(type), members, ARRAY_COUNT(members))
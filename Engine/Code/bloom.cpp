@@ -0,0 +1,41 @@
+#include "bloom.h"
+
+#define BLOOM_PREFILTER_GROUP_SIZE 8
+
+void InitBloom(Bloom& bloom, GLuint prefilterProgram, glm::ivec2 targetSize)
+{
+    bloom.prefilterProgram = prefilterProgram;
+    bloom.size = (targetSize + 1) / 2;
+    bloom.usedSize = bloom.size;
+
+    glGenTextures(1, &bloom.texture);
+    glBindTexture(GL_TEXTURE_2D, bloom.texture);
+    glTexStorage2D(GL_TEXTURE_2D, BLOOM_LEVELS, GL_RGBA16F, bloom.size.x, bloom.size.y);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+void BuildBloom(Bloom& bloom, Downsampler& downsampler, GLuint colorTexture, glm::ivec2 renderSize)
+{
+    bloom.usedSize = (renderSize + 1) / 2;
+
+    glUseProgram(bloom.prefilterProgram);
+    glUniform1i(glGetUniformLocation(bloom.prefilterProgram, "uColorTexture"), 0);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, colorTexture);
+    glUniform2i(glGetUniformLocation(bloom.prefilterProgram, "uRenderSize"), renderSize.x, renderSize.y);
+    glUniform2i(glGetUniformLocation(bloom.prefilterProgram, "uSize"), bloom.usedSize.x, bloom.usedSize.y);
+    glUniform1f(glGetUniformLocation(bloom.prefilterProgram, "uThreshold"), BLOOM_THRESHOLD);
+
+    glBindImageTexture(0, bloom.texture, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA16F);
+    const glm::ivec2 groups = (bloom.usedSize + BLOOM_PREFILTER_GROUP_SIZE - 1) / BLOOM_PREFILTER_GROUP_SIZE;
+    glDispatchCompute(groups.x, groups.y, 1);
+    glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+
+    // Every level at once, instead of a pass per level
+    DownsampleMips(downsampler, DownsampleReduction_Average, bloom.texture, 0, bloom.usedSize,
+                   bloom.texture, DownsampleFormat_RGBA16F, 1, BLOOM_LEVELS - 1, glm::max(bloom.usedSize / 2, glm::ivec2(1)));
+}
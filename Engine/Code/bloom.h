@@ -0,0 +1,31 @@
+//
+// bloom.h: Light bleeding around bright areas. The pixels over a threshold are copied to a half
+// resolution RGBA16F texture and its mip chain is built by the downsampler in one dispatch. The
+// composite pass, in engine.cpp, adds every level of the chain back to the frame, the coarser
+// levels spread the light further.
+//
+
+#pragma once
+
+#include "platform.h"
+#include <glad/glad.h>
+#include "downsampler.h"
+
+#define BLOOM_LEVELS    6
+#define BLOOM_THRESHOLD 1.0f // Brightness the bloom starts at, before the exposure
+#define BLOOM_INTENSITY 0.6f
+
+struct Bloom
+{
+    GLuint     prefilterProgram;
+    GLuint     texture;  // RGBA16F, BLOOM_LEVELS levels
+    glm::ivec2 size;     // Of level 0
+    glm::ivec2 usedSize; // Part of level 0 this frame wrote, the frame uses a corner of the targets
+};
+
+void InitBloom(Bloom& bloom, GLuint prefilterProgram, glm::ivec2 targetSize);
+
+/**
+ * Fills the chain from the renderSize corner of colorTexture.
+ */
+void BuildBloom(Bloom& bloom, Downsampler& downsampler, GLuint colorTexture, glm::ivec2 renderSize);
@@ -0,0 +1,138 @@
+#include "bounds.h"
+#include <float.h>
+
+AABB MakeEmptyAABB()
+{
+    AABB aabb;
+    aabb.min = glm::vec3(FLT_MAX);
+    aabb.max = glm::vec3(-FLT_MAX);
+    return aabb;
+}
+
+AABB MergeAABB(const AABB& a, const AABB& b)
+{
+    AABB aabb;
+    aabb.min = glm::min(a.min, b.min);
+    aabb.max = glm::max(a.max, b.max);
+    return aabb;
+}
+
+AABB TransformAABB(const AABB& aabb, const glm::mat4& mat)
+{
+    // Transform the center and project the extents on the absolute value of the rotation part
+    const glm::vec3 center = (aabb.min + aabb.max) * 0.5f;
+    const glm::vec3 extents = (aabb.max - aabb.min) * 0.5f;
+
+    const glm::vec3 newCenter = glm::vec3(mat * glm::vec4(center, 1.0f));
+    const glm::mat3 absMat = glm::mat3(glm::abs(glm::vec3(mat[0])), glm::abs(glm::vec3(mat[1])), glm::abs(glm::vec3(mat[2])));
+    const glm::vec3 newExtents = absMat * extents;
+
+    AABB result;
+    result.min = newCenter - newExtents;
+    result.max = newCenter + newExtents;
+    return result;
+}
+
+bool AABBOverlap(const AABB& a, const AABB& b)
+{
+    return a.min.x <= b.max.x && a.max.x >= b.min.x &&
+           a.min.y <= b.max.y && a.max.y >= b.min.y &&
+           a.min.z <= b.max.z && a.max.z >= b.min.z;
+}
+
+bool AABBContains(const AABB& outer, const AABB& inner)
+{
+    return outer.min.x <= inner.min.x && outer.min.y <= inner.min.y && outer.min.z <= inner.min.z &&
+           outer.max.x >= inner.max.x && outer.max.y >= inner.max.y && outer.max.z >= inner.max.z;
+}
+
+f32 AABBSurfaceArea(const AABB& aabb)
+{
+    const glm::vec3 d = aabb.max - aabb.min;
+    return 2.0f * (d.x * d.y + d.y * d.z + d.z * d.x);
+}
+
+Frustum ExtractFrustum(const glm::mat4& viewProjection)
+{
+    const glm::mat4 m = glm::transpose(viewProjection);
+
+    Frustum frustum;
+    frustum.planes[0] = m[3] + m[0]; // left
+    frustum.planes[1] = m[3] - m[0]; // right
+    frustum.planes[2] = m[3] + m[1]; // bottom
+    frustum.planes[3] = m[3] - m[1]; // top
+    frustum.planes[4] = m[3] + m[2]; // near
+    frustum.planes[5] = m[3] - m[2]; // far
+
+    for (u32 i = 0; i < 6; ++i)
+        frustum.planes[i] /= glm::length(glm::vec3(frustum.planes[i]));
+
+    return frustum;
+}
+
+bool FrustumIntersectsAABB(const Frustum& frustum, const AABB& aabb)
+{
+    for (u32 i = 0; i < 6; ++i)
+    {
+        const glm::vec4& plane = frustum.planes[i];
+
+        // Corner furthest along the plane normal
+        const glm::vec3 positive(plane.x >= 0.0f ? aabb.max.x : aabb.min.x,
+                                 plane.y >= 0.0f ? aabb.max.y : aabb.min.y,
+                                 plane.z >= 0.0f ? aabb.max.z : aabb.min.z);
+
+        if (glm::dot(glm::vec3(plane), positive) + plane.w < 0.0f)
+            return false;
+    }
+    return true;
+}
+
+bool FrustumIntersectsSphere(const Frustum& frustum, const glm::vec3& center, f32 radius)
+{
+    for (u32 i = 0; i < 6; ++i)
+        if (glm::dot(glm::vec3(frustum.planes[i]), center) + frustum.planes[i].w < -radius)
+            return false;
+    return true;
+}
+
+bool FrustumContainsAABB(const Frustum& frustum, const AABB& aabb)
+{
+    for (u32 i = 0; i < 6; ++i)
+    {
+        const glm::vec4& plane = frustum.planes[i];
+
+        // Corner furthest against the plane normal
+        const glm::vec3 negative(plane.x >= 0.0f ? aabb.min.x : aabb.max.x,
+                                 plane.y >= 0.0f ? aabb.min.y : aabb.max.y,
+                                 plane.z >= 0.0f ? aabb.min.z : aabb.max.z);
+
+        if (glm::dot(glm::vec3(plane), negative) + plane.w < 0.0f)
+            return false;
+    }
+    return true;
+}
+
+bool SphereIntersectsAABB(const glm::vec3& center, f32 radius, const AABB& aabb)
+{
+    const glm::vec3 closest = glm::clamp(center, aabb.min, aabb.max);
+    const glm::vec3 d = center - closest;
+    return glm::dot(d, d) <= radius * radius;
+}
+
+bool RayIntersectsAABB(const glm::vec3& origin, const glm::vec3& invDirection, f32 maxDistance, const AABB& aabb, f32* tHit)
+{
+    const glm::vec3 t0 = (aabb.min - origin) * invDirection;
+    const glm::vec3 t1 = (aabb.max - origin) * invDirection;
+    const glm::vec3 tNear = glm::min(t0, t1);
+    const glm::vec3 tFar = glm::max(t0, t1);
+
+    const f32 enter = glm::max(glm::max(tNear.x, tNear.y), glm::max(tNear.z, 0.0f));
+    const f32 exit = glm::min(glm::min(tFar.x, tFar.y), glm::min(tFar.z, maxDistance));
+
+    if (enter > exit)
+        return false;
+
+    if (tHit)
+        *tHit = enter;
+    return true;
+}
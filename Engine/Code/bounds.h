@@ -0,0 +1,53 @@
+//
+// bounds.h: Bounding volumes and the tests the culling code needs.
+//
+
+#pragma once
+
+#include "platform.h"
+
+struct AABB
+{
+    glm::vec3 min;
+    glm::vec3 max;
+};
+
+// Planes point inwards: a point p is inside when dot(plane.xyz, p) + plane.w >= 0 for all of them
+struct Frustum
+{
+    glm::vec4 planes[6];
+};
+
+AABB MakeEmptyAABB();
+
+AABB MergeAABB(const AABB& a, const AABB& b);
+
+AABB TransformAABB(const AABB& aabb, const glm::mat4& mat);
+
+bool AABBOverlap(const AABB& a, const AABB& b);
+
+bool AABBContains(const AABB& outer, const AABB& inner);
+
+f32 AABBSurfaceArea(const AABB& aabb);
+
+/**
+ * Extracts the six clip planes of a view projection matrix (Gribb/Hartmann), normalized.
+ */
+Frustum ExtractFrustum(const glm::mat4& viewProjection);
+
+bool FrustumIntersectsAABB(const Frustum& frustum, const AABB& aabb);
+
+bool FrustumIntersectsSphere(const Frustum& frustum, const glm::vec3& center, f32 radius);
+
+/**
+ * True when the box is completely on the inner side of every plane.
+ */
+bool FrustumContainsAABB(const Frustum& frustum, const AABB& aabb);
+
+bool SphereIntersectsAABB(const glm::vec3& center, f32 radius, const AABB& aabb);
+
+/**
+ * Slab test of the segment origin + t * direction, t in [0, maxDistance]. invDirection is
+ * 1 / direction per component. Writes the entry distance to tHit when there is a hit.
+ */
+bool RayIntersectsAABB(const glm::vec3& origin, const glm::vec3& invDirection, f32 maxDistance, const AABB& aabb, f32* tHit);
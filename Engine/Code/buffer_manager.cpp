@@ -53,10 +53,13 @@ void AlignHead(Buffer& buffer, u32 alignment)
     buffer.head = Align(buffer.head, alignment);
 }
 
-void PushAlignedData(Buffer& buffer, const void* data, u32 size, u32 alignment)
+u32 PushAlignedData(Buffer& buffer, const void* data, u32 size, u32 alignment)
 {
     ASSERT(buffer.data != NULL, "The buffer must be mapped first");
     AlignHead(buffer, alignment);
-    memcpy((u8*)buffer.data + buffer.head, data, size);
+    ASSERT(buffer.head + size <= buffer.size, "The buffer is too small");
+    const u32 offset = buffer.head;
+    memcpy((u8*)buffer.data + offset, data, size);
     buffer.head += size;
+    return offset;
 }
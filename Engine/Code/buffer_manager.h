@@ -19,12 +19,10 @@ void UnmapBuffer(Buffer& buffer);
 
 void AlignHead(Buffer& buffer, u32 alignment);
 
-void PushAlignedData(Buffer& buffer, const void* data, u32 size, u32 alignment);
+// Returns the offset the data was copied to
+u32 PushAlignedData(Buffer& buffer, const void* data, u32 size, u32 alignment);
 
 #define PushData(buffer, data, size) PushAlignedData(buffer, data, size, 1)
-#define PushUInt(buffer, value) { u32 v = value; PushAlignedData(buffer, &v, sizeof(v), 4); }
-#define PushFloat(buffer, value) { float v = value; PushAlignedData(buffer, &v, sizeof(v), 4); }
-#define PushVec3(buffer, value) PushAlignedData(buffer, glm::value_ptr(value), sizeof(value), sizeof(vec4))
-#define PushVec4(buffer, value) PushAlignedData(buffer, glm::value_ptr(value), sizeof(value), sizeof(vec4))
-#define PushMat3(buffer, value) PushAlignedData(buffer, glm::value_ptr(value), sizeof(value), sizeof(vec4))
-#define PushMat4(buffer, value) PushAlignedData(buffer, glm::value_ptr(value), sizeof(value), sizeof(vec4))
\ No newline at end of file
+
+// Copies a whole block declared with STD140() or STD430() members, returns its offset
+#define PushBlock(buffer, block, alignment) PushAlignedData(buffer, &(block), sizeof(block), alignment)
@@ -0,0 +1,166 @@
+#include "cascaded_shadows.h"
+
+void ComputeCascadeSplits(CascadeSplitScheme scheme, f32 lambda, f32 nearPlane, f32 farPlane, u32 count, f32* splitFars)
+{
+    for (u32 i = 1; i <= count; ++i)
+    {
+        const f32 t = (f32)i / (f32)count;
+        const f32 uniformSplit = nearPlane + (farPlane - nearPlane) * t;
+        const f32 logSplit = nearPlane * powf(farPlane / nearPlane, t);
+
+        switch (scheme)
+        {
+        case CascadeSplit_Uniform:     splitFars[i - 1] = uniformSplit; break;
+        case CascadeSplit_Logarithmic: splitFars[i - 1] = logSplit; break;
+        default:                       splitFars[i - 1] = glm::mix(uniformSplit, logSplit, lambda); break;
+        }
+    }
+}
+
+// The sphere only depends on the slice and not on where the camera looks, so its size stays
+// the same from frame to frame and so does the texel size of the cascade
+static void GetFrustumSliceSphere(const glm::mat4& cameraWorld, f32 tanHalfFovY, f32 aspect, f32 sliceNear, f32 sliceFar, glm::vec3& center, f32& radius)
+{
+    const f32 tanHalfFovX = tanHalfFovY * aspect;
+    const f32 k2 = tanHalfFovX * tanHalfFovX + tanHalfFovY * tanHalfFovY;
+
+    // Equidistant from the corners of both ends, or at the far end for very wide slices
+    f32 distance = 0.5f * (sliceNear + sliceFar) * (1.0f + k2);
+    if (distance > sliceFar)
+        distance = sliceFar;
+
+    const glm::vec3 position = glm::vec3(cameraWorld[3]);
+    const glm::vec3 forward = -glm::vec3(cameraWorld[2]);
+    center = position + forward * distance;
+
+    const f32 toFar = sliceFar - distance;
+    radius = sqrtf(toFar * toFar + sliceFar * sliceFar * k2);
+}
+
+static glm::mat4 GetLightRotation(const glm::vec3& lightDirection)
+{
+    const glm::vec3 up = fabsf(lightDirection.y) > 0.99f ? glm::vec3(0, 0, 1) : glm::vec3(0, 1, 0);
+    return glm::lookAt(glm::vec3(0.0f), lightDirection, up);
+}
+
+glm::mat4 MakeCascadeViewProjection(const glm::vec3& center, f32 radius, const glm::vec3& lightDirection, u32 mapSize)
+{
+    const glm::mat4 lightView = GetLightRotation(glm::normalize(lightDirection));
+
+    // Moving in whole texels keeps every world position on the same texel of the map
+    const f32 texelSize = 2.0f * radius / (f32)mapSize;
+    glm::vec3 lightSpaceCenter = glm::vec3(lightView * glm::vec4(center, 1.0f));
+    lightSpaceCenter.x = floorf(lightSpaceCenter.x / texelSize) * texelSize;
+    lightSpaceCenter.y = floorf(lightSpaceCenter.y / texelSize) * texelSize;
+
+    // The light looks down -z, so the distances to the planes are -z
+    const f32 nearPlane = -lightSpaceCenter.z - radius - SHADOW_CASTER_DISTANCE;
+    const f32 farPlane = -lightSpaceCenter.z + radius;
+
+    const glm::mat4 projection = glm::ortho(
+        lightSpaceCenter.x - radius, lightSpaceCenter.x + radius,
+        lightSpaceCenter.y - radius, lightSpaceCenter.y + radius,
+        nearPlane, farPlane);
+
+    return projection * lightView;
+}
+
+void UpdateShadowCascades(CascadedShadows& shadows, const glm::mat4& viewMatrix, f32 fovY, f32 aspect, f32 nearPlane, const glm::vec3& lightDirection, u32 staticVersion, ShadowCascadeView* cascades)
+{
+    const glm::mat4 cameraWorld = glm::inverse(viewMatrix);
+    const f32 tanHalfFovY = tanf(0.5f * fovY);
+
+    f32 splitFars[SHADOW_CASCADE_COUNT];
+    ComputeCascadeSplits(shadows.splitScheme, shadows.splitLambda, nearPlane, shadows.shadowDistance, SHADOW_CASCADE_COUNT, splitFars);
+
+    u32 refreshes = 0;
+    for (u32 i = 0; i < SHADOW_CASCADE_COUNT; ++i)
+    {
+        ShadowCascadeView& view = cascades[i];
+        view.splitFar = splitFars[i];
+        view.casters.clear();
+        view.cacheCasters.clear();
+
+        glm::vec3 center;
+        f32 radius;
+        GetFrustumSliceSphere(cameraWorld, tanHalfFovY, aspect, i == 0 ? nearPlane : splitFars[i - 1], splitFars[i], center, radius);
+
+        if (i < SHADOW_FIRST_CACHED_CASCADE)
+        {
+            view.viewProjection = MakeCascadeViewProjection(center, radius, lightDirection, SHADOW_MAP_SIZE);
+            view.texelSize = 2.0f * radius / SHADOW_MAP_SIZE;
+            view.cached = false;
+            view.refreshCache = false;
+            continue;
+        }
+
+        // The cache is padded, so the camera can move a while before it stops covering the slice
+        ShadowCascadeCache& cache = shadows.caches[i];
+        const bool covered = cache.valid && glm::length(center - cache.center) + radius <= cache.radius;
+        const bool upToDate = covered && cache.lightDirection == lightDirection && cache.staticVersion == staticVersion;
+
+        // Over the budget a stale cache is still used, it is refreshed on one of the next frames
+        view.refreshCache = false;
+        if (!upToDate && (!cache.valid || refreshes < SHADOW_CACHE_REFRESH_BUDGET))
+        {
+            cache.valid = true;
+            cache.center = center;
+            cache.radius = radius * SHADOW_CACHE_PADDING;
+            cache.lightDirection = lightDirection;
+            cache.staticVersion = staticVersion;
+            cache.viewProjection = MakeCascadeViewProjection(cache.center, cache.radius, lightDirection, SHADOW_MAP_SIZE);
+
+            view.refreshCache = true;
+            refreshes++;
+        }
+
+        view.viewProjection = cache.viewProjection;
+        view.texelSize = 2.0f * cache.radius / SHADOW_MAP_SIZE;
+        view.cached = true;
+    }
+}
+
+void InitShadowMaps(ShadowMaps& maps, GLuint depthProgram)
+{
+    maps.depthProgram = depthProgram;
+
+    glGenTextures(1, &maps.depthTexture);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, maps.depthTexture);
+    glTexStorage3D(GL_TEXTURE_2D_ARRAY, 1, GL_DEPTH_COMPONENT32F, SHADOW_MAP_SIZE, SHADOW_MAP_SIZE, 2 * SHADOW_CASCADE_COUNT);
+
+    // Linear filtering with compare mode gives 2x2 PCF for free on every lookup
+    const f32 borderColor[] = { 1.0f, 1.0f, 1.0f, 1.0f };
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
+    glTexParameterfv(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_BORDER_COLOR, borderColor);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+    glGenFramebuffers(1, &maps.framebuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, maps.framebuffer);
+    glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, maps.depthTexture, 0, 0);
+    glDrawBuffer(GL_NONE);
+    glReadBuffer(GL_NONE);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+void BeginShadowLayer(ShadowMaps& maps, u32 layer, bool clear)
+{
+    glBindFramebuffer(GL_FRAMEBUFFER, maps.framebuffer);
+    glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, maps.depthTexture, 0, layer);
+    glViewport(0, 0, SHADOW_MAP_SIZE, SHADOW_MAP_SIZE);
+
+    if (clear)
+        glClear(GL_DEPTH_BUFFER_BIT);
+}
+
+void CopyShadowCacheToCascade(ShadowMaps& maps, u32 cascade)
+{
+    glCopyImageSubData(
+        maps.depthTexture, GL_TEXTURE_2D_ARRAY, 0, 0, 0, SHADOW_CASCADE_COUNT + cascade,
+        maps.depthTexture, GL_TEXTURE_2D_ARRAY, 0, 0, 0, cascade,
+        SHADOW_MAP_SIZE, SHADOW_MAP_SIZE, 1);
+}
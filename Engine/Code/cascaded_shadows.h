@@ -0,0 +1,101 @@
+//
+// cascaded_shadows.h: Cascaded shadow maps for the directional light. The view frustum is split
+// in depth and every slice gets its own orthographic shadow map, fitted to the bounding sphere
+// of the slice and snapped to whole texels so the shadows do not shimmer as the camera moves.
+//
+// Far cascades keep their static casters in a cache layer. It is only re-rendered when the
+// light or the static entities change, or when the camera leaves the area it covers, and no
+// more than SHADOW_CACHE_REFRESH_BUDGET of them per frame. Every frame they just copy the cache
+// and draw the dynamic casters on top.
+//
+
+#pragma once
+
+#include "platform.h"
+#include <glad/glad.h>
+
+#define SHADOW_CASCADE_COUNT        4 // The shaders have it hardcoded too
+#define SHADOW_MAP_SIZE             2048
+#define SHADOW_FIRST_CACHED_CASCADE 2 // This cascade and the ones after it cache the static casters
+#define SHADOW_CACHE_REFRESH_BUDGET 1
+#define SHADOW_CACHE_PADDING        1.25f // Cached cascades cover this much more than their slice
+#define SHADOW_CASTER_DISTANCE      50.0f // How far towards the light casters are still drawn
+
+enum CascadeSplitScheme
+{
+    CascadeSplit_Uniform,
+    CascadeSplit_Logarithmic,
+    CascadeSplit_Practical, // Blend of both, see CascadedShadows::splitLambda
+    CascadeSplit_Count
+};
+
+// What Render() needs to draw one cascade, decided on the main thread
+struct ShadowCascadeView
+{
+    glm::mat4 viewProjection;
+    f32       splitFar;     // View depth where the cascade ends
+    f32       texelSize;    // World units, for the normal offset of the lookups
+    bool      cached;       // The static casters come from the cache layer
+    bool      refreshCache; // The cache layer is re-rendered this frame
+
+    std::vector<u32> casters;      // Drawn into the cascade every frame
+    std::vector<u32> cacheCasters; // Drawn into the cache layer, only when refreshCache
+};
+
+struct ShadowCascadeCache
+{
+    bool      valid;
+    glm::vec3 center;
+    f32       radius;
+    glm::vec3 lightDirection;
+    u32       staticVersion;
+    glm::mat4 viewProjection;
+};
+
+// Main thread side
+struct CascadedShadows
+{
+    CascadeSplitScheme splitScheme = CascadeSplit_Practical;
+    f32 splitLambda = 0.75f;    // 0 is uniform and 1 logarithmic
+    f32 shadowDistance = 60.0f; // Nothing is shadowed further away
+
+    ShadowCascadeCache caches[SHADOW_CASCADE_COUNT] = {};
+};
+
+// Render thread side. Layer i of the depth array is cascade i, and layer
+// SHADOW_CASCADE_COUNT + i its static cache.
+struct ShadowMaps
+{
+    GLuint depthProgram;
+    GLuint depthTexture;
+    GLuint framebuffer;
+};
+
+/**
+ * Far distances of every cascade, the first one starts at nearPlane.
+ */
+void ComputeCascadeSplits(CascadeSplitScheme scheme, f32 lambda, f32 nearPlane, f32 farPlane, u32 count, f32* splitFars);
+
+/**
+ * Orthographic light projection around the sphere, with the center snapped to whole texels of
+ * a mapSize shadow map. The near plane is pulled SHADOW_CASTER_DISTANCE towards the light.
+ */
+glm::mat4 MakeCascadeViewProjection(const glm::vec3& center, f32 radius, const glm::vec3& lightDirection, u32 mapSize);
+
+/**
+ * Fits every cascade to its slice of the camera frustum and decides which caches are stale.
+ * The casters of the views are left for the caller to fill.
+ */
+void UpdateShadowCascades(CascadedShadows& shadows, const glm::mat4& viewMatrix, f32 fovY, f32 aspect, f32 nearPlane, const glm::vec3& lightDirection, u32 staticVersion, ShadowCascadeView* cascades);
+
+void InitShadowMaps(ShadowMaps& maps, GLuint depthProgram);
+
+/**
+ * Binds the layer of the depth array as the target of the depth only draws.
+ */
+void BeginShadowLayer(ShadowMaps& maps, u32 layer, bool clear);
+
+/**
+ * Overwrites the cascade with its cache layer, before the dynamic casters are drawn on top.
+ */
+void CopyShadowCacheToCascade(ShadowMaps& maps, u32 cascade);
@@ -0,0 +1,313 @@
+#include "command_list.h"
+#include "engine.h"
+#include "job_system.h"
+#include <algorithm>
+
+#define MAX_CACHED_TEXTURE_SLOTS    16
+#define MAX_CACHED_UNIFORM_BINDINGS 16
+
+#define RADIX_BITS       8
+#define RADIX_BUCKETS    (1 << RADIX_BITS)
+#define RADIX_BATCH_SIZE 4096 // Keys per job of every radix pass
+
+void ResetCommandArena(CommandArena& arena, u32 commandCount)
+{
+    if (commandCount > arena.capacity)
+    {
+        free(arena.memory);
+        arena.capacity = commandCount + commandCount / 2;
+        arena.memory = (Command*)malloc(arena.capacity * sizeof(Command));
+    }
+    arena.head = 0;
+}
+
+void FreeCommandArena(CommandArena& arena)
+{
+    free(arena.memory);
+    arena.memory = NULL;
+    arena.capacity = 0;
+    arena.head = 0;
+}
+
+CommandList AllocateCommandList(CommandArena& arena, u32 capacity)
+{
+    CommandList list = {};
+    u32 first = arena.head.fetch_add(capacity, std::memory_order_relaxed);
+    ASSERT(first + capacity <= arena.capacity, "The command arena is full");
+    list.commands = arena.memory + first;
+    list.capacity = capacity;
+    return list;
+}
+
+static Command& PushCommand(CommandList& list, CommandType type)
+{
+    ASSERT(list.count < list.capacity, "The command list is full");
+    Command& command = list.commands[list.count++];
+    command.type = type;
+    return command;
+}
+
+u64 MakeSortKey(DrawPass pass, u32 program, u32 material, u32 mesh, f32 depth)
+{
+    const u64 depthMax = (1u << SORT_KEY_DEPTH_BITS) - 1;
+    const u64 quantizedDepth = (u64)(glm::clamp(depth, 0.0f, 1.0f) * depthMax);
+
+    u64 key = (u64)pass & ((1u << SORT_KEY_PASS_BITS) - 1);
+    key = (key << SORT_KEY_PROGRAM_BITS) | (program & ((1u << SORT_KEY_PROGRAM_BITS) - 1));
+    key = (key << SORT_KEY_MATERIAL_BITS) | (material & ((1u << SORT_KEY_MATERIAL_BITS) - 1));
+    key = (key << SORT_KEY_MESH_BITS) | (mesh & ((1u << SORT_KEY_MESH_BITS) - 1));
+    key = (key << SORT_KEY_DEPTH_BITS) | quantizedDepth;
+    return key;
+}
+
+void BeginSequence(CommandList& list, u64 sortKey)
+{
+    Command& command = PushCommand(list, CommandType_BeginSequence);
+    command.beginSequence.keyLow = (u32)sortKey;
+    command.beginSequence.keyHigh = (u32)(sortKey >> 32);
+}
+
+void CmdSetProgram(CommandList& list, u32 program)
+{
+    PushCommand(list, CommandType_SetProgram).setProgram.program = program;
+}
+
+void CmdBindVertexArray(CommandList& list, u32 vertexArray)
+{
+    PushCommand(list, CommandType_BindVertexArray).bindVertexArray.vertexArray = vertexArray;
+}
+
+void CmdBindTexture(CommandList& list, u32 slot, u32 target, u32 texture)
+{
+    Command& command = PushCommand(list, CommandType_BindTexture);
+    command.bindTexture.slot = slot;
+    command.bindTexture.target = target;
+    command.bindTexture.texture = texture;
+}
+
+void CmdBindUniformRange(CommandList& list, u32 binding, u32 buffer, u32 offset, u32 size)
+{
+    Command& command = PushCommand(list, CommandType_BindUniformRange);
+    command.bindUniformRange.binding = binding;
+    command.bindUniformRange.buffer = buffer;
+    command.bindUniformRange.offset = offset;
+    command.bindUniformRange.size = size;
+}
+
+void CmdDrawIndexed(CommandList& list, u32 indexCount, u32 indexOffset, u32 baseInstance)
+{
+    Command& command = PushCommand(list, CommandType_DrawIndexed);
+    command.drawIndexed.indexCount = indexCount;
+    command.drawIndexed.indexOffset = indexOffset;
+    command.drawIndexed.baseInstance = baseInstance;
+}
+
+void CmdDrawIndexedIndirect(CommandList& list, u32 buffer, u32 offset)
+{
+    Command& command = PushCommand(list, CommandType_DrawIndexedIndirect);
+    command.drawIndexedIndirect.buffer = buffer;
+    command.drawIndexedIndirect.offset = offset;
+}
+
+struct CommandSequence
+{
+    const Command* begin;
+    const Command* end;
+};
+
+// Least significant digit first, so every pass is stable and equal keys keep their order.
+// Digits that are the same in every key are skipped, which with sort keys is most of them.
+// The result ends up in keys and values, the scratch arrays must be as big.
+static void RadixSort(u64* keys, u32* values, u32 count, u64* scratchKeys, u32* scratchValues)
+{
+    if (count < 2)
+        return;
+
+    u64 anyBits = 0;
+    u64 allBits = ~0ull;
+    for (u32 i = 0; i < count; ++i)
+    {
+        anyBits |= keys[i];
+        allBits &= keys[i];
+    }
+    const u64 changingBits = anyBits ^ allBits;
+
+    const u32 batchCount = (count + RADIX_BATCH_SIZE - 1) / RADIX_BATCH_SIZE;
+    std::vector<u32> offsets(batchCount * RADIX_BUCKETS);
+
+    u64* srcKeys = keys;
+    u32* srcValues = values;
+    u64* dstKeys = scratchKeys;
+    u32* dstValues = scratchValues;
+
+    for (u32 shift = 0; shift < 64; shift += RADIX_BITS)
+    {
+        if (((changingBits >> shift) & (RADIX_BUCKETS - 1)) == 0)
+            continue;
+
+        // ParallelFor() may run everything as one batch, the other histograms then stay empty
+        std::fill(offsets.begin(), offsets.end(), 0);
+        ParallelFor(count, RADIX_BATCH_SIZE, [&](u32 begin, u32 end) {
+            u32* histogram = &offsets[(begin / RADIX_BATCH_SIZE) * RADIX_BUCKETS];
+            for (u32 i = begin; i < end; ++i)
+                histogram[(srcKeys[i] >> shift) & (RADIX_BUCKETS - 1)]++;
+        });
+
+        // Digit by digit, and batch by batch within a digit, so the scatter stays stable
+        u32 sum = 0;
+        for (u32 digit = 0; digit < RADIX_BUCKETS; ++digit)
+        {
+            for (u32 batch = 0; batch < batchCount; ++batch)
+            {
+                const u32 digitCount = offsets[batch * RADIX_BUCKETS + digit];
+                offsets[batch * RADIX_BUCKETS + digit] = sum;
+                sum += digitCount;
+            }
+        }
+
+        ParallelFor(count, RADIX_BATCH_SIZE, [&](u32 begin, u32 end) {
+            u32* batchOffsets = &offsets[(begin / RADIX_BATCH_SIZE) * RADIX_BUCKETS];
+            for (u32 i = begin; i < end; ++i)
+            {
+                const u32 dst = batchOffsets[(srcKeys[i] >> shift) & (RADIX_BUCKETS - 1)]++;
+                dstKeys[dst] = srcKeys[i];
+                dstValues[dst] = srcValues[i];
+            }
+        });
+
+        std::swap(srcKeys, dstKeys);
+        std::swap(srcValues, dstValues);
+    }
+
+    if (srcKeys != keys)
+    {
+        memcpy(keys, srcKeys, count * sizeof(u64));
+        memcpy(values, srcValues, count * sizeof(u32));
+    }
+}
+
+// What is bound right now, so the replay only talks to GL when something actually changes
+struct GLStateCache
+{
+    u32 program = UINT32_MAX;
+    u32 vertexArray = UINT32_MAX;
+    u32 indirectBuffer = UINT32_MAX;
+    u32 textures[MAX_CACHED_TEXTURE_SLOTS];
+    u32 uniformBuffers[MAX_CACHED_UNIFORM_BINDINGS];
+    u32 uniformOffsets[MAX_CACHED_UNIFORM_BINDINGS];
+    u32 uniformSizes[MAX_CACHED_UNIFORM_BINDINGS];
+
+    GLStateCache()
+    {
+        for (u32 i = 0; i < MAX_CACHED_TEXTURE_SLOTS; ++i) textures[i] = UINT32_MAX;
+        for (u32 i = 0; i < MAX_CACHED_UNIFORM_BINDINGS; ++i) uniformBuffers[i] = UINT32_MAX;
+    }
+};
+
+static void ExecuteCommand(const Command& command, GLStateCache& state)
+{
+    switch (command.type)
+    {
+    case CommandType_BeginSequence:
+        break;
+    case CommandType_SetProgram: {
+        if (state.program != command.setProgram.program)
+        {
+            state.program = command.setProgram.program;
+            glUseProgram(state.program);
+        }
+        break; }
+    case CommandType_BindVertexArray: {
+        if (state.vertexArray != command.bindVertexArray.vertexArray)
+        {
+            state.vertexArray = command.bindVertexArray.vertexArray;
+            glBindVertexArray(state.vertexArray);
+        }
+        break; }
+    case CommandType_BindTexture: {
+        const u32 slot = command.bindTexture.slot;
+        if (slot >= MAX_CACHED_TEXTURE_SLOTS || state.textures[slot] != command.bindTexture.texture)
+        {
+            if (slot < MAX_CACHED_TEXTURE_SLOTS)
+                state.textures[slot] = command.bindTexture.texture;
+            glActiveTexture(GL_TEXTURE0 + slot);
+            glBindTexture(command.bindTexture.target, command.bindTexture.texture);
+        }
+        break; }
+    case CommandType_BindUniformRange: {
+        const u32 binding = command.bindUniformRange.binding;
+        const bool cached = binding < MAX_CACHED_UNIFORM_BINDINGS &&
+                            state.uniformBuffers[binding] == command.bindUniformRange.buffer &&
+                            state.uniformOffsets[binding] == command.bindUniformRange.offset &&
+                            state.uniformSizes[binding] == command.bindUniformRange.size;
+        if (!cached)
+        {
+            if (binding < MAX_CACHED_UNIFORM_BINDINGS)
+            {
+                state.uniformBuffers[binding] = command.bindUniformRange.buffer;
+                state.uniformOffsets[binding] = command.bindUniformRange.offset;
+                state.uniformSizes[binding] = command.bindUniformRange.size;
+            }
+            glBindBufferRange(GL_UNIFORM_BUFFER, binding, command.bindUniformRange.buffer, command.bindUniformRange.offset, command.bindUniformRange.size);
+        }
+        break; }
+    case CommandType_DrawIndexed: {
+        glDrawElementsInstancedBaseInstance(GL_TRIANGLES, command.drawIndexed.indexCount, GL_UNSIGNED_INT, (void*)(u64)command.drawIndexed.indexOffset, 1, command.drawIndexed.baseInstance);
+        break; }
+    case CommandType_DrawIndexedIndirect: {
+        if (state.indirectBuffer != command.drawIndexedIndirect.buffer)
+        {
+            state.indirectBuffer = command.drawIndexedIndirect.buffer;
+            glBindBuffer(GL_DRAW_INDIRECT_BUFFER, state.indirectBuffer);
+        }
+        glDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, (void*)(u64)command.drawIndexedIndirect.offset);
+        break; }
+    }
+}
+
+void ExecuteCommandLists(const CommandList* lists, u32 listCount)
+{
+    std::vector<CommandSequence> sequences;
+    std::vector<u64> sortKeys;
+
+    for (u32 listIdx = 0; listIdx < listCount; ++listIdx)
+    {
+        const CommandList& list = lists[listIdx];
+        for (u32 i = 0; i < list.count; ++i)
+        {
+            const Command& command = list.commands[i];
+            if (command.type == CommandType_BeginSequence)
+            {
+                if (!sequences.empty() && sequences.back().end == NULL)
+                    sequences.back().end = &command;
+
+                CommandSequence sequence = {};
+                sequence.begin = &command;
+                sequences.push_back(sequence);
+                sortKeys.push_back(((u64)command.beginSequence.keyHigh << 32) | command.beginSequence.keyLow);
+            }
+        }
+        if (!sequences.empty() && sequences.back().end == NULL)
+            sequences.back().end = list.commands + list.count;
+    }
+
+    const u32 sequenceCount = sequences.size();
+    std::vector<u32> order(sequenceCount);
+    for (u32 i = 0; i < sequenceCount; ++i)
+        order[i] = i;
+
+    std::vector<u64> scratchKeys(sequenceCount);
+    std::vector<u32> scratchOrder(sequenceCount);
+    RadixSort(sortKeys.data(), order.data(), sequenceCount, scratchKeys.data(), scratchOrder.data());
+
+    GLStateCache state;
+    for (u32 i = 0; i < sequenceCount; ++i)
+    {
+        const CommandSequence& sequence = sequences[order[i]];
+        for (const Command* command = sequence.begin; command != sequence.end; ++command)
+            ExecuteCommand(*command, state);
+    }
+
+    if (state.indirectBuffer != UINT32_MAX)
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+}
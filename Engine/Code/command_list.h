@@ -0,0 +1,123 @@
+//
+// command_list.h: Backend agnostic draw command lists. Any thread can record commands into
+// memory taken from a CommandArena; the thread owning the graphics context then replays all
+// the lists at once, ordered by the sort key of each sequence and skipping redundant state.
+//
+// Sort keys are built with MakeSortKey(). From the most significant bits they hold the pass,
+// the program, the material, the mesh and the quantized view depth, so the replay changes the
+// expensive state as rarely as possible and draws sharing all of it go front to back.
+//
+
+#pragma once
+
+#include "platform.h"
+#include <atomic>
+
+enum CommandType
+{
+    CommandType_BeginSequence,
+    CommandType_SetProgram,
+    CommandType_BindVertexArray,
+    CommandType_BindTexture,
+    CommandType_BindUniformRange,
+    CommandType_DrawIndexed,
+    CommandType_DrawIndexedIndirect,
+};
+
+#define SORT_KEY_PASS_BITS     4
+#define SORT_KEY_PROGRAM_BITS  10
+#define SORT_KEY_MATERIAL_BITS 18
+#define SORT_KEY_MESH_BITS     16
+#define SORT_KEY_DEPTH_BITS    16
+
+// Passes sharing an ExecuteCommandLists() call replay in this order
+enum DrawPass
+{
+    DrawPass_Shadow,
+    DrawPass_Opaque,
+    DrawPass_Count
+};
+
+// Resource handles are plain u32 names, the backend decides what they mean
+struct Command
+{
+    u32 type;
+    union
+    {
+        struct { u32 keyLow, keyHigh; }                       beginSequence;
+        struct { u32 program; }                               setProgram;
+        struct { u32 vertexArray; }                           bindVertexArray;
+        struct { u32 slot, target, texture; }                 bindTexture;
+        struct { u32 binding, buffer, offset, size; }         bindUniformRange;
+        struct { u32 indexCount, indexOffset, baseInstance; } drawIndexed;
+        struct { u32 buffer, offset; }                        drawIndexedIndirect;
+    };
+};
+
+// Linear allocator for commands, reset once per frame. Allocation is a single atomic add, so
+// every job thread can take memory from it while recording.
+struct CommandArena
+{
+    Command*         memory = NULL;
+    u32              capacity = 0;
+    std::atomic<u32> head{ 0 };
+};
+
+struct CommandList
+{
+    Command* commands;
+    u32      count;
+    u32      capacity;
+};
+
+/**
+ * Makes room for at least commandCount commands and resets the arena. Only call it while no
+ * thread is recording.
+ */
+void ResetCommandArena(CommandArena& arena, u32 commandCount);
+
+void FreeCommandArena(CommandArena& arena);
+
+CommandList AllocateCommandList(CommandArena& arena, u32 capacity);
+
+/**
+ * Ids wider than their field are wrapped, which only costs some grouping. depth goes from 0
+ * at the camera to 1 at the far plane and is clamped, nearer draws sort first.
+ */
+u64 MakeSortKey(DrawPass pass, u32 program, u32 material, u32 mesh, f32 depth);
+
+/**
+ * Starts a sequence of commands that is replayed as a whole, ordered by sortKey against
+ * the sequences of every list passed to the same ExecuteCommandLists() call.
+ */
+void BeginSequence(CommandList& list, u64 sortKey);
+
+void CmdSetProgram(CommandList& list, u32 program);
+
+void CmdBindVertexArray(CommandList& list, u32 vertexArray);
+
+/**
+ * target is what the texture was created as, GL_TEXTURE_2D, GL_TEXTURE_2D_ARRAY or
+ * GL_TEXTURE_CUBE_MAP. The slot cache only compares texture names, which GL keeps unique
+ * across targets.
+ */
+void CmdBindTexture(CommandList& list, u32 slot, u32 target, u32 texture);
+
+void CmdBindUniformRange(CommandList& list, u32 binding, u32 buffer, u32 offset, u32 size);
+
+/**
+ * One instance, baseInstance is what per instance attributes start from.
+ */
+void CmdDrawIndexed(CommandList& list, u32 indexCount, u32 indexOffset, u32 baseInstance = 0);
+
+/**
+ * Draws with the parameters the GPU wrote at offset in buffer, so culling passes can turn
+ * draws off without the CPU knowing.
+ */
+void CmdDrawIndexedIndirect(CommandList& list, u32 buffer, u32 offset);
+
+/**
+ * GL backend. The sequences are radix sorted on the job threads before the replay, with equal
+ * keys kept in recording order. Must be called from the thread owning the GL context.
+ */
+void ExecuteCommandLists(const CommandList* lists, u32 listCount);
@@ -0,0 +1,222 @@
+#include "debug_draw.h"
+
+#define DEBUG_DRAW_INITIAL_CAPACITY 256
+
+// Segments around and rings from pole to pole of every level of detail
+static const u32 SphereLodSegments[DEBUG_DRAW_SPHERE_LODS] = { 32, 16, 8 };
+static const u32 SphereLodRings[DEBUG_DRAW_SPHERE_LODS] = { 16, 8, 4 };
+
+void ClearDebugDraw(DebugDrawList& list)
+{
+    for (u32 i = 0; i < DebugPrimitive_Count; ++i)
+        list.instances[i].clear();
+}
+
+static void AddInstance(DebugDrawList& list, DebugPrimitive primitive, const glm::vec3& origin, const glm::vec3& extent, const glm::vec4& color)
+{
+    DebugInstance instance;
+    instance.origin = glm::vec4(origin, 1.0f);
+    instance.extent = glm::vec4(extent, 0.0f);
+    instance.color = color;
+    list.instances[primitive].push_back(instance);
+}
+
+void DebugDrawLine(DebugDrawList& list, const glm::vec3& from, const glm::vec3& to, const glm::vec4& color)
+{
+    AddInstance(list, DebugPrimitive_Line, from, to - from, color);
+}
+
+void DebugDrawBox(DebugDrawList& list, const AABB& box, const glm::vec4& color)
+{
+    AddInstance(list, DebugPrimitive_Box, 0.5f * (box.min + box.max), 0.5f * (box.max - box.min), color);
+}
+
+void DebugDrawQuad(DebugDrawList& list, const glm::vec3& center, const glm::vec2& halfSize, const glm::vec4& color)
+{
+    AddInstance(list, DebugPrimitive_Quad, center, glm::vec3(halfSize, 0.0f), color);
+}
+
+void DebugDrawSphere(DebugDrawList& list, const glm::vec3& center, f32 radius, const glm::vec4& color)
+{
+    AddInstance(list, DebugPrimitive_Sphere, center, glm::vec3(radius), color);
+}
+
+static void AddMesh(DebugMesh& mesh, GLenum mode, std::vector<glm::vec3>& vertices, std::vector<u32>& indices,
+                    const std::vector<glm::vec3>& meshVertices, const std::vector<u32>& meshIndices)
+{
+    mesh.mode = mode;
+    mesh.indexCount = meshIndices.size();
+    mesh.firstIndex = indices.size();
+    mesh.baseVertex = vertices.size();
+    vertices.insert(vertices.end(), meshVertices.begin(), meshVertices.end());
+    indices.insert(indices.end(), meshIndices.begin(), meshIndices.end());
+}
+
+// Unit sphere as a triangle list
+static void BuildSphere(u32 segments, u32 rings, std::vector<glm::vec3>& vertices, std::vector<u32>& indices)
+{
+    for (u32 y = 0; y <= rings; ++y)
+    {
+        const f32 theta = (f32)y / rings * PI;
+        for (u32 x = 0; x <= segments; ++x)
+        {
+            const f32 phi = (f32)x / segments * 2.0f * PI;
+            vertices.push_back(glm::vec3(cosf(phi) * sinf(theta), cosf(theta), sinf(phi) * sinf(theta)));
+        }
+    }
+
+    for (u32 y = 0; y < rings; ++y)
+    {
+        for (u32 x = 0; x < segments; ++x)
+        {
+            const u32 a = y * (segments + 1) + x;
+            const u32 b = a + segments + 1;
+            indices.insert(indices.end(), { a, b, a + 1, a + 1, b, b + 1 });
+        }
+    }
+}
+
+void InitDebugDraw(DebugDraw& debugDraw, GLuint program)
+{
+    debugDraw.program = program;
+
+    std::vector<glm::vec3> vertices;
+    std::vector<u32> indices;
+
+    AddMesh(debugDraw.meshes[DebugPrimitive_Line], GL_LINES, vertices, indices, { glm::vec3(0.0f), glm::vec3(1.0f) }, { 0, 1 });
+
+    std::vector<glm::vec3> boxVertices;
+    for (u32 i = 0; i < 8; ++i)
+        boxVertices.push_back(glm::vec3(i & 1 ? 1.0f : -1.0f, i & 2 ? 1.0f : -1.0f, i & 4 ? 1.0f : -1.0f));
+    AddMesh(debugDraw.meshes[DebugPrimitive_Box], GL_LINES, vertices, indices, boxVertices,
+            { 0, 1, 2, 3, 4, 5, 6, 7, 0, 2, 1, 3, 4, 6, 5, 7, 0, 4, 1, 5, 2, 6, 3, 7 });
+
+    AddMesh(debugDraw.meshes[DebugPrimitive_Quad], GL_TRIANGLES, vertices, indices,
+            { glm::vec3(-1.0f, -1.0f, 0.0f), glm::vec3(1.0f, -1.0f, 0.0f), glm::vec3(1.0f, 1.0f, 0.0f), glm::vec3(-1.0f, 1.0f, 0.0f) },
+            { 0, 1, 2, 0, 2, 3 });
+
+    for (u32 lod = 0; lod < DEBUG_DRAW_SPHERE_LODS; ++lod)
+    {
+        std::vector<glm::vec3> sphereVertices;
+        std::vector<u32> sphereIndices;
+        BuildSphere(SphereLodSegments[lod], SphereLodRings[lod], sphereVertices, sphereIndices);
+        AddMesh(debugDraw.meshes[DebugPrimitive_Sphere + lod], GL_TRIANGLES, vertices, indices, sphereVertices, sphereIndices);
+    }
+
+    glGenVertexArrays(1, &debugDraw.vao);
+    glBindVertexArray(debugDraw.vao);
+
+    glGenBuffers(1, &debugDraw.vertexBuffer);
+    glBindBuffer(GL_ARRAY_BUFFER, debugDraw.vertexBuffer);
+    glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(glm::vec3), vertices.data(), GL_STATIC_DRAW);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), (void*)0);
+    glEnableVertexAttribArray(0);
+
+    glGenBuffers(1, &debugDraw.indexBuffer);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, debugDraw.indexBuffer);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(u32), indices.data(), GL_STATIC_DRAW);
+
+    debugDraw.instanceCapacity = DEBUG_DRAW_INITIAL_CAPACITY;
+    glGenBuffers(1, &debugDraw.instanceBuffer);
+    glBindBuffer(GL_ARRAY_BUFFER, debugDraw.instanceBuffer);
+    glBufferData(GL_ARRAY_BUFFER, debugDraw.instanceCapacity * sizeof(DebugInstance), NULL, GL_STREAM_DRAW);
+    for (u32 i = 0; i < 3; ++i)
+    {
+        const u32 location = DEBUG_DRAW_INSTANCE_LOCATION + i;
+        glVertexAttribPointer(location, 4, GL_FLOAT, GL_FALSE, sizeof(DebugInstance), (void*)(u64)(i * sizeof(glm::vec4)));
+        glVertexAttribDivisor(location, 1);
+        glEnableVertexAttribArray(location);
+    }
+
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+}
+
+// Coarser the smaller the sphere is on screen
+static u32 GetSphereLod(const DebugInstance& sphere, const glm::vec3& cameraPosition, f32 pixelsPerUnit)
+{
+    const f32 radius = sphere.extent.x;
+    const f32 distance = glm::length(glm::vec3(sphere.origin) - cameraPosition);
+    if (distance <= radius)
+        return 0;
+
+    const f32 screenRadius = radius * pixelsPerUnit / distance;
+    u32 lod = 0;
+    f32 threshold = DEBUG_DRAW_SPHERE_LOD_PIXELS;
+    while (lod < DEBUG_DRAW_SPHERE_LODS - 1 && screenRadius < threshold)
+    {
+        lod++;
+        threshold *= 0.5f;
+    }
+    return lod;
+}
+
+void RenderDebugDraw(DebugDraw& debugDraw, const DebugDrawList& list, const glm::mat4& viewProjection, const glm::vec3& cameraPosition, f32 pixelsPerUnit)
+{
+    const u32 meshCount = ARRAY_COUNT(debugDraw.meshes);
+
+    // Instances of the same mesh are contiguous, so each mesh is one draw
+    const std::vector<DebugInstance>& spheres = list.instances[DebugPrimitive_Sphere];
+    std::vector<u32> sphereLods(spheres.size());
+    u32 counts[meshCount] = {};
+    for (u32 i = 0; i < DebugPrimitive_Sphere; ++i)
+        counts[i] = list.instances[i].size();
+    for (u32 i = 0; i < spheres.size(); ++i)
+    {
+        sphereLods[i] = GetSphereLod(spheres[i], cameraPosition, pixelsPerUnit);
+        counts[DebugPrimitive_Sphere + sphereLods[i]]++;
+    }
+
+    u32 firsts[meshCount];
+    u32 instanceCount = 0;
+    for (u32 i = 0; i < meshCount; ++i)
+    {
+        firsts[i] = instanceCount;
+        instanceCount += counts[i];
+    }
+
+    if (instanceCount == 0)
+        return;
+
+    std::vector<DebugInstance>& instances = debugDraw.instances;
+    instances.resize(instanceCount);
+    for (u32 i = 0; i < DebugPrimitive_Sphere; ++i)
+        std::copy(list.instances[i].begin(), list.instances[i].end(), instances.begin() + firsts[i]);
+
+    u32 sphereHeads[DEBUG_DRAW_SPHERE_LODS];
+    for (u32 lod = 0; lod < DEBUG_DRAW_SPHERE_LODS; ++lod)
+        sphereHeads[lod] = firsts[DebugPrimitive_Sphere + lod];
+    for (u32 i = 0; i < spheres.size(); ++i)
+        instances[sphereHeads[sphereLods[i]]++] = spheres[i];
+
+    // Orphaned every frame, so the upload never waits for the draws of the last one
+    glBindBuffer(GL_ARRAY_BUFFER, debugDraw.instanceBuffer);
+    if (instanceCount > debugDraw.instanceCapacity)
+        debugDraw.instanceCapacity = glm::max(instanceCount, debugDraw.instanceCapacity * 2);
+    glBufferData(GL_ARRAY_BUFFER, debugDraw.instanceCapacity * sizeof(DebugInstance), NULL, GL_STREAM_DRAW);
+    glBufferSubData(GL_ARRAY_BUFFER, 0, instanceCount * sizeof(DebugInstance), instances.data());
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    glUseProgram(debugDraw.program);
+    glUniformMatrix4fv(glGetUniformLocation(debugDraw.program, "uViewProjection"), 1, GL_FALSE, glm::value_ptr(viewProjection));
+
+    // Pulled towards the camera by the rasterizer, so the shapes win against the surfaces at
+    // their depth. It only applies to the triangles.
+    glEnable(GL_POLYGON_OFFSET_FILL);
+    glPolygonOffset(-1.0f, -1.0f);
+
+    glBindVertexArray(debugDraw.vao);
+    for (u32 i = 0; i < meshCount; ++i)
+    {
+        if (counts[i] == 0)
+            continue;
+
+        const DebugMesh& mesh = debugDraw.meshes[i];
+        glDrawElementsInstancedBaseVertexBaseInstance(mesh.mode, mesh.indexCount, GL_UNSIGNED_INT, (void*)(u64)(mesh.firstIndex * sizeof(u32)),
+                                                      counts[i], mesh.baseVertex, firsts[i]);
+    }
+    glBindVertexArray(0);
+
+    glDisable(GL_POLYGON_OFFSET_FILL);
+}
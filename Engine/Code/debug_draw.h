@@ -0,0 +1,86 @@
+//
+// debug_draw.h: Gizmos, lines, boxes and spheres drawn over the final image. The main thread
+// adds them to a DebugDrawList that travels in the RenderPacket, and the render thread streams
+// the whole list to one instance buffer and draws every primitive with a single instanced draw,
+// whatever the number of shapes. The meshes are small and shared: a line, the edges of a box, a
+// quad, and a sphere with a few levels of detail picked by the size on screen.
+//
+
+#pragma once
+
+#include "platform.h"
+#include <glad/glad.h>
+#include "bounds.h"
+#include "block_layout.h"
+#include <vector>
+
+#define DEBUG_DRAW_SPHERE_LODS         3
+#define DEBUG_DRAW_SPHERE_LOD_PIXELS   48.0f // Screen radius every coarser sphere is used under, halved per level
+#define DEBUG_DRAW_INSTANCE_LOCATION   1     // First vertex attribute of the instance data
+
+enum DebugPrimitive
+{
+    DebugPrimitive_Line,
+    DebugPrimitive_Box,  // Edges only
+    DebugPrimitive_Quad, // Facing +z
+    DebugPrimitive_Sphere,
+    DebugPrimitive_Count
+};
+
+// A shape as the DEBUG_DRAW vertex shader reads it, the vertex is origin + position * extent
+struct DebugInstance
+{
+    STD430(glm::vec4) origin; // Center, the start of a line
+    STD430(glm::vec4) extent; // Half size, the end of a line minus its start
+    STD430(glm::vec4) color;
+};
+
+static_assert(sizeof(DebugInstance) == 48, "DebugInstance is not the size of the instance attributes");
+
+// Main thread side, sent to the render thread in the RenderPacket
+struct DebugDrawList
+{
+    std::vector<DebugInstance> instances[DebugPrimitive_Count];
+};
+
+void ClearDebugDraw(DebugDrawList& list);
+
+void DebugDrawLine(DebugDrawList& list, const glm::vec3& from, const glm::vec3& to, const glm::vec4& color);
+
+void DebugDrawBox(DebugDrawList& list, const AABB& box, const glm::vec4& color);
+
+void DebugDrawQuad(DebugDrawList& list, const glm::vec3& center, const glm::vec2& halfSize, const glm::vec4& color);
+
+void DebugDrawSphere(DebugDrawList& list, const glm::vec3& center, f32 radius, const glm::vec4& color);
+
+// Range of the shared buffers one primitive mesh is in
+struct DebugMesh
+{
+    GLenum mode;
+    u32    indexCount;
+    u32    firstIndex;
+    u32    baseVertex;
+};
+
+// Render thread side
+struct DebugDraw
+{
+    GLuint program;
+    GLuint vao;
+    GLuint vertexBuffer;   // vec3 positions of every mesh
+    GLuint indexBuffer;
+    GLuint instanceBuffer; // DebugInstance, rewritten every frame
+    u32    instanceCapacity;
+
+    DebugMesh meshes[DebugPrimitive_Count - 1 + DEBUG_DRAW_SPHERE_LODS]; // The spheres last, finest first
+
+    std::vector<DebugInstance> instances; // Sorted by mesh for the upload
+};
+
+void InitDebugDraw(DebugDraw& debugDraw, GLuint program);
+
+/**
+ * Draws the list on the bound framebuffer, testing against its depth. pixelsPerUnit is the size
+ * on screen of one world unit at distance one, what the sphere level of detail is chosen from.
+ */
+void RenderDebugDraw(DebugDraw& debugDraw, const DebugDrawList& list, const glm::mat4& viewProjection, const glm::vec3& cameraPosition, f32 pixelsPerUnit);
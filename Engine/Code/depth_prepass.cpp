@@ -0,0 +1,68 @@
+#include "depth_prepass.h"
+
+void InitDepthPrepass(DepthPrepass& prepass)
+{
+    glGenQueries(DEPTH_PREPASS_QUERY_COUNT, prepass.queries);
+    prepass.queriesIssued = 0;
+    prepass.queriesRead = 0;
+    prepass.filteredOverdraw = 0.0f;
+    prepass.autoEnabled = false;
+    prepass.framesPastThreshold = 0;
+    prepass.displayedOverdraw = 0.0f;
+    prepass.displayedEnabled = false;
+}
+
+bool UpdateDepthPrepass(DepthPrepass& prepass, const DepthPrepassSettings& settings)
+{
+    // Results come back in order, stop at the first one that is not ready
+    while (prepass.queriesRead < prepass.queriesIssued)
+    {
+        const u32 query = prepass.queriesRead % DEPTH_PREPASS_QUERY_COUNT;
+        GLint available = GL_FALSE;
+        glGetQueryObjectiv(prepass.queries[query], GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available)
+            break;
+
+        GLuint64 samples = 0;
+        glGetQueryObjectui64v(prepass.queries[query], GL_QUERY_RESULT, &samples);
+        prepass.queriesRead++;
+
+        const f32 overdraw = (f32)samples / prepass.queryPixels[query];
+        prepass.filteredOverdraw = prepass.filteredOverdraw == 0.0f ? overdraw : glm::mix(prepass.filteredOverdraw, overdraw, 0.2f);
+        prepass.displayedOverdraw = prepass.filteredOverdraw;
+
+        // Two thresholds, so it does not switch back and forth around one
+        const bool pastThreshold = prepass.autoEnabled ? prepass.filteredOverdraw < DEPTH_PREPASS_DISABLE_OVERDRAW
+                                                       : prepass.filteredOverdraw > DEPTH_PREPASS_ENABLE_OVERDRAW;
+        prepass.framesPastThreshold = pastThreshold ? prepass.framesPastThreshold + 1 : 0;
+        if (prepass.framesPastThreshold >= DEPTH_PREPASS_SWITCH_FRAMES)
+        {
+            prepass.autoEnabled = !prepass.autoEnabled;
+            prepass.framesPastThreshold = 0;
+        }
+    }
+
+    bool enabled = prepass.autoEnabled;
+    if (settings.mode != DepthPrepassMode_Auto)
+        enabled = settings.mode == DepthPrepassMode_On;
+
+    prepass.displayedEnabled = enabled;
+    return enabled;
+}
+
+void BeginOverdrawQuery(DepthPrepass& prepass, glm::ivec2 renderSize)
+{
+    // Every query is in use, drop the oldest result rather than waiting for it
+    if (prepass.queriesIssued - prepass.queriesRead == DEPTH_PREPASS_QUERY_COUNT)
+        prepass.queriesRead++;
+
+    const u32 query = prepass.queriesIssued % DEPTH_PREPASS_QUERY_COUNT;
+    prepass.queryPixels[query] = renderSize.x * renderSize.y;
+    glBeginQuery(GL_SAMPLES_PASSED, prepass.queries[query]);
+}
+
+void EndOverdrawQuery(DepthPrepass& prepass)
+{
+    glEndQuery(GL_SAMPLES_PASSED);
+    prepass.queriesIssued++;
+}
@@ -0,0 +1,68 @@
+//
+// depth_prepass.h: Optional depth only pass before the G-buffer pass. It draws the entities with
+// the position stream and no color writes, so the G-buffer pass after it tests with GL_EQUAL and
+// writes its targets once per pixel, instead of once for every fragment that passes the depth
+// test on its way to the front. It costs a second geometry pass, so in auto mode it is only on
+// while the measured overdraw is high.
+//
+// The overdraw comes from a samples passed query around whichever of the two passes tests with
+// GL_LESS, which counts the fragments the G-buffer pass writes without the prepass either way.
+// Like the timer queries of dynamic_resolution.h, the results are read frames later, when they
+// are available, and never waited for.
+//
+
+#pragma once
+
+#include "platform.h"
+#include <glad/glad.h>
+#include <atomic>
+
+#define DEPTH_PREPASS_QUERY_COUNT      4    // Samples passed queries in flight
+#define DEPTH_PREPASS_ENABLE_OVERDRAW  1.5f // Fragments per pixel the auto mode turns it on over
+#define DEPTH_PREPASS_DISABLE_OVERDRAW 1.2f // And off under
+#define DEPTH_PREPASS_SWITCH_FRAMES    10   // Frames past the threshold before switching
+
+enum DepthPrepassMode
+{
+    DepthPrepassMode_Off,
+    DepthPrepassMode_On,
+    DepthPrepassMode_Auto
+};
+
+// Main thread side, sent to the render thread in the RenderPacket
+struct DepthPrepassSettings
+{
+    DepthPrepassMode mode = DepthPrepassMode_Auto;
+};
+
+// Render thread side
+struct DepthPrepass
+{
+    GLuint queries[DEPTH_PREPASS_QUERY_COUNT];
+    u32    queryPixels[DEPTH_PREPASS_QUERY_COUNT]; // Pixels of the frame every query measured
+    u64    queriesIssued;
+    u64    queriesRead;
+
+    f32  filteredOverdraw;
+    bool autoEnabled;         // What the auto mode decided
+    u32  framesPastThreshold; // Consecutive, towards switching autoEnabled
+
+    // For the Gui, which runs on the main thread
+    std::atomic<f32>  displayedOverdraw;
+    std::atomic<bool> displayedEnabled;
+};
+
+void InitDepthPrepass(DepthPrepass& prepass);
+
+/**
+ * Reads the queries that finished and returns whether this frame draws the prepass. Call once
+ * per frame, before the geometry of the frame.
+ */
+bool UpdateDepthPrepass(DepthPrepass& prepass, const DepthPrepassSettings& settings);
+
+/**
+ * Around the pass that tests with GL_LESS, the prepass when there is one.
+ */
+void BeginOverdrawQuery(DepthPrepass& prepass, glm::ivec2 renderSize);
+
+void EndOverdrawQuery(DepthPrepass& prepass);
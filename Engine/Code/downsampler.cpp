@@ -0,0 +1,64 @@
+#include "downsampler.h"
+
+#define DOWNSAMPLE_GROUP_OUTPUT 32 // Texels of the first level every group writes, per side
+
+static const GLenum DownsampleImageFormats[DownsampleFormat_Count] = { GL_R32F, GL_RGBA16F };
+
+void InitDownsampler(Downsampler& downsampler, GLuint r32fProgram, GLuint rgba16fProgram)
+{
+    downsampler.programs[DownsampleFormat_R32F] = r32fProgram;
+    downsampler.programs[DownsampleFormat_RGBA16F] = rgba16fProgram;
+
+    const u32 zero = 0;
+    glGenBuffers(1, &downsampler.counterBuffer);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, downsampler.counterBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(u32), &zero, GL_DYNAMIC_COPY);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+}
+
+void DownsampleMips(Downsampler& downsampler, DownsampleReduction reduction, GLuint source, u32 sourceLevel, glm::ivec2 sourceSize,
+                    GLuint target, DownsampleFormat format, u32 firstLevel, u32 levelCount, glm::ivec2 firstLevelSize)
+{
+    const GLuint program = downsampler.programs[format];
+    glUseProgram(program);
+    glUniform1i(glGetUniformLocation(program, "uSource"), 0);
+    glUniform1i(glGetUniformLocation(program, "uReduction"), reduction);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, downsampler.counterBuffer);
+    glActiveTexture(GL_TEXTURE0);
+
+    glm::ivec2 outputSize = firstLevelSize;
+    while (levelCount > 0)
+    {
+        const u32 count = glm::min(levelCount, (u32)DOWNSAMPLE_LEVELS_PER_DISPATCH);
+
+        glBindTexture(GL_TEXTURE_2D, source);
+        glUniform1i(glGetUniformLocation(program, "uSourceLevel"), sourceLevel);
+        glUniform2i(glGetUniformLocation(program, "uSourceSize"), sourceSize.x, sourceSize.y);
+        glUniform2i(glGetUniformLocation(program, "uOutputSize"), outputSize.x, outputSize.y);
+        glUniform1i(glGetUniformLocation(program, "uLevelCount"), count);
+        for (u32 i = 0; i < count; ++i)
+            glBindImageTexture(i, target, firstLevel + i, GL_FALSE, 0, GL_READ_WRITE, DownsampleImageFormats[format]);
+
+        const glm::ivec2 groups = (outputSize + DOWNSAMPLE_GROUP_OUTPUT - 1) / DOWNSAMPLE_GROUP_OUTPUT;
+        glDispatchCompute(groups.x, groups.y, 1);
+        glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT | GL_SHADER_IMAGE_ACCESS_BARRIER_BIT | GL_SHADER_STORAGE_BARRIER_BIT);
+
+        // The next dispatch continues from the last level of this one
+        source = target;
+        sourceLevel = firstLevel + count - 1;
+        sourceSize = glm::max(glm::ivec2(outputSize.x >> (count - 1), outputSize.y >> (count - 1)), glm::ivec2(1));
+        outputSize = glm::max(sourceSize / 2, glm::ivec2(1));
+        firstLevel += count;
+        levelCount -= count;
+    }
+
+    glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+u32 GetMipCount(glm::ivec2 size)
+{
+    u32 count = 1;
+    while ((size.x >> count) > 0 || (size.y >> count) > 0)
+        count++;
+    return count;
+}
@@ -0,0 +1,54 @@
+//
+// downsampler.h: Builds mip chains in a single compute dispatch. Every work group reduces a
+// 64x64 block of the source through six levels in shared memory, and the last group to finish,
+// found with an atomic counter, reduces what the others wrote through the next two. Eight levels
+// is the number of image units every GL 4.3 implementation has for a compute shader, so chains
+// longer than that take one more dispatch per eight levels instead of one per level.
+//
+// Level sizes are halved and rounded down, texels past the edge of the level above are clamped
+// to it. Chains whose every level must cover the whole source, like a depth pyramid, are best
+// allocated with power of two sizes.
+//
+
+#pragma once
+
+#include "platform.h"
+#include <glad/glad.h>
+
+#define DOWNSAMPLE_LEVELS_PER_DISPATCH 8
+
+enum DownsampleReduction
+{
+    DownsampleReduction_Min,
+    DownsampleReduction_Max,
+    DownsampleReduction_Average,
+};
+
+// The format of the target, the shader declares it for its images
+enum DownsampleFormat
+{
+    DownsampleFormat_R32F,
+    DownsampleFormat_RGBA16F,
+    DownsampleFormat_Count
+};
+
+struct Downsampler
+{
+    GLuint programs[DownsampleFormat_Count];
+    GLuint counterBuffer; // Groups finished, the last one resets it
+};
+
+void InitDownsampler(Downsampler& downsampler, GLuint r32fProgram, GLuint rgba16fProgram);
+
+/**
+ * Writes levelCount levels of target, starting at firstLevel, which is firstLevelSize. The first
+ * is reduced from sourceSize texels of sourceLevel of source, which can be target itself, and
+ * every other from the one before it.
+ */
+void DownsampleMips(Downsampler& downsampler, DownsampleReduction reduction, GLuint source, u32 sourceLevel, glm::ivec2 sourceSize,
+                    GLuint target, DownsampleFormat format, u32 firstLevel, u32 levelCount, glm::ivec2 firstLevelSize);
+
+/**
+ * Levels of a full chain for a level 0 of the given size.
+ */
+u32 GetMipCount(glm::ivec2 size);
@@ -0,0 +1,105 @@
+#include "dynamic_resolution.h"
+
+void InitDynamicResolution(DynamicResolution& resolution)
+{
+    glGenQueries(DYNAMIC_RESOLUTION_QUERY_COUNT, resolution.queries);
+    resolution.queriesIssued = 0;
+    resolution.queriesRead = 0;
+    resolution.scale = DYNAMIC_RESOLUTION_MAX_SCALE;
+    resolution.filteredGpuTime = 0.0f;
+    resolution.framesOverBudget = 0;
+    resolution.framesUnderBudget = 0;
+    resolution.displayedScale = resolution.scale;
+    resolution.displayedGpuTime = 0.0f;
+}
+
+static void SetScale(DynamicResolution& resolution, f32 scale)
+{
+    resolution.scale = scale;
+    resolution.filteredGpuTime = 0.0f;
+    resolution.framesOverBudget = 0;
+    resolution.framesUnderBudget = 0;
+}
+
+void UpdateDynamicResolution(DynamicResolution& resolution, const DynamicResolutionSettings& settings)
+{
+    // Results come back in order, stop at the first one that is not ready
+    while (resolution.queriesRead < resolution.queriesIssued)
+    {
+        const u32 query = resolution.queriesRead % DYNAMIC_RESOLUTION_QUERY_COUNT;
+        GLint available = GL_FALSE;
+        glGetQueryObjectiv(resolution.queries[query], GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available)
+            break;
+
+        GLuint64 elapsed = 0;
+        glGetQueryObjectui64v(resolution.queries[query], GL_QUERY_RESULT, &elapsed);
+        resolution.queriesRead++;
+
+        const f32 gpuTime = elapsed / 1000000.0f;
+        resolution.displayedGpuTime = gpuTime;
+
+        // Frames rendered at another scale say nothing about the current one
+        if (resolution.queryScales[query] != resolution.scale)
+            continue;
+
+        resolution.filteredGpuTime = resolution.filteredGpuTime == 0.0f ? gpuTime : glm::mix(resolution.filteredGpuTime, gpuTime, 0.2f);
+        if (!settings.enabled)
+            continue;
+
+        if (resolution.filteredGpuTime > settings.gpuBudget * DYNAMIC_RESOLUTION_OVER_BUDGET)
+        {
+            resolution.framesOverBudget++;
+            resolution.framesUnderBudget = 0;
+        }
+        else if (resolution.filteredGpuTime < settings.gpuBudget * DYNAMIC_RESOLUTION_UNDER_BUDGET)
+        {
+            resolution.framesUnderBudget++;
+            resolution.framesOverBudget = 0;
+        }
+        else
+        {
+            resolution.framesOverBudget = 0;
+            resolution.framesUnderBudget = 0;
+        }
+
+        if (resolution.framesOverBudget >= DYNAMIC_RESOLUTION_OVER_FRAMES || resolution.framesUnderBudget >= DYNAMIC_RESOLUTION_UNDER_FRAMES)
+        {
+            // The cost goes with the pixel count, the square of the scale
+            const f32 target = resolution.scale * sqrtf(settings.gpuBudget / resolution.filteredGpuTime);
+            const f32 step = glm::clamp(target - resolution.scale, -DYNAMIC_RESOLUTION_MAX_STEP, DYNAMIC_RESOLUTION_MAX_STEP);
+            SetScale(resolution, glm::clamp(resolution.scale + step, settings.minScale, DYNAMIC_RESOLUTION_MAX_SCALE));
+        }
+    }
+
+    if (!settings.enabled && resolution.scale != DYNAMIC_RESOLUTION_MAX_SCALE)
+        SetScale(resolution, DYNAMIC_RESOLUTION_MAX_SCALE);
+    else if (resolution.scale < settings.minScale)
+        SetScale(resolution, settings.minScale);
+
+    resolution.displayedScale = resolution.scale;
+}
+
+glm::ivec2 GetRenderSize(const DynamicResolution& resolution, glm::ivec2 displaySize, glm::ivec2 targetSize)
+{
+    const glm::ivec2 scaledSize = glm::ivec2(glm::vec2(displaySize) * resolution.scale);
+    const glm::ivec2 alignedSize = (scaledSize + DYNAMIC_RESOLUTION_SIZE_ALIGNMENT - 1) / DYNAMIC_RESOLUTION_SIZE_ALIGNMENT * DYNAMIC_RESOLUTION_SIZE_ALIGNMENT;
+    return glm::clamp(glm::min(alignedSize, displaySize), glm::ivec2(1), targetSize);
+}
+
+void BeginFrameTimer(DynamicResolution& resolution)
+{
+    // Every query is in use, drop the oldest result rather than waiting for it
+    if (resolution.queriesIssued - resolution.queriesRead == DYNAMIC_RESOLUTION_QUERY_COUNT)
+        resolution.queriesRead++;
+
+    const u32 query = resolution.queriesIssued % DYNAMIC_RESOLUTION_QUERY_COUNT;
+    resolution.queryScales[query] = resolution.scale;
+    glBeginQuery(GL_TIME_ELAPSED, resolution.queries[query]);
+}
+
+void EndFrameTimer(DynamicResolution& resolution)
+{
+    glEndQuery(GL_TIME_ELAPSED);
+    resolution.queriesIssued++;
+}
@@ -0,0 +1,70 @@
+//
+// dynamic_resolution.h: Keeps the GPU time of a frame inside a budget by changing how many
+// pixels the scene is rendered at. The render targets are allocated once for the full scale and
+// the scene passes use a viewport sub-rectangle of them, so changing the scale costs nothing. A
+// final pass upscales that rectangle to the backbuffer and sharpens it.
+//
+// The GPU time comes from timer queries read frames later, when they are available, so the
+// render thread never waits for them. The scale drops after a few frames over the budget and
+// only grows back after many frames well under it, so it does not oscillate.
+//
+
+#pragma once
+
+#include "platform.h"
+#include <glad/glad.h>
+#include <atomic>
+
+#define DYNAMIC_RESOLUTION_QUERY_COUNT    4     // Timer queries in flight
+#define DYNAMIC_RESOLUTION_MAX_SCALE      1.0f  // The render targets are allocated for this scale
+#define DYNAMIC_RESOLUTION_SIZE_ALIGNMENT 8     // Render sizes are multiples of this, in pixels
+#define DYNAMIC_RESOLUTION_OVER_FRAMES    3     // Frames over the budget before the scale drops
+#define DYNAMIC_RESOLUTION_UNDER_FRAMES   30    // Frames under the budget before it grows
+#define DYNAMIC_RESOLUTION_OVER_BUDGET    1.05f // Fraction of the budget considered over it
+#define DYNAMIC_RESOLUTION_UNDER_BUDGET   0.85f // Fraction of the budget considered under it
+#define DYNAMIC_RESOLUTION_MAX_STEP       0.1f  // Largest change of the scale at once
+#define DYNAMIC_RESOLUTION_SHARPNESS      0.4f  // Strength of the sharpening after the upscale
+
+// Main thread side, sent to the render thread in the RenderPacket
+struct DynamicResolutionSettings
+{
+    bool enabled = true;
+    f32  gpuBudget = 12.0f; // Milliseconds
+    f32  minScale = 0.5f;
+};
+
+// Render thread side
+struct DynamicResolution
+{
+    GLuint queries[DYNAMIC_RESOLUTION_QUERY_COUNT];
+    f32    queryScales[DYNAMIC_RESOLUTION_QUERY_COUNT]; // Scale every query measured
+    u64    queriesIssued;
+    u64    queriesRead;
+
+    f32 scale;
+    f32 filteredGpuTime; // Milliseconds, averaged over the last frames
+    u32 framesOverBudget;
+    u32 framesUnderBudget;
+
+    // For the Gui, which runs on the main thread
+    std::atomic<f32> displayedScale;
+    std::atomic<f32> displayedGpuTime; // Last measured
+};
+
+void InitDynamicResolution(DynamicResolution& resolution);
+
+/**
+ * Reads the timer queries that finished and updates the scale from them. Call once per frame,
+ * before GetRenderSize() and the timer of the frame.
+ */
+void UpdateDynamicResolution(DynamicResolution& resolution, const DynamicResolutionSettings& settings);
+
+/**
+ * Size the scene is rendered at this frame, never bigger than targetSize, the size of the
+ * render targets.
+ */
+glm::ivec2 GetRenderSize(const DynamicResolution& resolution, glm::ivec2 displaySize, glm::ivec2 targetSize);
+
+void BeginFrameTimer(DynamicResolution& resolution);
+
+void EndFrameTimer(DynamicResolution& resolution);
@@ -11,8 +11,11 @@
 #include <stb_image_write.h>
 #include "assimp_model_loading.h"
 #include "buffer_manager.h"
+#include "job_system.h"
+#include "command_list.h"
+#include "shader_source.h"
 
-GLuint CreateProgramFromSource(String programSource, const char* shaderName)
+GLuint CreateProgramFromSource(String programSource, const char* shaderName, bool hasGeometryShader = false)
 {
     GLchar  infoLogBuffer[1024] = {};
     GLsizei infoLogBufferSize = sizeof(infoLogBuffer);
@@ -24,6 +27,7 @@ GLuint CreateProgramFromSource(String programSource, const char* shaderName)
     sprintf(shaderNameDefine, "#define %s\n", shaderName);
     char vertexShaderDefine[] = "#define VERTEX\n";
     char fragmentShaderDefine[] = "#define FRAGMENT\n";
+    char geometryShaderDefine[] = "#define GEOMETRY\n";
 
     const GLchar* vertexShaderSource[] = {
         versionString,
@@ -49,6 +53,18 @@ GLuint CreateProgramFromSource(String programSource, const char* shaderName)
         (GLint) strlen(fragmentShaderDefine),
         (GLint) programSource.len
     };
+    const GLchar* geometryShaderSource[] = {
+        versionString,
+        shaderNameDefine,
+        geometryShaderDefine,
+        programSource.str
+    };
+    const GLint geometryShaderLengths[] = {
+        (GLint) strlen(versionString),
+        (GLint) strlen(shaderNameDefine),
+        (GLint) strlen(geometryShaderDefine),
+        (GLint) programSource.len
+    };
 
     GLuint vshader = glCreateShader(GL_VERTEX_SHADER);
     glShaderSource(vshader, ARRAY_COUNT(vertexShaderSource), vertexShaderSource, vertexShaderLengths);
@@ -70,9 +86,25 @@ GLuint CreateProgramFromSource(String programSource, const char* shaderName)
         ELOG("glCompileShader() failed with fragment shader %s\nReported message:\n%s\n", shaderName, infoLogBuffer);
     }
 
+    GLuint gshader = 0;
+    if (hasGeometryShader)
+    {
+        gshader = glCreateShader(GL_GEOMETRY_SHADER);
+        glShaderSource(gshader, ARRAY_COUNT(geometryShaderSource), geometryShaderSource, geometryShaderLengths);
+        glCompileShader(gshader);
+        glGetShaderiv(gshader, GL_COMPILE_STATUS, &success);
+        if (!success)
+        {
+            glGetShaderInfoLog(gshader, infoLogBufferSize, &infoLogSize, infoLogBuffer);
+            ELOG("glCompileShader() failed with geometry shader %s\nReported message:\n%s\n", shaderName, infoLogBuffer);
+        }
+    }
+
     GLuint programHandle = glCreateProgram();
     glAttachShader(programHandle, vshader);
     glAttachShader(programHandle, fshader);
+    if (gshader)
+        glAttachShader(programHandle, gshader);
     glLinkProgram(programHandle);
     glGetProgramiv(programHandle, GL_LINK_STATUS, &success);
     if (!success)
@@ -88,15 +120,201 @@ GLuint CreateProgramFromSource(String programSource, const char* shaderName)
     glDeleteShader(vshader);
     glDeleteShader(fshader);
 
+    if (gshader)
+    {
+        glDetachShader(programHandle, gshader);
+        glDeleteShader(gshader);
+    }
+
+    return programHandle;
+}
+
+// Includes expanded and the defines of the features on top
+static std::string BuildProgramSource(const char* filepath, u32 features)
+{
+    std::vector<std::string> files;
+    return GetShaderFeatureDefines(features) + PreprocessShaderSource(filepath, files);
+}
+
+// The LocalParams block of the mesh programs, std140
+struct EntityLocalParams
+{
+    STD140(glm::mat4) world;
+    STD140(glm::mat4) worldViewProjection;
+    STD140(BlockMat3) normalMatrix;
+    STD140(glm::mat4) previousWorld; // For the motion vectors
+};
+
+ASSERT_BLOCK_OFFSET(EntityLocalParams, normalMatrix, 128);
+ASSERT_BLOCK_OFFSET(EntityLocalParams, previousWorld, 176);
+
+#define ARRAY_ELEMENT_OFFSET(type, array, i) (offsetof(type, array) + (i) * decltype(type::array)::stride)
+
+static const BlockMember ViewParamsMembers[] =
+{
+    { "uViewMatrix",                      offsetof(ViewParams, viewMatrix) },
+    { "uProjectionMatrix",                offsetof(ViewParams, projectionMatrix) },
+    { "uViewProjectionMatrix",            offsetof(ViewParams, viewProjectionMatrix) },
+    { "uInverseViewMatrix",               offsetof(ViewParams, inverseViewMatrix) },
+    { "uInverseProjectionMatrix",         offsetof(ViewParams, inverseProjectionMatrix) },
+    { "uInverseViewProjectionMatrix",     offsetof(ViewParams, inverseViewProjectionMatrix) },
+    { "uCameraPosition",                  offsetof(ViewParams, cameraPosition) },
+    { "uViewport",                        offsetof(ViewParams, viewport) },
+    { "uUnjitteredViewProjectionMatrix",  offsetof(ViewParams, unjitteredViewProjectionMatrix) },
+    { "uPreviousViewProjectionMatrix",    offsetof(ViewParams, previousViewProjectionMatrix) },
+    { "uJitter",                          offsetof(ViewParams, jitter) },
+};
+
+static const BlockMember GlobalParamsMembers[] =
+{
+    { "uLightCount",         offsetof(GlobalParams, lightCount) },
+    { "uLight[0].type",      ARRAY_ELEMENT_OFFSET(GlobalParams, lights, 0) + offsetof(GPULight, type) },
+    { "uLight[0].color",     ARRAY_ELEMENT_OFFSET(GlobalParams, lights, 0) + offsetof(GPULight, color) },
+    { "uLight[0].direction", ARRAY_ELEMENT_OFFSET(GlobalParams, lights, 0) + offsetof(GPULight, direction) },
+    { "uLight[0].position",  ARRAY_ELEMENT_OFFSET(GlobalParams, lights, 0) + offsetof(GPULight, position) },
+    { "uLight[0].intensity", ARRAY_ELEMENT_OFFSET(GlobalParams, lights, 0) + offsetof(GPULight, intensity) },
+    { "uLight[0].linear",    ARRAY_ELEMENT_OFFSET(GlobalParams, lights, 0) + offsetof(GPULight, linear) },
+    { "uLight[0].quadratic", ARRAY_ELEMENT_OFFSET(GlobalParams, lights, 0) + offsetof(GPULight, quadratic) },
+    { "uLight[1].type",      ARRAY_ELEMENT_OFFSET(GlobalParams, lights, 1) + offsetof(GPULight, type) },
+};
+
+static const BlockMember ShadowParamsMembers[] =
+{
+    { "uCascadeViewProjection[0]", ARRAY_ELEMENT_OFFSET(ShadowParams, cascadeViewProjection, 0) },
+    { "uCascadeSplits",            offsetof(ShadowParams, cascadeSplits) },
+    { "uCascadeTexelSizes",        offsetof(ShadowParams, cascadeTexelSizes) },
+    { "uCameraForward",            offsetof(ShadowParams, cameraForward) },
+    { "uShadowLight",              offsetof(ShadowParams, shadowLight) },
+};
+
+static const BlockMember PointShadowParamsMembers[] =
+{
+    { "uLightPointShadow[0]",           ARRAY_ELEMENT_OFFSET(PointShadowParams, lightPointShadow, 0) },
+    { "uPointShadow[0].positionRadius", ARRAY_ELEMENT_OFFSET(PointShadowParams, pointShadows, 0) + offsetof(GPUPointShadow, positionRadius) },
+    { "uPointShadow[0].faceRects[0]",   ARRAY_ELEMENT_OFFSET(PointShadowParams, pointShadows, 0) + offsetof(GPUPointShadow, faceRects) },
+    { "uPointShadow[1].positionRadius", ARRAY_ELEMENT_OFFSET(PointShadowParams, pointShadows, 1) + offsetof(GPUPointShadow, positionRadius) },
+};
+
+static const BlockMember EntityLocalParamsMembers[] =
+{
+    { "uWorldMatrix",               offsetof(EntityLocalParams, world) },
+    { "uWorldViewProjectionMatrix", offsetof(EntityLocalParams, worldViewProjection) },
+    { "uNormalMatrix",              offsetof(EntityLocalParams, normalMatrix) },
+    { "uPreviousWorldMatrix",       offsetof(EntityLocalParams, previousWorld) },
+};
+
+// The blocks every program shares. LocalParams differs between programs, so it is checked where
+// they are loaded.
+static void VerifyProgramBlocks(const Program& program)
+{
+    bool matches = VERIFY_BLOCK_LAYOUT(program.handle, "ViewParams", ViewParams, ViewParamsMembers);
+    matches &= VERIFY_BLOCK_LAYOUT(program.handle, "GlobalParams", GlobalParams, GlobalParamsMembers);
+    matches &= VERIFY_BLOCK_LAYOUT(program.handle, "ShadowParams", ShadowParams, ShadowParamsMembers);
+    matches &= VERIFY_BLOCK_LAYOUT(program.handle, "PointShadowParams", PointShadowParams, PointShadowParamsMembers);
+    if (!matches)
+        ELOG("Program %s of %s does not match the C++ blocks", program.programName.c_str(), program.filepath.c_str());
+}
+
+u32 LoadProgram(App* app, const char* filepath, const char* programName, bool hasGeometryShader = false, u32 features = 0)
+{
+    std::string source = BuildProgramSource(filepath, features);
+    String programSource = { &source[0], (u32)source.size() };
+
+    Program program = {};
+    program.handle = CreateProgramFromSource(programSource, programName, hasGeometryShader);
+    program.filepath = filepath;
+    program.programName = programName;
+    program.lastWriteTimestamp = GetFileLastWriteTimestamp(filepath);
+    program.features = features;
+    program.hasGeometryShader = hasGeometryShader;
+    VerifyProgramBlocks(program);
+    app->programs.push_back(program);
+
+    const u32 programIdx = app->programs.size() - 1;
+    app->programVariants[((u64)programIdx << 32) | features] = programIdx;
+    return programIdx;
+}
+
+u32 GetProgramVariant(App* app, u32 programIdx, u32 features)
+{
+    const u64 key = ((u64)programIdx << 32) | features;
+    auto it = app->programVariants.find(key);
+    if (it != app->programVariants.end())
+        return it->second;
+
+    const Program& base = app->programs[programIdx];
+    std::string source = BuildProgramSource(base.filepath.c_str(), features);
+    String programSource = { &source[0], (u32)source.size() };
+
+    Program variant = base;
+    variant.handle = CreateProgramFromSource(programSource, base.programName.c_str(), base.hasGeometryShader);
+    variant.features = features;
+    VerifyProgramBlocks(variant);
+    app->programs.push_back(variant);
+
+    const u32 variantIdx = app->programs.size() - 1;
+    app->programVariants[key] = variantIdx;
+    return variantIdx;
+}
+
+GLuint CreateComputeProgramFromSource(String programSource, const char* shaderName)
+{
+    GLchar  infoLogBuffer[1024] = {};
+    GLsizei infoLogBufferSize = sizeof(infoLogBuffer);
+    GLsizei infoLogSize;
+    GLint   success;
+
+    char versionString[] = "#version 430\n";
+    char shaderNameDefine[128];
+    sprintf(shaderNameDefine, "#define %s\n", shaderName);
+    char computeShaderDefine[] = "#define COMPUTE\n";
+
+    const GLchar* computeShaderSource[] = {
+        versionString,
+        shaderNameDefine,
+        computeShaderDefine,
+        programSource.str
+    };
+    const GLint computeShaderLengths[] = {
+        (GLint) strlen(versionString),
+        (GLint) strlen(shaderNameDefine),
+        (GLint) strlen(computeShaderDefine),
+        (GLint) programSource.len
+    };
+
+    GLuint cshader = glCreateShader(GL_COMPUTE_SHADER);
+    glShaderSource(cshader, ARRAY_COUNT(computeShaderSource), computeShaderSource, computeShaderLengths);
+    glCompileShader(cshader);
+    glGetShaderiv(cshader, GL_COMPILE_STATUS, &success);
+    if (!success)
+    {
+        glGetShaderInfoLog(cshader, infoLogBufferSize, &infoLogSize, infoLogBuffer);
+        ELOG("glCompileShader() failed with compute shader %s\nReported message:\n%s\n", shaderName, infoLogBuffer);
+    }
+
+    GLuint programHandle = glCreateProgram();
+    glAttachShader(programHandle, cshader);
+    glLinkProgram(programHandle);
+    glGetProgramiv(programHandle, GL_LINK_STATUS, &success);
+    if (!success)
+    {
+        glGetProgramInfoLog(programHandle, infoLogBufferSize, &infoLogSize, infoLogBuffer);
+        ELOG("glLinkProgram() failed with program %s\nReported message:\n%s\n", shaderName, infoLogBuffer);
+    }
+
+    glDetachShader(programHandle, cshader);
+    glDeleteShader(cshader);
+
     return programHandle;
 }
 
-u32 LoadProgram(App* app, const char* filepath, const char* programName)
+u32 LoadComputeProgram(App* app, const char* filepath, const char* programName)
 {
-    String programSource = ReadTextFile(filepath);
+    std::string source = BuildProgramSource(filepath, 0);
+    String programSource = { &source[0], (u32)source.size() };
 
     Program program = {};
-    program.handle = CreateProgramFromSource(programSource, programName);
+    program.handle = CreateComputeProgramFromSource(programSource, programName);
     program.filepath = filepath;
     program.programName = programName;
     program.lastWriteTimestamp = GetFileLastWriteTimestamp(filepath);
@@ -105,10 +323,16 @@ u32 LoadProgram(App* app, const char* filepath, const char* programName)
     return app->programs.size() - 1;
 }
 
-Image LoadImage(const char* filename)
+// 0 when the GPU has no compute shaders and the program was not loaded
+static GLuint GetComputeProgram(const App* app, u32 programIdx)
+{
+    return app->gpu.computeShaders ? app->programs[programIdx].handle : 0;
+}
+
+// Does not touch stb's global flip flag, so it is safe to call from job threads
+static Image DecodeImage(const char* filename)
 {
     Image img = {};
-    stbi_set_flip_vertically_on_load(true);
     img.pixels = stbi_load(filename, &img.size.x, &img.size.y, &img.nchannels, 0);
     if (img.pixels)
     {
@@ -121,37 +345,15 @@ Image LoadImage(const char* filename)
     return img;
 }
 
-void FreeImage(Image image)
+Image LoadImage(const char* filename)
 {
-    stbi_image_free(image.pixels);
+    stbi_set_flip_vertically_on_load(true);
+    return DecodeImage(filename);
 }
 
-GLuint CreateTexture2DFromImage(Image image)
+void FreeImage(Image image)
 {
-    GLenum internalFormat = GL_RGB8;
-    GLenum dataFormat     = GL_RGB;
-    GLenum dataType       = GL_UNSIGNED_BYTE;
-
-    switch (image.nchannels)
-    {
-        case 3: dataFormat = GL_RGB; internalFormat = GL_RGB8; break;
-        case 4: dataFormat = GL_RGBA; internalFormat = GL_RGBA8; break;
-        default: ELOG("LoadTexture2D() - Unsupported number of channels");
-    }
-
-    GLuint texHandle;
-    glGenTextures(1, &texHandle);
-    glBindTexture(GL_TEXTURE_2D, texHandle);
-    glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, image.size.x, image.size.y, 0, dataFormat, dataType, image.pixels);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-    glGenerateMipmap(GL_TEXTURE_2D);
-    glBindTexture(GL_TEXTURE_2D, 0);
-
-    return texHandle;
+    stbi_image_free(image.pixels);
 }
 
 u32 LoadTexture2D(App* app, const char* filepath)
@@ -165,8 +367,9 @@ u32 LoadTexture2D(App* app, const char* filepath)
     if (image.pixels)
     {
         Texture tex = {};
-        tex.handle = CreateTexture2DFromImage(image);
+        tex.layer = AddTextureLayer(app->textureArrays, image.pixels, image.size, image.nchannels);
         tex.filepath = filepath;
+        UpdateTextureArrayMips(app->textureArrays);
 
         u32 texIdx = app->textures.size();
         app->textures.push_back(tex);
@@ -180,57 +383,271 @@ u32 LoadTexture2D(App* app, const char* filepath)
     }
 }
 
+void LoadTextures2D(App* app, const char** filepaths, u32 count, u32* textureIndices)
+{
+    // Files not loaded yet, and for every request the file it waits on
+    std::vector<const char*> pending;
+    std::vector<u32> pendingIdx(count, UINT32_MAX);
+
+    for (u32 i = 0; i < count; ++i)
+    {
+        textureIndices[i] = UINT32_MAX;
+
+        for (u32 texIdx = 0; texIdx < app->textures.size(); ++texIdx)
+            if (app->textures[texIdx].filepath == filepaths[i])
+                textureIndices[i] = texIdx;
+
+        if (textureIndices[i] != UINT32_MAX)
+            continue;
+
+        for (u32 j = 0; j < pending.size() && pendingIdx[i] == UINT32_MAX; ++j)
+            if (strcmp(pending[j], filepaths[i]) == 0)
+                pendingIdx[i] = j;
+
+        if (pendingIdx[i] == UINT32_MAX)
+        {
+            pendingIdx[i] = pending.size();
+            pending.push_back(filepaths[i]);
+        }
+    }
+
+    // Decoding is the expensive part and does not need the GL context
+    std::vector<Image> images(pending.size());
+    stbi_set_flip_vertically_on_load(true);
+    ParallelFor(pending.size(), 1, [&](u32 begin, u32 end) {
+        for (u32 i = begin; i < end; ++i)
+            images[i] = DecodeImage(pending[i]);
+    });
+
+    std::vector<u32> pendingTexIdx(pending.size(), UINT32_MAX);
+    for (u32 i = 0; i < pending.size(); ++i)
+    {
+        if (images[i].pixels)
+        {
+            Texture tex = {};
+            tex.layer = AddTextureLayer(app->textureArrays, images[i].pixels, images[i].size, images[i].nchannels);
+            tex.filepath = pending[i];
+
+            pendingTexIdx[i] = app->textures.size();
+            app->textures.push_back(tex);
+
+            FreeImage(images[i]);
+        }
+    }
+    UpdateTextureArrayMips(app->textureArrays);
+
+    for (u32 i = 0; i < count; ++i)
+        if (pendingIdx[i] != UINT32_MAX)
+            textureIndices[i] = pendingTexIdx[pendingIdx[i]];
+}
+
+static u32 GetMaterialTextureLayer(App* app, u32 textureIdx)
+{
+    return textureIdx < app->textures.size() ? app->textures[textureIdx].layer : NO_TEXTURE_LAYER;
+}
+
+// Every material loaded so far, in the order of App::materials
+void UploadMaterials(App* app)
+{
+    ASSERT(app->materials.size() <= MAX_MATERIALS, "Too many materials for the material id buffer");
+
+    std::vector<GPUMaterial> gpuMaterials(app->materials.size());
+    for (u32 i = 0; i < app->materials.size(); ++i)
+    {
+        const Material& material = app->materials[i];
+        GPUMaterial& gpuMaterial = gpuMaterials[i];
+        gpuMaterial = {};
+        gpuMaterial.albedo = vec4(material.albedo, material.smoothness);
+        gpuMaterial.emissive = vec4(material.emissive, 0.0f);
+        gpuMaterial.albedoTexture = GetMaterialTextureLayer(app, material.albedoTextureIdx);
+        gpuMaterial.emissiveTexture = GetMaterialTextureLayer(app, material.emissiveTextureIdx);
+        gpuMaterial.specularTexture = GetMaterialTextureLayer(app, material.specularTextureIdx);
+        gpuMaterial.normalsTexture = GetMaterialTextureLayer(app, material.normalsTextureIdx);
+        gpuMaterial.bumpTexture = GetMaterialTextureLayer(app, material.bumpTextureIdx);
+    }
+
+    if (app->materialBuffer == 0)
+    {
+        glGenBuffers(1, &app->materialBuffer);
+
+        std::vector<u32> materialIds(MAX_MATERIALS);
+        for (u32 i = 0; i < MAX_MATERIALS; ++i)
+            materialIds[i] = i;
+
+        glGenBuffers(1, &app->materialIdBuffer);
+        glBindBuffer(GL_ARRAY_BUFFER, app->materialIdBuffer);
+        glBufferData(GL_ARRAY_BUFFER, MAX_MATERIALS * sizeof(u32), materialIds.data(), GL_STATIC_DRAW);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, app->materialBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, gpuMaterials.size() * sizeof(GPUMaterial), gpuMaterials.data(), GL_STATIC_DRAW);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+}
+
+u32 SpawnModel(App* app, u32 modelIdx, const vec3& position, const glm::quat& rotation, const vec3& scale, u32 entityFlags)
+{
+    const EntityHandle noEntity = { UINT32_MAX, 0 };
+    const u32 rootId = CreateTransform(app->transforms, TRANSFORM_ROOT, position, rotation, scale, noEntity);
+
+    // Nodes are stored with parents first, so their transform ids already exist
+    const Model& model = app->models[modelIdx];
+    std::vector<u32> nodeIds(model.nodes.size());
+    for (u32 i = 0; i < model.nodes.size(); ++i)
+    {
+        const ModelNode& node = model.nodes[i];
+        const u32 parentId = node.parent == UINT32_MAX ? rootId : nodeIds[node.parent];
+
+        // The hierarchy writes the world transform into the entity on the next update
+        EntityHandle entity = noEntity;
+        if (!node.submeshes.empty())
+            entity = CreateEntity(app->entities, glm::mat4(1.0f), RenderMesh{ modelIdx, i, node.localBounds }, entityFlags);
+
+        nodeIds[i] = CreateTransform(app->transforms, parentId, node.position, node.rotation, node.scale, entity);
+    }
+
+    return rootId;
+}
+
+// Defaults of the settings for the tier and the features of the GPU, the Gui can change them later
+void ApplyGpuTier(App* app)
+{
+    const GpuCapabilities& gpu = app->gpu;
+    switch (gpu.tier)
+    {
+    case GpuTier_Software:
+        // Every fragment costs CPU time, so shade each one once and skip the full screen passes
+        app->mode = Mode_Forward;
+        app->temporalAAEnabled = false;
+        app->bloomEnabled = false;
+        app->ssaoSettings.enabled = false;
+        app->occlusionCullingEnabled = false;
+        app->softwareOcclusionEnabled = true;
+        app->resolutionSettings.gpuBudget = 33.0f;
+        app->resolutionSettings.minScale = 0.25f;
+        break;
+    case GpuTier_Low:
+        app->ssaoSettings.enabled = false;
+        break;
+    default:
+        break;
+    }
+
+    // The culling, SSAO, bloom, exposure and the Forward+ light lists are compute shaders, which
+    // are not even loaded without them, and Gui() does not offer them
+    if (!gpu.computeShaders)
+    {
+        if (app->mode == Mode_ForwardPlus)
+            app->mode = Mode_Deferred;
+        app->ssaoSettings.enabled = false;
+        app->bloomEnabled = false;
+        app->exposureSettings.enabled = false;
+        app->occlusionCullingEnabled = false;
+        app->softwareOcclusionEnabled = true;
+    }
+}
+
 void Init(App* app)
 {
     app->mode = Mode::Mode_Deferred;
+    app->maxFramesInFlight = 2;
 
-    glGetIntegerv(GL_MAX_UNIFORM_BLOCK_SIZE, &app->maxUniformBufferSize);
-    glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &app->uniformBlockAlignment);
+    QueryGpuCapabilities(app->gpu);
+    ILOG("GPU: %s, OpenGL %s, tier %s%s", app->gpu.renderer, app->gpu.version, GetGpuTierName(app->gpu.tier), app->gpu.tierForced ? " (forced)" : "");
+    ApplyGpuTier(app);
+
+    app->maxUniformBufferSize = app->gpu.maxUniformBlockSize;
+    app->uniformBlockAlignment = app->gpu.uniformBufferOffsetAlignment;
 
     app->cbuffer = CreateBuffer(app->maxUniformBufferSize, GL_UNIFORM_BUFFER, GL_STREAM_DRAW);
 
-    switch (app->mode) {
-    case Mode::Mode_Forward: {
-        app->texturedMeshProgramIdx = LoadProgram(app, "shader2.glsl", "SHOW_TEXTURED_MESH");
-        Program& texturedMeshProgram = app->programs[app->texturedMeshProgramIdx];
-        texturedMeshProgram.vertexInputLayout.attributes.push_back({ 0, 3 }); // position
-        texturedMeshProgram.vertexInputLayout.attributes.push_back({ 1, 3 }); // normals
-        texturedMeshProgram.vertexInputLayout.attributes.push_back({ 2, 2 }); // texCoord
-        app->programUniformTexture = glGetUniformLocation(texturedMeshProgram.handle, "uTexture");
-        break; }
-    case Mode::Mode_Deferred: {
-        app->texturedMeshProgramIdx = LoadProgram(app, "shader2.glsl", "DEF_GEOMETRY");
-        Program& texturedMeshProgram = app->programs[app->texturedMeshProgramIdx];
-        texturedMeshProgram.vertexInputLayout.attributes.push_back({ 0, 3 }); // position
-        texturedMeshProgram.vertexInputLayout.attributes.push_back({ 1, 3 }); // normals
-        texturedMeshProgram.vertexInputLayout.attributes.push_back({ 2, 2 }); // texCoord
-        app->programUniformTexture = glGetUniformLocation(texturedMeshProgram.handle, "uTexture");
+    // The mode can change at any frame, so the programs of every path are loaded
+    app->texturedMeshProgramIdx = LoadProgram(app, "shader2.glsl", "SHOW_TEXTURED_MESH", false, ShaderFeature_All);
+    Program& texturedMeshProgram = app->programs[app->texturedMeshProgramIdx];
+    VERIFY_BLOCK_LAYOUT(texturedMeshProgram.handle, "LocalParams", EntityLocalParams, EntityLocalParamsMembers);
+    texturedMeshProgram.vertexInputLayout.attributes.push_back({ 0, 3 }); // position
+    texturedMeshProgram.vertexInputLayout.attributes.push_back({ 1, 3 }); // normals
+    texturedMeshProgram.vertexInputLayout.attributes.push_back({ 2, 2 }); // texCoord
+    texturedMeshProgram.vertexInputLayout.attributes.push_back({ MATERIAL_ID_LOCATION, 1 });
+
+    app->geometryProgramIdx = LoadProgram(app, "shader2.glsl", "DEF_GEOMETRY");
+    Program& geometryProgram = app->programs[app->geometryProgramIdx];
+    VERIFY_BLOCK_LAYOUT(geometryProgram.handle, "LocalParams", EntityLocalParams, EntityLocalParamsMembers);
+    geometryProgram.vertexInputLayout.attributes.push_back({ 0, 3 }); // position
+    geometryProgram.vertexInputLayout.attributes.push_back({ 1, 3 }); // normals
+    geometryProgram.vertexInputLayout.attributes.push_back({ 2, 2 }); // texCoord
+    geometryProgram.vertexInputLayout.attributes.push_back({ MATERIAL_ID_LOCATION, 1 });
+
+    app->depthPrepassProgramIdx = LoadProgram(app, "shader2.glsl", "DEPTH_PREPASS");
+    Program& depthPrepass = app->programs[app->depthPrepassProgramIdx];
+    depthPrepass.vertexInputLayout.attributes.push_back({ 0, 3 }); // position
+
+    app->lightProgramIdx = LoadProgram(app, "shader2.glsl", "LIGHTING", false, ShaderFeature_All);
+    Program& light = app->programs[app->lightProgramIdx];
+    light.vertexInputLayout.attributes.push_back({ 0, 3 }); // position
+    light.vertexInputLayout.attributes.push_back({ 1, 2 }); // texCoord
+
+    app->debugDrawProgramIdx = LoadProgram(app, "shader2.glsl", "DEBUG_DRAW");
+
+    if (app->gpu.computeShaders)
+    {
+        app->downsampleR32FProgramIdx = LoadComputeProgram(app, "shader2.glsl", "DOWNSAMPLE_R32F");
+        app->downsampleRGBA16FProgramIdx = LoadComputeProgram(app, "shader2.glsl", "DOWNSAMPLE_RGBA16F");
+        app->occlusionCullingProgramIdx = LoadComputeProgram(app, "shader2.glsl", "OCCLUSION_CULLING");
+        app->ssaoDownsampleProgramIdx = LoadComputeProgram(app, "shader2.glsl", "SSAO_DOWNSAMPLE");
+        app->ssaoProgramIdx = LoadComputeProgram(app, "shader2.glsl", "SSAO");
+        app->ssaoBlurProgramIdx = LoadComputeProgram(app, "shader2.glsl", "SSAO_BLUR");
+        app->bloomPrefilterProgramIdx = LoadComputeProgram(app, "shader2.glsl", "BLOOM_PREFILTER");
+        app->exposureHistogramProgramIdx = LoadComputeProgram(app, "shader2.glsl", "EXPOSURE_HISTOGRAM");
+        app->exposureAdaptProgramIdx = LoadComputeProgram(app, "shader2.glsl", "EXPOSURE_ADAPT");
+        app->lightCullingProgramIdx = LoadComputeProgram(app, "shader2.glsl", "LIGHT_CULLING");
+    }
 
-        app->lightProgramIdx = LoadProgram(app, "shader2.glsl", "LIGHTING");
-        Program& light = app->programs[app->lightProgramIdx];
-        light.vertexInputLayout.attributes.push_back({ 0, 3 }); // position
-        light.vertexInputLayout.attributes.push_back({ 1, 2 }); // texCoord
+    app->shadowDepthProgramIdx = LoadProgram(app, "shader2.glsl", "SHADOW_DEPTH");
+    Program& shadowDepth = app->programs[app->shadowDepthProgramIdx];
+    shadowDepth.vertexInputLayout.attributes.push_back({ 0, 3 }); // position
 
-        app->gizmosProgramIdx = LoadProgram(app, "shader2.glsl", "GIZMOS");
-        Program& gizmos = app->programs[app->gizmosProgramIdx];
-        gizmos.vertexInputLayout.attributes.push_back({ 0, 3 }); // position
-        break; 
-    }
-    }
+    app->pointShadowDepthProgramIdx = LoadProgram(app, "shader2.glsl", "POINT_SHADOW_DEPTH", true);
+    Program& pointShadowDepth = app->programs[app->pointShadowDepthProgramIdx];
+    pointShadowDepth.vertexInputLayout.attributes.push_back({ 0, 3 }); // position
+
+    app->upscaleProgramIdx = LoadProgram(app, "shader2.glsl", "UPSCALE");
+    Program& upscale = app->programs[app->upscaleProgramIdx];
+    upscale.vertexInputLayout.attributes.push_back({ 0, 3 }); // position
+    upscale.vertexInputLayout.attributes.push_back({ 1, 2 }); // texCoord
+
+    app->temporalAAProgramIdx = LoadProgram(app, "shader2.glsl", "TEMPORAL_AA");
+    Program& temporalAA = app->programs[app->temporalAAProgramIdx];
+    temporalAA.vertexInputLayout.attributes.push_back({ 0, 3 }); // position
+    temporalAA.vertexInputLayout.attributes.push_back({ 1, 2 }); // texCoord
+
+    app->bloomCompositeProgramIdx = LoadProgram(app, "shader2.glsl", "BLOOM_COMPOSITE");
+    Program& bloomComposite = app->programs[app->bloomCompositeProgramIdx];
+    bloomComposite.vertexInputLayout.attributes.push_back({ 0, 3 }); // position
+    bloomComposite.vertexInputLayout.attributes.push_back({ 1, 2 }); // texCoord
 
     app->patrick = LoadModel(app, "Patrick/Patrick.obj");
 
-    app->entities.emplace_back(vec3(0, 0.0F, 0.0F), vec3(1, 1, 1), app->patrick);
-    app->entities.emplace_back(vec3(-2.5F, 0.0F, 0), vec3(1, 1, 1), app->patrick);
-    app->entities.emplace_back(vec3(2.5F, 0.0F, 0.0F), vec3(1, 1, 1), app->patrick);
+    UploadMaterials(app);
+
+    const u32 patrickFlags = EntityFlag_Static | EntityFlag_CastShadows | EntityFlag_Occluder;
+
+    SpawnModel(app, app->patrick, vec3(0, 0.0F, 0.0F), glm::quat(1, 0, 0, 0), vec3(1, 1, 1), patrickFlags);
+    SpawnModel(app, app->patrick, vec3(-2.5F, 0.0F, 0), glm::quat(1, 0, 0, 0), vec3(1, 1, 1), patrickFlags);
+    SpawnModel(app, app->patrick, vec3(2.5F, 0.0F, 0.0F), glm::quat(1, 0, 0, 0), vec3(1, 1, 1), patrickFlags);
 
     app->mainCam = new Camera();
 
+    // Allocated once for the largest scale, dynamic resolution only changes the viewport
+    app->renderTargetSize = ivec2(vec2(app->displaySize) * DYNAMIC_RESOLUTION_MAX_SCALE);
+    app->renderSize = app->renderTargetSize;
+
+    // HDR, the exposure and the tonemapping bring it to the backbuffer range at the end
     glGenTextures(1, &app->colorAttachment);
     glBindTexture(GL_TEXTURE_2D, app->colorAttachment);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, app->displaySize.x, app->displaySize.y, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, app->renderTargetSize.x, app->renderTargetSize.y, 0, GL_RGBA, GL_FLOAT, NULL);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
@@ -238,7 +655,7 @@ void Init(App* app)
 
     glGenTextures(1, &app->depthAttachment);
     glBindTexture(GL_TEXTURE_2D, app->depthAttachment);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT24, app->displaySize.x, app->displaySize.y, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT24, app->renderTargetSize.x, app->renderTargetSize.y, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
@@ -248,7 +665,7 @@ void Init(App* app)
 
     glGenTextures(1, &app->normalsAttachment);
     glBindTexture(GL_TEXTURE_2D, app->normalsAttachment);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, app->displaySize.x, app->displaySize.y, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, app->renderTargetSize.x, app->renderTargetSize.y, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
@@ -258,7 +675,7 @@ void Init(App* app)
 
     glGenTextures(1, &app->albedoAttachment);
     glBindTexture(GL_TEXTURE_2D, app->albedoAttachment);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, app->displaySize.x, app->displaySize.y, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, app->renderTargetSize.x, app->renderTargetSize.y, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
@@ -268,7 +685,7 @@ void Init(App* app)
 
     glGenTextures(1, &app->positionsAttachment);
     glBindTexture(GL_TEXTURE_2D, app->positionsAttachment);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, app->displaySize.x, app->displaySize.y, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, app->renderTargetSize.x, app->renderTargetSize.y, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
@@ -276,6 +693,15 @@ void Init(App* app)
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
     glBindTexture(GL_TEXTURE_2D, 0);
 
+    glGenTextures(1, &app->motionAttachment);
+    glBindTexture(GL_TEXTURE_2D, app->motionAttachment);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RG16F, app->renderTargetSize.x, app->renderTargetSize.y, 0, GL_RG, GL_FLOAT, NULL);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
     glGenFramebuffers(1, &app->frameBuffer);
     glBindFramebuffer(GL_FRAMEBUFFER, app->frameBuffer);
     glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, app->colorAttachment, 0);
@@ -283,6 +709,7 @@ void Init(App* app)
     glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, app->normalsAttachment, 0);
     glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT2, app->albedoAttachment, 0);
     glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT3, app->positionsAttachment, 0);
+    glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT4, app->motionAttachment, 0);
 
     GLenum framebufferStatus = glCheckFramebufferStatus(GL_FRAMEBUFFER);
     if (framebufferStatus != GL_FRAMEBUFFER_COMPLETE) {
@@ -320,6 +747,48 @@ void Init(App* app)
     glDrawBuffers(1, &app->colorAttachment);
     glBindFramebuffer(GL_FRAMEBUFFER, 0);
 
+    glGenFramebuffers(1, &app->lightingFrameBuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, app->lightingFrameBuffer);
+    glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, app->colorAttachment, 0);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+    InitDynamicResolution(app->dynamicResolution);
+
+    // The history is at display resolution whatever the render size is
+    InitTemporalAA(app->temporalAA, app->displaySize);
+
+    InitAutoExposure(app->autoExposure, GetComputeProgram(app, app->exposureHistogramProgramIdx), GetComputeProgram(app, app->exposureAdaptProgramIdx));
+
+    InitBloom(app->bloom, GetComputeProgram(app, app->bloomPrefilterProgramIdx), app->renderTargetSize);
+
+    InitDepthPrepass(app->depthPrepass);
+
+    InitDebugDraw(app->debugDraw, app->programs[app->debugDrawProgramIdx].handle);
+
+    InitTiledLights(app->tiledLights, GetComputeProgram(app, app->lightCullingProgramIdx), app->renderTargetSize);
+
+    InitSSAO(app->ssao, GetComputeProgram(app, app->ssaoDownsampleProgramIdx), GetComputeProgram(app, app->ssaoProgramIdx), GetComputeProgram(app, app->ssaoBlurProgramIdx), app->renderTargetSize);
+
+    InitOcclusionBuffer(app->softwareOcclusion, SOFTWARE_OCCLUSION_WIDTH, SOFTWARE_OCCLUSION_HEIGHT);
+
+    glGenTextures(1, &app->softwareOcclusionTexture);
+    glBindTexture(GL_TEXTURE_2D, app->softwareOcclusionTexture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_R32F, SOFTWARE_OCCLUSION_WIDTH, SOFTWARE_OCCLUSION_HEIGHT, 0, GL_RED, GL_FLOAT, NULL);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    InitDownsampler(app->downsampler, GetComputeProgram(app, app->downsampleR32FProgramIdx), GetComputeProgram(app, app->downsampleRGBA16FProgramIdx));
+
+    InitOcclusionCulling(app->occlusionCulling, GetComputeProgram(app, app->occlusionCullingProgramIdx), app->renderTargetSize);
+
+    InitShadowMaps(app->shadowMaps, app->programs[app->shadowDepthProgramIdx].handle);
+    InitPointShadowMaps(app->pointShadowMaps, app->programs[app->pointShadowDepthProgramIdx].handle);
+    InitShadowAtlas(app->pointShadows.atlas, POINT_SHADOW_ATLAS_SIZE, POINT_SHADOW_MIN_TILE);
+    app->shadowCBuffer = CreateBuffer(app->maxUniformBufferSize, GL_UNIFORM_BUFFER, GL_STREAM_DRAW);
+
     app->lights.push_back(Light(LightType::Directional, vec3(1.0F, 0.1f, 0.5f), vec3(-3, -1, -2), vec3(3, 1, 2), 0.5f));
     app->lights.push_back(Light(LightType::Directional, vec3(0, 1, 1.0F), vec3(-1, 0, 1), vec3(3, 0, -3), 0.5));
     app->lights.push_back(Light(LightType::Point, vec3(1.0F, 0.3F, 0.3F), vec3(-1, 0, 0), vec3(1, 0, 3), 2));
@@ -329,22 +798,87 @@ void Init(App* app)
     app->lights.push_back(Light(LightType::Point, vec3(1, 0, 1), vec3(-1, 0, 0), vec3(-1, 3, -2.5), 4));
     app->lights.push_back(Light(LightType::Point, vec3(0.5, 1, 0), vec3(-1, 0, 0), vec3(-3, 2, 2.5), 1));
     app->lights.push_back(Light(LightType::Point, vec3(0.5, 0.5, 1), vec3(-1, 0, 0), vec3(5, 2, 2.5), 5));
+
+    for (u32 i = 0; i < app->lights.size(); ++i)
+    {
+        if (app->lights[i].type != LightType::Point)
+            continue;
+
+        const f32 radius = GetLightRadius(app->lights[i]);
+        const AABB lightBounds = { app->lights[i].position - vec3(radius), app->lights[i].position + vec3(radius) };
+        CreateProxy(app->spatialIndex, lightBounds, SpatialCategory_PointLight, i);
+    }
+}
+
+f32 GetLightRadius(const Light& light)
+{
+    // Solve quadratic * d^2 + linear * d + 1 = 256 * brightness
+    const f32 brightness = light.intensity * glm::max(glm::max(light.color.r, light.color.g), light.color.b);
+    const f32 c = 1.0f - 256.0f * brightness;
+    if (c >= 0.0f)
+        return 0.0f;
+
+    const f32 a = LIGHT_ATTENUATION_QUADRATIC;
+    const f32 b = LIGHT_ATTENUATION_LINEAR;
+    return (-b + sqrtf(b * b - 4.0f * a * c)) / (2.0f * a);
 }
 
 void Gui(App* app)
 {
     ImGui::Begin("Info");
     ImGui::Text("FPS: %f", 1.0f/app->deltaTime);
-    ImGui::Text("OpenGL Version: %s", glGetString(GL_VERSION));
-    ImGui::Text("OpenGL Renderer: %s", glGetString(GL_RENDERER));
-    ImGui::Text("OpenGL Vendor: %s", glGetString(GL_VENDOR));
-    ImGui::Text("OpenGL GLSL Version: %s", glGetString(GL_SHADING_LANGUAGE_VERSION));
+    ImGui::Text("OpenGL Version: %s", app->gpu.version);
+    ImGui::Text("OpenGL Renderer: %s", app->gpu.renderer);
+    ImGui::Text("OpenGL Vendor: %s", app->gpu.vendor);
+    ImGui::Text("OpenGL GLSL Version: %s", app->gpu.glslVersion);
+    ImGui::Text("GPU Tier: %s%s", GetGpuTierName(app->gpu.tier), app->gpu.tierForced ? " (forced)" : "");
+    ImGui::Text("Job Threads: %u", GetJobThreadCount());
+    ImGui::Text("Frames In Flight: %u", app->maxFramesInFlight);
+    // Forward+ is last, so without compute shaders the combo only loses its entry
+    ImGui::Combo("Render Path", (int*)&app->mode, app->gpu.computeShaders ? "Forward\0Deferred\0Forward+\0" : "Forward\0Deferred\0");
+    if (app->mode == Mode_Deferred)
+    {
+        ImGui::Combo("Depth Prepass", (int*)&app->depthPrepassSettings.mode, "Off\0On\0Auto\0");
+        ImGui::Text("Overdraw: %.2f, Prepass: %s", app->depthPrepass.displayedOverdraw.load(), app->depthPrepass.displayedEnabled ? "On" : "Off");
+    }
+    ImGui::Checkbox("Light Gizmos", &app->renderLightGuizmos);
+    if (app->gpu.computeShaders)
+        ImGui::Checkbox("Occlusion Culling", &app->occlusionCullingEnabled);
+    ImGui::Checkbox("Software Occlusion Culling", &app->softwareOcclusionEnabled);
+    ImGui::Combo("Cascade Splits", (int*)&app->shadows.splitScheme, "Uniform\0Logarithmic\0Practical\0");
+    if (app->shadows.splitScheme == CascadeSplit_Practical)
+        ImGui::SliderFloat("Split Lambda", &app->shadows.splitLambda, 0.0f, 1.0f);
+    ImGui::SliderFloat("Shadow Distance", &app->shadows.shadowDistance, 10.0f, 500.0f);
+    ImGui::Checkbox("Dynamic Resolution", &app->resolutionSettings.enabled);
+    if (app->resolutionSettings.enabled)
+    {
+        ImGui::SliderFloat("GPU Budget (ms)", &app->resolutionSettings.gpuBudget, 2.0f, 50.0f);
+        ImGui::SliderFloat("Min Resolution Scale", &app->resolutionSettings.minScale, 0.25f, DYNAMIC_RESOLUTION_MAX_SCALE);
+    }
+    ImGui::Text("Resolution Scale: %.2f", app->dynamicResolution.displayedScale.load());
+    ImGui::Text("GPU Time: %.2f ms", app->dynamicResolution.displayedGpuTime.load());
+    ImGui::Checkbox("Temporal AA", &app->temporalAAEnabled);
+    if (app->gpu.computeShaders)
+    {
+        ImGui::Checkbox("Bloom", &app->bloomEnabled);
+        ImGui::Checkbox("Auto Exposure", &app->exposureSettings.enabled);
+    }
+    ImGui::SliderFloat("Exposure Compensation", &app->exposureSettings.compensation, -4.0f, 4.0f);
+    if (app->exposureSettings.enabled)
+        ImGui::SliderFloat("Adaptation Speed", &app->exposureSettings.adaptationSpeed, 0.1f, 10.0f);
+    if (app->gpu.computeShaders)
+        ImGui::Checkbox("SSAO", &app->ssaoSettings.enabled);
+    if (app->ssaoSettings.enabled)
+    {
+        ImGui::SliderFloat("SSAO Radius", &app->ssaoSettings.radius, 0.05f, 2.0f);
+        ImGui::SliderFloat("SSAO Intensity", &app->ssaoSettings.intensity, 0.0f, 4.0f);
+    }
     ImGui::Text("--- Camera Pos ---");
     ImGui::Text("Camera Pos X: %f", app->mainCam->cameraPos.x);
     ImGui::Text("Camera Pos Y: %f", app->mainCam->cameraPos.y);
     ImGui::Text("Camera Pos Z: %f", app->mainCam->cameraPos.z);
     ImGui::Text("------------------");
-    ImGui::Combo("Painted Texture", (int*)&app->currentTextureType, "Albedo Color\0Depth Buffer\0Normals Buffer\0Positions");
+    ImGui::Combo("Painted Texture", (int*)&app->currentTextureType, "Albedo Color\0Depth Buffer\0Normals Buffer\0Positions\0Software Occlusion");
     ImGui::PushStyleVar(ImGuiStyleVar_FramePadding, ImVec2(4, 2.5F));
     ImGui::AlignTextToFramePadding();
     ImGui::PopStyleVar();
@@ -362,13 +896,25 @@ void Gui(App* app)
     case TextureTypes::PositionBuffer: {
         ImGui::Image((ImTextureID)app->positionsAttachment, ImVec2(app->displaySize.x, app->displaySize.y), ImVec2(0, 1), ImVec2(1, 0));
         break; }
+    case TextureTypes::SoftwareOcclusionDepth: {
+        ImGui::Image((ImTextureID)app->softwareOcclusionTexture, ImVec2(app->displaySize.x, app->displaySize.y), ImVec2(0, 1), ImVec2(1, 0));
+        break; }
+    }
+
+    if (ImGui::TreeNodeEx("GPU Features", ImGuiTreeNodeFlags_SpanAvailWidth)) {
+        ImGui::Text("Compute Shaders: %s", app->gpu.computeShaders ? "Yes" : "No");
+        ImGui::Text("Parallel Shader Compile: %s", app->gpu.parallelShaderCompile ? "Yes" : "No");
+        ImGui::Text("Max Uniform Block Size: %d", app->gpu.maxUniformBlockSize);
+        ImGui::Text("Max Shader Storage Block Size: %d", app->gpu.maxShaderStorageBlockSize);
+        ImGui::Text("Max Compute Shared Memory: %d", app->gpu.maxComputeSharedMemorySize);
+        ImGui::Text("Max Texture Size: %d", app->gpu.maxTextureSize);
+        ImGui::Text("Max Array Texture Layers: %d", app->gpu.maxArrayTextureLayers);
+        ImGui::TreePop();
     }
 
     if (ImGui::TreeNodeEx("OpenGL Extensions", ImGuiTreeNodeFlags_SpanAvailWidth)) {
-        GLint numExtensions;
-        glGetIntegerv(GL_NUM_EXTENSIONS, &numExtensions);
-        for (int i = 0; i < numExtensions; ++i) {
-            ImGui::Text((const char*)glGetStringi(GL_EXTENSIONS, i));
+        for (u32 i = 0; i < app->gpu.extensions.size(); ++i) {
+            ImGui::Text("%s", app->gpu.extensions[i].c_str());
         }
         ImGui::TreePop();
     }
@@ -376,45 +922,404 @@ void Gui(App* app)
     ImGui::End();
 }
 
-void Update(App* app)
+// Rasterizes the visible occluders on the CPU and drops from the packet every entity hidden
+// behind them, so neither culling nor drawing them reaches the GPU
+void CullOccludedEntities(App* app, RenderPacket& packet, const std::vector<u32>& occluders)
 {
-    // You can handle app->input keyboard/mouse here
-    if (app->input.keys[Key::K_W] == ButtonState::BUTTON_PRESSED)
+    OcclusionBuffer& buffer = app->softwareOcclusion;
+    ClearOcclusionBuffer(buffer);
+
+    std::vector<OccluderInstance> instances;
+    for (u32 i = 0; i < occluders.size(); ++i)
     {
-        app->mainCam->cameraPos += app->mainCam->speed * app->mainCam->cameraDirection * app->deltaTime;
+        const RenderEntity& entity = packet.entities[occluders[i]];
+        const Model& model = app->models[entity.model];
+        const Mesh& mesh = app->meshes[model.meshIdx];
+        const ModelNode& node = model.nodes[entity.modelNode];
+
+        for (u32 j = 0; j < node.submeshes.size(); ++j)
+        {
+            OccluderInstance instance;
+            instance.mesh = &mesh.submeshes[node.submeshes[j]].occluder;
+            instance.worldViewProjection = packet.view.viewProjectionMatrix * entity.world;
+            instances.push_back(instance);
+        }
     }
 
-    if (app->input.keys[Key::K_S] == ButtonState::BUTTON_PRESSED)
+    AddOccluders(buffer, instances.data(), instances.size());
+    RasterizeOccluders(buffer);
+
+    std::vector<u8> occluded(packet.entities.size());
+    ParallelFor(packet.entities.size(), 64, [&](u32 begin, u32 end) {
+        for (u32 i = begin; i < end; ++i)
+            occluded[i] = IsOccluded(buffer, packet.entities[i].bounds, packet.view.viewProjectionMatrix);
+    });
+
+    u32 visibleCount = 0;
+    for (u32 i = 0; i < packet.entities.size(); ++i)
     {
-        app->mainCam->cameraPos -= app->mainCam->speed * app->mainCam->cameraDirection * app->deltaTime;
+        if (occluded[i])
+        {
+            const u32 dense = app->entities.slotToDense[packet.entities[i].slot];
+            app->entities.flags[dense] &= ~EntityFlag_Visible;
+        }
+        else
+        {
+            packet.entities[visibleCount++] = packet.entities[i];
+        }
     }
+    packet.entities.resize(visibleCount);
+}
 
-    if (app->input.keys[Key::K_D] == ButtonState::BUTTON_PRESSED)
+// Casters are shared by every shadow map, each one is copied into the packet once
+u32 AddShadowCaster(App* app, RenderPacket& packet, std::vector<u32>& casterIndices, u32 slot)
+{
+    if (casterIndices[slot] == UINT32_MAX)
     {
-        app->mainCam->cameraPos -= app->mainCam->speed * app->mainCam->cameraRight * app->deltaTime;
+        const EntityStore& store = app->entities;
+        const u32 dense = store.slotToDense[slot];
+        casterIndices[slot] = packet.shadowCasters.size();
+
+        RenderEntity caster;
+        caster.world = store.transforms[dense];
+        caster.bounds = store.bounds[dense];
+        caster.model = store.renderMeshes[dense].model;
+        caster.modelNode = store.renderMeshes[dense].modelNode;
+        caster.slot = slot;
+        packet.shadowCasters.push_back(caster);
     }
+    return casterIndices[slot];
+}
 
-    if (app->input.keys[Key::K_A] == ButtonState::BUTTON_PRESSED)
+// Gives tiles of the atlas to the most important point lights in view and picks the budgeted
+// faces to render. Faces are invalidated by the casters that moved inside them.
+void CollectPointShadows(App* app, RenderPacket& packet, const std::vector<u32>& lightSources, std::vector<u32>& casterIndices)
+{
+    PointShadows& shadows = app->pointShadows;
+    EntityStore& store = app->entities;
+
+    packet.pointShadows.clear();
+    packet.pointShadowUpdates.clear();
+
+    // Goes from what moved to the lights it touches, so it does not grow with the light count
+    std::vector<u32> touchedLights;
+    for (u32 i = 0; i < store.changedBounds.size(); ++i)
     {
-        app->mainCam->cameraPos += app->mainCam->speed * app->mainCam->cameraRight * app->deltaTime;
+        touchedLights.clear();
+        QueryBox(app->spatialIndex, store.changedBounds[i], SpatialCategory_PointLight, touchedLights);
+        for (u32 j = 0; j < touchedLights.size(); ++j)
+            for (u32 k = 0; k < shadows.shadows.size(); ++k)
+                if (shadows.shadows[k].light == touchedLights[j])
+                    InvalidatePointShadowFaces(shadows.shadows[k], store.changedBounds[i]);
     }
 
-    if (app->input.mouseButtons[MouseButton::LEFT] == BUTTON_PRESSED)
+    // Only the lights the shaders can see are worth a shadow
+    std::vector<u32> candidates;
+    std::vector<f32> importances(packet.lights.size());
+    const f32 tanHalfFovY = tanf(glm::radians(CAMERA_FOV_Y) * 0.5f);
+    for (u32 i = 0; i < packet.lights.size() && i < MAX_SHADER_LIGHTS; ++i)
     {
-        app->mainCam->yaw += app->input.mouseDelta.x * app->deltaTime * 30;
-        app->mainCam->pitch -= app->input.mouseDelta.y * app->deltaTime * 30;
+        const Light& light = packet.lights[i];
+        if (light.type != LightType::Point)
+            continue;
 
-        if (app->mainCam->pitch > 89.0f)
-            app->mainCam->pitch = 89.0f;
-        if (app->mainCam->pitch < -89.0f)
-            app->mainCam->pitch = -89.0f;
+        importances[i] = GetPointShadowImportance(packet.view.cameraPosition, tanHalfFovY, packet.displaySize.y, light.position, GetLightRadius(light));
+        candidates.push_back(i);
     }
 
-    app->mainCam->RecalcalculateViewMatrix();
-}
+    std::sort(candidates.begin(), candidates.end(), [&](u32 a, u32 b) { return importances[a] > importances[b]; });
+    if (candidates.size() > POINT_SHADOW_MAX_LIGHTS)
+        candidates.resize(POINT_SHADOW_MAX_LIGHTS);
+
+    const u32 count = candidates.size();
+    std::vector<u32> lights(count);
+    std::vector<glm::vec3> positions(count);
+    std::vector<f32> radii(count);
+    std::vector<f32> candidateImportances(count);
+    std::vector<u32> shadowIndices(count);
+    for (u32 k = 0; k < count; ++k)
+    {
+        const Light& light = packet.lights[candidates[k]];
+        lights[k] = lightSources[candidates[k]];
+        positions[k] = light.position;
+        radii[k] = GetLightRadius(light);
+        candidateImportances[k] = importances[candidates[k]];
+    }
 
-void renderQuad()
-{
+    AssignPointShadowTiles(shadows, lights.data(), positions.data(), radii.data(), candidateImportances.data(), count, shadowIndices.data());
+
+    std::vector<u8> faceMasks;
+    SelectPointShadowFaces(shadows, POINT_SHADOW_FACE_BUDGET, faceMasks);
+
+    std::vector<u32> entitySlots;
+    for (u32 k = 0; k < count; ++k)
+    {
+        if (shadowIndices[k] == UINT32_MAX)
+            continue;
+
+        const PointShadow& shadow = shadows.shadows[shadowIndices[k]];
+
+        PointShadowView view;
+        view.light = candidates[k];
+        view.position = shadow.position;
+        view.radius = shadow.radius;
+        view.tileSize = shadow.tileSize;
+        for (u32 f = 0; f < 6; ++f)
+            view.tiles[f] = shadow.tiles[f];
+        view.validFaces = shadow.validFaces;
+        packet.pointShadows.push_back(view);
+
+        const u8 faceMask = faceMasks[shadowIndices[k]];
+        if (faceMask == 0)
+            continue;
+
+        Frustum faceFrustums[6];
+        for (u32 f = 0; f < 6; ++f)
+            if (faceMask & (1 << f))
+                faceFrustums[f] = ExtractFrustum(GetPointShadowFaceViewProjection(shadow.position, shadow.radius, f));
+
+        PointShadowUpdate update;
+        update.view = packet.pointShadows.size() - 1;
+        update.faceMask = faceMask;
+
+        // Only the casters of the faces rendered this frame
+        entitySlots.clear();
+        QuerySphere(app->spatialIndex, shadow.position, shadow.radius, SpatialCategory_Entity, entitySlots);
+        for (u32 i = 0; i < entitySlots.size(); ++i)
+        {
+            const u32 dense = store.slotToDense[entitySlots[i]];
+            if (!(store.flags[dense] & EntityFlag_CastShadows))
+                continue;
+
+            bool inFace = false;
+            for (u32 f = 0; f < 6 && !inFace; ++f)
+                inFace = (faceMask & (1 << f)) && FrustumIntersectsAABB(faceFrustums[f], store.bounds[dense]);
+
+            if (inFace)
+                update.casters.push_back(AddShadowCaster(app, packet, casterIndices, entitySlots[i]));
+        }
+
+        packet.pointShadowUpdates.push_back(update);
+    }
+}
+
+// Fits the cascades of the first directional light and culls the casters of every cascade
+// against its light frustum. Static casters of cached cascades are only gathered on the frames
+// their cache is re-rendered.
+void CollectCascadeCasters(App* app, RenderPacket& packet, std::vector<u32>& casterIndices)
+{
+    packet.shadowLight = -1;
+    for (u32 i = 0; i < packet.lights.size(); ++i)
+    {
+        if (packet.lights[i].type == LightType::Directional)
+        {
+            packet.shadowLight = i;
+            break;
+        }
+    }
+
+    if (packet.shadowLight < 0)
+        return;
+
+    EntityStore& store = app->entities;
+    const f32 aspect = (f32)packet.displaySize.x / (f32)packet.displaySize.y;
+    UpdateShadowCascades(app->shadows, packet.view.viewMatrix, glm::radians(CAMERA_FOV_Y), aspect, CAMERA_NEAR, glm::normalize(packet.lights[packet.shadowLight].direction), store.staticVersion, packet.shadowCascades);
+
+    std::vector<u32> candidates;
+
+    for (u32 c = 0; c < SHADOW_CASCADE_COUNT; ++c)
+    {
+        ShadowCascadeView& cascade = packet.shadowCascades[c];
+        const Frustum frustum = ExtractFrustum(cascade.viewProjection);
+
+        candidates.clear();
+        QueryFrustum(app->spatialIndex, frustum, SpatialCategory_Entity, candidates);
+
+        for (u32 i = 0; i < candidates.size(); ++i)
+        {
+            const u32 slot = candidates[i];
+            const u32 dense = store.slotToDense[slot];
+            if (!(store.flags[dense] & EntityFlag_CastShadows) || !FrustumIntersectsAABB(frustum, store.bounds[dense]))
+                continue;
+
+            const bool inCache = cascade.cached && (store.flags[dense] & EntityFlag_Static);
+            if (inCache && !cascade.refreshCache)
+                continue;
+
+            const u32 caster = AddShadowCaster(app, packet, casterIndices, slot);
+            if (inCache)
+                cascade.cacheCasters.push_back(caster);
+            else
+                cascade.casters.push_back(caster);
+        }
+    }
+}
+
+void CollectShadowCasters(App* app, RenderPacket& packet, const std::vector<u32>& lightSources)
+{
+    std::vector<u32> casterIndices(app->entities.slotToDense.size(), UINT32_MAX);
+    packet.shadowCasters.clear();
+
+    CollectCascadeCasters(app, packet, casterIndices);
+    CollectPointShadows(app, packet, lightSources, casterIndices);
+}
+
+ViewParams Camera::GetViewParams(ivec2 viewportSize) const
+{
+    ViewParams view = {};
+    view.viewMatrix = viewMatrix;
+    view.projectionMatrix = glm::perspective(glm::radians(CAMERA_FOV_Y), (f32)viewportSize.x / (f32)viewportSize.y, CAMERA_NEAR, CAMERA_FAR);
+    view.viewProjectionMatrix = view.projectionMatrix * view.viewMatrix;
+    view.inverseViewMatrix = glm::inverse(view.viewMatrix);
+    view.inverseProjectionMatrix = glm::inverse(view.projectionMatrix);
+    view.inverseViewProjectionMatrix = glm::inverse(view.viewProjectionMatrix);
+    view.cameraPosition = cameraPos;
+    view.viewport = vec4(viewportSize.x, viewportSize.y, 1.0f / viewportSize.x, 1.0f / viewportSize.y);
+    return view;
+}
+
+void Update(App* app, RenderPacket& packet)
+{
+    // You can handle app->input keyboard/mouse here
+    if (app->input.keys[Key::K_W] == ButtonState::BUTTON_PRESSED)
+    {
+        app->mainCam->cameraPos += app->mainCam->speed * app->mainCam->cameraDirection * app->deltaTime;
+    }
+
+    if (app->input.keys[Key::K_S] == ButtonState::BUTTON_PRESSED)
+    {
+        app->mainCam->cameraPos -= app->mainCam->speed * app->mainCam->cameraDirection * app->deltaTime;
+    }
+
+    if (app->input.keys[Key::K_D] == ButtonState::BUTTON_PRESSED)
+    {
+        app->mainCam->cameraPos -= app->mainCam->speed * app->mainCam->cameraRight * app->deltaTime;
+    }
+
+    if (app->input.keys[Key::K_A] == ButtonState::BUTTON_PRESSED)
+    {
+        app->mainCam->cameraPos += app->mainCam->speed * app->mainCam->cameraRight * app->deltaTime;
+    }
+
+    if (app->input.mouseButtons[MouseButton::LEFT] == BUTTON_PRESSED)
+    {
+        app->mainCam->yaw += app->input.mouseDelta.x * app->deltaTime * 30;
+        app->mainCam->pitch -= app->input.mouseDelta.y * app->deltaTime * 30;
+
+        if (app->mainCam->pitch > 89.0f)
+            app->mainCam->pitch = 89.0f;
+        if (app->mainCam->pitch < -89.0f)
+            app->mainCam->pitch = -89.0f;
+    }
+
+    app->mainCam->RecalcalculateViewMatrix();
+
+    UpdateTransforms(app->transforms, app->entities);
+
+    // Snapshot of the frame for the render thread, nothing below may be touched by Render()
+    packet.displaySize = app->displaySize;
+    packet.deltaTime = app->deltaTime;
+    packet.mode = app->mode;
+    packet.view = app->mainCam->GetViewParams(app->displaySize);
+    packet.resolution = app->resolutionSettings;
+    packet.temporalAA = app->temporalAAEnabled;
+    packet.ssao = app->ssaoSettings;
+    packet.bloom = app->bloomEnabled;
+    packet.exposure = app->exposureSettings;
+    packet.depthPrepass = app->depthPrepassSettings;
+
+    EntityStore& store = app->entities;
+    SyncEntityProxies(store, app->spatialIndex);
+
+    // Only the entities of the tree nodes that touch the frustum are visited
+    for (u32 i = 0; i < app->visibleEntitySlots.size(); ++i)
+    {
+        const u32 dense = store.slotToDense[app->visibleEntitySlots[i]];
+        if (dense != UINT32_MAX)
+            store.flags[dense] &= ~EntityFlag_Visible;
+    }
+
+    const Frustum frustum = ExtractFrustum(packet.view.viewProjectionMatrix);
+    std::vector<u32> candidates;
+    QueryFrustum(app->spatialIndex, frustum, SpatialCategory_Entity, candidates);
+
+    app->visibleEntitySlots.clear();
+    packet.entities.clear();
+    std::vector<u32> occluders;
+    packet.occlusionCulling = app->occlusionCullingEnabled;
+    for (u32 i = 0; i < candidates.size(); ++i)
+    {
+        // The tree stores fat bounds, the tight ones decide
+        const u32 dense = store.slotToDense[candidates[i]];
+        if (!FrustumIntersectsAABB(frustum, store.bounds[dense]))
+            continue;
+
+        store.flags[dense] |= EntityFlag_Visible;
+        app->visibleEntitySlots.push_back(candidates[i]);
+
+        if (store.flags[dense] & EntityFlag_Occluder)
+            occluders.push_back(packet.entities.size());
+
+        RenderEntity renderEntity;
+        renderEntity.world = store.transforms[dense];
+        renderEntity.bounds = store.bounds[dense];
+        renderEntity.model = store.renderMeshes[dense].model;
+        renderEntity.modelNode = store.renderMeshes[dense].modelNode;
+        renderEntity.slot = candidates[i];
+        packet.entities.push_back(renderEntity);
+    }
+
+    packet.softwareOcclusionDepth.clear();
+    if (app->softwareOcclusionEnabled)
+    {
+        CullOccludedEntities(app, packet, occluders);
+
+        if (app->currentTextureType == TextureTypes::SoftwareOcclusionDepth)
+            packet.softwareOcclusionDepth = app->softwareOcclusion.depth;
+    }
+
+    // Directional lights reach everything, point lights only when their sphere is in view
+    packet.lights.clear();
+    std::vector<u32> lightSources; // Index in app->lights of every packet light
+    for (u32 i = 0; i < app->lights.size(); ++i)
+    {
+        if (app->lights[i].type == LightType::Directional)
+        {
+            packet.lights.push_back(app->lights[i]);
+            lightSources.push_back(i);
+        }
+    }
+
+    std::vector<u32> pointLights;
+    QueryFrustum(app->spatialIndex, frustum, SpatialCategory_PointLight, pointLights);
+    for (u32 i = 0; i < pointLights.size(); ++i)
+    {
+        const Light& light = app->lights[pointLights[i]];
+        if (FrustumIntersectsSphere(frustum, light.position, GetLightRadius(light)))
+        {
+            packet.lights.push_back(light);
+            lightSources.push_back(pointLights[i]);
+        }
+    }
+
+    CollectShadowCasters(app, packet, lightSources);
+
+    ClearDebugDraw(packet.debugDraw);
+    if (app->renderLightGuizmos)
+    {
+        for (const Light& light : packet.lights)
+        {
+            const vec4 color = vec4(light.color, 0.6f);
+            if (light.type == LightType::Point)
+                DebugDrawSphere(packet.debugDraw, light.position, 0.5f, color);
+            else
+                DebugDrawQuad(packet.debugDraw, light.position, vec2(0.5f), color);
+        }
+    }
+}
+
+void renderQuad()
+{
     static unsigned int quadVAO = 0;
     static unsigned int quadVBO;
 
@@ -443,217 +1348,879 @@ void renderQuad()
     glBindVertexArray(0);
 }
 
-void Render(App* app)
+// The view the shaders see this frame. The render size is only known here, so the jitter of
+// temporal AA, which is a fraction of a render pixel, is applied here and not by the camera.
+void PrepareRenderView(App* app, const RenderPacket& packet)
 {
-    glBindFramebuffer(GL_FRAMEBUFFER, app->frameBuffer);
+    ViewParams& view = app->renderView;
+    view = packet.view;
+    view.viewport = vec4(app->renderSize.x, app->renderSize.y, 1.0f / app->renderSize.x, 1.0f / app->renderSize.y);
+    view.unjitteredViewProjectionMatrix = packet.view.viewProjectionMatrix;
+    view.previousViewProjectionMatrix = app->temporalAA.historyValid ? app->previousViewProjection : packet.view.viewProjectionMatrix;
+    view.jitter = vec4(0.0f);
+
+    if (packet.temporalAA)
+    {
+        const glm::vec2 jitter = GetTemporalJitter(app->renderFrame);
+        view.projectionMatrix = JitterProjection(packet.view.projectionMatrix, jitter, app->renderSize);
+        view.viewProjectionMatrix = view.projectionMatrix * view.viewMatrix;
+        view.inverseProjectionMatrix = glm::inverse(view.projectionMatrix);
+        view.inverseViewProjectionMatrix = glm::inverse(view.viewProjectionMatrix);
+        view.jitter = vec4(jitter / vec2(app->renderSize), 0.0f, 0.0f);
+    }
+}
 
-    GLuint drawBuffers[] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1, GL_COLOR_ATTACHMENT2, GL_COLOR_ATTACHMENT3 };
-    glDrawBuffers(ARRAY_COUNT(drawBuffers), drawBuffers);
+// Binds the ViewParams block for the whole frame
+void PushViewParams(App* app)
+{
+    const u32 offset = PushBlock(app->cbuffer, app->renderView, app->uniformBlockAlignment);
+    glBindBufferRange(GL_UNIFORM_BUFFER, VIEW_PARAMS_BINDING, app->cbuffer.handle, offset, sizeof(ViewParams));
+}
 
-    glClearColor(0.1F, 0.1F, 0.1F, 1.0F);
-    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+// Binds the GlobalParams block with the lights of the frame
+void PushGlobalParams(App* app, const RenderPacket& packet)
+{
+    GlobalParams params = {};
+    params.lightCount = glm::min((u32)packet.lights.size(), (u32)MAX_SHADER_LIGHTS);
+    for (u32 i = 0; i < params.lightCount; ++i)
+    {
+        const Light& light = packet.lights[i];
+        GPULight& gpuLight = params.lights[i];
+        gpuLight.type = light.type;
+        gpuLight.color = light.color;
+        gpuLight.direction = light.direction;
+        gpuLight.position = light.position;
+        gpuLight.intensity = light.intensity;
+        gpuLight.linear = LIGHT_ATTENUATION_LINEAR;
+        gpuLight.quadratic = LIGHT_ATTENUATION_QUADRATIC;
+    }
 
-    glViewport(0, 0, app->displaySize.x, app->displaySize.y);
+    app->globalParamsOffset = PushBlock(app->cbuffer, params, app->uniformBlockAlignment);
+    app->globalParamsSize = sizeof(GlobalParams);
+    glBindBufferRange(GL_UNIFORM_BUFFER, 0, app->cbuffer.handle, app->globalParamsOffset, app->globalParamsSize);
+}
 
-    glEnable(GL_DEPTH_TEST);
+// The LocalParams blocks have a fixed stride, so every entity knows its offset in the mapped
+// constant buffer up front and the matrices can be computed and written by all job threads.
+// The normal matrix is inverted here once per entity and not once per vertex.
+// Returns the offset of the first block.
+u32 PushEntitiesLocalParams(App* app, const RenderPacket& packet)
+{
+    const u32 blockSize = sizeof(EntityLocalParams);
+    const u32 blockStride = Align(blockSize, app->uniformBlockAlignment);
+
+    AlignHead(app->cbuffer, app->uniformBlockAlignment);
+    const u32 baseOffset = app->cbuffer.head;
+    ASSERT(baseOffset + blockStride * packet.entities.size() <= app->cbuffer.size, "The constant buffer is too small for all the entities");
+
+    // Slots are unique within a frame, so every job thread writes its own entries
+    u32 slotCount = (u32)app->previousWorlds.size();
+    for (const RenderEntity& entity : packet.entities)
+        slotCount = glm::max(slotCount, entity.slot + 1);
+    app->previousWorlds.resize(slotCount);
+    app->previousWorldFrames.resize(slotCount, ~0ull);
+
+    u8* data = (u8*)app->cbuffer.data;
+    const glm::mat4 viewProjection = app->renderView.viewProjectionMatrix;
+    const u64 frame = app->renderFrame;
+    ParallelFor(packet.entities.size(), 256, [&](u32 begin, u32 end) {
+        for (u32 i = begin; i < end; ++i)
+        {
+            const RenderEntity& entity = packet.entities[i];
+            EntityLocalParams params;
+            params.world = entity.world;
+            params.worldViewProjection = viewProjection * entity.world;
+            params.normalMatrix = glm::transpose(glm::inverse(glm::mat3(entity.world)));
+
+            // Entities that were not drawn last frame have no motion of their own
+            const bool drawnLastFrame = frame > 0 && app->previousWorldFrames[entity.slot] == frame - 1;
+            params.previousWorld = drawnLastFrame ? app->previousWorlds[entity.slot] : entity.world;
+            app->previousWorlds[entity.slot] = entity.world;
+            app->previousWorldFrames[entity.slot] = frame;
+
+            memcpy(data + baseOffset + i * blockStride, &params, sizeof(params));
+        }
+    });
+
+    app->cbuffer.head = baseOffset + blockStride * packet.entities.size();
+    return baseOffset;
+}
 
-    switch (app->mode)
+// VAOs are created lazily by FindVAO(), which needs the GL context, so they are resolved here
+// before the job threads look them up while recording
+void CreateMissingVAOs(App* app, const Program& program)
+{
+    for (u32 modelIdx = 0; modelIdx < app->models.size(); ++modelIdx)
     {
-    case Mode_Forward: {
-        Program& textureMeshProgram = app->programs[app->texturedMeshProgramIdx];
-        glUseProgram(textureMeshProgram.handle);
+        Mesh& mesh = app->meshes[app->models[modelIdx].meshIdx];
+        for (u32 i = 0; i < mesh.submeshes.size(); ++i)
+            FindVAO(mesh, i, program, app->materialIdBuffer);
+    }
+}
 
-        MapBuffer(app->cbuffer, GL_WRITE_ONLY);
+// Every submesh of a visible entity is one draw, numbered in entity order
+u32 CountEntityDraws(App* app, const RenderPacket& packet, std::vector<u32>& firstDraws)
+{
+    u32 drawCount = 0;
+    firstDraws.resize(packet.entities.size());
+    for (u32 i = 0; i < packet.entities.size(); ++i)
+    {
+        firstDraws[i] = drawCount;
+        drawCount += app->models[packet.entities[i].model].nodes[packet.entities[i].modelNode].submeshes.size();
+    }
+    return drawCount;
+}
+
+// Draws come from indirectBuffer at indirectOffset when given, otherwise straight from the submeshes
+void RenderEntities(App* app, const RenderPacket& packet, const Program& program, u32 localParamsOffset, GLuint indirectBuffer = 0, u32 indirectOffset = 0)
+{
+    const u32 localParamsSize = sizeof(EntityLocalParams);
+    const u32 localParamsStride = Align(localParamsSize, app->uniformBlockAlignment);
+    const u32 commandsPerSubmesh = 6;
+    const u32 entitiesPerList = 256;
+
+    CreateMissingVAOs(app, program);
+
+    std::vector<u32> firstDraws;
+    const u32 submeshCount = CountEntityDraws(app, packet, firstDraws);
+
+    ResetCommandArena(app->commandArena, submeshCount * commandsPerSubmesh);
+
+    std::vector<CommandList> commandLists((packet.entities.size() + entitiesPerList - 1) / entitiesPerList);
+    ParallelFor(packet.entities.size(), entitiesPerList, [&](u32 begin, u32 end) {
+        u32 listSubmeshCount = 0;
+        for (u32 entityIdx = begin; entityIdx < end; ++entityIdx)
+            listSubmeshCount += app->models[packet.entities[entityIdx].model].nodes[packet.entities[entityIdx].modelNode].submeshes.size();
+
+        CommandList& list = commandLists[begin / entitiesPerList];
+        list = AllocateCommandList(app->commandArena, listSubmeshCount * commandsPerSubmesh);
+
+        for (u32 entityIdx = begin; entityIdx < end; ++entityIdx)
+        {
+            const RenderEntity& entity = packet.entities[entityIdx];
+            Model& model = app->models[entity.model];
+            Mesh& mesh = app->meshes[model.meshIdx];
+            const ModelNode& node = model.nodes[entity.modelNode];
+
+            const glm::vec3 center = 0.5f * (entity.bounds.min + entity.bounds.max);
+            const f32 viewDepth = -(packet.view.viewMatrix * glm::vec4(center, 1.0f)).z;
+
+            for (u32 j = 0; j < node.submeshes.size(); ++j)
+            {
+                const u32 i = node.submeshes[j];
+                GLuint vao = FindVAO(mesh, i, program, app->materialIdBuffer);
+                const u32 submeshMaterialIdx = model.materialIdx[i];
+
+                // Materials are read from the material buffer, so they do not split the
+                // groups of draws sharing a VAO, front to back within a group
+                BeginSequence(list, MakeSortKey(DrawPass_Opaque, program.handle, 0, vao, viewDepth / CAMERA_FAR));
+                CmdSetProgram(list, program.handle);
+                CmdBindVertexArray(list, vao);
+                CmdBindUniformRange(list, 1, app->cbuffer.handle, localParamsOffset + entityIdx * localParamsStride, localParamsSize);
+
+                Submesh& submesh = mesh.submeshes[i];
+                if (indirectBuffer)
+                    CmdDrawIndexedIndirect(list, indirectBuffer, indirectOffset + (firstDraws[entityIdx] + j) * sizeof(DrawElementsIndirectCommand));
+                else
+                    CmdDrawIndexed(list, submesh.indices.size(), submesh.indexOffset, submeshMaterialIdx);
+            }
+        }
+    });
 
-        app->globalParamsOffset = app->cbuffer.head;
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, MATERIAL_BUFFER_BINDING, app->materialBuffer);
+    BindTextureArrays(app->textureArrays);
 
-        PushVec3(app->cbuffer, app->mainCam->cameraPos);
+    ExecuteCommandLists(commandLists.data(), commandLists.size());
+
+    glBindVertexArray(0);
+}
+
+void UploadOcclusionCullInputs(App* app, const RenderPacket& packet)
+{
+    std::vector<u32> firstDraws;
+    const u32 drawCount = CountEntityDraws(app, packet, firstDraws);
 
-        PushUInt(app->cbuffer, app->lights.size());
+    std::vector<CullInstance> instances(packet.entities.size());
+    std::vector<DrawElementsIndirectCommand> draws(drawCount);
+    u32 slotCount = 0;
 
-        for (u32 i = 0; i < app->lights.size(); ++i)
+    for (u32 entityIdx = 0; entityIdx < packet.entities.size(); ++entityIdx)
+    {
+        const RenderEntity& entity = packet.entities[entityIdx];
+        const Model& model = app->models[entity.model];
+        const Mesh& mesh = app->meshes[model.meshIdx];
+        const ModelNode& node = model.nodes[entity.modelNode];
+
+        CullInstance& instance = instances[entityIdx];
+        instance.boundsMin = vec4(entity.bounds.min, 1.0f);
+        instance.boundsMax = vec4(entity.bounds.max, 1.0f);
+        instance.slot = entity.slot;
+        instance.firstDraw = firstDraws[entityIdx];
+        instance.drawCount = node.submeshes.size();
+        instance.padding = 0;
+
+        for (u32 j = 0; j < node.submeshes.size(); ++j)
         {
-            AlignHead(app->cbuffer, sizeof(vec4));
-
-            Light& light = app->lights[i];
-            PushUInt(app->cbuffer, light.type);
-            PushVec3(app->cbuffer, light.color);
-            PushVec3(app->cbuffer, light.direction);
-            PushVec3(app->cbuffer, light.position);
-            PushFloat(app->cbuffer, light.intensity);
-            PushFloat(app->cbuffer, 0.82f);
-            PushFloat(app->cbuffer, 1.63f);
+            const Submesh& submesh = mesh.submeshes[node.submeshes[j]];
+            DrawElementsIndirectCommand& draw = draws[instance.firstDraw + j];
+            draw.count = submesh.indices.size();
+            draw.instanceCount = 0;
+            draw.firstIndex = submesh.indexOffset / sizeof(u32);
+            draw.baseVertex = 0;
+            draw.baseInstance = model.materialIdx[node.submeshes[j]];
         }
 
-        app->globalParamsSize = app->cbuffer.head - app->globalParamsOffset;
+        slotCount = glm::max(slotCount, entity.slot + 1);
+    }
 
-        glBindBufferRange(GL_UNIFORM_BUFFER, 0, app->cbuffer.handle, app->globalParamsOffset, app->globalParamsSize);
+    UploadCullInputs(app->occlusionCulling, instances.data(), instances.size(), draws.data(), draws.size(), slotCount);
+}
 
-        for (auto item = app->entities.begin(); item != app->entities.end(); ++item) {
-            AlignHead(app->cbuffer, app->uniformBlockAlignment);
+// Draws what was visible last frame, builds the Hi-Z from that depth, and then draws what the
+// occlusion test finds visible and was not drawn yet.
+void RenderEntitiesOcclusionCulled(App* app, const RenderPacket& packet, const Program& program, u32 localParamsOffset)
+{
+    if (!packet.occlusionCulling)
+    {
+        RenderEntities(app, packet, program, localParamsOffset);
+        return;
+    }
 
-            Entity& entity = *item;
-            glm::mat4 world = entity.mat;
-            glm::mat4 worldViewProjection = glm::perspective(glm::radians(60.0f), (float)app->displaySize.x / (float)app->displaySize.y, 0.1f, 2000.0f) * app->mainCam->viewMatrix * world;
+    OcclusionCulling& culling = app->occlusionCulling;
+    UploadOcclusionCullInputs(app, packet);
 
+    CullInstances(culling, CullPhase_LastFrameVisible, packet.view.viewProjectionMatrix, app->renderSize);
+    RenderEntities(app, packet, program, localParamsOffset, culling.drawBuffer, GetIndirectDrawOffset(culling, CullPhase_LastFrameVisible, 0));
 
-            entity.localParamsOffset = app->cbuffer.head;
-            PushMat4(app->cbuffer, world);
-            PushMat4(app->cbuffer, worldViewProjection);
-            entity.localParamsSize = app->cbuffer.head - entity.localParamsOffset;
+    BuildHiZ(culling, app->downsampler, app->depthAttachment);
 
-            glBindBufferRange(GL_UNIFORM_BUFFER, 1, app->cbuffer.handle, entity.localParamsOffset, entity.localParamsSize);
+    CullInstances(culling, CullPhase_Occlusion, packet.view.viewProjectionMatrix, app->renderSize);
+    RenderEntities(app, packet, program, localParamsOffset, culling.drawBuffer, GetIndirectDrawOffset(culling, CullPhase_Occlusion, 0));
+}
 
-            Model& model = app->models[entity.model];
-            Mesh& mesh = app->meshes[model.meshIdx];
+// Draws the same entities as the last RenderEntitiesOcclusionCulled(), with another program and
+// without culling again, from the draws both phases left in the draw buffer
+void RenderEntitiesCulledAgain(App* app, const RenderPacket& packet, const Program& program, u32 localParamsOffset)
+{
+    if (!packet.occlusionCulling)
+    {
+        RenderEntities(app, packet, program, localParamsOffset);
+        return;
+    }
+
+    OcclusionCulling& culling = app->occlusionCulling;
+    RenderEntities(app, packet, program, localParamsOffset, culling.drawBuffer, GetIndirectDrawOffset(culling, CullPhase_LastFrameVisible, 0));
+    RenderEntities(app, packet, program, localParamsOffset, culling.drawBuffer, GetIndirectDrawOffset(culling, CullPhase_Occlusion, 0));
+}
+
+// Depth only draws of the casters, with the position stream. Every caster has one LocalParams
+// block per shadow pass it is drawn in, starting at paramsOffset.
+void RenderShadowCasters(App* app, const RenderPacket& packet, const std::vector<u32>& casters, u32 paramsOffset, GLuint program)
+{
+    const u32 paramsSize = sizeof(glm::mat4);
+    const u32 paramsStride = Align(paramsSize, app->uniformBlockAlignment);
+    const u32 commandsPerSubmesh = 5;
+    const u32 castersPerList = 256;
+
+    u32 submeshCount = 0;
+    for (u32 i = 0; i < casters.size(); ++i)
+        submeshCount += app->models[packet.shadowCasters[casters[i]].model].nodes[packet.shadowCasters[casters[i]].modelNode].submeshes.size();
+
+    ResetCommandArena(app->commandArena, submeshCount * commandsPerSubmesh);
 
-            for (u32 i = 0; i < mesh.submeshes.size(); ++i)
+    std::vector<CommandList> commandLists((casters.size() + castersPerList - 1) / castersPerList);
+    ParallelFor(casters.size(), castersPerList, [&](u32 begin, u32 end) {
+        u32 listSubmeshCount = 0;
+        for (u32 i = begin; i < end; ++i)
+            listSubmeshCount += app->models[packet.shadowCasters[casters[i]].model].nodes[packet.shadowCasters[casters[i]].modelNode].submeshes.size();
+
+        CommandList& list = commandLists[begin / castersPerList];
+        list = AllocateCommandList(app->commandArena, listSubmeshCount * commandsPerSubmesh);
+
+        for (u32 i = begin; i < end; ++i)
+        {
+            const RenderEntity& caster = packet.shadowCasters[casters[i]];
+            const Model& model = app->models[caster.model];
+            const Mesh& mesh = app->meshes[model.meshIdx];
+            const ModelNode& node = model.nodes[caster.modelNode];
+
+            for (u32 j = 0; j < node.submeshes.size(); ++j)
             {
-                GLuint vao = FindVAO(mesh, i, textureMeshProgram);
-                glBindVertexArray(vao);
+                const Submesh& submesh = mesh.submeshes[node.submeshes[j]];
+
+                // No textures in a depth pass, draws only differ by VAO
+                BeginSequence(list, MakeSortKey(DrawPass_Shadow, program, 0, submesh.depthVao, 0.0f));
+                CmdSetProgram(list, program);
+                CmdBindVertexArray(list, submesh.depthVao);
+                CmdBindUniformRange(list, 1, app->shadowCBuffer.handle, paramsOffset + i * paramsStride, paramsSize);
+                CmdDrawIndexed(list, submesh.indices.size(), submesh.indexOffset);
+            }
+        }
+    });
 
-                u32 submeshMaterialIdx = model.materialIdx[i];
-                Material& submeshMaterial = app->materials[submeshMaterialIdx];
+    ExecuteCommandLists(commandLists.data(), commandLists.size());
 
-                glActiveTexture(GL_TEXTURE0);
-                glBindTexture(GL_TEXTURE_2D, app->textures[submeshMaterial.albedoTextureIdx].handle);
-                glUniform1i(app->programUniformTexture, 0);
+    glBindVertexArray(0);
+}
 
-                Submesh& submesh = mesh.submeshes[i];
-                glDrawElements(GL_TRIANGLES, submesh.indices.size(), GL_UNSIGNED_INT, (void*)(u64)submesh.indexOffset);
+// Writes the ShadowParams and PointShadowParams blocks the lighting reads, bound at bindings 2
+// and 3, and draws the casters of every cascade and point light face updated this frame.
+// Cached cascades re-render their cache layer first when it is stale, and then start from a
+// copy of it. Point light casters get their world matrix, the geometry shader has the faces.
+void RenderShadowMaps(App* app, const RenderPacket& packet)
+{
+    struct ShadowPass
+    {
+        u32                     layer;
+        bool                    fromCache;
+        const std::vector<u32>* casters;
+        const glm::mat4*        viewProjection;
+        u32                     paramsOffset;
+    };
+
+    std::vector<ShadowPass> passes;
+    u32 blockCount = 0;
+    if (packet.shadowLight >= 0)
+    {
+        for (u32 c = 0; c < SHADOW_CASCADE_COUNT; ++c)
+        {
+            const ShadowCascadeView& cascade = packet.shadowCascades[c];
+            if (cascade.refreshCache)
+                passes.push_back({ SHADOW_CASCADE_COUNT + c, false, &cascade.cacheCasters, &cascade.viewProjection, 0 });
+
+            passes.push_back({ c, cascade.cached, &cascade.casters, &cascade.viewProjection, 0 });
+        }
+
+        for (u32 i = 0; i < passes.size(); ++i)
+            blockCount += passes[i].casters->size();
+    }
+
+    const glm::mat4 identity = glm::mat4(1.0f);
+    const u32 cascadePassCount = passes.size();
+    for (u32 i = 0; i < packet.pointShadowUpdates.size(); ++i)
+    {
+        passes.push_back({ 0, false, &packet.pointShadowUpdates[i].casters, &identity, 0 });
+        blockCount += packet.pointShadowUpdates[i].casters.size();
+    }
+
+    const u32 blockStride = Align(sizeof(glm::mat4), app->uniformBlockAlignment);
+    const u32 requiredSize = Align(sizeof(ShadowParams), app->uniformBlockAlignment) + Align(sizeof(PointShadowParams), app->uniformBlockAlignment) + blockStride * blockCount;
+    if (requiredSize > app->shadowCBuffer.size)
+    {
+        glDeleteBuffers(1, &app->shadowCBuffer.handle);
+        app->shadowCBuffer = CreateBuffer(glm::max(requiredSize, 2 * app->shadowCBuffer.size), GL_UNIFORM_BUFFER, GL_STREAM_DRAW);
+    }
+
+    MapBuffer(app->shadowCBuffer, GL_WRITE_ONLY);
+
+    ShadowParams shadowParams = {};
+    for (u32 c = 0; c < SHADOW_CASCADE_COUNT; ++c)
+    {
+        shadowParams.cascadeViewProjection[c] = packet.shadowCascades[c].viewProjection;
+        shadowParams.cascadeSplits[c] = packet.shadowCascades[c].splitFar;
+        shadowParams.cascadeTexelSizes[c] = packet.shadowCascades[c].texelSize;
+    }
+    shadowParams.cameraForward = -vec3(packet.view.viewMatrix[0][2], packet.view.viewMatrix[1][2], packet.view.viewMatrix[2][2]);
+    shadowParams.shadowLight = packet.shadowLight;
+    const u32 shadowParamsOffset = PushBlock(app->shadowCBuffer, shadowParams, app->uniformBlockAlignment);
+
+    // uLightPointShadow is an ivec4 array, so the indices are packed four per element
+    PointShadowParams pointShadowParams = {};
+    for (u32 i = 0; i < MAX_SHADER_LIGHTS; ++i)
+        pointShadowParams.lightPointShadow[i / 4][i % 4] = -1;
+    for (u32 i = 0; i < packet.pointShadows.size(); ++i)
+    {
+        const u32 light = packet.pointShadows[i].light;
+        pointShadowParams.lightPointShadow[light / 4][light % 4] = i;
+    }
+
+    for (u32 i = 0; i < packet.pointShadows.size(); ++i)
+    {
+        const PointShadowView& view = packet.pointShadows[i];
+        GPUPointShadow& pointShadow = pointShadowParams.pointShadows[i];
+        pointShadow.positionRadius = vec4(view.position, view.radius);
+
+        // Tile origin and size in atlas uv, w tells if the face was ever rendered
+        const f32 tileSize = (f32)view.tileSize / POINT_SHADOW_ATLAS_SIZE;
+        for (u32 f = 0; f < 6; ++f)
+        {
+            const vec2 tileOrigin = vec2(view.tiles[f]) / (f32)POINT_SHADOW_ATLAS_SIZE;
+            pointShadow.faceRects[f] = vec4(tileOrigin, tileSize, (view.validFaces & (1 << f)) ? 1.0f : 0.0f);
+        }
+    }
+    const u32 pointShadowParamsOffset = PushBlock(app->shadowCBuffer, pointShadowParams, app->uniformBlockAlignment);
+
+    u8* data = (u8*)app->shadowCBuffer.data;
+    for (u32 p = 0; p < passes.size(); ++p)
+    {
+        ShadowPass& pass = passes[p];
+        AlignHead(app->shadowCBuffer, app->uniformBlockAlignment);
+        pass.paramsOffset = app->shadowCBuffer.head;
+
+        ParallelFor(pass.casters->size(), 256, [&](u32 begin, u32 end) {
+            for (u32 i = begin; i < end; ++i)
+            {
+                const glm::mat4 worldViewProjection = *pass.viewProjection * packet.shadowCasters[(*pass.casters)[i]].world;
+                memcpy(data + pass.paramsOffset + i * blockStride, glm::value_ptr(worldViewProjection), sizeof(glm::mat4));
             }
+        });
+
+        app->shadowCBuffer.head += blockStride * pass.casters->size();
+    }
+
+    UnmapBuffer(app->shadowCBuffer);
+
+    glBindBufferRange(GL_UNIFORM_BUFFER, 2, app->shadowCBuffer.handle, shadowParamsOffset, sizeof(ShadowParams));
+    glBindBufferRange(GL_UNIFORM_BUFFER, 3, app->shadowCBuffer.handle, pointShadowParamsOffset, sizeof(PointShadowParams));
+
+    if (passes.empty())
+        return;
+
+    // Casters between the light and the near plane are flattened onto it instead of clipped
+    glEnable(GL_DEPTH_TEST);
+    glEnable(GL_DEPTH_CLAMP);
+    glEnable(GL_POLYGON_OFFSET_FILL);
+    glPolygonOffset(2.0f, 4.0f);
+
+    for (u32 p = 0; p < cascadePassCount; ++p)
+    {
+        if (passes[p].fromCache)
+            CopyShadowCacheToCascade(app->shadowMaps, passes[p].layer);
+
+        BeginShadowLayer(app->shadowMaps, passes[p].layer, !passes[p].fromCache);
+        RenderShadowCasters(app, packet, *passes[p].casters, passes[p].paramsOffset, app->shadowMaps.depthProgram);
+    }
+
+    if (!packet.pointShadowUpdates.empty())
+    {
+        const GLuint program = app->pointShadowMaps.depthProgram;
+        const GLint faceViewProjectionLocation = glGetUniformLocation(program, "uFaceViewProjection");
+        const GLint faceMaskLocation = glGetUniformLocation(program, "uFaceMask");
+
+        glEnable(GL_SCISSOR_TEST);
+        glUseProgram(program);
+
+        for (u32 i = 0; i < packet.pointShadowUpdates.size(); ++i)
+        {
+            const PointShadowUpdate& update = packet.pointShadowUpdates[i];
+            const PointShadowView& view = packet.pointShadows[update.view];
+            BeginPointShadowFaces(app->pointShadowMaps, view, update.faceMask);
+
+            glm::mat4 faceViewProjections[6];
+            for (u32 f = 0; f < 6; ++f)
+                faceViewProjections[f] = GetPointShadowFaceViewProjection(view.position, view.radius, f);
+
+            glUniformMatrix4fv(faceViewProjectionLocation, 6, GL_FALSE, glm::value_ptr(faceViewProjections[0]));
+            glUniform1i(faceMaskLocation, update.faceMask);
+
+            RenderShadowCasters(app, packet, update.casters, passes[cascadePassCount + i].paramsOffset, program);
         }
 
+        glDisable(GL_SCISSOR_TEST);
+    }
+
+    glDisable(GL_POLYGON_OFFSET_FILL);
+    glDisable(GL_DEPTH_CLAMP);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+// Grows the constant buffer when the scene no longer fits in it. Only the bound ranges are
+// limited by GL_MAX_UNIFORM_BLOCK_SIZE, the buffer itself can be as big as needed.
+void ReserveConstantBuffer(App* app, const RenderPacket& packet)
+{
+    const u32 localParamsStride = Align(sizeof(EntityLocalParams), app->uniformBlockAlignment);
+    const u32 requiredSize = 2 * app->maxUniformBufferSize + localParamsStride * (packet.entities.size() + 1);
+
+    if (requiredSize > app->cbuffer.size)
+    {
+        glDeleteBuffers(1, &app->cbuffer.handle);
+        app->cbuffer = CreateBuffer(requiredSize, GL_UNIFORM_BUFFER, GL_STREAM_DRAW);
+    }
+}
+
+// Only the lighting code the frame uses goes into the variant that shades it
+static u32 GetLightingFeatures(const RenderPacket& packet)
+{
+    u32 features = 0;
+    for (const Light& light : packet.lights)
+        features |= light.type == LightType::Directional ? ShaderFeature_DirectionalLights : ShaderFeature_PointLights;
+
+    if (packet.shadowLight >= 0 || !packet.pointShadows.empty())
+        features |= ShaderFeature_Shadows;
+
+    return features;
+}
+
+// G-buffer pass testing with GL_LESS, the overdraw is what it writes
+void RenderGeometry(App* app, const RenderPacket& packet, u32 localParamsOffset)
+{
+    Program& geometryProgram = app->programs[app->geometryProgramIdx];
+    glUseProgram(geometryProgram.handle);
+
+    BeginOverdrawQuery(app->depthPrepass, app->renderSize);
+    RenderEntitiesOcclusionCulled(app, packet, geometryProgram, localParamsOffset);
+    EndOverdrawQuery(app->depthPrepass);
+}
+
+// Depth only pass, and then the G-buffer pass on the fragments it left in front, once per pixel
+void RenderGeometryAfterPrepass(App* app, const RenderPacket& packet, u32 localParamsOffset)
+{
+    glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+    BeginOverdrawQuery(app->depthPrepass, app->renderSize);
+    RenderEntitiesOcclusionCulled(app, packet, app->programs[app->depthPrepassProgramIdx], localParamsOffset);
+    EndOverdrawQuery(app->depthPrepass);
+    glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+
+    glDepthFunc(GL_EQUAL);
+    glDepthMask(GL_FALSE);
+    RenderEntitiesCulledAgain(app, packet, app->programs[app->geometryProgramIdx], localParamsOffset);
+    glDepthMask(GL_TRUE);
+    glDepthFunc(GL_LESS);
+}
+
+// The debug shapes of the frame over the backbuffer, tested against the depth of the scene
+void RenderDebugShapes(App* app, const RenderPacket& packet)
+{
+    bool empty = true;
+    for (u32 i = 0; i < DebugPrimitive_Count; ++i)
+        empty = empty && packet.debugDraw.instances[i].empty();
+    if (empty)
+        return;
+
+    // Depth stretched like the color
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, app->frameBuffer);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+    glBlitFramebuffer(
+        0, 0, app->renderSize.x, app->renderSize.y, 0, 0, packet.displaySize.x, packet.displaySize.y, GL_DEPTH_BUFFER_BIT, GL_NEAREST
+    );
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+    const f32 pixelsPerUnit = packet.view.projectionMatrix[1][1] * packet.displaySize.y * 0.5f;
+    RenderDebugDraw(app->debugDraw, packet.debugDraw, packet.view.viewProjectionMatrix, packet.view.cameraPosition, pixelsPerUnit);
+}
+
+// Builds the light list of every tile from the depth of the prepass. Every point light of the
+// packet is culled, not only the ones that fit in uLight.
+void CullForwardPlusLights(App* app, const RenderPacket& packet)
+{
+    std::vector<GPUTiledLight> lights;
+    for (u32 i = 0; i < packet.lights.size(); ++i)
+    {
+        const Light& light = packet.lights[i];
+        if (light.type != LightType::Point)
+            continue;
+
+        // Point shadows are looked up by the index in uLight
+        const f32 shadowLight = i < MAX_SHADER_LIGHTS ? (f32)i : -1.0f;
+
+        GPUTiledLight gpuLight;
+        gpuLight.positionRadius = vec4(light.position, GetLightRadius(light));
+        gpuLight.colorIntensity = vec4(light.color, light.intensity);
+        gpuLight.attenuation = vec4(LIGHT_ATTENUATION_LINEAR, LIGHT_ATTENUATION_QUADRATIC, shadowLight, 0.0f);
+        lights.push_back(gpuLight);
+    }
+
+    CullTiledLights(app->tiledLights, lights.data(), lights.size(), app->depthAttachment, app->renderSize);
+}
+
+// Stretches the sourceSize corner of an HDR texture over the whole backbuffer, sharpens it, and
+// tonemaps it with the exposure UpdateAutoExposure() left on the GPU
+void UpscaleToBackbuffer(App* app, const RenderPacket& packet, GLuint texture, ivec2 sourceSize, f32 sharpness)
+{
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glViewport(0, 0, packet.displaySize.x, packet.displaySize.y);
+
+    const Program& upscale = app->programs[app->upscaleProgramIdx];
+    glUseProgram(upscale.handle);
+
+    glUniform1i(glGetUniformLocation(upscale.handle, "uColorTexture"), 0);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glUniform2f(glGetUniformLocation(upscale.handle, "uSourceSize"), (f32)sourceSize.x, (f32)sourceSize.y);
+    glUniform1f(glGetUniformLocation(upscale.handle, "uSharpness"), sharpness);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, EXPOSURE_BUFFER_BINDING, app->autoExposure.exposureBuffer);
+
+    glDisable(GL_DEPTH_TEST);
+    renderQuad();
+    glEnable(GL_DEPTH_TEST);
+}
+
+// Blends the frame into history[current], at display resolution, which also upscales it
+void ResolveTemporalAA(App* app)
+{
+    TemporalAA& taa = app->temporalAA;
+
+    glBindFramebuffer(GL_FRAMEBUFFER, taa.framebuffers[taa.current]);
+    glViewport(0, 0, taa.size.x, taa.size.y);
+
+    const Program& temporalAA = app->programs[app->temporalAAProgramIdx];
+    glUseProgram(temporalAA.handle);
+
+    glUniform1i(glGetUniformLocation(temporalAA.handle, "uColorTexture"), 0);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, app->colorAttachment);
+
+    glUniform1i(glGetUniformLocation(temporalAA.handle, "uDepthTexture"), 1);
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_2D, app->depthAttachment);
+
+    glUniform1i(glGetUniformLocation(temporalAA.handle, "uMotionTexture"), 2);
+    glActiveTexture(GL_TEXTURE2);
+    glBindTexture(GL_TEXTURE_2D, app->motionAttachment);
+
+    glUniform1i(glGetUniformLocation(temporalAA.handle, "uHistoryTexture"), 3);
+    glActiveTexture(GL_TEXTURE3);
+    glBindTexture(GL_TEXTURE_2D, taa.history[1 - taa.current]);
+    glActiveTexture(GL_TEXTURE0);
+
+    glUniform1i(glGetUniformLocation(temporalAA.handle, "uHistoryValid"), taa.historyValid);
+    glUniform1f(glGetUniformLocation(temporalAA.handle, "uFeedback"), TAA_FEEDBACK);
+
+    glDisable(GL_DEPTH_TEST);
+    renderQuad();
+    glEnable(GL_DEPTH_TEST);
+}
+
+// Adds the light bleeding around the bright areas of colorAttachment to it
+void ApplyBloom(App* app)
+{
+    BuildBloom(app->bloom, app->downsampler, app->colorAttachment, app->renderSize);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, app->lightingFrameBuffer);
+    glViewport(0, 0, app->renderSize.x, app->renderSize.y);
+
+    const Program& composite = app->programs[app->bloomCompositeProgramIdx];
+    glUseProgram(composite.handle);
+
+    glUniform1i(glGetUniformLocation(composite.handle, "uBloomTexture"), 0);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, app->bloom.texture);
+    glUniform2i(glGetUniformLocation(composite.handle, "uBloomSize"), app->bloom.usedSize.x, app->bloom.usedSize.y);
+    glUniform1i(glGetUniformLocation(composite.handle, "uLevelCount"), BLOOM_LEVELS);
+    glUniform1f(glGetUniformLocation(composite.handle, "uIntensity"), BLOOM_INTENSITY);
+
+    glDisable(GL_DEPTH_TEST);
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_ONE, GL_ONE);
+    renderQuad();
+    glDisable(GL_BLEND);
+    glEnable(GL_DEPTH_TEST);
+}
+
+// The final image of the frame on the backbuffer, at display resolution
+void ResolveToBackbuffer(App* app, const RenderPacket& packet)
+{
+    if (packet.bloom)
+        ApplyBloom(app);
+
+    UpdateAutoExposure(app->autoExposure, packet.exposure, app->colorAttachment, app->renderSize, packet.deltaTime);
+
+    if (packet.temporalAA)
+    {
+        TemporalAA& taa = app->temporalAA;
+        ResolveTemporalAA(app);
+        UpscaleToBackbuffer(app, packet, taa.history[taa.current], taa.size, 0.0f);
+        SwapTemporalAAHistory(taa);
+        return;
+    }
+
+    // Turning it back on must not blend in a stale history
+    app->temporalAA.historyValid = false;
+
+    const f32 sharpness = app->renderSize == packet.displaySize ? 0.0f : DYNAMIC_RESOLUTION_SHARPNESS;
+    UpscaleToBackbuffer(app, packet, app->colorAttachment, app->renderSize, sharpness);
+}
+
+void Render(App* app, const RenderPacket& packet)
+{
+    UpdateDynamicResolution(app->dynamicResolution, packet.resolution);
+    app->renderSize = GetRenderSize(app->dynamicResolution, packet.displaySize, app->renderTargetSize);
+    PrepareRenderView(app, packet);
+    BeginFrameTimer(app->dynamicResolution);
+
+    ReserveConstantBuffer(app, packet);
+
+    if (!packet.softwareOcclusionDepth.empty())
+    {
+        glBindTexture(GL_TEXTURE_2D, app->softwareOcclusionTexture);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, SOFTWARE_OCCLUSION_WIDTH, SOFTWARE_OCCLUSION_HEIGHT, GL_RED, GL_FLOAT, packet.softwareOcclusionDepth.data());
+        glBindTexture(GL_TEXTURE_2D, 0);
+    }
+
+    RenderShadowMaps(app, packet);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, app->frameBuffer);
+
+    GLuint drawBuffers[] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1, GL_COLOR_ATTACHMENT2, GL_COLOR_ATTACHMENT3, GL_COLOR_ATTACHMENT4 };
+    glDrawBuffers(ARRAY_COUNT(drawBuffers), drawBuffers);
+
+    glClearColor(0.1F, 0.1F, 0.1F, 1.0F);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+    // No motion where nothing is drawn
+    const GLfloat noMotion[] = { 0.0f, 0.0f, 0.0f, 0.0f };
+    glClearBufferfv(GL_COLOR, 4, noMotion);
+
+    glViewport(0, 0, app->renderSize.x, app->renderSize.y);
+
+    glEnable(GL_DEPTH_TEST);
+
+    switch (packet.mode)
+    {
+    case Mode_Forward: {
+        const u32 textureMeshProgramIdx = GetProgramVariant(app, app->texturedMeshProgramIdx, GetLightingFeatures(packet));
+        Program& textureMeshProgram = app->programs[textureMeshProgramIdx];
+        glUseProgram(textureMeshProgram.handle);
+
+        glUniform1i(glGetUniformLocation(textureMeshProgram.handle, "uShadowMap"), 4);
+        glActiveTexture(GL_TEXTURE4);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, app->shadowMaps.depthTexture);
+
+        glUniform1i(glGetUniformLocation(textureMeshProgram.handle, "uPointShadowAtlas"), 5);
+        glActiveTexture(GL_TEXTURE5);
+        glBindTexture(GL_TEXTURE_2D, app->pointShadowMaps.atlasTexture);
+        glActiveTexture(GL_TEXTURE0);
+
+        MapBuffer(app->cbuffer, GL_WRITE_ONLY);
+        PushViewParams(app);
+        PushGlobalParams(app, packet);
+
+        u32 localParamsOffset = PushEntitiesLocalParams(app, packet);
+        RenderEntitiesOcclusionCulled(app, packet, textureMeshProgram, localParamsOffset);
+
         UnmapBuffer(app->cbuffer);
 
-        glBindFramebuffer(GL_READ_FRAMEBUFFER, app->frameBuffer);
-        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
-        glBlitFramebuffer(0, 0, app->displaySize.x, app->displaySize.y, 0, 0, app->displaySize.x, app->displaySize.y, GL_COLOR_BUFFER_BIT, GL_NEAREST);
-        glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+        ResolveToBackbuffer(app, packet);
 
         break; }
-    case Mode::Mode_Deferred: {
-        Program& textureMeshProgram = app->programs[app->texturedMeshProgramIdx];
-        glUseProgram(textureMeshProgram.handle);
+    case Mode_ForwardPlus: {
+        const u32 textureMeshProgramIdx = GetProgramVariant(app, app->texturedMeshProgramIdx, GetLightingFeatures(packet) | ShaderFeature_TiledLights);
 
         MapBuffer(app->cbuffer, GL_WRITE_ONLY);
+        PushViewParams(app);
+        PushGlobalParams(app, packet);
+
+        u32 localParamsOffset = PushEntitiesLocalParams(app, packet);
 
-        app->globalParamsOffset = app->cbuffer.head;
+        UnmapBuffer(app->cbuffer);
 
-        app->globalParamsSize = app->cbuffer.head - app->globalParamsOffset;
+        // Depth only, which the light culling needs and which leaves a single shaded fragment
+        // per pixel. The culling of the prepass is reused by the shading pass.
+        glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+        RenderEntitiesOcclusionCulled(app, packet, app->programs[app->depthPrepassProgramIdx], localParamsOffset);
+        glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
 
-        glBindBufferRange(GL_UNIFORM_BUFFER, 0, app->cbuffer.handle, app->globalParamsOffset, app->globalParamsSize);
+        CullForwardPlusLights(app, packet);
 
-        for (auto item = app->entities.begin(); item != app->entities.end(); ++item) {
-            AlignHead(app->cbuffer, app->uniformBlockAlignment);
+        Program& textureMeshProgram = app->programs[textureMeshProgramIdx];
+        glUseProgram(textureMeshProgram.handle);
 
-            Entity& entity = *item;
-            glm::mat4 world = entity.mat;
-            glm::mat4 worldViewProjection = glm::perspective(glm::radians(60.0f), (float)app->displaySize.x / (float)app->displaySize.y, 0.1f, 2000.0f) * app->mainCam->viewMatrix * world;
+        glUniform1i(glGetUniformLocation(textureMeshProgram.handle, "uShadowMap"), 4);
+        glActiveTexture(GL_TEXTURE4);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, app->shadowMaps.depthTexture);
 
+        glUniform1i(glGetUniformLocation(textureMeshProgram.handle, "uPointShadowAtlas"), 5);
+        glActiveTexture(GL_TEXTURE5);
+        glBindTexture(GL_TEXTURE_2D, app->pointShadowMaps.atlasTexture);
+        glActiveTexture(GL_TEXTURE0);
 
-            entity.localParamsOffset = app->cbuffer.head;
-            PushMat4(app->cbuffer, world);
-            PushMat4(app->cbuffer, worldViewProjection);
-            entity.localParamsSize = app->cbuffer.head - entity.localParamsOffset;
+        BindTiledLights(app->tiledLights);
 
-            glBindBufferRange(GL_UNIFORM_BUFFER, 1, app->cbuffer.handle, entity.localParamsOffset, entity.localParamsSize);
+        glDepthFunc(GL_EQUAL);
+        glDepthMask(GL_FALSE);
+        RenderEntitiesCulledAgain(app, packet, textureMeshProgram, localParamsOffset);
+        glDepthMask(GL_TRUE);
+        glDepthFunc(GL_LESS);
 
-            Model& model = app->models[entity.model];
-            Mesh& mesh = app->meshes[model.meshIdx];
+        ResolveToBackbuffer(app, packet);
 
-            for (u32 i = 0; i < mesh.submeshes.size(); ++i)
-            {
-                GLuint vao = FindVAO(mesh, i, textureMeshProgram);
-                glBindVertexArray(vao);
+        break; }
+    case Mode::Mode_Deferred: {
+        const u32 lightProgramIdx = GetProgramVariant(app, app->lightProgramIdx, GetLightingFeatures(packet));
 
-                u32 submeshMaterialIdx = model.materialIdx[i];
-                Material& submeshMaterial = app->materials[submeshMaterialIdx];
+        const bool depthPrepass = UpdateDepthPrepass(app->depthPrepass, packet.depthPrepass);
 
-                glActiveTexture(GL_TEXTURE0);
-                glBindTexture(GL_TEXTURE_2D, app->textures[submeshMaterial.albedoTextureIdx].handle);
-                glUniform1i(app->programUniformTexture, 0);
+        MapBuffer(app->cbuffer, GL_WRITE_ONLY);
+        PushViewParams(app);
 
-                Submesh& submesh = mesh.submeshes[i];
-                glDrawElements(GL_TRIANGLES, submesh.indices.size(), GL_UNSIGNED_INT, (void*)(u64)submesh.indexOffset);
-            }
-        }
+        u32 localParamsOffset = PushEntitiesLocalParams(app, packet);
+        if (depthPrepass)
+            RenderGeometryAfterPrepass(app, packet, localParamsOffset);
+        else
+            RenderGeometry(app, packet, localParamsOffset);
 
-        glBindFramebuffer(GL_FRAMEBUFFER, NULL);
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        PushGlobalParams(app, packet);
 
-        glUseProgram(app->programs[app->lightProgramIdx].handle);
+        UnmapBuffer(app->cbuffer);
+
+        if (packet.ssao.enabled)
+            ComputeSSAO(app->ssao, packet.ssao, app->depthAttachment, app->normalsAttachment, app->renderSize);
+
+        glBindFramebuffer(GL_FRAMEBUFFER, app->lightingFrameBuffer);
+
+        glUseProgram(app->programs[lightProgramIdx].handle);
 
-        glUniform1i(glGetUniformLocation(app->programs[app->lightProgramIdx].handle, "uPositionTexture"), 0);
+        glUniform1i(glGetUniformLocation(app->programs[lightProgramIdx].handle, "uPositionTexture"), 0);
         glActiveTexture(GL_TEXTURE0);
         glBindTexture(GL_TEXTURE_2D, app->positionsAttachment);
 
-        glUniform1i(glGetUniformLocation(app->programs[app->lightProgramIdx].handle, "uNormalsTexture"), 1);
+        glUniform1i(glGetUniformLocation(app->programs[lightProgramIdx].handle, "uNormalsTexture"), 1);
         glActiveTexture(GL_TEXTURE1);
         glBindTexture(GL_TEXTURE_2D, app->normalsAttachment);
 
-        glUniform1i(glGetUniformLocation(app->programs[app->lightProgramIdx].handle, "uAlbedoTexture"), 2);
+        glUniform1i(glGetUniformLocation(app->programs[lightProgramIdx].handle, "uAlbedoTexture"), 2);
         glActiveTexture(GL_TEXTURE2);
         glBindTexture(GL_TEXTURE_2D, app->albedoAttachment);
 
-        glUniform1i(glGetUniformLocation(app->programs[app->lightProgramIdx].handle, "uDepthTexture"), 3);
+        glUniform1i(glGetUniformLocation(app->programs[lightProgramIdx].handle, "uDepthTexture"), 3);
         glActiveTexture(GL_TEXTURE3);
         glBindTexture(GL_TEXTURE_2D, app->depthAttachment);
 
-        AlignHead(app->cbuffer, app->uniformBlockAlignment);
+        glUniform1i(glGetUniformLocation(app->programs[lightProgramIdx].handle, "uShadowMap"), 4);
+        glActiveTexture(GL_TEXTURE4);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, app->shadowMaps.depthTexture);
 
-        app->globalParamsOffset = app->cbuffer.head;
+        glUniform1i(glGetUniformLocation(app->programs[lightProgramIdx].handle, "uPointShadowAtlas"), 5);
+        glActiveTexture(GL_TEXTURE5);
+        glBindTexture(GL_TEXTURE_2D, app->pointShadowMaps.atlasTexture);
 
-        PushVec3(app->cbuffer, app->mainCam->cameraPos);
-        PushUInt(app->cbuffer, app->lights.size());
-
-        for (u32 i = 0; i < app->lights.size(); ++i)
-        {
-            AlignHead(app->cbuffer, sizeof(vec4));
-
-            Light& light = app->lights[i];
-            PushUInt(app->cbuffer, light.type);
-            PushVec3(app->cbuffer, light.color);
-            PushVec3(app->cbuffer, light.direction);
-            PushVec3(app->cbuffer, light.position);
-            PushFloat(app->cbuffer, light.intensity);
-            PushFloat(app->cbuffer, 0.82f);
-            PushFloat(app->cbuffer, 1.63f);
-        }
-        app->globalParamsSize = app->cbuffer.head - app->globalParamsOffset;
+        glUniform1i(glGetUniformLocation(app->programs[lightProgramIdx].handle, "uAmbientOcclusion"), packet.ssao.enabled);
 
-        glBindBufferRange(GL_UNIFORM_BUFFER, 0, app->cbuffer.handle, app->globalParamsOffset, app->globalParamsSize);
+        glUniform1i(glGetUniformLocation(app->programs[lightProgramIdx].handle, "uOcclusionTexture"), 6);
+        glActiveTexture(GL_TEXTURE6);
+        glBindTexture(GL_TEXTURE_2D, app->ssao.occlusionTextures[0]);
 
-        UnmapBuffer(app->cbuffer);
+        glUniform1i(glGetUniformLocation(app->programs[lightProgramIdx].handle, "uOcclusionDepthTexture"), 7);
+        glActiveTexture(GL_TEXTURE7);
+        glBindTexture(GL_TEXTURE_2D, app->ssao.depthTexture);
+        glActiveTexture(GL_TEXTURE0);
 
         renderQuad();
 
-        glBindFramebuffer(GL_READ_FRAMEBUFFER, app->frameBuffer);
-        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
-        glBlitFramebuffer(
-            0, 0, app->displaySize.x, app->displaySize.y, 0, 0, app->displaySize.x, app->displaySize.y, GL_DEPTH_BUFFER_BIT, GL_NEAREST
-        );
-        glBindFramebuffer(GL_FRAMEBUFFER, 0);
-
-        glUseProgram(app->programs[app->gizmosProgramIdx].handle);
-
-        glUniformMatrix4fv(glGetUniformLocation(app->programs[app->gizmosProgramIdx].handle, "projectionView"), 1, GL_FALSE, glm::value_ptr(glm::perspective(glm::radians(60.0f), (float)app->displaySize.x / (float)app->displaySize.y, 0.1f, 2000.0f)* app->mainCam->viewMatrix));
-        for (unsigned int i = 0; i < app->lights.size(); ++i) {
-            glm::mat4 mat = glm::mat4(1.f);
-            mat = glm::translate(mat, app->lights[i].position);
-            mat = glm::scale(mat, vec3(0.5f));
-            glUniformMatrix4fv(glGetUniformLocation(app->programs[app->gizmosProgramIdx].handle, "model"), 1, GL_FALSE, glm::value_ptr(mat));
-            glUniform3fv(glGetUniformLocation(app->programs[app->gizmosProgramIdx].handle, "lightColor"), 1, glm::value_ptr(app->lights[i].color));
-            app->lights[i].type == LightType::Point ? renderSphere() : renderQuad();
-        }
+        ResolveToBackbuffer(app, packet);
+
         break; }
+    case Mode_Count:
+        ASSERT(false, "Invalid render mode");
+        break;
     }
+
+    RenderDebugShapes(app, packet);
+
+    app->previousViewProjection = packet.view.viewProjectionMatrix;
+    app->renderFrame++;
+
+    EndFrameTimer(app->dynamicResolution);
 }
 
-GLuint FindVAO(Mesh& mesh, u32 submeshIndex, const Program& program)
+GLuint FindVAO(Mesh& mesh, u32 submeshIndex, const Program& program, GLuint materialIdBuffer)
 {
     Submesh& submesh = mesh.submeshes[submeshIndex];
 
+    const std::vector<VertexShaderAttribute>& attributes = program.vertexInputLayout.attributes;
+    if (attributes.size() == 1 && attributes[0].location == 0)
+        return submesh.depthVao;
+
     for (u32 i = 0; i < (u32)submesh.vaos.size(); ++i)
     {
         if (submesh.vaos[i].programHandle == program.handle)
@@ -672,6 +2239,16 @@ GLuint FindVAO(Mesh& mesh, u32 submeshIndex, const Program& program)
 
     for (u32 i = 0; i < program.vertexInputLayout.attributes.size(); ++i)
     {
+        if (program.vertexInputLayout.attributes[i].location == MATERIAL_ID_LOCATION)
+        {
+            glBindBuffer(GL_ARRAY_BUFFER, materialIdBuffer);
+            glVertexAttribIPointer(MATERIAL_ID_LOCATION, 1, GL_UNSIGNED_INT, sizeof(u32), (void*)0);
+            glVertexAttribDivisor(MATERIAL_ID_LOCATION, 1);
+            glEnableVertexAttribArray(MATERIAL_ID_LOCATION);
+            glBindBuffer(GL_ARRAY_BUFFER, mesh.vertexBufferHandle);
+            continue;
+        }
+
         bool attributeWasLinked = false;
 
         for (u32 j = 0; j < submesh.vertexBufferLayout.attributes.size(); ++j)
@@ -700,99 +2277,4 @@ GLuint FindVAO(Mesh& mesh, u32 submeshIndex, const Program& program)
     submesh.vaos.push_back(vao);
 
     return vaoHandle;
-}
-
-void renderSphere()
-{
-    static unsigned int sphereVAO = 0;
-    static unsigned int indexCount; 
-
-    if (sphereVAO == 0)
-    {
-        glGenVertexArrays(1, &sphereVAO);
-
-        unsigned int vbo, ebo;
-        glGenBuffers(1, &vbo);
-        glGenBuffers(1, &ebo);
-
-        std::vector<glm::vec3> positions;
-        std::vector<glm::vec2> uv;
-        std::vector<glm::vec3> normals;
-        std::vector<unsigned int> indices;
-
-        const unsigned int X_SEGMENTS = 64;
-        const unsigned int Y_SEGMENTS = 64;
-        for (unsigned int y = 0; y <= Y_SEGMENTS; ++y)
-        {
-            for (unsigned int x = 0; x <= X_SEGMENTS; ++x)
-            {
-                float xSegment = (float)x / (float)X_SEGMENTS;
-                float ySegment = (float)y / (float)Y_SEGMENTS;
-                float xPos = std::cos(xSegment * 2.0f * PI) * std::sin(ySegment * PI);
-                float yPos = std::cos(ySegment * PI);
-                float zPos = std::sin(xSegment * 2.0f * PI) * std::sin(ySegment * PI);
-
-                positions.push_back(glm::vec3(xPos, yPos, zPos));
-                uv.push_back(glm::vec2(xSegment, ySegment));
-                normals.push_back(glm::vec3(xPos, yPos, zPos));
-            }
-        }
-
-        bool oddRow = false;
-        for (unsigned int y = 0; y < Y_SEGMENTS; ++y)
-        {
-            if (!oddRow) // even rows: y == 0, y == 2; and so on
-            {
-                for (unsigned int x = 0; x <= X_SEGMENTS; ++x)
-                {
-                    indices.push_back(y * (X_SEGMENTS + 1) + x);
-                    indices.push_back((y + 1) * (X_SEGMENTS + 1) + x);
-                }
-            }
-            else
-            {
-                for (int x = X_SEGMENTS; x >= 0; --x)
-                {
-                    indices.push_back((y + 1) * (X_SEGMENTS + 1) + x);
-                    indices.push_back(y * (X_SEGMENTS + 1) + x);
-                }
-            }
-            oddRow = !oddRow;
-        }
-        indexCount = indices.size();
-
-        std::vector<float> data;
-        for (unsigned int i = 0; i < positions.size(); ++i)
-        {
-            data.push_back(positions[i].x);
-            data.push_back(positions[i].y);
-            data.push_back(positions[i].z);
-            if (uv.size() > 0)
-            {
-                data.push_back(uv[i].x);
-                data.push_back(uv[i].y);
-            }
-            if (normals.size() > 0)
-            {
-                data.push_back(normals[i].x);
-                data.push_back(normals[i].y);
-                data.push_back(normals[i].z);
-            }
-        }
-        glBindVertexArray(sphereVAO);
-        glBindBuffer(GL_ARRAY_BUFFER, vbo);
-        glBufferData(GL_ARRAY_BUFFER, data.size() * sizeof(float), &data[0], GL_STATIC_DRAW);
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
-        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), &indices[0], GL_STATIC_DRAW);
-        float stride = (3 + 2 + 3) * sizeof(float);
-        glEnableVertexAttribArray(0);
-        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, stride, (void*)0);
-        glEnableVertexAttribArray(1);
-        glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, stride, (void*)(3 * sizeof(float)));
-        glEnableVertexAttribArray(2);
-        glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, stride, (void*)(5 * sizeof(float)));
-    }
-
-    glBindVertexArray(sphereVAO);
-    glDrawElements(GL_TRIANGLE_STRIP, indexCount, GL_UNSIGNED_INT, 0);
 }
\ No newline at end of file
@@ -5,7 +5,26 @@
 #pragma once
 
 #include "platform.h"
+#include "command_list.h"
+#include "entity_store.h"
+#include "transform_hierarchy.h"
+#include "occlusion_culling.h"
+#include "software_occlusion.h"
+#include "cascaded_shadows.h"
+#include "point_shadows.h"
+#include "texture_arrays.h"
+#include "block_layout.h"
+#include "dynamic_resolution.h"
+#include "temporal_aa.h"
+#include "ssao.h"
+#include "bloom.h"
+#include "exposure.h"
+#include "tiled_lights.h"
+#include "depth_prepass.h"
+#include "debug_draw.h"
+#include "gpu_caps.h"
 #include <glad/glad.h>
+#include <unordered_map>
 
 typedef glm::vec2  vec2;
 typedef glm::vec3  vec3;
@@ -19,7 +38,8 @@ enum TextureTypes
     AlbedoColor,
     DepthBuffer,
     NormalsBuffer,
-    PositionBuffer
+    PositionBuffer,
+    SoftwareOcclusionDepth
 };
 
 struct Image
@@ -32,7 +52,7 @@ struct Image
 
 struct Texture
 {
-    GLuint      handle;
+    u32         layer; // In App::textureArrays, see PackTextureLayer()
     std::string filepath;
 };
 
@@ -55,16 +75,6 @@ struct VertexShaderLayout
     std::vector<VertexShaderAttribute> attributes;
 };
 
-struct Entity {
-    glm::mat4 mat = glm::mat4(1.0f);
-    u32 model;
-
-    u32 localParamsOffset = 0;
-    u32 localParamsSize = 0;
-
-    Entity(const glm::vec3& pos, const glm::vec3& scale, u32 model) : mat(glm::translate(pos) * glm::scale(scale)), model(model) {}
-};
-
 struct Program
 {
     GLuint             handle;
@@ -72,19 +82,34 @@ struct Program
     std::string        programName;
     u64                lastWriteTimestamp; // What is this for?
     VertexShaderLayout vertexInputLayout;
+    u32                features; // ShaderFeature flags it was compiled with
+    bool               hasGeometryShader;
 };
 
 enum Mode
 {
     Mode_Forward,
     Mode_Deferred,
+    Mode_ForwardPlus, // Depth prepass, per tile light lists, and forward shading with them
     Mode_Count
 };
 
+// Node of the imported scene graph, repeated meshes are referenced instead of copied
+struct ModelNode
+{
+    glm::vec3        position;
+    glm::quat        rotation;
+    glm::vec3        scale;
+    u32              parent; // UINT32_MAX for the root
+    std::vector<u32> submeshes;
+    AABB             localBounds;
+};
+
 struct Model
 {
     u32 meshIdx;
     std::vector<u32> materialIdx;
+    std::vector<ModelNode> nodes; // Parents are always stored before their children
 };
 
 struct Material 
@@ -100,6 +125,27 @@ struct Material
     u32 bumpTextureIdx;
 };
 
+#define MAX_MATERIALS           4096
+#define MATERIAL_BUFFER_BINDING 4 // Shader storage binding of the Materials buffer
+#define MATERIAL_ID_LOCATION    5 // Vertex attribute with the material of the draw
+
+// Material as the shaders read it from the Materials buffer, std430. Textures are packed with
+// PackTextureLayer(), NO_TEXTURE_LAYER when the material has none.
+struct GPUMaterial
+{
+    STD430(glm::vec4) albedo; // w is the smoothness
+    STD430(glm::vec4) emissive;
+    STD430(u32)       albedoTexture;
+    STD430(u32)       emissiveTexture;
+    STD430(u32)       specularTexture;
+    STD430(u32)       normalsTexture;
+    STD430(u32)       bumpTexture;
+};
+
+ASSERT_BLOCK_OFFSET(GPUMaterial, albedoTexture, 32);
+ASSERT_BLOCK_OFFSET(GPUMaterial, bumpTexture, 48);
+static_assert(sizeof(GPUMaterial) == 64, "GPUMaterial is not the size of Material in the shaders");
+
 struct VertexV3V2
 {
     glm::vec3 pos;
@@ -130,10 +176,14 @@ struct Submesh
     VertexBufferLayout vertexBufferLayout;
     std::vector<float> vertices;
     std::vector<u32> indices;
+    AABB aabb;
+    OccluderMesh occluder; // Simplified at import
     u32 vertexOffset;
     u32 indexOffset;
+    u32 positionOffset;
 
     std::vector<VAO> vaos;
+    GLuint depthVao; // Position stream only, for every depth only program
 };
 
 struct Mesh
@@ -141,8 +191,37 @@ struct Mesh
     std::vector<Submesh> submeshes;
     GLuint vertexBufferHandle;
     GLuint indexBufferHandle;
+    GLuint positionBufferHandle; // Tightly packed vec3 positions of all the submeshes
 };
 
+#define CAMERA_FOV_Y 60.0f // Degrees
+#define CAMERA_NEAR  0.1f
+#define CAMERA_FAR   2000.0f
+
+#define VIEW_PARAMS_BINDING 4 // Uniform block binding of ViewParams
+
+// The ViewParams block, std140. Written once per frame and bound for every pass of the view.
+struct ViewParams
+{
+    STD140(glm::mat4) viewMatrix;
+    STD140(glm::mat4) projectionMatrix;
+    STD140(glm::mat4) viewProjectionMatrix;
+    STD140(glm::mat4) inverseViewMatrix;
+    STD140(glm::mat4) inverseProjectionMatrix;
+    STD140(glm::mat4) inverseViewProjectionMatrix;
+    STD140(glm::vec3) cameraPosition;
+    STD140(glm::vec4) viewport; // Width, height, and one over them
+
+    // Motion vectors compare where a point is with where it was, both without the jitter
+    STD140(glm::mat4) unjitteredViewProjectionMatrix;
+    STD140(glm::mat4) previousViewProjectionMatrix;
+    STD140(glm::vec4) jitter; // xy: offset of the image this frame, in uv
+};
+
+ASSERT_BLOCK_OFFSET(ViewParams, cameraPosition, 384);
+ASSERT_BLOCK_OFFSET(ViewParams, viewport, 400);
+ASSERT_BLOCK_OFFSET(ViewParams, jitter, 544);
+
 struct Camera
 {
     vec3 cameraPos;
@@ -182,8 +261,16 @@ struct Camera
 
         viewMatrix = glm::lookAt(cameraPos, cameraPos + cameraDirection, cameraUp);
     }
+
+    ViewParams GetViewParams(ivec2 viewportSize) const;
 };
 
+// Matches the attenuation pushed for every light: 1 / (1 + linear * d + quadratic * d^2)
+#define LIGHT_ATTENUATION_LINEAR    0.82f
+#define LIGHT_ATTENUATION_QUADRATIC 1.63f
+
+#define MAX_SHADER_LIGHTS 16 // Size of uLight in the shaders
+
 enum LightType
 {
     Directional,
@@ -201,11 +288,111 @@ struct Light
     Light(LightType type, vec3 color, vec3 direction, vec3 position, float intensity) : type(type), color(color), direction(direction), position(position), intensity(intensity) {}
 };
 
+// A light as the shaders read it from uLight, std140
+struct GPULight
+{
+    STD140(u32)       type;
+    STD140(glm::vec3) color;
+    STD140(glm::vec3) direction;
+    STD140(glm::vec3) position;
+    STD140(f32)       intensity;
+    STD140(f32)       linear;
+    STD140(f32)       quadratic;
+};
+
+// The GlobalParams block, std140
+struct GlobalParams
+{
+    STD140(u32)                                      lightCount;
+    STD140(Std140Array<GPULight, MAX_SHADER_LIGHTS>) lights;
+};
+
+ASSERT_BLOCK_OFFSET(GPULight, intensity, 60);
+ASSERT_BLOCK_OFFSET(GPULight, quadratic, 68);
+ASSERT_BLOCK_OFFSET(GlobalParams, lights, 16);
+static_assert(decltype(GlobalParams::lights)::stride == 80, "uLight elements are 80 bytes apart in the shaders");
+
+// The ShadowParams block, std140
+struct ShadowParams
+{
+    STD140(Std140Array<glm::mat4, SHADOW_CASCADE_COUNT>) cascadeViewProjection;
+    STD140(glm::vec4)                                    cascadeSplits;     // View depth where every cascade ends
+    STD140(glm::vec4)                                    cascadeTexelSizes; // World units
+    STD140(glm::vec3)                                    cameraForward;
+    STD140(i32)                                          shadowLight;       // Index in uLight, -1 when nothing casts shadows
+};
+
+ASSERT_BLOCK_OFFSET(ShadowParams, cascadeSplits, 256);
+ASSERT_BLOCK_OFFSET(ShadowParams, shadowLight, 300);
+
+// A point light shadow as the shaders read it from uPointShadow, std140
+struct GPUPointShadow
+{
+    STD140(glm::vec4)                 positionRadius;
+    STD140(Std140Array<glm::vec4, 6>) faceRects; // Origin and size in the atlas, w is 0 until the face is rendered
+};
+
+// The PointShadowParams block, std140. uLightPointShadow packs the shadow index of every light
+// in ivec4s.
+struct PointShadowParams
+{
+    STD140(Std140Array<glm::ivec4, MAX_SHADER_LIGHTS / 4>)       lightPointShadow;
+    STD140(Std140Array<GPUPointShadow, POINT_SHADOW_MAX_LIGHTS>) pointShadows;
+};
+
+ASSERT_BLOCK_OFFSET(PointShadowParams, pointShadows, 64);
+static_assert(sizeof(GPUPointShadow) == 112, "uPointShadow elements are 112 bytes in the shaders");
+
+struct RenderEntity
+{
+    glm::mat4 world;
+    AABB      bounds; // World space
+    u32       model;
+    u32       modelNode;
+    u32       slot;   // Entity slot, stable across frames
+};
+
+// Everything Render() needs from the simulation for one frame. It is written by Update() on
+// the main thread and only read afterwards, by the render thread.
+struct RenderPacket
+{
+    ivec2 displaySize;
+    f32   deltaTime;
+    Mode  mode;
+
+    ViewParams view; // viewport is the display size, Render() replaces it with the render size
+
+    DynamicResolutionSettings resolution;
+    bool temporalAA;
+    SSAOSettings ssao;
+    bool bloom;
+    ExposureSettings exposure;
+    DepthPrepassSettings depthPrepass;
+
+    DebugDrawList debugDraw; // Drawn over the final image
+
+    std::vector<RenderEntity> entities; // Only the ones that survived culling
+    std::vector<Light>        lights;
+
+    bool occlusionCulling;
+
+    std::vector<f32> softwareOcclusionDepth; // Only filled while its debug view is shown
+
+    // Cascades of the first directional light of lights, shadowLight is -1 when there is none
+    i32                       shadowLight;
+    ShadowCascadeView         shadowCascades[SHADOW_CASCADE_COUNT];
+    std::vector<RenderEntity> shadowCasters; // Every caster of any cascade or point light, once
+
+    std::vector<PointShadowView>   pointShadows;
+    std::vector<PointShadowUpdate> pointShadowUpdates; // Faces to render this frame
+};
+
 struct App
 {
     ~App()
     {
         delete mainCam;
+        FreeCommandArena(commandArena);
     }
 
     // Loop
@@ -217,8 +404,10 @@ struct App
 
     // Graphics
     TextureTypes currentTextureType = TextureTypes::AlbedoColor;
-    char gpuName[64];
-    char openGlVersion[64];
+    GpuCapabilities gpu; // Queried once in Init(), Gui() runs on the main thread and cannot ask GL
+
+    // How many frames the simulation can run ahead of the render thread (1 to MAX_FRAMES_IN_FLIGHT)
+    u32 maxFramesInFlight = 2;
 
     ivec2 displaySize;
 
@@ -228,10 +417,34 @@ struct App
     std::vector<Mesh>     meshes;
     std::vector<Model>    models;
 
+    TextureArrays textureArrays;
+    GLuint        materialBuffer;   // GPUMaterial per material, bound at MATERIAL_BUFFER_BINDING
+    GLuint        materialIdBuffer; // 0 to MAX_MATERIALS - 1, the source of aMaterial
+
+    // Every compiled variant, by (base program index << 32) | feature flags
+    std::unordered_map<u64, u32> programVariants;
+
     // program indices
     u32 texturedMeshProgramIdx;
+    u32 geometryProgramIdx;
+    u32 depthPrepassProgramIdx;
+    u32 lightCullingProgramIdx;
     u32 lightProgramIdx;
-    u32 gizmosProgramIdx;
+    u32 debugDrawProgramIdx;
+    u32 downsampleR32FProgramIdx;
+    u32 downsampleRGBA16FProgramIdx;
+    u32 occlusionCullingProgramIdx;
+    u32 shadowDepthProgramIdx;
+    u32 pointShadowDepthProgramIdx;
+    u32 upscaleProgramIdx;
+    u32 temporalAAProgramIdx;
+    u32 ssaoDownsampleProgramIdx;
+    u32 ssaoProgramIdx;
+    u32 ssaoBlurProgramIdx;
+    u32 bloomPrefilterProgramIdx;
+    u32 bloomCompositeProgramIdx;
+    u32 exposureHistogramProgramIdx;
+    u32 exposureAdaptProgramIdx;
 
     // Model
     u32 patrick;
@@ -240,13 +453,15 @@ struct App
     // Mode
     Mode mode;
 
-    // Location of the texture uniform in the textured quad shader
-    GLuint programUniformTexture;
-
     // VAO object to link our screen filling quad with our textured quad shader
     GLuint vao;
 
-    std::vector<Entity> entities;
+    EntityStore entities;
+    TransformHierarchy transforms;
+
+    // Entities and point lights, see SpatialCategory
+    AABBTree spatialIndex;
+    std::vector<u32> visibleEntitySlots; // Last frame's, to clear their visible flag
 
     Camera* mainCam = nullptr;
 
@@ -256,6 +471,43 @@ struct App
     GLuint normalsAttachment;
     GLuint albedoAttachment;
     GLuint positionsAttachment;
+    GLuint motionAttachment; // RG16F, uv the surface moved since last frame
+    GLuint lightingFrameBuffer; // Only colorAttachment, the lighting pass samples the others
+
+    // The attachments are this big, the scene is rendered in the renderSize corner of them
+    ivec2 renderTargetSize;
+    ivec2 renderSize; // This frame's, set by Render()
+
+    DynamicResolutionSettings resolutionSettings;
+    DynamicResolution dynamicResolution;
+
+    bool temporalAAEnabled = true;
+    TemporalAA temporalAA;
+
+    SSAOSettings ssaoSettings;
+    SSAO ssao;
+
+    Downsampler downsampler;
+
+    bool bloomEnabled = true;
+    Bloom bloom;
+
+    ExposureSettings exposureSettings;
+    AutoExposure autoExposure;
+
+    TiledLights tiledLights;
+
+    DepthPrepassSettings depthPrepassSettings;
+    DepthPrepass depthPrepass; // Before the G-buffer pass
+
+    DebugDraw debugDraw;
+
+    // Render thread state carried to the next frame, for the motion vectors and the jitter
+    ViewParams             renderView; // This frame's as the shaders see it, jittered and at renderSize
+    glm::mat4              previousViewProjection;
+    std::vector<glm::mat4> previousWorlds;      // By entity slot
+    std::vector<u64>       previousWorldFrames; // Frame previousWorlds was written, by entity slot
+    u64                    renderFrame = 0;
 
     GLint maxUniformBufferSize;
     GLint uniformBlockAlignment;
@@ -264,6 +516,22 @@ struct App
     u32 globalParamsOffset;
     u32 globalParamsSize;
 
+    // Draw commands recorded by the job threads every frame
+    CommandArena commandArena;
+
+    OcclusionCulling occlusionCulling;
+    bool occlusionCullingEnabled = true;
+
+    OcclusionBuffer softwareOcclusion;
+    bool softwareOcclusionEnabled = false;
+    GLuint softwareOcclusionTexture; // Debug view of the occlusion buffer
+
+    CascadedShadows shadows;
+    ShadowMaps shadowMaps;
+    PointShadows pointShadows;
+    PointShadowMaps pointShadowMaps;
+    Buffer shadowCBuffer; // Caster matrices, and the ShadowParams and PointShadowParams blocks
+
     std::vector<Light> lights;
 
     bool renderLightGuizmos = true;
@@ -273,12 +541,40 @@ void Init(App* app);
 
 void Gui(App* app);
 
-void Update(App* app);
+void Update(App* app, RenderPacket& packet);
 
-void Render(App* app);
+void Render(App* app, const RenderPacket& packet);
 
-u32 LoadTexture2D(App* app, const char* filepath);
+/**
+ * Index of the program compiled with the given ShaderFeature flags instead of the ones it was
+ * loaded with. Variants are built the first time they are asked for, on the GL thread, and
+ * cached. References into App::programs taken before the call may be invalidated.
+ */
+u32 GetProgramVariant(App* app, u32 programIdx, u32 features);
 
-GLuint FindVAO(Mesh& mesh, u32 submeshIndex, const Program& program);
+u32 LoadTexture2D(App* app, const char* filepath);
 
-void renderSphere();
+/**
+ * Loads several textures at once, decoding the images on the job threads. Already loaded
+ * files are reused. Textures that failed to load get UINT32_MAX as their index.
+ */
+void LoadTextures2D(App* app, const char** filepaths, u32 count, u32* textureIndices);
+
+/**
+ * VAO of the submesh for the program, created the first time. An attribute of the program at
+ * MATERIAL_ID_LOCATION is fed one value per instance from materialIdBuffer, so the base
+ * instance of a draw is the material it uses. Programs that only read the position get the
+ * position stream, Submesh::depthVao.
+ */
+GLuint FindVAO(Mesh& mesh, u32 submeshIndex, const Program& program, GLuint materialIdBuffer);
+
+/**
+ * Instantiates every node of the model in the transform hierarchy, with an entity for each
+ * node that has meshes. Returns the id of the transform node the whole model hangs from.
+ */
+u32 SpawnModel(App* app, u32 modelIdx, const vec3& position, const glm::quat& rotation, const vec3& scale, u32 entityFlags);
+
+/**
+ * Distance at which the light contribution falls under 1/256 with the engine attenuation.
+ */
+f32 GetLightRadius(const Light& light);
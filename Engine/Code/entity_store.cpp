@@ -0,0 +1,141 @@
+#include "entity_store.h"
+#include "job_system.h"
+
+EntityHandle CreateEntity(EntityStore& store, const glm::mat4& transform, const RenderMesh& renderMesh, u32 flags)
+{
+    EntityHandle handle;
+    if (!store.freeSlots.empty())
+    {
+        handle.slot = store.freeSlots.back();
+        store.freeSlots.pop_back();
+    }
+    else
+    {
+        handle.slot = store.slotToDense.size();
+        store.slotToDense.push_back(UINT32_MAX);
+        store.slotGenerations.push_back(0);
+    }
+    handle.generation = store.slotGenerations[handle.slot];
+
+    const u32 denseIdx = store.transforms.size();
+    store.slotToDense[handle.slot] = denseIdx;
+
+    store.transforms.push_back(transform);
+    store.bounds.push_back(TransformAABB(renderMesh.localBounds, transform));
+    store.renderMeshes.push_back(renderMesh);
+    store.flags.push_back(flags | EntityFlag_Moved);
+    store.denseToSlot.push_back(handle.slot);
+    store.proxies.push_back(AABB_TREE_NULL);
+
+    return handle;
+}
+
+void DestroyEntity(EntityStore& store, EntityHandle handle)
+{
+    if (!IsEntityAlive(store, handle))
+        return;
+
+    const u32 denseIdx = store.slotToDense[handle.slot];
+    const u32 lastIdx = store.transforms.size() - 1;
+
+    if (store.proxies[denseIdx] != AABB_TREE_NULL)
+        store.releasedProxies.push_back(store.proxies[denseIdx]);
+
+    if (store.flags[denseIdx] & EntityFlag_Static)
+        store.staticVersion++;
+
+    if (denseIdx != lastIdx)
+    {
+        store.transforms[denseIdx] = store.transforms[lastIdx];
+        store.bounds[denseIdx] = store.bounds[lastIdx];
+        store.renderMeshes[denseIdx] = store.renderMeshes[lastIdx];
+        store.flags[denseIdx] = store.flags[lastIdx];
+        store.denseToSlot[denseIdx] = store.denseToSlot[lastIdx];
+        store.proxies[denseIdx] = store.proxies[lastIdx];
+        store.slotToDense[store.denseToSlot[denseIdx]] = denseIdx;
+    }
+
+    store.transforms.pop_back();
+    store.bounds.pop_back();
+    store.renderMeshes.pop_back();
+    store.flags.pop_back();
+    store.denseToSlot.pop_back();
+    store.proxies.pop_back();
+
+    store.slotToDense[handle.slot] = UINT32_MAX;
+    store.slotGenerations[handle.slot]++;
+    store.freeSlots.push_back(handle.slot);
+}
+
+bool IsEntityAlive(const EntityStore& store, EntityHandle handle)
+{
+    return handle.slot < store.slotToDense.size() &&
+           store.slotGenerations[handle.slot] == handle.generation &&
+           store.slotToDense[handle.slot] != UINT32_MAX;
+}
+
+u32 GetEntityIndex(const EntityStore& store, EntityHandle handle)
+{
+    ASSERT(IsEntityAlive(store, handle), "Stale entity handle");
+    return store.slotToDense[handle.slot];
+}
+
+u32 GetEntityCount(const EntityStore& store)
+{
+    return store.transforms.size();
+}
+
+void SetEntityTransform(EntityStore& store, EntityHandle handle, const glm::mat4& transform)
+{
+    const u32 idx = GetEntityIndex(store, handle);
+    store.transforms[idx] = transform;
+    store.bounds[idx] = TransformAABB(store.renderMeshes[idx].localBounds, transform);
+    store.flags[idx] |= EntityFlag_Moved;
+}
+
+void ForEachEntityBatch(EntityStore& store, u32 batchSize, const std::function<void(u32 begin, u32 end)>& body)
+{
+    ParallelFor(GetEntityCount(store), batchSize, body);
+}
+
+void SyncEntityProxies(EntityStore& store, AABBTree& tree)
+{
+    store.changedBounds.clear();
+
+    for (u32 i = 0; i < store.releasedProxies.size(); ++i)
+    {
+        store.changedBounds.push_back(GetFatAABB(tree, store.releasedProxies[i]));
+        DestroyProxy(tree, store.releasedProxies[i]);
+    }
+    store.releasedProxies.clear();
+
+    for (u32 i = 0; i < store.flags.size(); ++i)
+    {
+        if (!(store.flags[i] & EntityFlag_Moved))
+            continue;
+
+        if (store.proxies[i] == AABB_TREE_NULL)
+        {
+            store.proxies[i] = CreateProxy(tree, store.bounds[i], SpatialCategory_Entity, store.denseToSlot[i]);
+        }
+        else
+        {
+            store.changedBounds.push_back(GetFatAABB(tree, store.proxies[i]));
+            MoveProxy(tree, store.proxies[i], store.bounds[i]);
+        }
+        store.changedBounds.push_back(store.bounds[i]);
+
+        if (store.flags[i] & EntityFlag_Static)
+            store.staticVersion++;
+
+        store.flags[i] &= ~EntityFlag_Moved;
+    }
+}
+
+void QueryEntities(const EntityStore& store, u32 requiredFlags, std::vector<u32>& indices)
+{
+    indices.clear();
+    for (u32 i = 0; i < store.flags.size(); ++i)
+        if ((store.flags[i] & requiredFlags) == requiredFlags)
+            indices.push_back(i);
+}
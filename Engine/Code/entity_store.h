@@ -0,0 +1,97 @@
+//
+// entity_store.h: Structure-of-arrays storage for the renderable entities. Every component
+// lives in its own dense array, so systems that only need transforms and bounds (culling,
+// uploads) walk contiguous memory. Handles stay valid while entities around them are created
+// and destroyed, and a generation counter detects handles to destroyed entities.
+//
+
+#pragma once
+
+#include "platform.h"
+#include "bounds.h"
+#include "aabb_tree.h"
+#include <functional>
+
+enum EntityFlags
+{
+    EntityFlag_Visible     = 1 << 0, // Survived culling this frame
+    EntityFlag_Static      = 1 << 1, // Never moves, caches may keep what they computed for it
+    EntityFlag_CastShadows = 1 << 2,
+    EntityFlag_Moved       = 1 << 3, // Bounds changed since the last SyncEntityProxies()
+    EntityFlag_Occluder    = 1 << 4, // Rasterized by the software occlusion culling
+};
+
+struct EntityHandle
+{
+    u32 slot;
+    u32 generation;
+};
+
+struct RenderMesh
+{
+    u32  model;
+    u32  modelNode; // Only the submeshes of this node of the model are drawn
+    AABB localBounds;
+};
+
+struct EntityStore
+{
+    // Dense component arrays, all the same length
+    std::vector<glm::mat4>  transforms;
+    std::vector<AABB>       bounds; // World space
+    std::vector<RenderMesh> renderMeshes;
+    std::vector<u32>        flags;
+    std::vector<u32>        denseToSlot;
+    std::vector<u32>        proxies; // In the spatial index, AABB_TREE_NULL until synced
+
+    // Handle slots, pointing into the dense arrays
+    std::vector<u32> slotToDense;
+    std::vector<u32> slotGenerations;
+    std::vector<u32> freeSlots;
+
+    // Proxies of destroyed entities, removed from the spatial index on the next sync
+    std::vector<u32> releasedProxies;
+
+    // Changes whenever a static entity appears, moves or goes away, for caches built from them
+    u32 staticVersion = 0;
+
+    // World bounds of everything the last SyncEntityProxies() added, moved or removed, with
+    // both the old and the new bounds of what moved
+    std::vector<AABB> changedBounds;
+};
+
+EntityHandle CreateEntity(EntityStore& store, const glm::mat4& transform, const RenderMesh& renderMesh, u32 flags);
+
+/**
+ * Removes the entity by moving the last one into its place, so dense indices of other
+ * entities may change. Handles do not.
+ */
+void DestroyEntity(EntityStore& store, EntityHandle handle);
+
+bool IsEntityAlive(const EntityStore& store, EntityHandle handle);
+
+/**
+ * Index of the entity in the dense component arrays, valid until the next DestroyEntity().
+ */
+u32 GetEntityIndex(const EntityStore& store, EntityHandle handle);
+
+u32 GetEntityCount(const EntityStore& store);
+
+void SetEntityTransform(EntityStore& store, EntityHandle handle, const glm::mat4& transform);
+
+/**
+ * Runs body(begin, end) over contiguous ranges of the dense arrays on all job threads.
+ */
+void ForEachEntityBatch(EntityStore& store, u32 batchSize, const std::function<void(u32 begin, u32 end)>& body);
+
+/**
+ * Brings the spatial index up to date with the entities created, moved and destroyed since the
+ * last call. Proxy userData is the entity slot. Not thread safe, run it after the transforms
+ * are updated.
+ */
+void SyncEntityProxies(EntityStore& store, AABBTree& tree);
+
+/**
+ * Gathers, in dense order, the indices of the entities that have all the requiredFlags set.
+ */
+void QueryEntities(const EntityStore& store, u32 requiredFlags, std::vector<u32>& indices);
@@ -0,0 +1,77 @@
+#include "exposure.h"
+
+#define EXPOSURE_HISTOGRAM_GROUP_SIZE 16
+
+void InitAutoExposure(AutoExposure& exposure, GLuint histogramProgram, GLuint adaptProgram)
+{
+    exposure.histogramProgram = histogramProgram;
+    exposure.adaptProgram = adaptProgram;
+
+    const u32 zeros[EXPOSURE_HISTOGRAM_BINS] = {};
+    glGenBuffers(1, &exposure.histogramBuffer);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, exposure.histogramBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(zeros), zeros, GL_DYNAMIC_COPY);
+
+    // No adapted luminance yet, the first frame takes the one it measures
+    const f32 initial[2] = { 0.0f, 1.0f };
+    glGenBuffers(1, &exposure.exposureBuffer);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, exposure.exposureBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(initial), initial, GL_DYNAMIC_COPY);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    exposure.fixedExposure = initial[1];
+}
+
+void UpdateAutoExposure(AutoExposure& exposure, const ExposureSettings& settings, GLuint colorTexture, glm::ivec2 renderSize, f32 deltaTime)
+{
+    const f32 logLuminanceRange = EXPOSURE_MAX_LOG_LUMINANCE - EXPOSURE_MIN_LOG_LUMINANCE;
+
+    // Every other pixel in both directions is enough for an average, and keeps the cost fixed
+    const glm::ivec2 sampleSize = (renderSize + 1) / 2;
+
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, EXPOSURE_BUFFER_BINDING, exposure.exposureBuffer);
+
+    // Nothing to measure, the fixed exposure is written from here when it changes. The adapted
+    // luminance stays in the buffer, so enabling it again carries on from it.
+    if (!settings.enabled)
+    {
+        const f32 fixedExposure = exp2f(settings.compensation);
+        if (fixedExposure != exposure.fixedExposure)
+        {
+            glBindBuffer(GL_SHADER_STORAGE_BUFFER, exposure.exposureBuffer);
+            glBufferSubData(GL_SHADER_STORAGE_BUFFER, sizeof(f32), sizeof(f32), &fixedExposure);
+            glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+            exposure.fixedExposure = fixedExposure;
+        }
+        return;
+    }
+
+    exposure.fixedExposure = 0.0f;
+
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, exposure.histogramBuffer);
+
+    glUseProgram(exposure.histogramProgram);
+    glUniform1i(glGetUniformLocation(exposure.histogramProgram, "uColorTexture"), 0);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, colorTexture);
+    glUniform2i(glGetUniformLocation(exposure.histogramProgram, "uRenderSize"), renderSize.x, renderSize.y);
+    glUniform2i(glGetUniformLocation(exposure.histogramProgram, "uSize"), sampleSize.x, sampleSize.y);
+    glUniform1f(glGetUniformLocation(exposure.histogramProgram, "uMinLogLuminance"), EXPOSURE_MIN_LOG_LUMINANCE);
+    glUniform1f(glGetUniformLocation(exposure.histogramProgram, "uLogLuminanceRange"), logLuminanceRange);
+
+    const glm::ivec2 groups = (sampleSize + EXPOSURE_HISTOGRAM_GROUP_SIZE - 1) / EXPOSURE_HISTOGRAM_GROUP_SIZE;
+    glDispatchCompute(groups.x, groups.y, 1);
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    glUseProgram(exposure.adaptProgram);
+    glUniform1f(glGetUniformLocation(exposure.adaptProgram, "uPixelCount"), (f32)(sampleSize.x * sampleSize.y));
+    glUniform1f(glGetUniformLocation(exposure.adaptProgram, "uMinLogLuminance"), EXPOSURE_MIN_LOG_LUMINANCE);
+    glUniform1f(glGetUniformLocation(exposure.adaptProgram, "uLogLuminanceRange"), logLuminanceRange);
+    glUniform1f(glGetUniformLocation(exposure.adaptProgram, "uAdaptation"), 1.0f - expf(-deltaTime * settings.adaptationSpeed));
+    glUniform1f(glGetUniformLocation(exposure.adaptProgram, "uCompensation"), exp2f(settings.compensation));
+
+    glDispatchCompute(1, 1, 1);
+
+    // Read by the tonemapping of this frame and the histogram of the next
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+}
@@ -0,0 +1,43 @@
+//
+// exposure.h: Automatic exposure of the HDR frame, entirely on the GPU. A compute shader builds
+// a histogram of the log luminance of the frame with shared memory atomics, and a second one,
+// a single group, averages it, adapts the luminance the eye is used to towards it over time and
+// writes the exposure to a buffer. The final pass reads the exposure from that buffer before
+// tonemapping, so the CPU never waits for the result.
+//
+
+#pragma once
+
+#include "platform.h"
+#include <glad/glad.h>
+
+#define EXPOSURE_BUFFER_BINDING    5     // Shader storage binding of the Exposure buffer
+#define EXPOSURE_HISTOGRAM_BINS    256   // Bin 0 holds the black pixels, which are not averaged
+#define EXPOSURE_MIN_LOG_LUMINANCE -10.0f
+#define EXPOSURE_MAX_LOG_LUMINANCE 6.0f
+
+// Main thread side, sent to the render thread in the RenderPacket
+struct ExposureSettings
+{
+    bool enabled = true;
+    f32  compensation = 0.0f;   // Stops, also applied when not enabled
+    f32  adaptationSpeed = 1.5f; // The larger the faster
+};
+
+// Render thread side
+struct AutoExposure
+{
+    GLuint histogramProgram;
+    GLuint adaptProgram;
+    GLuint histogramBuffer; // EXPOSURE_HISTOGRAM_BINS u32, emptied by the adapt pass
+    GLuint exposureBuffer;  // Adapted luminance and exposure, kept from frame to frame
+    f32    fixedExposure;   // Last exposure written from the CPU while disabled, 0 once the adapt pass writes it
+};
+
+void InitAutoExposure(AutoExposure& exposure, GLuint histogramProgram, GLuint adaptProgram);
+
+/**
+ * Updates the exposure from the renderSize corner of colorTexture. deltaTime is in seconds.
+ * Nothing is dispatched while it is disabled.
+ */
+void UpdateAutoExposure(AutoExposure& exposure, const ExposureSettings& settings, GLuint colorTexture, glm::ivec2 renderSize, f32 deltaTime);
@@ -0,0 +1,153 @@
+#include "gpu_caps.h"
+#include <GLFW/glfw3.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef void (APIENTRYP MaxShaderCompilerThreadsProc)(GLuint count);
+
+static const char* GpuTierNames[GpuTier_Count] = { "software", "low", "high" };
+
+// Substrings of GL_RENDERER of the drivers that rasterize on the CPU
+static const char* SoftwareRenderers[] = { "llvmpipe", "softpipe", "SwiftShader", "Software Rasterizer", "Microsoft Basic Render", "GDI Generic" };
+
+static bool IsVersionAtLeast(const GpuCapabilities& caps, i32 major, i32 minor)
+{
+    return caps.majorVersion > major || (caps.majorVersion == major && caps.minorVersion >= minor);
+}
+
+static bool IsHidden(const std::vector<std::string>& hidden, const char* name)
+{
+    for (const std::string& extension : hidden)
+    {
+        if (extension == name)
+            return true;
+    }
+    return false;
+}
+
+static std::vector<std::string> GetHiddenExtensions()
+{
+    std::vector<std::string> hidden;
+    const char* variable = getenv("ENGINE_DISABLE_GL_EXTENSIONS");
+    if (!variable)
+        return hidden;
+
+    std::string list = variable;
+    size_t begin = 0;
+    while (begin <= list.size())
+    {
+        size_t end = list.find(',', begin);
+        if (end == std::string::npos)
+            end = list.size();
+        if (end > begin)
+            hidden.push_back(list.substr(begin, end - begin));
+        begin = end + 1;
+    }
+    return hidden;
+}
+
+// Core since the given version or exposed by one of the extensions, and not hidden in any form
+static bool HasFeature(const GpuCapabilities& caps, const std::vector<std::string>& hidden, i32 major, i32 minor,
+                       const char* extension, const char* otherExtension = nullptr)
+{
+    if (IsHidden(hidden, extension) || (otherExtension && IsHidden(hidden, otherExtension)))
+        return false;
+
+    return (major > 0 && IsVersionAtLeast(caps, major, minor)) || HasExtension(caps, extension) ||
+           (otherExtension && HasExtension(caps, otherExtension));
+}
+
+static GpuTier DetectTier(const GpuCapabilities& caps)
+{
+    if (caps.softwareRenderer)
+        return GpuTier_Software;
+
+    if (strstr(caps.vendor, "Intel") || strstr(caps.renderer, "Intel"))
+        return GpuTier_Low;
+
+    return GpuTier_High;
+}
+
+static void EnableParallelShaderCompile()
+{
+    MaxShaderCompilerThreadsProc maxThreads = (MaxShaderCompilerThreadsProc)glfwGetProcAddress("glMaxShaderCompilerThreadsKHR");
+    if (!maxThreads)
+        maxThreads = (MaxShaderCompilerThreadsProc)glfwGetProcAddress("glMaxShaderCompilerThreadsARB");
+
+    // As many threads as the driver wants
+    if (maxThreads)
+        maxThreads(0xFFFFFFFF);
+}
+
+void QueryGpuCapabilities(GpuCapabilities& caps)
+{
+    snprintf(caps.renderer, sizeof(caps.renderer), "%s", glGetString(GL_RENDERER));
+    snprintf(caps.version, sizeof(caps.version), "%s", glGetString(GL_VERSION));
+    snprintf(caps.vendor, sizeof(caps.vendor), "%s", glGetString(GL_VENDOR));
+    snprintf(caps.glslVersion, sizeof(caps.glslVersion), "%s", glGetString(GL_SHADING_LANGUAGE_VERSION));
+    glGetIntegerv(GL_MAJOR_VERSION, &caps.majorVersion);
+    glGetIntegerv(GL_MINOR_VERSION, &caps.minorVersion);
+
+    const std::vector<std::string> hidden = GetHiddenExtensions();
+
+    GLint extensionCount;
+    glGetIntegerv(GL_NUM_EXTENSIONS, &extensionCount);
+    caps.extensions.clear();
+    for (GLint i = 0; i < extensionCount; ++i)
+    {
+        const char* extension = (const char*)glGetStringi(GL_EXTENSIONS, i);
+        if (!IsHidden(hidden, extension))
+            caps.extensions.push_back(extension);
+    }
+
+    caps.computeShaders = HasFeature(caps, hidden, 4, 3, "GL_ARB_compute_shader");
+    caps.parallelShaderCompile = HasFeature(caps, hidden, 0, 0, "GL_KHR_parallel_shader_compile", "GL_ARB_parallel_shader_compile");
+
+    caps.softwareRenderer = false;
+    for (u32 i = 0; i < ARRAY_COUNT(SoftwareRenderers); ++i)
+        caps.softwareRenderer = caps.softwareRenderer || strstr(caps.renderer, SoftwareRenderers[i]) != nullptr;
+
+    glGetIntegerv(GL_MAX_UNIFORM_BLOCK_SIZE, &caps.maxUniformBlockSize);
+    glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &caps.uniformBufferOffsetAlignment);
+    glGetIntegerv(GL_MAX_SHADER_STORAGE_BLOCK_SIZE, &caps.maxShaderStorageBlockSize);
+    glGetIntegerv(GL_MAX_COMPUTE_SHARED_MEMORY_SIZE, &caps.maxComputeSharedMemorySize);
+    glGetIntegerv(GL_MAX_COMPUTE_WORK_GROUP_INVOCATIONS, &caps.maxComputeWorkGroupInvocations);
+    glGetIntegerv(GL_MAX_IMAGE_UNITS, &caps.maxImageUnits);
+    glGetIntegerv(GL_MAX_TEXTURE_SIZE, &caps.maxTextureSize);
+    glGetIntegerv(GL_MAX_ARRAY_TEXTURE_LAYERS, &caps.maxArrayTextureLayers);
+
+    caps.tier = DetectTier(caps);
+    caps.tierForced = false;
+    if (const char* forcedTier = getenv("ENGINE_GPU_TIER"))
+    {
+        for (u32 i = 0; i < GpuTier_Count; ++i)
+        {
+            if (strcmp(forcedTier, GpuTierNames[i]) == 0)
+            {
+                caps.tier = (GpuTier)i;
+                caps.tierForced = true;
+            }
+        }
+
+        if (!caps.tierForced)
+            ELOG("Unknown ENGINE_GPU_TIER %s, expected software, low or high", forcedTier);
+    }
+
+    if (caps.parallelShaderCompile)
+        EnableParallelShaderCompile();
+}
+
+bool HasExtension(const GpuCapabilities& caps, const char* name)
+{
+    for (const std::string& extension : caps.extensions)
+    {
+        if (extension == name)
+            return true;
+    }
+    return false;
+}
+
+const char* GetGpuTierName(GpuTier tier)
+{
+    return GpuTierNames[tier];
+}
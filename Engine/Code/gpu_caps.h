@@ -0,0 +1,64 @@
+//
+// gpu_caps.h: What the driver supports, queried once at startup on the GL thread and cached, so
+// nothing asks the driver again, Gui() included. The GPU is also put in a tier, which Init()
+// picks the implementation and the defaults of every subsystem from.
+//
+// Two environment variables override the probing, to try the fallbacks on hardware that does
+// not need them:
+//   ENGINE_GPU_TIER               software, low or high
+//   ENGINE_DISABLE_GL_EXTENSIONS  Comma separated names, hidden from the list, and the features
+//                                 they provide are reported missing even when the version has them
+//
+
+#pragma once
+
+#include "platform.h"
+#include <glad/glad.h>
+
+enum GpuTier
+{
+    GpuTier_Software, // llvmpipe and the like, the CPU does the rasterization
+    GpuTier_Low,      // Integrated
+    GpuTier_High,
+    GpuTier_Count
+};
+
+struct GpuCapabilities
+{
+    char renderer[64];
+    char version[64];
+    char vendor[64];
+    char glslVersion[64];
+    i32  majorVersion;
+    i32  minorVersion;
+
+    std::vector<std::string> extensions;
+
+    // In the core of the version, or exposed as an extension. Only the features something picks
+    // a code path from, the rest is in extensions.
+    bool computeShaders;        // 4.3, GL_ARB_compute_shader
+    bool parallelShaderCompile; // GL_KHR_parallel_shader_compile or GL_ARB_parallel_shader_compile
+    bool softwareRenderer;
+
+    GLint maxUniformBlockSize;
+    GLint uniformBufferOffsetAlignment;
+    GLint maxShaderStorageBlockSize;
+    GLint maxComputeSharedMemorySize;
+    GLint maxComputeWorkGroupInvocations;
+    GLint maxImageUnits;
+    GLint maxTextureSize;
+    GLint maxArrayTextureLayers;
+
+    GpuTier tier;
+    bool    tierForced; // By ENGINE_GPU_TIER
+};
+
+/**
+ * Fills caps from the current context, with the overrides of the environment applied. Also turns
+ * on the parallel shader compilation when the driver has it.
+ */
+void QueryGpuCapabilities(GpuCapabilities& caps);
+
+bool HasExtension(const GpuCapabilities& caps, const char* name);
+
+const char* GetGpuTierName(GpuTier tier);
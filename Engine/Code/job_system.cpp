@@ -0,0 +1,348 @@
+#include "job_system.h"
+#include <thread>
+#include <condition_variable>
+
+#define MAX_JOB_QUEUES     64
+#define JOB_QUEUE_CAPACITY 4096
+
+// The owner pushes and pops at the tail, thieves take from the head. Contention is rare
+// (only when a worker runs dry), so a spin lock per queue is enough.
+struct JobQueue
+{
+    std::atomic_flag lock = ATOMIC_FLAG_INIT;
+    Job jobs[JOB_QUEUE_CAPACITY];
+    u32 head = 0;
+    u32 tail = 0;
+
+    void Lock()   { while (lock.test_and_set(std::memory_order_acquire)) std::this_thread::yield(); }
+    void Unlock() { lock.clear(std::memory_order_release); }
+};
+
+static JobQueue*                GlobalJobQueues = NULL;
+static std::atomic<u32>         GlobalJobQueueCount{ 0 };
+static std::vector<std::thread> GlobalJobWorkers;
+static std::atomic<bool>        GlobalJobSystemRunning{ false };
+static std::atomic<i32>         GlobalPendingJobs{ 0 };
+static std::mutex               GlobalJobSleepLock;
+static std::condition_variable  GlobalJobWakeUp;
+
+static std::mutex                   GlobalGLJobsLock;
+static std::vector<Job>             GlobalGLJobs;
+static std::atomic<std::thread::id> GlobalGLThreadId;
+
+static thread_local i32         ThreadQueueIdx = -1;
+
+static JobQueue& GetThreadQueue()
+{
+    if (ThreadQueueIdx < 0)
+    {
+        ThreadQueueIdx = (i32)GlobalJobQueueCount.fetch_add(1);
+        ASSERT(ThreadQueueIdx < MAX_JOB_QUEUES, "Too many threads are submitting jobs");
+    }
+    return GlobalJobQueues[ThreadQueueIdx];
+}
+
+static bool PushJob(JobQueue& queue, const Job& job)
+{
+    queue.Lock();
+    bool pushed = queue.tail - queue.head < JOB_QUEUE_CAPACITY;
+    if (pushed)
+    {
+        queue.jobs[queue.tail % JOB_QUEUE_CAPACITY] = job;
+        queue.tail++;
+    }
+    queue.Unlock();
+    return pushed;
+}
+
+static bool PopJob(JobQueue& queue, Job& job)
+{
+    queue.Lock();
+    bool popped = queue.tail != queue.head;
+    if (popped)
+    {
+        queue.tail--;
+        job = queue.jobs[queue.tail % JOB_QUEUE_CAPACITY];
+    }
+    queue.Unlock();
+    return popped;
+}
+
+static bool StealJob(JobQueue& queue, Job& job)
+{
+    queue.Lock();
+    bool stolen = queue.tail != queue.head;
+    if (stolen)
+    {
+        job = queue.jobs[queue.head % JOB_QUEUE_CAPACITY];
+        queue.head++;
+    }
+    queue.Unlock();
+    return stolen;
+}
+
+static void ScheduleJob(const Job& job);
+
+static void FinishJob(JobCounter* counter)
+{
+    if (counter == NULL)
+        return;
+
+    // The decrement happens under the lock so a waiter that sees zero (and may destroy the
+    // counter right after) cannot do so while we still touch it, see WaitForCounter()
+    std::vector<Job> released;
+    {
+        std::lock_guard<std::mutex> guard(counter->waitingLock);
+        if (counter->value.fetch_sub(1, std::memory_order_acq_rel) == 1)
+            released.swap(counter->waiting);
+    }
+    for (u32 i = 0; i < released.size(); ++i)
+        ScheduleJob(released[i]);
+}
+
+static void ExecuteJob(const Job& job)
+{
+    job.function(job.data);
+    FinishJob(job.counter);
+}
+
+static void ScheduleJob(const Job& job)
+{
+    if (job.affinity == JobAffinity_GLThread)
+    {
+        std::lock_guard<std::mutex> guard(GlobalGLJobsLock);
+        GlobalGLJobs.push_back(job);
+        return;
+    }
+
+    if (!GlobalJobSystemRunning || !PushJob(GetThreadQueue(), job))
+    {
+        // No workers or the queue is full: run it right here
+        ExecuteJob(job);
+        return;
+    }
+
+    GlobalPendingJobs.fetch_add(1, std::memory_order_release);
+    GlobalJobWakeUp.notify_one();
+}
+
+static bool TryRunGLJob()
+{
+    if (!IsGLThread())
+        return false;
+
+    Job job;
+    {
+        std::lock_guard<std::mutex> guard(GlobalGLJobsLock);
+        if (GlobalGLJobs.empty())
+            return false;
+        job = GlobalGLJobs.back();
+        GlobalGLJobs.pop_back();
+    }
+    ExecuteJob(job);
+    return true;
+}
+
+static bool TryRunJob()
+{
+    if (GlobalJobQueues == NULL)
+        return false;
+
+    Job job;
+    JobQueue& ownQueue = GetThreadQueue();
+    bool found = PopJob(ownQueue, job);
+
+    const u32 queueCount = GlobalJobQueueCount.load(std::memory_order_acquire);
+    for (u32 i = 1; !found && i <= queueCount; ++i)
+    {
+        u32 victim = ((u32)ThreadQueueIdx + i) % queueCount;
+        if (victim != (u32)ThreadQueueIdx)
+            found = StealJob(GlobalJobQueues[victim], job);
+    }
+
+    if (!found)
+        return TryRunGLJob();
+
+    GlobalPendingJobs.fetch_sub(1, std::memory_order_acq_rel);
+    ExecuteJob(job);
+    return true;
+}
+
+static void WorkerLoop()
+{
+    GetThreadQueue();
+
+    while (GlobalJobSystemRunning)
+    {
+        if (TryRunJob())
+            continue;
+
+        std::unique_lock<std::mutex> lock(GlobalJobSleepLock);
+        GlobalJobWakeUp.wait_for(lock, std::chrono::milliseconds(1), [] {
+            return GlobalPendingJobs.load(std::memory_order_acquire) > 0 || !GlobalJobSystemRunning;
+        });
+    }
+}
+
+void InitJobSystem(u32 workerCount)
+{
+    ASSERT(GlobalJobQueues == NULL, "The job system is already running");
+
+    if (workerCount == 0)
+    {
+        u32 hardwareThreads = std::thread::hardware_concurrency();
+        workerCount = hardwareThreads > 1 ? hardwareThreads - 1 : 0;
+    }
+    if (workerCount > MAX_JOB_QUEUES / 2)
+        workerCount = MAX_JOB_QUEUES / 2;
+
+    GlobalJobQueues = new JobQueue[MAX_JOB_QUEUES];
+    GlobalJobQueueCount = 0;
+    GlobalPendingJobs = 0;
+    GlobalJobSystemRunning = workerCount > 0;
+
+    // The initializing thread always gets the first queue
+    ThreadQueueIdx = -1;
+    GetThreadQueue();
+
+    for (u32 i = 0; i < workerCount; ++i)
+        GlobalJobWorkers.emplace_back(WorkerLoop);
+
+    ILOG("Job system started with %u worker threads", workerCount);
+}
+
+void ShutdownJobSystem()
+{
+    GlobalJobSystemRunning = false;
+    GlobalJobWakeUp.notify_all();
+
+    for (u32 i = 0; i < GlobalJobWorkers.size(); ++i)
+        GlobalJobWorkers[i].join();
+    GlobalJobWorkers.clear();
+
+    delete[] GlobalJobQueues;
+    GlobalJobQueues = NULL;
+    ThreadQueueIdx = -1;
+}
+
+u32 GetJobThreadCount()
+{
+    return (u32)GlobalJobWorkers.size() + 1;
+}
+
+void SetGLThread()
+{
+    GlobalGLThreadId = std::this_thread::get_id();
+}
+
+bool IsGLThread()
+{
+    return GlobalGLThreadId == std::this_thread::get_id();
+}
+
+void RunJobs(const Job* jobs, u32 count, JobCounter* counter)
+{
+    if (counter)
+        counter->value.fetch_add(count, std::memory_order_acq_rel);
+
+    for (u32 i = 0; i < count; ++i)
+    {
+        Job job = jobs[i];
+        job.counter = counter;
+        ScheduleJob(job);
+    }
+}
+
+void RunJobsAfter(const Job* jobs, u32 count, JobCounter* dependency, JobCounter* counter)
+{
+    if (counter)
+        counter->value.fetch_add(count, std::memory_order_acq_rel);
+
+    {
+        std::lock_guard<std::mutex> guard(dependency->waitingLock);
+        if (dependency->value.load(std::memory_order_acquire) > 0)
+        {
+            for (u32 i = 0; i < count; ++i)
+            {
+                Job job = jobs[i];
+                job.counter = counter;
+                dependency->waiting.push_back(job);
+            }
+            return;
+        }
+    }
+
+    for (u32 i = 0; i < count; ++i)
+    {
+        Job job = jobs[i];
+        job.counter = counter;
+        ScheduleJob(job);
+    }
+}
+
+void WaitForCounter(JobCounter* counter)
+{
+    while (counter->value.load(std::memory_order_acquire) > 0)
+    {
+        if (!TryRunJob() && !TryRunGLJob())
+            std::this_thread::yield();
+    }
+
+    std::lock_guard<std::mutex> guard(counter->waitingLock);
+}
+
+void ExecuteGLJobs()
+{
+    ASSERT(IsGLThread(), "GL jobs can only be executed by the GL thread");
+
+    std::vector<Job> jobs;
+    {
+        std::lock_guard<std::mutex> guard(GlobalGLJobsLock);
+        jobs.swap(GlobalGLJobs);
+    }
+    for (u32 i = 0; i < jobs.size(); ++i)
+        ExecuteJob(jobs[i]);
+}
+
+struct ParallelForBatch
+{
+    const std::function<void(u32, u32)>* body;
+    u32 begin;
+    u32 end;
+};
+
+static void ParallelForJob(void* data)
+{
+    ParallelForBatch* batch = (ParallelForBatch*)data;
+    (*batch->body)(batch->begin, batch->end);
+}
+
+void ParallelFor(u32 count, u32 batchSize, const std::function<void(u32 begin, u32 end)>& body)
+{
+    if (count == 0)
+        return;
+
+    if (batchSize == 0)
+        batchSize = 1;
+
+    const u32 batchCount = (count + batchSize - 1) / batchSize;
+    if (batchCount == 1 || !GlobalJobSystemRunning)
+    {
+        body(0, count);
+        return;
+    }
+
+    std::vector<ParallelForBatch> batches(batchCount);
+    std::vector<Job> jobs(batchCount);
+    for (u32 i = 0; i < batchCount; ++i)
+    {
+        batches[i].body = &body;
+        batches[i].begin = i * batchSize;
+        batches[i].end = batches[i].begin + batchSize < count ? batches[i].begin + batchSize : count;
+        jobs[i] = { ParallelForJob, &batches[i], NULL, JobAffinity_Any };
+    }
+
+    JobCounter counter;
+    RunJobs(jobs.data(), batchCount, &counter);
+    WaitForCounter(&counter);
+}
@@ -0,0 +1,80 @@
+//
+// job_system.h: Work-stealing job system. Every worker thread owns a deque it pushes to and
+// pops from, idle workers steal from the other end of somebody else's deque. Jobs signal a
+// JobCounter when they finish, which is what callers wait on and what dependent jobs hang from.
+//
+
+#pragma once
+
+#include "platform.h"
+#include <atomic>
+#include <mutex>
+#include <functional>
+
+typedef void (*JobFunction)(void* data);
+
+enum JobAffinity
+{
+    JobAffinity_Any,
+    JobAffinity_GLThread, // Only the thread that owns the GL context may run it
+};
+
+struct JobCounter;
+
+struct Job
+{
+    JobFunction function;
+    void*       data;
+    JobCounter* counter;
+    JobAffinity affinity;
+};
+
+struct JobCounter
+{
+    std::atomic<i32>  value{ 0 };
+
+    // Jobs submitted with RunJobsAfter() wait here until the counter reaches zero
+    std::mutex        waitingLock;
+    std::vector<Job>  waiting;
+};
+
+/**
+ * Starts the worker threads. With workerCount == 0 one worker per hardware thread is spawned,
+ * minus the calling thread, which also runs jobs while it waits on a counter.
+ */
+void InitJobSystem(u32 workerCount = 0);
+
+void ShutdownJobSystem();
+
+/**
+ * Number of threads that execute jobs, counting the thread that called InitJobSystem().
+ */
+u32 GetJobThreadCount();
+
+/**
+ * Marks the calling thread as the one owning the GL context. Jobs with JobAffinity_GLThread
+ * are only executed by this thread, from ExecuteGLJobs() or while it waits on a counter.
+ */
+void SetGLThread();
+
+bool IsGLThread();
+
+void RunJobs(const Job* jobs, u32 count, JobCounter* counter);
+
+/**
+ * Same as RunJobs() but the jobs are not scheduled until dependency reaches zero.
+ */
+void RunJobsAfter(const Job* jobs, u32 count, JobCounter* dependency, JobCounter* counter);
+
+/**
+ * Runs other jobs on the calling thread until the counter reaches zero.
+ */
+void WaitForCounter(JobCounter* counter);
+
+void ExecuteGLJobs();
+
+/**
+ * Splits [0, count) into batches of at most batchSize elements and runs body(begin, end) for
+ * each of them across all job threads. Returns once every batch has finished.
+ */
+void ParallelFor(u32 count, u32 batchSize, const std::function<void(u32 begin, u32 end)>& body);
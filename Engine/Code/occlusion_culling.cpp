@@ -0,0 +1,124 @@
+#include "occlusion_culling.h"
+
+#define CULL_GROUP_SIZE 64
+
+static i32 NextPowerOf2(i32 value)
+{
+    i32 result = 1;
+    while (result < value)
+        result *= 2;
+    return result;
+}
+
+void InitOcclusionCulling(OcclusionCulling& culling, GLuint cullProgram, glm::ivec2 depthSize)
+{
+    culling.cullProgram = cullProgram;
+
+    culling.depthSize = depthSize;
+    culling.hiZSize = glm::ivec2(NextPowerOf2((depthSize.x + 1) / 2), NextPowerOf2((depthSize.y + 1) / 2));
+    culling.hiZMipCount = GetMipCount(culling.hiZSize);
+
+    glGenTextures(1, &culling.hiZTexture);
+    glBindTexture(GL_TEXTURE_2D, culling.hiZTexture);
+    glTexStorage2D(GL_TEXTURE_2D, culling.hiZMipCount, GL_R32F, culling.hiZSize.x, culling.hiZSize.y);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    glGenBuffers(1, &culling.instanceBuffer);
+    glGenBuffers(1, &culling.drawBuffer);
+    glGenBuffers(1, &culling.visibilityBuffer);
+
+    culling.instanceCount = 0;
+    culling.drawCount = 0;
+    culling.slotCapacity = 0;
+}
+
+void UploadCullInputs(OcclusionCulling& culling, const CullInstance* instances, u32 instanceCount, const DrawElementsIndirectCommand* draws, u32 drawCount, u32 slotCount)
+{
+    culling.instanceCount = instanceCount;
+    culling.drawCount = drawCount;
+
+    // Orphaned every frame, the previous contents may still be in use by the GPU
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, culling.instanceBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, instanceCount * sizeof(CullInstance), instances, GL_STREAM_DRAW);
+
+    const u32 drawsSize = drawCount * sizeof(DrawElementsIndirectCommand);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, culling.drawBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, drawsSize * CullPhase_Count, NULL, GL_STREAM_DRAW);
+    for (u32 phase = 0; phase < CullPhase_Count; ++phase)
+        glBufferSubData(GL_SHADER_STORAGE_BUFFER, phase * drawsSize, drawsSize, draws);
+
+    // Slots that appear for the first time start as not visible, the occlusion phase decides
+    if (slotCount > culling.slotCapacity)
+    {
+        const u32 newCapacity = glm::max(slotCount, culling.slotCapacity * 2);
+        std::vector<u32> zeros(newCapacity, 0);
+
+        GLuint newBuffer;
+        glGenBuffers(1, &newBuffer);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, newBuffer);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, newCapacity * sizeof(u32), zeros.data(), GL_DYNAMIC_COPY);
+
+        if (culling.slotCapacity > 0)
+        {
+            glBindBuffer(GL_COPY_READ_BUFFER, culling.visibilityBuffer);
+            glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_SHADER_STORAGE_BUFFER, 0, 0, culling.slotCapacity * sizeof(u32));
+            glBindBuffer(GL_COPY_READ_BUFFER, 0);
+        }
+
+        glDeleteBuffers(1, &culling.visibilityBuffer);
+        culling.visibilityBuffer = newBuffer;
+        culling.slotCapacity = newCapacity;
+    }
+
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+}
+
+void CullInstances(OcclusionCulling& culling, CullPhase phase, const glm::mat4& viewProjection, glm::ivec2 renderSize)
+{
+    if (culling.instanceCount == 0)
+        return;
+
+    // Every Hi-Z texel of level 0 covers 2x2 depth texels
+    const glm::vec2 viewportScale = glm::vec2(renderSize) / glm::vec2(culling.hiZSize * 2);
+
+    glUseProgram(culling.cullProgram);
+    glUniformMatrix4fv(glGetUniformLocation(culling.cullProgram, "uViewProjection"), 1, GL_FALSE, glm::value_ptr(viewProjection));
+    glUniform1ui(glGetUniformLocation(culling.cullProgram, "uPhase"), phase);
+    glUniform1ui(glGetUniformLocation(culling.cullProgram, "uInstanceCount"), culling.instanceCount);
+    glUniform1ui(glGetUniformLocation(culling.cullProgram, "uDrawCount"), culling.drawCount);
+    glUniform2i(glGetUniformLocation(culling.cullProgram, "uHiZSize"), culling.hiZSize.x, culling.hiZSize.y);
+    glUniform1i(glGetUniformLocation(culling.cullProgram, "uHiZMipCount"), culling.hiZMipCount);
+    glUniform2f(glGetUniformLocation(culling.cullProgram, "uViewportScale"), viewportScale.x, viewportScale.y);
+
+    glUniform1i(glGetUniformLocation(culling.cullProgram, "uHiZTexture"), 0);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, culling.hiZTexture);
+
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, culling.instanceBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, culling.drawBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, culling.visibilityBuffer);
+
+    glDispatchCompute((culling.instanceCount + CULL_GROUP_SIZE - 1) / CULL_GROUP_SIZE, 1, 1);
+
+    // The draws read the arguments, the next phase reads the visibility
+    glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_SHADER_STORAGE_BARRIER_BIT);
+
+    glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+void BuildHiZ(OcclusionCulling& culling, Downsampler& downsampler, GLuint depthTexture)
+{
+    // The depth past the render size was cleared to the far plane, the whole of it is reduced so
+    // the padding of the power of two size never holds older depth
+    DownsampleMips(downsampler, DownsampleReduction_Max, depthTexture, 0, culling.depthSize,
+                   culling.hiZTexture, DownsampleFormat_R32F, 0, culling.hiZMipCount, culling.hiZSize);
+}
+
+u32 GetIndirectDrawOffset(const OcclusionCulling& culling, CullPhase phase, u32 drawIdx)
+{
+    return (phase * culling.drawCount + drawIdx) * sizeof(DrawElementsIndirectCommand);
+}
@@ -0,0 +1,85 @@
+//
+// occlusion_culling.h: Two-phase GPU occlusion culling. The instances visible last frame are
+// drawn first, a hierarchical depth (Hi-Z) pyramid is built from that depth with a compute
+// shader, and every instance is tested against it. The ones that became visible are drawn in
+// a second pass. Both passes read their draw arguments from an indirect buffer the culling
+// shader writes, so occluded instances cost no vertex or fragment work.
+//
+// The Hi-Z starts at half the depth resolution and is rounded up to a power of two, so every
+// texel of every level covers the same square of depth texels and the single dispatch of the
+// downsampler builds it without losing the last row or column of odd levels.
+//
+
+#pragma once
+
+#include "platform.h"
+#include <glad/glad.h>
+#include "downsampler.h"
+
+enum CullPhase
+{
+    CullPhase_LastFrameVisible, // Draws what was visible last frame, no test
+    CullPhase_Occlusion,        // Tests everything against the Hi-Z, draws the newly visible
+    CullPhase_Count
+};
+
+// std430 layout, matches CullInstance in the OCCLUSION_CULLING shader
+struct CullInstance
+{
+    glm::vec4 boundsMin; // World space
+    glm::vec4 boundsMax;
+    u32       slot;      // Persistent id, indexes the visibility buffer across frames
+    u32       firstDraw;
+    u32       drawCount;
+    u32       padding;
+};
+
+// Layout fixed by glDrawElementsIndirect
+struct DrawElementsIndirectCommand
+{
+    u32 count;
+    u32 instanceCount; // Written by the culling shader, 0 or 1
+    u32 firstIndex;
+    u32 baseVertex;
+    u32 baseInstance;
+};
+
+struct OcclusionCulling
+{
+    GLuint     cullProgram;
+
+    // R32F with a full mip chain, every texel is the furthest depth below it
+    GLuint     hiZTexture;
+    glm::ivec2 hiZSize;   // Of level 0, which covers twice as many depth texels
+    glm::ivec2 depthSize;
+    u32        hiZMipCount;
+
+    GLuint     instanceBuffer;
+    GLuint     drawBuffer;       // CullPhase_Count copies of the draws, one after the other
+    GLuint     visibilityBuffer; // One u32 per slot, survives between frames
+    u32        instanceCount;
+    u32        drawCount;
+    u32        slotCapacity;
+};
+
+void InitOcclusionCulling(OcclusionCulling& culling, GLuint cullProgram, glm::ivec2 depthSize);
+
+/**
+ * Uploads this frame's instances and draw arguments. slotCount is one past the highest slot
+ * any instance uses.
+ */
+void UploadCullInputs(OcclusionCulling& culling, const CullInstance* instances, u32 instanceCount, const DrawElementsIndirectCommand* draws, u32 drawCount, u32 slotCount);
+
+/**
+ * Writes the instance counts of the draws of the given phase. The occlusion phase needs
+ * BuildHiZ() to have run on the depth of the first phase.
+ * renderSize is the corner of the depth the frame was rendered to.
+ */
+void CullInstances(OcclusionCulling& culling, CullPhase phase, const glm::mat4& viewProjection, glm::ivec2 renderSize);
+
+void BuildHiZ(OcclusionCulling& culling, Downsampler& downsampler, GLuint depthTexture);
+
+/**
+ * Byte offset, inside drawBuffer, of the arguments of a draw for the given phase.
+ */
+u32 GetIndirectDrawOffset(const OcclusionCulling& culling, CullPhase phase, u32 drawIdx);
@@ -16,9 +16,12 @@
 #endif
 
 #include "engine.h"
+#include "job_system.h"
+#include "render_thread.h"
 
 #include <GLFW/glfw3.h>
 #include <stdio.h>
+#include <thread>
 #include <imgui.h>
 #include <imgui_impl_glfw.h>
 #include <imgui_impl_opengl3.h>
@@ -114,6 +117,34 @@ void OnGlfwCloseWindow(GLFWwindow* window)
     app->isRunning = false;
 }
 
+// Owns the GL context from the end of Init() until shutdown. Consumes the frames produced by
+// the main thread in order and presents them.
+void RenderThreadMain(GLFWwindow* window, App* app, RenderFrameQueue* queue)
+{
+    glfwMakeContextCurrent(window);
+    SetGLThread();
+
+    while (RenderFrame* frame = WaitRenderFrame(*queue))
+    {
+        // Jobs that needed the GL context (e.g. uploads of resources loaded in the background)
+        ExecuteGLJobs();
+
+        // Render
+        Render(app, frame->packet);
+
+        // ImGui Render
+        ImGui_ImplOpenGL3_RenderDrawData(&frame->guiDrawData);
+
+        // Present image on screen
+        glfwSwapBuffers(window);
+
+        ReleaseRenderFrame(*queue);
+    }
+
+    ExecuteGLJobs();
+    glfwMakeContextCurrent(NULL);
+}
+
 int main()
 {
     ShowWindow(GetConsoleWindow(), SW_HIDE);
@@ -169,7 +200,7 @@ int main()
     io.ConfigFlags |= ImGuiConfigFlags_NavEnableKeyboard;       // Enable Keyboard Controls
     //io.ConfigFlags |= ImGuiConfigFlags_NavEnableGamepad;      // Enable Gamepad Controls
     io.ConfigFlags |= ImGuiConfigFlags_DockingEnable;           // Enable Docking
-    io.ConfigFlags |= ImGuiConfigFlags_ViewportsEnable;         // Enable Multi-Viewport / Platform Windows
+    //io.ConfigFlags |= ImGuiConfigFlags_ViewportsEnable;       // Enable Multi-Viewport / Platform Windows (needs the GL context on the main thread)
     //io.ConfigViewportsNoAutoMerge = true;
     //io.ConfigViewportsNoTaskBarIcon = true;
 
@@ -201,8 +232,20 @@ int main()
 
     GlobalFrameArenaMemory = (u8*)malloc(GLOBAL_FRAME_ARENA_SIZE);
 
+    InitJobSystem();
+    SetGLThread();
+
     Init(&app);
 
+    // ImGui creates its GL objects lazily, make it do so while the main thread still has the context
+    ImGui_ImplOpenGL3_NewFrame();
+
+    RenderFrameQueue* renderQueue = new RenderFrameQueue();
+    renderQueue->framesInFlight = app.maxFramesInFlight;
+
+    glfwMakeContextCurrent(NULL);
+    std::thread renderThread(RenderThreadMain, window, &app, renderQueue);
+
     while (app.isRunning)
     {
         // Tell GLFW to call platform callbacks
@@ -224,8 +267,11 @@ int main()
             for (u32 i = 0; i < MOUSE_BUTTON_COUNT; ++i)
                 app.input.mouseButtons[i] = BUTTON_IDLE;
 
-        // Update
-        Update(&app);
+        // Update, which leaves the frame ready for the render thread
+        RenderFrame* frame = AcquireRenderFrame(*renderQueue);
+        Update(&app, frame->packet);
+        CopyGuiDrawData(*frame, ImGui::GetDrawData());
+        SubmitRenderFrame(*renderQueue);
 
         // Transition input key/button states
         if (!ImGui::GetIO().WantCaptureKeyboard)
@@ -240,21 +286,6 @@ int main()
 
         app.input.mouseDelta = glm::vec2(0.0f, 0.0f);
 
-        // Render
-        Render(&app);
-
-        // ImGui Render
-        ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
-        if (io.ConfigFlags & ImGuiConfigFlags_ViewportsEnable) {
-            GLFWwindow* backup_current_context = glfwGetCurrentContext();
-            ImGui::UpdatePlatformWindows();
-            ImGui::RenderPlatformWindowsDefault();
-            glfwMakeContextCurrent(backup_current_context);
-        }
-
-        // Present image on screen
-        glfwSwapBuffers(window);
-
         // Frame time
         f64 currentFrameTime = glfwGetTime();
         app.deltaTime = (f32)(currentFrameTime - lastFrameTime);
@@ -264,6 +295,16 @@ int main()
         GlobalFrameArenaHead = 0;
     }
 
+    StopRenderFrameQueue(*renderQueue);
+    renderThread.join();
+    glfwMakeContextCurrent(window);
+
+    for (u32 i = 0; i < MAX_FRAMES_IN_FLIGHT; ++i)
+        FreeGuiDrawData(renderQueue->frames[i]);
+    delete renderQueue;
+
+    ShutdownJobSystem();
+
     free(GlobalFrameArenaMemory);
 
     ImGui_ImplOpenGL3_Shutdown();
@@ -0,0 +1,364 @@
+#include "point_shadows.h"
+#include "buffer_manager.h"
+#include <algorithm>
+
+// Same order and orientation as the GL cube map faces, and as the POINT_SHADOW_DEPTH shaders
+static const glm::vec3 faceForwards[6] = { { 1, 0, 0 }, { -1, 0, 0 }, { 0, 1, 0 }, { 0, -1, 0 }, { 0, 0, 1 }, { 0, 0, -1 } };
+static const glm::vec3 faceUps[6]      = { { 0, -1, 0 }, { 0, -1, 0 }, { 0, 0, 1 }, { 0, 0, -1 }, { 0, -1, 0 }, { 0, -1, 0 } };
+
+static u32 GetAtlasLevel(const ShadowAtlas& atlas, u32 tileSize)
+{
+    u32 level = 0;
+    while ((atlas.size >> level) > tileSize)
+        level++;
+    return level;
+}
+
+void InitShadowAtlas(ShadowAtlas& atlas, u32 size, u32 minTile)
+{
+    ASSERT(IsPowerOf2(size) && IsPowerOf2(minTile), "Atlas and tile sizes must be powers of 2");
+
+    atlas.size = size;
+    atlas.minTile = minTile;
+    atlas.freeTiles.clear();
+    atlas.freeTiles.resize(GetAtlasLevel(atlas, minTile) + 1);
+    atlas.freeTiles[0].push_back(glm::uvec2(0));
+}
+
+bool AllocateShadowTile(ShadowAtlas& atlas, u32 tileSize, glm::uvec2& origin)
+{
+    const u32 level = GetAtlasLevel(atlas, tileSize);
+    ASSERT(level < atlas.freeTiles.size(), "Tile smaller than the atlas minimum");
+
+    // Smallest free tile that is big enough
+    i32 found = level;
+    while (found >= 0 && atlas.freeTiles[found].empty())
+        found--;
+
+    if (found < 0)
+        return false;
+
+    origin = atlas.freeTiles[found].back();
+    atlas.freeTiles[found].pop_back();
+
+    // Split it down to the requested size, the first quarter is kept every time
+    for (u32 l = found + 1; l <= level; ++l)
+    {
+        const u32 half = atlas.size >> l;
+        atlas.freeTiles[l].push_back(origin + glm::uvec2(half, 0));
+        atlas.freeTiles[l].push_back(origin + glm::uvec2(0, half));
+        atlas.freeTiles[l].push_back(origin + glm::uvec2(half, half));
+    }
+
+    return true;
+}
+
+static bool TakeFreeTile(std::vector<glm::uvec2>& freeTiles, glm::uvec2 origin)
+{
+    for (u32 i = 0; i < freeTiles.size(); ++i)
+    {
+        if (freeTiles[i] == origin)
+        {
+            freeTiles[i] = freeTiles.back();
+            freeTiles.pop_back();
+            return true;
+        }
+    }
+    return false;
+}
+
+void FreeShadowTile(ShadowAtlas& atlas, u32 tileSize, glm::uvec2 origin)
+{
+    u32 level = GetAtlasLevel(atlas, tileSize);
+
+    // Merge back with the three siblings while all of them are free
+    while (level > 0)
+    {
+        const u32 size = atlas.size >> level;
+        const glm::uvec2 parent = origin - origin % (2u * size);
+
+        glm::uvec2 siblings[3];
+        u32 siblingCount = 0;
+        for (u32 i = 0; i < 4; ++i)
+        {
+            const glm::uvec2 child = parent + glm::uvec2((i & 1) * size, (i >> 1) * size);
+            if (child != origin)
+                siblings[siblingCount++] = child;
+        }
+
+        std::vector<glm::uvec2>& freeTiles = atlas.freeTiles[level];
+        u32 taken = 0;
+        while (taken < 3 && TakeFreeTile(freeTiles, siblings[taken]))
+            taken++;
+
+        if (taken < 3)
+        {
+            for (u32 i = 0; i < taken; ++i)
+                freeTiles.push_back(siblings[i]);
+            break;
+        }
+
+        origin = parent;
+        level--;
+    }
+
+    atlas.freeTiles[level].push_back(origin);
+}
+
+glm::mat4 GetPointShadowFaceViewProjection(const glm::vec3& position, f32 radius, u32 face)
+{
+    const glm::mat4 projection = glm::perspective(glm::radians(90.0f), 1.0f, POINT_SHADOW_NEAR, radius);
+    return projection * glm::lookAt(position, position + faceForwards[face], faceUps[face]);
+}
+
+f32 GetPointShadowImportance(const glm::vec3& cameraPos, f32 tanHalfFovY, f32 screenHeight, const glm::vec3& position, f32 radius)
+{
+    const glm::vec3 toLight = position - cameraPos;
+    const f32 distanceSq = glm::dot(toLight, toLight);
+    if (distanceSq <= radius * radius)
+        return screenHeight;
+
+    return radius / sqrtf(distanceSq - radius * radius) / tanHalfFovY * screenHeight * 0.5f;
+}
+
+static void ReleasePointShadowTiles(ShadowAtlas& atlas, PointShadow& shadow)
+{
+    for (u32 f = 0; f < 6; ++f)
+        FreeShadowTile(atlas, shadow.tileSize, shadow.tiles[f]);
+
+    shadow.tileSize = 0;
+    shadow.validFaces = 0;
+    shadow.dirtyFaces = 0;
+}
+
+static bool AllocatePointShadowTiles(ShadowAtlas& atlas, PointShadow& shadow, u32 tileSize)
+{
+    for (u32 f = 0; f < 6; ++f)
+    {
+        if (!AllocateShadowTile(atlas, tileSize, shadow.tiles[f]))
+        {
+            for (u32 i = 0; i < f; ++i)
+                FreeShadowTile(atlas, tileSize, shadow.tiles[i]);
+            return false;
+        }
+    }
+
+    shadow.tileSize = tileSize;
+    shadow.validFaces = 0;
+    shadow.dirtyFaces = 0;
+    return true;
+}
+
+// The shadow with tiles that was used the longest ago, and not this frame
+static i32 FindEvictableShadow(const PointShadows& shadows)
+{
+    i32 oldest = -1;
+    for (u32 i = 0; i < shadows.shadows.size(); ++i)
+    {
+        const PointShadow& shadow = shadows.shadows[i];
+        if (shadow.tileSize == 0 || shadow.lastUsedFrame == shadows.frame)
+            continue;
+
+        if (oldest < 0 || shadow.lastUsedFrame < shadows.shadows[oldest].lastUsedFrame)
+            oldest = i;
+    }
+    return oldest;
+}
+
+void AssignPointShadowTiles(PointShadows& shadows, const u32* lights, const glm::vec3* positions, const f32* radii, const f32* importances, u32 count, u32* shadowIndices)
+{
+    shadows.frame++;
+
+    std::vector<u32> tileSizes(count);
+    u64 requestedArea = 0;
+    for (u32 k = 0; k < count; ++k)
+    {
+        tileSizes[k] = POINT_SHADOW_MIN_TILE;
+        while (tileSizes[k] < importances[k] && tileSizes[k] < POINT_SHADOW_MAX_TILE)
+            tileSizes[k] *= 2;
+        requestedArea += 6 * (u64)tileSizes[k] * tileSizes[k];
+    }
+
+    // When everything does not fit, the least important lights shrink first
+    const u64 atlasArea = (u64)shadows.atlas.size * shadows.atlas.size;
+    bool shrunk = true;
+    while (requestedArea > atlasArea && shrunk)
+    {
+        shrunk = false;
+        for (i32 k = count - 1; k >= 0 && requestedArea > atlasArea; --k)
+        {
+            if (tileSizes[k] > POINT_SHADOW_MIN_TILE)
+            {
+                requestedArea -= 6 * (u64)tileSizes[k] * tileSizes[k] * 3 / 4;
+                tileSizes[k] /= 2;
+                shrunk = true;
+            }
+        }
+    }
+
+    for (u32 k = 0; k < count; ++k)
+    {
+        u32 idx = 0;
+        while (idx < shadows.shadows.size() && shadows.shadows[idx].light != lights[k])
+            idx++;
+
+        if (idx == shadows.shadows.size())
+        {
+            PointShadow shadow = {};
+            shadow.light = lights[k];
+            shadow.position = positions[k];
+            shadow.radius = radii[k];
+            shadows.shadows.push_back(shadow);
+        }
+
+        PointShadow& shadow = shadows.shadows[idx];
+        shadow.importance = importances[k];
+        shadow.lastUsedFrame = shadows.frame;
+
+        if (shadow.position != positions[k] || shadow.radius != radii[k])
+        {
+            shadow.position = positions[k];
+            shadow.radius = radii[k];
+            shadow.dirtyFaces = 0x3F;
+        }
+
+        u32 tileSize = tileSizes[k];
+
+        // Grows right away but only shrinks when four times too big, so it does not flicker
+        // between two sizes
+        if (shadow.tileSize != 0 && (tileSize > shadow.tileSize || tileSize * 4 <= shadow.tileSize))
+            ReleasePointShadowTiles(shadows.atlas, shadow);
+
+        while (shadow.tileSize == 0 && tileSize >= POINT_SHADOW_MIN_TILE)
+        {
+            if (AllocatePointShadowTiles(shadows.atlas, shadow, tileSize))
+                break;
+
+            const i32 evicted = FindEvictableShadow(shadows);
+            if (evicted >= 0)
+                ReleasePointShadowTiles(shadows.atlas, shadows.shadows[evicted]);
+            else
+                tileSize /= 2;
+        }
+    }
+
+    // Entries without tiles are only worth keeping while their light is in use
+    u32 kept = 0;
+    for (u32 i = 0; i < shadows.shadows.size(); ++i)
+        if (shadows.shadows[i].tileSize != 0 || shadows.shadows[i].lastUsedFrame == shadows.frame)
+            shadows.shadows[kept++] = shadows.shadows[i];
+    shadows.shadows.resize(kept);
+
+    for (u32 k = 0; k < count; ++k)
+    {
+        shadowIndices[k] = UINT32_MAX;
+        for (u32 i = 0; i < shadows.shadows.size(); ++i)
+            if (shadows.shadows[i].light == lights[k] && shadows.shadows[i].tileSize != 0)
+                shadowIndices[k] = i;
+    }
+}
+
+void InvalidatePointShadowFaces(PointShadow& shadow, const AABB& bounds)
+{
+    if (!SphereIntersectsAABB(shadow.position, shadow.radius, bounds))
+        return;
+
+    for (u32 f = 0; f < 6; ++f)
+    {
+        const Frustum frustum = ExtractFrustum(GetPointShadowFaceViewProjection(shadow.position, shadow.radius, f));
+        if (FrustumIntersectsAABB(frustum, bounds))
+            shadow.dirtyFaces |= 1 << f;
+    }
+}
+
+void SelectPointShadowFaces(PointShadows& shadows, u32 budget, std::vector<u8>& faceMasks)
+{
+    struct FaceCandidate
+    {
+        u32  shadow;
+        u32  face;
+        bool moved;
+        f32  importance;
+    };
+
+    std::vector<FaceCandidate> candidates;
+    for (u32 i = 0; i < shadows.shadows.size(); ++i)
+    {
+        const PointShadow& shadow = shadows.shadows[i];
+        if (shadow.tileSize == 0 || shadow.lastUsedFrame != shadows.frame)
+            continue;
+
+        for (u32 f = 0; f < 6; ++f)
+        {
+            const u8 bit = 1 << f;
+            if ((shadow.dirtyFaces & bit) || !(shadow.validFaces & bit))
+                candidates.push_back({ i, f, (shadow.dirtyFaces & bit) != 0, shadow.importance });
+        }
+    }
+
+    const u32 selected = glm::min(budget, (u32)candidates.size());
+    std::partial_sort(candidates.begin(), candidates.begin() + selected, candidates.end(), [](const FaceCandidate& a, const FaceCandidate& b) {
+        if (a.moved != b.moved)
+            return a.moved;
+        return a.importance > b.importance;
+    });
+
+    faceMasks.assign(shadows.shadows.size(), 0);
+    for (u32 i = 0; i < selected; ++i)
+    {
+        PointShadow& shadow = shadows.shadows[candidates[i].shadow];
+        const u8 bit = 1 << candidates[i].face;
+        faceMasks[candidates[i].shadow] |= bit;
+        shadow.validFaces |= bit;
+        shadow.dirtyFaces &= ~bit;
+    }
+}
+
+void InitPointShadowMaps(PointShadowMaps& maps, GLuint depthProgram)
+{
+    maps.depthProgram = depthProgram;
+
+    glGenTextures(1, &maps.atlasTexture);
+    glBindTexture(GL_TEXTURE_2D, maps.atlasTexture);
+    glTexStorage2D(GL_TEXTURE_2D, 1, GL_DEPTH_COMPONENT32F, POINT_SHADOW_ATLAS_SIZE, POINT_SHADOW_ATLAS_SIZE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    glGenFramebuffers(1, &maps.framebuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, maps.framebuffer);
+    glFramebufferTexture(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, maps.atlasTexture, 0);
+    glDrawBuffer(GL_NONE);
+    glReadBuffer(GL_NONE);
+
+    // Unused tiles read as unshadowed
+    glClear(GL_DEPTH_BUFFER_BIT);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+void BeginPointShadowFaces(PointShadowMaps& maps, const PointShadowView& view, u8 faceMask)
+{
+    const GLsizei size = view.tileSize;
+
+    glBindFramebuffer(GL_FRAMEBUFFER, maps.framebuffer);
+
+    // glClear() only looks at the first scissor box
+    for (u32 f = 0; f < 6; ++f)
+    {
+        if (faceMask & (1 << f))
+        {
+            glScissorIndexed(0, view.tiles[f].x, view.tiles[f].y, size, size);
+            glClear(GL_DEPTH_BUFFER_BIT);
+        }
+    }
+
+    for (u32 f = 0; f < 6; ++f)
+    {
+        glViewportIndexedf(f, (f32)view.tiles[f].x, (f32)view.tiles[f].y, (f32)size, (f32)size);
+        glScissorIndexed(f, view.tiles[f].x, view.tiles[f].y, size, size);
+    }
+}
@@ -0,0 +1,122 @@
+//
+// point_shadows.h: Shadows for point lights, kept in the tiles of a single depth atlas. Every
+// shadowed light gets six square tiles, one per cube face, as big as the light is important on
+// screen. A geometry shader sends every caster triangle to all the faces of the light being
+// updated, through the viewport array, so a light costs one pass however many faces it needs.
+//
+// Faces are cached in the atlas. Only POINT_SHADOW_FACE_BUDGET of them are rendered per frame,
+// the ones whose casters moved first, so the cost follows the budget and not the light count.
+//
+
+#pragma once
+
+#include "platform.h"
+#include "bounds.h"
+#include <glad/glad.h>
+
+#define POINT_SHADOW_ATLAS_SIZE  4096
+#define POINT_SHADOW_MIN_TILE    64
+#define POINT_SHADOW_MAX_TILE    512
+#define POINT_SHADOW_MAX_LIGHTS  32 // Shadowed in the same frame, the shaders have it hardcoded too
+#define POINT_SHADOW_FACE_BUDGET 12 // Faces rendered per frame
+#define POINT_SHADOW_NEAR        0.05f
+
+// Power of two square tiles, split from and merged back into bigger ones like a buddy allocator
+struct ShadowAtlas
+{
+    u32 size;
+    u32 minTile;
+    std::vector<std::vector<glm::uvec2>> freeTiles; // Per level, level 0 is the whole atlas
+};
+
+struct PointShadow
+{
+    u32        light;      // Index in App::lights
+    glm::vec3  position;
+    f32        radius;     // Far plane of the faces
+    u32        tileSize;   // Texels, 0 while it has no tiles
+    glm::uvec2 tiles[6];   // Origin of every face in the atlas
+    u8         validFaces; // Rendered since the tiles were assigned
+    u8         dirtyFaces; // A caster moved inside the face since it was rendered
+    f32        importance; // Projected radius in pixels
+    u64        lastUsedFrame;
+};
+
+// Main thread side
+struct PointShadows
+{
+    ShadowAtlas              atlas;
+    std::vector<PointShadow> shadows; // Lights keep their tiles until the space is needed
+    u64                      frame = 0;
+};
+
+// What the lighting needs from one shadowed light
+struct PointShadowView
+{
+    u32        light; // Index in RenderPacket::lights
+    glm::vec3  position;
+    f32        radius;
+    u32        tileSize;
+    glm::uvec2 tiles[6];
+    u8         validFaces;
+};
+
+// Faces of one light rendered this frame
+struct PointShadowUpdate
+{
+    u32              view;     // Index in RenderPacket::pointShadows
+    u8               faceMask;
+    std::vector<u32> casters;  // Into RenderPacket::shadowCasters
+};
+
+void InitShadowAtlas(ShadowAtlas& atlas, u32 size, u32 minTile);
+
+bool AllocateShadowTile(ShadowAtlas& atlas, u32 tileSize, glm::uvec2& origin);
+
+void FreeShadowTile(ShadowAtlas& atlas, u32 tileSize, glm::uvec2 origin);
+
+/**
+ * Cube face view projection, with the same face orientations as GL cube maps. The shaders
+ * rebuild it from the face vectors, keep them in sync.
+ */
+glm::mat4 GetPointShadowFaceViewProjection(const glm::vec3& position, f32 radius, u32 face);
+
+/**
+ * Projected radius, in pixels, of the light sphere on a screen of the given height.
+ */
+f32 GetPointShadowImportance(const glm::vec3& cameraPos, f32 tanHalfFovY, f32 screenHeight, const glm::vec3& position, f32 radius);
+
+/**
+ * Makes sure the count lights, sorted from the most important, have tiles of the size they
+ * deserve, evicting the lights that were not used for the longest when the atlas is full.
+ * Lights that still do not fit get no shadow. Returns the shadow index of every light,
+ * UINT32_MAX for none.
+ */
+void AssignPointShadowTiles(PointShadows& shadows, const u32* lights, const glm::vec3* positions, const f32* radii, const f32* importances, u32 count, u32* shadowIndices);
+
+/**
+ * Marks the faces of the shadow whose frustum touches the box as needing a re-render.
+ */
+void InvalidatePointShadowFaces(PointShadow& shadow, const AABB& bounds);
+
+/**
+ * Picks at most budget faces among the shadows used this frame, the ones with moved casters
+ * first and then the never rendered ones, each group by importance. The picked faces are
+ * considered rendered from now on. faceMasks gets a bit per picked face for every shadow.
+ */
+void SelectPointShadowFaces(PointShadows& shadows, u32 budget, std::vector<u8>& faceMasks);
+
+struct PointShadowMaps
+{
+    GLuint depthProgram; // Vertex, geometry and fragment, see POINT_SHADOW_DEPTH
+    GLuint atlasTexture;
+    GLuint framebuffer;
+};
+
+void InitPointShadowMaps(PointShadowMaps& maps, GLuint depthProgram);
+
+/**
+ * Binds the atlas framebuffer, clears the faces in faceMask and points the viewports 0 to 5,
+ * and their scissors, at the tiles. The scissor test must already be enabled.
+ */
+void BeginPointShadowFaces(PointShadowMaps& maps, const PointShadowView& view, u8 faceMask);
@@ -0,0 +1,74 @@
+#include "render_thread.h"
+
+RenderFrame* AcquireRenderFrame(RenderFrameQueue& queue)
+{
+    ASSERT(queue.framesInFlight > 0 && queue.framesInFlight <= MAX_FRAMES_IN_FLIGHT, "Invalid number of frames in flight");
+
+    std::unique_lock<std::mutex> lock(queue.lock);
+    queue.changed.wait(lock, [&] { return queue.submitted - queue.consumed < queue.framesInFlight; });
+    return &queue.frames[queue.submitted % queue.framesInFlight];
+}
+
+void SubmitRenderFrame(RenderFrameQueue& queue)
+{
+    {
+        std::lock_guard<std::mutex> guard(queue.lock);
+        queue.submitted++;
+    }
+    queue.changed.notify_all();
+}
+
+RenderFrame* WaitRenderFrame(RenderFrameQueue& queue)
+{
+    std::unique_lock<std::mutex> lock(queue.lock);
+    queue.changed.wait(lock, [&] { return queue.consumed < queue.submitted || queue.stopped; });
+
+    if (queue.consumed == queue.submitted)
+        return NULL;
+
+    return &queue.frames[queue.consumed % queue.framesInFlight];
+}
+
+void ReleaseRenderFrame(RenderFrameQueue& queue)
+{
+    {
+        std::lock_guard<std::mutex> guard(queue.lock);
+        queue.consumed++;
+    }
+    queue.changed.notify_all();
+}
+
+void StopRenderFrameQueue(RenderFrameQueue& queue)
+{
+    {
+        std::lock_guard<std::mutex> guard(queue.lock);
+        queue.stopped = true;
+    }
+    queue.changed.notify_all();
+}
+
+void CopyGuiDrawData(RenderFrame& frame, const ImDrawData* drawData)
+{
+    FreeGuiDrawData(frame);
+
+    frame.guiDrawData = *drawData;
+
+    if (!drawData->Valid)
+        return;
+
+    frame.guiDrawLists.resize(drawData->CmdListsCount);
+    for (int i = 0; i < drawData->CmdListsCount; ++i)
+        frame.guiDrawLists[i] = drawData->CmdLists[i]->CloneOutput();
+
+    frame.guiDrawData.CmdLists = frame.guiDrawLists.data();
+    frame.guiDrawData.OwnerViewport = NULL;
+}
+
+void FreeGuiDrawData(RenderFrame& frame)
+{
+    for (u32 i = 0; i < frame.guiDrawLists.size(); ++i)
+        IM_DELETE(frame.guiDrawLists[i]);
+
+    frame.guiDrawLists.clear();
+    frame.guiDrawData.Clear();
+}
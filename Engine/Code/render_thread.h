@@ -0,0 +1,58 @@
+//
+// render_thread.h: Hand-off between the simulation (main) thread and the thread that owns the
+// GL context. The main thread fills a RenderFrame per frame and the render thread consumes
+// them in order, so Update() of frame N+1 overlaps with the GL submission of frame N.
+//
+
+#pragma once
+
+#include "engine.h"
+#include <imgui.h>
+#include <mutex>
+#include <condition_variable>
+
+#define MAX_FRAMES_IN_FLIGHT 3
+
+struct RenderFrame
+{
+    RenderPacket packet;
+
+    // Copy of the ImGui draw data, ImGui reuses its own lists as soon as the next frame starts
+    ImDrawData               guiDrawData;
+    std::vector<ImDrawList*> guiDrawLists;
+};
+
+struct RenderFrameQueue
+{
+    RenderFrame frames[MAX_FRAMES_IN_FLIGHT];
+    u32 framesInFlight = 2;
+
+    u64  submitted = 0;
+    u64  consumed = 0;
+    bool stopped = false;
+
+    std::mutex              lock;
+    std::condition_variable changed;
+};
+
+/**
+ * Main thread: returns the next frame to fill, blocking while the render thread is already
+ * framesInFlight frames behind.
+ */
+RenderFrame* AcquireRenderFrame(RenderFrameQueue& queue);
+
+void SubmitRenderFrame(RenderFrameQueue& queue);
+
+/**
+ * Render thread: returns the oldest submitted frame, or NULL once the queue was stopped and
+ * every submitted frame has been consumed.
+ */
+RenderFrame* WaitRenderFrame(RenderFrameQueue& queue);
+
+void ReleaseRenderFrame(RenderFrameQueue& queue);
+
+void StopRenderFrameQueue(RenderFrameQueue& queue);
+
+void CopyGuiDrawData(RenderFrame& frame, const ImDrawData* drawData);
+
+void FreeGuiDrawData(RenderFrame& frame);
@@ -0,0 +1,114 @@
+#include "shader_source.h"
+
+static const char* ShaderFeatureNames[] =
+{
+    "FEATURE_DIRECTIONAL_LIGHTS",
+    "FEATURE_POINT_LIGHTS",
+    "FEATURE_SHADOWS",
+    "FEATURE_TILED_LIGHTS",
+};
+
+// Does not use ReadTextFile(), variants are built on the render thread and the temporary
+// memory belongs to the main thread
+static bool ReadShaderFile(const std::string& filepath, std::string& text)
+{
+    FILE* file = fopen(filepath.c_str(), "rb");
+    if (!file)
+        return false;
+
+    fseek(file, 0, SEEK_END);
+    text.resize(ftell(file));
+    fseek(file, 0, SEEK_SET);
+    fread(&text[0], sizeof(char), text.size(), file);
+    fclose(file);
+    return true;
+}
+
+// #include "path", with any spacing around the tokens
+static bool ParseInclude(const std::string& text, size_t begin, size_t end, std::string& path)
+{
+    size_t i = begin;
+    while (i < end && (text[i] == ' ' || text[i] == '\t')) ++i;
+    if (i == end || text[i++] != '#')
+        return false;
+    while (i < end && (text[i] == ' ' || text[i] == '\t')) ++i;
+    if (text.compare(i, 7, "include") != 0)
+        return false;
+    i += 7;
+    while (i < end && (text[i] == ' ' || text[i] == '\t')) ++i;
+    if (i == end || text[i++] != '"')
+        return false;
+
+    const size_t close = text.find('"', i);
+    if (close == std::string::npos || close >= end)
+        return false;
+
+    path = text.substr(i, close - i);
+    return true;
+}
+
+static bool ExpandIncludes(const std::string& filepath, u32 depth, std::vector<std::string>& files, std::string& output)
+{
+    if (depth > MAX_SHADER_INCLUDE_DEPTH)
+    {
+        ELOG("Shader includes nested too deep at %s, does it include itself?", filepath.c_str());
+        return false;
+    }
+
+    std::string text;
+    if (!ReadShaderFile(filepath, text))
+    {
+        ELOG("fopen() failed reading shader %s", filepath.c_str());
+        return false;
+    }
+
+    const u32 fileIdx = files.size();
+    files.push_back(filepath);
+
+    const size_t slash = filepath.find_last_of("/\\");
+    const std::string directory = slash == std::string::npos ? std::string() : filepath.substr(0, slash + 1);
+
+    output += "#line 1 " + std::to_string(fileIdx) + "\n";
+
+    u32 lineNumber = 1;
+    for (size_t lineStart = 0; lineStart < text.size(); ++lineNumber)
+    {
+        size_t lineEnd = text.find('\n', lineStart);
+        if (lineEnd == std::string::npos)
+            lineEnd = text.size();
+
+        std::string includePath;
+        if (ParseInclude(text, lineStart, lineEnd, includePath))
+        {
+            if (!ExpandIncludes(directory + includePath, depth + 1, files, output))
+                return false;
+            output += "#line " + std::to_string(lineNumber + 1) + " " + std::to_string(fileIdx) + "\n";
+        }
+        else
+        {
+            output.append(text, lineStart, lineEnd - lineStart);
+            output += '\n';
+        }
+
+        lineStart = lineEnd + 1;
+    }
+
+    return true;
+}
+
+std::string PreprocessShaderSource(const char* filepath, std::vector<std::string>& files)
+{
+    std::string output;
+    if (!ExpandIncludes(filepath, 0, files, output))
+        output.clear();
+    return output;
+}
+
+std::string GetShaderFeatureDefines(u32 features)
+{
+    std::string defines;
+    for (u32 i = 0; i < ARRAY_COUNT(ShaderFeatureNames); ++i)
+        if (features & (1u << i))
+            defines += std::string("#define ") + ShaderFeatureNames[i] + "\n";
+    return defines;
+}
@@ -0,0 +1,35 @@
+//
+// shader_source.h: Front-end for the GLSL sources. It expands #include "file" directives,
+// relative to the file that includes them, and turns a bitmask of feature flags into the
+// defines a program variant is compiled with. The shaders test the flags with #ifdef to leave
+// out what a variant does not need.
+//
+
+#pragma once
+
+#include "platform.h"
+#include <string>
+#include <vector>
+
+#define MAX_SHADER_INCLUDE_DEPTH 16
+
+enum ShaderFeature
+{
+    ShaderFeature_DirectionalLights = 1 << 0, // FEATURE_DIRECTIONAL_LIGHTS
+    ShaderFeature_PointLights       = 1 << 1, // FEATURE_POINT_LIGHTS
+    ShaderFeature_Shadows           = 1 << 2, // FEATURE_SHADOWS
+    ShaderFeature_TiledLights       = 1 << 3, // FEATURE_TILED_LIGHTS, point lights from the Forward+ tile lists
+    ShaderFeature_All               = (1 << 4) - 1
+};
+
+/**
+ * Contents of the file with every include expanded, empty if some file could not be read.
+ * #line directives keep the compiler messages pointing at the right lines; the source string
+ * number they report is the index of the file in files.
+ */
+std::string PreprocessShaderSource(const char* filepath, std::vector<std::string>& files);
+
+/**
+ * A "#define FEATURE_..." line for every feature in the mask.
+ */
+std::string GetShaderFeatureDefines(u32 features);
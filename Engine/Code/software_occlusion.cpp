@@ -0,0 +1,372 @@
+#include "software_occlusion.h"
+#include "job_system.h"
+#include <float.h>
+#include <algorithm>
+#include <unordered_map>
+
+#if defined(_M_X64) || defined(__x86_64__)
+#define SOFTWARE_OCCLUSION_SIMD
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#define TARGET_AVX2
+#else
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#endif
+
+#define RASTER_BAND_HEIGHT 16
+
+static bool CPUSupportsAVX2()
+{
+#if defined(SOFTWARE_OCCLUSION_SIMD) && defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 1);
+    const bool osSavesYMM = (info[2] & (1 << 27)) && (_xgetbv(0) & 6) == 6;
+    if (!osSavesYMM)
+        return false;
+    __cpuidex(info, 7, 0);
+    return (info[1] & (1 << 5)) != 0;
+#elif defined(SOFTWARE_OCCLUSION_SIMD)
+    return __builtin_cpu_supports("avx2");
+#else
+    return false;
+#endif
+}
+
+void SimplifyOccluder(const float* vertices, u32 floatStride, u32 vertexCount, const u32* indices, u32 indexCount, u32 maxTriangles, OccluderMesh& occluder)
+{
+    occluder.vertices.clear();
+    occluder.indices.clear();
+    if (vertexCount == 0)
+        return;
+
+    auto position = [&](u32 vertex) {
+        return glm::vec3(vertices[vertex * floatStride], vertices[vertex * floatStride + 1], vertices[vertex * floatStride + 2]);
+    };
+
+    std::vector<std::pair<f32, u32>> triangleAreas; // Twice the area, first index
+    triangleAreas.reserve(indexCount / 3);
+    for (u32 i = 0; i + 2 < indexCount; i += 3)
+    {
+        const glm::vec3 p0 = position(indices[i]);
+        const f32 area = glm::length(glm::cross(position(indices[i + 1]) - p0, position(indices[i + 2]) - p0));
+        if (area > FLT_EPSILON)
+            triangleAreas.push_back(std::make_pair(area, i));
+    }
+
+    // The largest triangles occlude the most for their cost. Moving vertices, as clustering or
+    // collapsing edges does, can push a surface out of the mesh where it is concave or thin and
+    // cull what is visible, a subset of the triangles as they are only ever covers less.
+    if (triangleAreas.size() > maxTriangles)
+    {
+        std::nth_element(triangleAreas.begin(), triangleAreas.begin() + maxTriangles, triangleAreas.end(),
+                         [](const std::pair<f32, u32>& a, const std::pair<f32, u32>& b) { return a.first > b.first; });
+        triangleAreas.resize(maxTriangles);
+    }
+
+    // Back in mesh order, so the kept vertices are close to the order they had
+    std::sort(triangleAreas.begin(), triangleAreas.end(),
+              [](const std::pair<f32, u32>& a, const std::pair<f32, u32>& b) { return a.second < b.second; });
+
+    std::unordered_map<u32, u32> vertexRemap;
+    for (const std::pair<f32, u32>& triangle : triangleAreas)
+    {
+        for (u32 corner = 0; corner < 3; ++corner)
+        {
+            const u32 vertex = indices[triangle.second + corner];
+            auto it = vertexRemap.find(vertex);
+            if (it == vertexRemap.end())
+            {
+                it = vertexRemap.insert(std::make_pair(vertex, (u32)occluder.vertices.size())).first;
+                occluder.vertices.push_back(position(vertex));
+            }
+            occluder.indices.push_back(it->second);
+        }
+    }
+}
+
+void InitOcclusionBuffer(OcclusionBuffer& buffer, u32 width, u32 height)
+{
+    ASSERT(width % SOFTWARE_OCCLUSION_TILE == 0 && height % SOFTWARE_OCCLUSION_TILE == 0, "The occlusion buffer must be made of whole tiles");
+
+    buffer.width = width;
+    buffer.height = height;
+    buffer.depth.resize(width * height);
+    buffer.tileMaxDepth.resize((width / SOFTWARE_OCCLUSION_TILE) * (height / SOFTWARE_OCCLUSION_TILE));
+    buffer.useAVX2 = CPUSupportsAVX2();
+
+    ClearOcclusionBuffer(buffer);
+}
+
+void ClearOcclusionBuffer(OcclusionBuffer& buffer)
+{
+    std::fill(buffer.depth.begin(), buffer.depth.end(), 1.0f);
+    std::fill(buffer.tileMaxDepth.begin(), buffer.tileMaxDepth.end(), 1.0f);
+    buffer.triangles.clear();
+}
+
+void AddOccluders(OcclusionBuffer& buffer, const OccluderInstance* occluders, u32 count)
+{
+    std::vector<u32> firstTriangles(count + 1, 0);
+    for (u32 i = 0; i < count; ++i)
+        firstTriangles[i + 1] = firstTriangles[i] + occluders[i].mesh->indices.size() / 3;
+
+    const u32 baseTriangle = buffer.triangles.size();
+    buffer.triangles.resize(baseTriangle + firstTriangles[count]);
+
+    const glm::vec2 screenSize((f32)buffer.width, (f32)buffer.height);
+
+    ParallelFor(count, 1, [&](u32 begin, u32 end) {
+        std::vector<glm::vec3> projected;
+        for (u32 occluderIdx = begin; occluderIdx < end; ++occluderIdx)
+        {
+            const OccluderInstance& occluder = occluders[occluderIdx];
+            const OccluderMesh& mesh = *occluder.mesh;
+
+            // NaN marks the vertices behind the near plane
+            projected.resize(mesh.vertices.size());
+            for (u32 i = 0; i < mesh.vertices.size(); ++i)
+            {
+                const glm::vec4 clip = occluder.worldViewProjection * glm::vec4(mesh.vertices[i], 1.0f);
+                if (clip.w <= FLT_EPSILON || clip.z < -clip.w)
+                {
+                    projected[i] = glm::vec3(NAN);
+                    continue;
+                }
+                const glm::vec3 ndc = glm::vec3(clip) / clip.w;
+                projected[i] = glm::vec3((glm::vec2(ndc) * 0.5f + 0.5f) * screenSize, ndc.z * 0.5f + 0.5f);
+            }
+
+            for (u32 t = 0; t < mesh.indices.size() / 3; ++t)
+            {
+                ScreenTriangle& triangle = buffer.triangles[baseTriangle + firstTriangles[occluderIdx] + t];
+                triangle.vertices[0] = projected[mesh.indices[t * 3]];
+                triangle.vertices[1] = projected[mesh.indices[t * 3 + 1]];
+                triangle.vertices[2] = projected[mesh.indices[t * 3 + 2]];
+
+                // Empty row range for the dropped ones, no band picks them
+                const bool clipped = glm::isnan(triangle.vertices[0].x) || glm::isnan(triangle.vertices[1].x) || glm::isnan(triangle.vertices[2].x);
+                triangle.minY = clipped ? FLT_MAX : glm::min(glm::min(triangle.vertices[0].y, triangle.vertices[1].y), triangle.vertices[2].y);
+                triangle.maxY = clipped ? -FLT_MAX : glm::max(glm::max(triangle.vertices[0].y, triangle.vertices[1].y), triangle.vertices[2].y);
+            }
+        }
+    });
+}
+
+// Edge functions and depth plane of a triangle, evaluated at pixel centers
+struct TriangleSetup
+{
+    glm::vec3 edgeA; // Per edge: value = a * x + b * y + c, inside when >= 0. Pixels on an edge
+                     // shared by two triangles go to both, so meshes have no cracks
+    glm::vec3 edgeB;
+    glm::vec3 edgeC;
+    f32 depthDx;
+    f32 depthDy;
+    f32 depthC;      // depth = depthDx * x + depthDy * y + depthC
+    i32 minX, maxX, minY, maxY;
+};
+
+static bool SetupTriangle(const ScreenTriangle& triangle, u32 width, u32 bandMinY, u32 bandMaxY, TriangleSetup& setup)
+{
+    glm::vec3 v0 = triangle.vertices[0];
+    glm::vec3 v1 = triangle.vertices[1];
+    glm::vec3 v2 = triangle.vertices[2];
+
+    f32 area = (v1.x - v0.x) * (v2.y - v0.y) - (v2.x - v0.x) * (v1.y - v0.y);
+    if (fabsf(area) < 1e-6f)
+        return false;
+
+    // Occluders are double sided, flip to counter clockwise
+    if (area < 0.0f)
+    {
+        std::swap(v1, v2);
+        area = -area;
+    }
+
+    // Clamped as floats first, vertices close to the camera plane can be far outside the screen
+    setup.minX = (i32)glm::clamp(floorf(glm::min(glm::min(v0.x, v1.x), v2.x)), 0.0f, (f32)width);
+    setup.maxX = (i32)glm::clamp(ceilf(glm::max(glm::max(v0.x, v1.x), v2.x)), -1.0f, (f32)width - 1.0f);
+    setup.minY = (i32)glm::clamp(floorf(triangle.minY), (f32)bandMinY, (f32)bandMaxY);
+    setup.maxY = (i32)glm::clamp(ceilf(triangle.maxY), (f32)bandMinY - 1.0f, (f32)bandMaxY - 1.0f);
+    if (setup.minX > setup.maxX || setup.minY > setup.maxY)
+        return false;
+
+    const glm::vec3 xs(v0.x, v1.x, v2.x);
+    const glm::vec3 ys(v0.y, v1.y, v2.y);
+    const glm::vec3 nextXs(v1.x, v2.x, v0.x);
+    const glm::vec3 nextYs(v1.y, v2.y, v0.y);
+    setup.edgeA = ys - nextYs;
+    setup.edgeB = nextXs - xs;
+    setup.edgeC = xs * nextYs - ys * nextXs;
+
+    const f32 dz1 = v1.z - v0.z;
+    const f32 dz2 = v2.z - v0.z;
+    setup.depthDx = (dz1 * (v2.y - v0.y) - dz2 * (v1.y - v0.y)) / area;
+    setup.depthDy = (dz2 * (v1.x - v0.x) - dz1 * (v2.x - v0.x)) / area;
+    setup.depthC = v0.z - setup.depthDx * v0.x - setup.depthDy * v0.y;
+    return true;
+}
+
+static void RasterizeTriangleScalar(const TriangleSetup& setup, OcclusionBuffer& buffer)
+{
+    for (i32 y = setup.minY; y <= setup.maxY; ++y)
+    {
+        const f32 py = y + 0.5f;
+        f32* row = buffer.depth.data() + y * buffer.width;
+        for (i32 x = setup.minX; x <= setup.maxX; ++x)
+        {
+            const f32 px = x + 0.5f;
+            const glm::vec3 edges = setup.edgeA * px + setup.edgeB * py + setup.edgeC;
+            if (edges.x >= 0.0f && edges.y >= 0.0f && edges.z >= 0.0f)
+                row[x] = glm::min(row[x], setup.depthDx * px + setup.depthDy * py + setup.depthC);
+        }
+    }
+}
+
+#if defined(SOFTWARE_OCCLUSION_SIMD)
+TARGET_AVX2 static void RasterizeTriangleAVX2(const TriangleSetup& setup, OcclusionBuffer& buffer)
+{
+    const __m256 laneOffsets = _mm256_setr_ps(0.5f, 1.5f, 2.5f, 3.5f, 4.5f, 5.5f, 6.5f, 7.5f);
+    const __m256 zero = _mm256_setzero_ps();
+    const __m256 a0 = _mm256_set1_ps(setup.edgeA.x);
+    const __m256 a1 = _mm256_set1_ps(setup.edgeA.y);
+    const __m256 a2 = _mm256_set1_ps(setup.edgeA.z);
+    const __m256 depthDx = _mm256_set1_ps(setup.depthDx);
+
+    // Width is a multiple of 8, so spans aligned to 8 never leave the row
+    const i32 spanBegin = setup.minX & ~7;
+
+    for (i32 y = setup.minY; y <= setup.maxY; ++y)
+    {
+        const f32 py = y + 0.5f;
+        const __m256 rowE0 = _mm256_set1_ps(setup.edgeB.x * py + setup.edgeC.x);
+        const __m256 rowE1 = _mm256_set1_ps(setup.edgeB.y * py + setup.edgeC.y);
+        const __m256 rowE2 = _mm256_set1_ps(setup.edgeB.z * py + setup.edgeC.z);
+        const __m256 rowDepth = _mm256_set1_ps(setup.depthDy * py + setup.depthC);
+        f32* row = buffer.depth.data() + y * buffer.width;
+
+        for (i32 x = spanBegin; x <= setup.maxX; x += 8)
+        {
+            const __m256 px = _mm256_add_ps(_mm256_set1_ps((f32)x), laneOffsets);
+            const __m256 e0 = _mm256_add_ps(_mm256_mul_ps(a0, px), rowE0);
+            const __m256 e1 = _mm256_add_ps(_mm256_mul_ps(a1, px), rowE1);
+            const __m256 e2 = _mm256_add_ps(_mm256_mul_ps(a2, px), rowE2);
+            const __m256 inside = _mm256_and_ps(_mm256_and_ps(_mm256_cmp_ps(e0, zero, _CMP_GE_OQ), _mm256_cmp_ps(e1, zero, _CMP_GE_OQ)), _mm256_cmp_ps(e2, zero, _CMP_GE_OQ));
+            if (_mm256_testz_ps(inside, inside))
+                continue;
+
+            const __m256 depth = _mm256_add_ps(_mm256_mul_ps(depthDx, px), rowDepth);
+            const __m256 old = _mm256_loadu_ps(row + x);
+            _mm256_storeu_ps(row + x, _mm256_blendv_ps(old, _mm256_min_ps(old, depth), inside));
+        }
+    }
+}
+#endif
+
+void RasterizeOccluders(OcclusionBuffer& buffer)
+{
+    const u32 bandCount = (buffer.height + RASTER_BAND_HEIGHT - 1) / RASTER_BAND_HEIGHT;
+
+    // Bands own their rows, so no two jobs ever write the same pixel
+    ParallelFor(bandCount, 1, [&](u32 begin, u32 end) {
+        for (u32 band = begin; band < end; ++band)
+        {
+            const u32 bandMinY = band * RASTER_BAND_HEIGHT;
+            const u32 bandMaxY = glm::min(bandMinY + RASTER_BAND_HEIGHT, buffer.height);
+
+            for (u32 i = 0; i < buffer.triangles.size(); ++i)
+            {
+                const ScreenTriangle& triangle = buffer.triangles[i];
+                if (triangle.maxY < bandMinY || triangle.minY >= bandMaxY)
+                    continue;
+
+                TriangleSetup setup;
+                if (!SetupTriangle(triangle, buffer.width, bandMinY, bandMaxY, setup))
+                    continue;
+
+#if defined(SOFTWARE_OCCLUSION_SIMD)
+                if (buffer.useAVX2)
+                {
+                    RasterizeTriangleAVX2(setup, buffer);
+                    continue;
+                }
+#endif
+                RasterizeTriangleScalar(setup, buffer);
+            }
+        }
+    });
+
+    const u32 tilesX = buffer.width / SOFTWARE_OCCLUSION_TILE;
+    const u32 tilesY = buffer.height / SOFTWARE_OCCLUSION_TILE;
+    ParallelFor(tilesY, 4, [&](u32 begin, u32 end) {
+        for (u32 tileY = begin; tileY < end; ++tileY)
+        {
+            for (u32 tileX = 0; tileX < tilesX; ++tileX)
+            {
+                f32 maxDepth = 0.0f;
+                for (u32 y = 0; y < SOFTWARE_OCCLUSION_TILE; ++y)
+                {
+                    const f32* row = buffer.depth.data() + (tileY * SOFTWARE_OCCLUSION_TILE + y) * buffer.width + tileX * SOFTWARE_OCCLUSION_TILE;
+                    for (u32 x = 0; x < SOFTWARE_OCCLUSION_TILE; ++x)
+                        maxDepth = glm::max(maxDepth, row[x]);
+                }
+                buffer.tileMaxDepth[tileY * tilesX + tileX] = maxDepth;
+            }
+        }
+    });
+}
+
+bool IsOccluded(const OcclusionBuffer& buffer, const AABB& bounds, const glm::mat4& viewProjection)
+{
+    glm::vec2 screenMin(FLT_MAX);
+    glm::vec2 screenMax(-FLT_MAX);
+    f32 closestDepth = 1.0f;
+
+    for (u32 i = 0; i < 8; ++i)
+    {
+        const glm::vec3 corner((i & 1) ? bounds.max.x : bounds.min.x,
+                               (i & 2) ? bounds.max.y : bounds.min.y,
+                               (i & 4) ? bounds.max.z : bounds.min.z);
+        const glm::vec4 clip = viewProjection * glm::vec4(corner, 1.0f);
+
+        // Crossing the near plane, the projected rectangle is meaningless
+        if (clip.w <= FLT_EPSILON)
+            return false;
+
+        const glm::vec3 ndc = glm::vec3(clip) / clip.w;
+        const glm::vec2 screen = (glm::vec2(ndc) * 0.5f + 0.5f) * glm::vec2((f32)buffer.width, (f32)buffer.height);
+        screenMin = glm::min(screenMin, screen);
+        screenMax = glm::max(screenMax, screen);
+        closestDepth = glm::min(closestDepth, ndc.z * 0.5f + 0.5f);
+    }
+
+    const i32 minX = (i32)glm::clamp(floorf(screenMin.x), 0.0f, (f32)buffer.width);
+    const i32 minY = (i32)glm::clamp(floorf(screenMin.y), 0.0f, (f32)buffer.height);
+    const i32 maxX = (i32)glm::clamp(ceilf(screenMax.x), -1.0f, (f32)buffer.width - 1.0f);
+    const i32 maxY = (i32)glm::clamp(ceilf(screenMax.y), -1.0f, (f32)buffer.height - 1.0f);
+    if (minX > maxX || minY > maxY)
+        return false;
+
+    const i32 tilesX = buffer.width / SOFTWARE_OCCLUSION_TILE;
+    for (i32 tileY = minY / SOFTWARE_OCCLUSION_TILE; tileY <= maxY / SOFTWARE_OCCLUSION_TILE; ++tileY)
+    {
+        for (i32 tileX = minX / SOFTWARE_OCCLUSION_TILE; tileX <= maxX / SOFTWARE_OCCLUSION_TILE; ++tileX)
+        {
+            // Everything in the tile is closer than the box
+            if (buffer.tileMaxDepth[tileY * tilesX + tileX] < closestDepth)
+                continue;
+
+            const i32 x0 = glm::max(tileX * SOFTWARE_OCCLUSION_TILE, minX);
+            const i32 x1 = glm::min(tileX * SOFTWARE_OCCLUSION_TILE + SOFTWARE_OCCLUSION_TILE - 1, maxX);
+            const i32 y0 = glm::max(tileY * SOFTWARE_OCCLUSION_TILE, minY);
+            const i32 y1 = glm::min(tileY * SOFTWARE_OCCLUSION_TILE + SOFTWARE_OCCLUSION_TILE - 1, maxY);
+            for (i32 y = y0; y <= y1; ++y)
+                for (i32 x = x0; x <= x1; ++x)
+                    if (buffer.depth[y * buffer.width + x] >= closestDepth)
+                        return false;
+        }
+    }
+
+    return true;
+}
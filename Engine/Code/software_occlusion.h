@@ -0,0 +1,81 @@
+//
+// software_occlusion.h: CPU occlusion culling. Simplified occluder meshes are rasterized into a
+// small depth buffer on the job threads, 8 pixels at a time with AVX2 when the CPU has it, and
+// the bounds of the occludees are tested against it before anything reaches the GPU. A max
+// depth per tile lets most tests finish without looking at single pixels.
+//
+// Nothing in here touches GL, so it runs and can be tested on any thread.
+//
+
+#pragma once
+
+#include "platform.h"
+#include "bounds.h"
+
+#define SOFTWARE_OCCLUSION_WIDTH              320
+#define SOFTWARE_OCCLUSION_HEIGHT             192
+#define SOFTWARE_OCCLUSION_TILE               8   // Both dimensions must be a multiple of it
+#define SOFTWARE_OCCLUSION_OCCLUDER_TRIANGLES 256 // Kept from every mesh by SimplifyOccluder
+
+// Position only triangle list, a subset of the triangles of the mesh it was simplified from
+struct OccluderMesh
+{
+    std::vector<glm::vec3> vertices;
+    std::vector<u32>       indices;
+};
+
+struct OccluderInstance
+{
+    const OccluderMesh* mesh;
+    glm::mat4           worldViewProjection;
+};
+
+// Triangle after projection, x and y in pixels and z as window depth
+struct ScreenTriangle
+{
+    glm::vec3 vertices[3];
+    f32       minY;
+    f32       maxY;
+};
+
+struct OcclusionBuffer
+{
+    u32 width;
+    u32 height;
+
+    // Row 0 is the bottom of the screen, like GL textures. 1 is the far plane.
+    std::vector<f32> depth;
+    std::vector<f32> tileMaxDepth;
+
+    std::vector<ScreenTriangle> triangles;
+
+    bool useAVX2;
+};
+
+/**
+ * Keeps the maxTriangles largest triangles of the mesh, untouched, and drops the rest. The result
+ * is conservative: it never covers a pixel the full mesh does not. The position is read from the
+ * first three floats of every vertex.
+ */
+void SimplifyOccluder(const float* vertices, u32 floatStride, u32 vertexCount, const u32* indices, u32 indexCount, u32 maxTriangles, OccluderMesh& occluder);
+
+void InitOcclusionBuffer(OcclusionBuffer& buffer, u32 width, u32 height);
+
+void ClearOcclusionBuffer(OcclusionBuffer& buffer);
+
+/**
+ * Projects the triangles of the occluders, in parallel. Triangles crossing the near plane
+ * are dropped, which only makes the buffer less occluding.
+ */
+void AddOccluders(OcclusionBuffer& buffer, const OccluderInstance* occluders, u32 count);
+
+/**
+ * Rasterizes every added triangle, one horizontal band of the buffer per job, and builds
+ * the tile max depths.
+ */
+void RasterizeOccluders(OcclusionBuffer& buffer);
+
+/**
+ * True when every pixel the box projects to holds something closer than the box.
+ */
+bool IsOccluded(const OcclusionBuffer& buffer, const AABB& bounds, const glm::mat4& viewProjection);
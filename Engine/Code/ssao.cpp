@@ -0,0 +1,107 @@
+#include "ssao.h"
+
+#define SSAO_DOWNSAMPLE_GROUP_SIZE 8
+#define SSAO_BLUR_GROUP_SIZE       64
+
+static GLuint CreateSSAOTexture(GLenum format, glm::ivec2 size)
+{
+    GLuint texture;
+    glGenTextures(1, &texture);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glTexStorage2D(GL_TEXTURE_2D, 1, format, size.x, size.y);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    return texture;
+}
+
+void InitSSAO(SSAO& ssao, GLuint downsampleProgram, GLuint occlusionProgram, GLuint blurProgram, glm::ivec2 targetSize)
+{
+    ssao.downsampleProgram = downsampleProgram;
+    ssao.occlusionProgram = occlusionProgram;
+    ssao.blurProgram = blurProgram;
+
+    ssao.size = GetSSAOSize(targetSize);
+    ssao.depthTexture = CreateSSAOTexture(GL_R32F, ssao.size);
+    ssao.normalsTexture = CreateSSAOTexture(GL_RGBA8, ssao.size);
+    for (u32 i = 0; i < 2; ++i)
+        ssao.occlusionTextures[i] = CreateSSAOTexture(GL_R8, ssao.size);
+}
+
+glm::ivec2 GetSSAOSize(glm::ivec2 renderSize)
+{
+    return (renderSize + 1) / 2;
+}
+
+static glm::ivec2 GetGroupCount(glm::ivec2 size, glm::ivec2 groupSize)
+{
+    return (size + groupSize - 1) / groupSize;
+}
+
+void ComputeSSAO(SSAO& ssao, const SSAOSettings& settings, GLuint depthTexture, GLuint normalsTexture, glm::ivec2 renderSize)
+{
+    const glm::ivec2 size = GetSSAOSize(renderSize);
+
+    // G-buffer to half resolution linear depth and view space normals
+    glUseProgram(ssao.downsampleProgram);
+    glUniform1i(glGetUniformLocation(ssao.downsampleProgram, "uDepthTexture"), 0);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, depthTexture);
+    glUniform1i(glGetUniformLocation(ssao.downsampleProgram, "uNormalsTexture"), 1);
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_2D, normalsTexture);
+    glUniform2i(glGetUniformLocation(ssao.downsampleProgram, "uSize"), size.x, size.y);
+
+    glBindImageTexture(0, ssao.depthTexture, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_R32F);
+    glBindImageTexture(1, ssao.normalsTexture, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA8);
+    const glm::ivec2 downsampleGroups = GetGroupCount(size, glm::ivec2(SSAO_DOWNSAMPLE_GROUP_SIZE));
+    glDispatchCompute(downsampleGroups.x, downsampleGroups.y, 1);
+    glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+
+    // Occlusion, the blur passes go to the second texture and back
+    glUseProgram(ssao.occlusionProgram);
+    glUniform1i(glGetUniformLocation(ssao.occlusionProgram, "uDepthTexture"), 0);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, ssao.depthTexture);
+    glUniform1i(glGetUniformLocation(ssao.occlusionProgram, "uNormalsTexture"), 1);
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_2D, ssao.normalsTexture);
+    glUniform2i(glGetUniformLocation(ssao.occlusionProgram, "uSize"), size.x, size.y);
+    glUniform1f(glGetUniformLocation(ssao.occlusionProgram, "uRadius"), settings.radius);
+    glUniform1f(glGetUniformLocation(ssao.occlusionProgram, "uIntensity"), settings.intensity);
+
+    glBindImageTexture(0, ssao.occlusionTextures[0], 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_R8);
+    const glm::ivec2 occlusionGroups = GetGroupCount(size, glm::ivec2(SSAO_GROUP_SIZE));
+    glDispatchCompute(occlusionGroups.x, occlusionGroups.y, 1);
+    glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+
+    // Horizontal then vertical, every group blurs a segment of a row or a column
+    glUseProgram(ssao.blurProgram);
+    glUniform1i(glGetUniformLocation(ssao.blurProgram, "uOcclusionTexture"), 0);
+    glUniform1i(glGetUniformLocation(ssao.blurProgram, "uDepthTexture"), 1);
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_2D, ssao.depthTexture);
+    glUniform2i(glGetUniformLocation(ssao.blurProgram, "uSize"), size.x, size.y);
+
+    for (u32 pass = 0; pass < 2; ++pass)
+    {
+        const glm::ivec2 direction = pass == 0 ? glm::ivec2(1, 0) : glm::ivec2(0, 1);
+        glUniform2i(glGetUniformLocation(ssao.blurProgram, "uDirection"), direction.x, direction.y);
+
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, ssao.occlusionTextures[pass]);
+        glBindImageTexture(0, ssao.occlusionTextures[1 - pass], 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_R8);
+
+        const i32 along = pass == 0 ? size.x : size.y;
+        const i32 across = pass == 0 ? size.y : size.x;
+        glDispatchCompute((along + SSAO_BLUR_GROUP_SIZE - 1) / SSAO_BLUR_GROUP_SIZE, across, 1);
+        glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+    }
+
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glActiveTexture(GL_TEXTURE0);
+}
@@ -0,0 +1,56 @@
+//
+// ssao.h: Screen space ambient occlusion at half resolution, in compute shaders. The G-buffer
+// depth and normals are reduced to half resolution, keeping the closest of every 2x2 block, and
+// the occlusion is computed from them with a fixed number of samples inside a fixed pixel radius,
+// read from a tile of the half resolution buffers every work group loads into shared memory once.
+// A separable blur that does not cross depth discontinuities removes the noise of the rotated
+// sample pattern, and the lighting pass upsamples the result weighting the four closest texels by
+// how close their depth is to the pixel's.
+//
+// The work per half resolution pixel does not depend on the scene, so the cost is a fixed
+// fraction of the frame at any resolution.
+//
+
+#pragma once
+
+#include "platform.h"
+#include <glad/glad.h>
+
+#define SSAO_GROUP_SIZE   16 // Work groups are SSAO_GROUP_SIZE^2 pixels
+#define SSAO_TILE_BORDER  8  // Pixels the tile extends past the group, the largest sample radius
+#define SSAO_SAMPLE_COUNT 12
+
+// Main thread side, sent to the render thread in the RenderPacket
+struct SSAOSettings
+{
+    bool enabled = true;
+    f32  radius = 0.5f;    // World units, limited to SSAO_TILE_BORDER half resolution pixels
+    f32  intensity = 1.5f;
+};
+
+// Render thread side
+struct SSAO
+{
+    GLuint downsampleProgram;
+    GLuint occlusionProgram;
+    GLuint blurProgram;
+
+    // Half of the render targets, the frame uses the corner of them dynamic resolution chose
+    GLuint     depthTexture;   // R32F, linear view depth, 0 where nothing was drawn
+    GLuint     normalsTexture; // RGBA8, view space normals encoded to [0, 1]
+    GLuint     occlusionTextures[2]; // R8, the result and the blur's intermediate
+    glm::ivec2 size;
+};
+
+void InitSSAO(SSAO& ssao, GLuint downsampleProgram, GLuint occlusionProgram, GLuint blurProgram, glm::ivec2 targetSize);
+
+/**
+ * Computes the occlusion of the renderSize corner of the G-buffer into
+ * occlusionTextures[0]. The ViewParams block must be bound.
+ */
+void ComputeSSAO(SSAO& ssao, const SSAOSettings& settings, GLuint depthTexture, GLuint normalsTexture, glm::ivec2 renderSize);
+
+/**
+ * Size of the corner of the SSAO textures a frame rendered at renderSize fills.
+ */
+glm::ivec2 GetSSAOSize(glm::ivec2 renderSize);
@@ -0,0 +1,57 @@
+#include "temporal_aa.h"
+
+void InitTemporalAA(TemporalAA& taa, glm::ivec2 size)
+{
+    taa.size = size;
+    taa.current = 0;
+    taa.historyValid = false;
+
+    glGenTextures(2, taa.history);
+    glGenFramebuffers(2, taa.framebuffers);
+    for (u32 i = 0; i < 2; ++i)
+    {
+        glBindTexture(GL_TEXTURE_2D, taa.history[i]);
+        glTexStorage2D(GL_TEXTURE_2D, 1, GL_RGBA16F, size.x, size.y);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+        glBindFramebuffer(GL_FRAMEBUFFER, taa.framebuffers[i]);
+        glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, taa.history[i], 0);
+    }
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+static f32 Halton(u32 index, u32 base)
+{
+    f32 result = 0.0f;
+    f32 fraction = 1.0f / base;
+    for (; index > 0; index /= base, fraction /= base)
+        result += fraction * (index % base);
+    return result;
+}
+
+glm::vec2 GetTemporalJitter(u64 frame)
+{
+    // Index 0 of the sequence is 0 in every base, start at 1
+    const u32 index = (u32)(frame % TAA_JITTER_PHASES) + 1;
+    return glm::vec2(Halton(index, 2), Halton(index, 3)) - 0.5f;
+}
+
+glm::mat4 JitterProjection(const glm::mat4& projection, glm::vec2 jitter, glm::ivec2 viewportSize)
+{
+    // The third column is multiplied by the view z, and w is -z, so after the divide the offset
+    // is the same everywhere on screen
+    glm::mat4 jittered = projection;
+    jittered[2][0] -= 2.0f * jitter.x / viewportSize.x;
+    jittered[2][1] -= 2.0f * jitter.y / viewportSize.y;
+    return jittered;
+}
+
+void SwapTemporalAAHistory(TemporalAA& taa)
+{
+    taa.current = 1 - taa.current;
+    taa.historyValid = true;
+}
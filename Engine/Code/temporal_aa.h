@@ -0,0 +1,44 @@
+//
+// temporal_aa.h: Temporal anti-aliasing and upsampling. Every frame the projection is moved by a
+// different sub-pixel offset, so consecutive frames sample different points of every pixel. The
+// resolve pass follows the motion vectors back into the history, the result of the previous
+// frames at display resolution, clamps it to the colors around the pixel in the current frame
+// to drop what is no longer visible, and blends the current frame in. Rendering at a fraction of
+// the display resolution then converges to a full resolution image over a few frames.
+//
+
+#pragma once
+
+#include "platform.h"
+#include <glad/glad.h>
+
+#define TAA_JITTER_PHASES 8     // Length of the Halton sequence the jitter cycles through
+#define TAA_FEEDBACK      0.9f  // Weight of the history in the blend
+
+struct TemporalAA
+{
+    // Ping-pong RGBA16F targets at display resolution, one is read while the other is written
+    GLuint     history[2];
+    GLuint     framebuffers[2];
+    glm::ivec2 size;
+    u32        current;      // The one written this frame
+    bool       historyValid; // The other one holds last frame's result
+};
+
+void InitTemporalAA(TemporalAA& taa, glm::ivec2 size);
+
+/**
+ * Offset of the projection for a frame, in pixels, inside (-0.5, 0.5).
+ */
+glm::vec2 GetTemporalJitter(u64 frame);
+
+/**
+ * Moves the projection by jitter pixels of a viewport of the given size, which shifts the image
+ * without changing the perspective.
+ */
+glm::mat4 JitterProjection(const glm::mat4& projection, glm::vec2 jitter, glm::ivec2 viewportSize);
+
+/**
+ * Makes the target of this frame the history of the next one.
+ */
+void SwapTemporalAAHistory(TemporalAA& taa);
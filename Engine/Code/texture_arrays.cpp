@@ -0,0 +1,164 @@
+#include "texture_arrays.h"
+#include "downsampler.h"
+#include <float.h>
+
+// Immutable storage cannot grow, so the layers move to a bigger array
+static void GrowTextureArray(TextureArray& array, u32 layerCapacity)
+{
+    GLuint handle;
+    glGenTextures(1, &handle);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, handle);
+    glTexStorage3D(GL_TEXTURE_2D_ARRAY, array.mipCount, GL_RGBA8, array.size.x, array.size.y, layerCapacity);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+    if (array.layerCount > 0)
+    {
+        for (u32 mip = 0; mip < array.mipCount; ++mip)
+        {
+            glCopyImageSubData(
+                array.handle, GL_TEXTURE_2D_ARRAY, mip, 0, 0, 0,
+                handle, GL_TEXTURE_2D_ARRAY, mip, 0, 0, 0,
+                glm::max(array.size.x >> mip, 1), glm::max(array.size.y >> mip, 1), array.layerCount);
+        }
+    }
+
+    glDeleteTextures(1, &array.handle);
+    array.handle = handle;
+    array.layerCapacity = layerCapacity;
+}
+
+// The array of the size closest to size, by how many times each side would have to be halved
+// or doubled
+static u32 FindClosestTextureArray(const TextureArrays& arrays, glm::ivec2 size)
+{
+    u32 closest = 0;
+    f32 closestDistance = FLT_MAX;
+    for (u32 i = 0; i < arrays.count; ++i)
+    {
+        const glm::vec2 ratio = glm::vec2(arrays.arrays[i].size) / glm::vec2(size);
+        const f32 distance = fabsf(log2f(ratio.x)) + fabsf(log2f(ratio.y));
+        if (distance < closestDistance)
+        {
+            closest = i;
+            closestDistance = distance;
+        }
+    }
+    return closest;
+}
+
+// Filters the pixels into a layer of another size. The blit reads from the mip closest above
+// the layer size, so reductions of any ratio do not skip texels.
+static void ResampleIntoLayer(const TextureArray& array, u32 layer, const void* pixels, glm::ivec2 size, GLenum dataFormat)
+{
+    GLuint source;
+    glGenTextures(1, &source);
+    glBindTexture(GL_TEXTURE_2D, source);
+    glTexStorage2D(GL_TEXTURE_2D, GetMipCount(size), GL_RGBA8, size.x, size.y);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, size.x, size.y, dataFormat, GL_UNSIGNED_BYTE, pixels);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glGenerateMipmap(GL_TEXTURE_2D);
+
+    u32 mip = 0;
+    glm::ivec2 mipSize = size;
+    while (mipSize.x / 2 >= array.size.x && mipSize.y / 2 >= array.size.y)
+    {
+        mipSize /= 2;
+        mip++;
+    }
+
+    GLuint framebuffers[2];
+    glGenFramebuffers(2, framebuffers);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, framebuffers[0]);
+    glFramebufferTexture2D(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, source, mip);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, framebuffers[1]);
+    glFramebufferTextureLayer(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, array.handle, 0, layer);
+    glBlitFramebuffer(0, 0, mipSize.x, mipSize.y, 0, 0, array.size.x, array.size.y, GL_COLOR_BUFFER_BIT, GL_LINEAR);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glDeleteFramebuffers(2, framebuffers);
+
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glDeleteTextures(1, &source);
+}
+
+u32 AddTextureLayer(TextureArrays& arrays, const void* pixels, glm::ivec2 size, u32 channelCount)
+{
+    GLenum dataFormat = GL_RGBA;
+    switch (channelCount)
+    {
+        case 3: dataFormat = GL_RGB; break;
+        case 4: dataFormat = GL_RGBA; break;
+        default: ELOG("AddTextureLayer() - Unsupported number of channels"); return NO_TEXTURE_LAYER;
+    }
+
+    u32 arrayIdx = 0;
+    while (arrayIdx < arrays.count && arrays.arrays[arrayIdx].size != size)
+        arrayIdx++;
+
+    // Every array is taken by other sizes, the texture goes to the closest one resampled.
+    // Texture coordinates are normalized, so it maps to the mesh the same.
+    const bool resample = arrayIdx == arrays.count && arrays.count == MAX_TEXTURE_ARRAYS;
+    if (resample)
+    {
+        arrayIdx = FindClosestTextureArray(arrays, size);
+        ILOG("AddTextureLayer() - No texture array left for %dx%d textures, resampled to %dx%d", size.x, size.y,
+             arrays.arrays[arrayIdx].size.x, arrays.arrays[arrayIdx].size.y);
+    }
+    else if (arrayIdx == arrays.count)
+    {
+        TextureArray& array = arrays.arrays[arrays.count++];
+        array = {};
+        array.size = size;
+        array.mipCount = GetMipCount(size);
+    }
+
+    TextureArray& array = arrays.arrays[arrayIdx];
+    if (array.layerCount == array.layerCapacity)
+        GrowTextureArray(array, glm::max(array.layerCapacity * 2, (u32)TEXTURE_ARRAY_MIN_LAYERS));
+
+    const u32 layer = array.layerCount++;
+
+    if (resample)
+    {
+        ResampleIntoLayer(array, layer, pixels, size, dataFormat);
+    }
+    else
+    {
+        // Rows of 3 channel images are not 4 byte aligned in general
+        glBindTexture(GL_TEXTURE_2D_ARRAY, array.handle);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, layer, size.x, size.y, 1, dataFormat, GL_UNSIGNED_BYTE, pixels);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+    }
+
+    array.mipsDirty = true;
+    return PackTextureLayer(arrayIdx, layer);
+}
+
+void UpdateTextureArrayMips(TextureArrays& arrays)
+{
+    for (u32 i = 0; i < arrays.count; ++i)
+    {
+        TextureArray& array = arrays.arrays[i];
+        if (!array.mipsDirty)
+            continue;
+
+        glBindTexture(GL_TEXTURE_2D_ARRAY, array.handle);
+        glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
+        array.mipsDirty = false;
+    }
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+}
+
+void BindTextureArrays(const TextureArrays& arrays)
+{
+    for (u32 i = 0; i < arrays.count; ++i)
+    {
+        glActiveTexture(GL_TEXTURE0 + TEXTURE_ARRAY_FIRST_UNIT + i);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, arrays.arrays[i].handle);
+    }
+}
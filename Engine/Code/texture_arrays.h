@@ -0,0 +1,48 @@
+//
+// texture_arrays.h: Material textures live in the layers of a few GL_TEXTURE_2D_ARRAY pools,
+// one per texture size, all of them RGBA8 with full mip chains. Shaders take the array and the
+// layer from the material, so no texture is bound per draw and draws with different materials
+// share all their state.
+//
+
+#pragma once
+
+#include "platform.h"
+#include <glad/glad.h>
+
+#define MAX_TEXTURE_ARRAYS       8 // The shaders have it hardcoded too
+#define TEXTURE_ARRAY_FIRST_UNIT 8 // Array i is bound to this texture unit plus i
+#define TEXTURE_ARRAY_MIN_LAYERS 4
+#define NO_TEXTURE_LAYER         UINT32_MAX
+
+struct TextureArray
+{
+    GLuint     handle;
+    glm::ivec2 size;
+    u32        mipCount;
+    u32        layerCount;
+    u32        layerCapacity;
+    bool       mipsDirty; // Layers were written since the mips were generated
+};
+
+struct TextureArrays
+{
+    TextureArray arrays[MAX_TEXTURE_ARRAYS];
+    u32          count = 0;
+};
+
+/**
+ * Copies the pixels, with 3 or 4 channels, into a new layer of the array of their size. Arrays
+ * grow as needed, which copies the layers they had. Once every array is taken by other sizes,
+ * the pixels are resampled into the array of the closest size. Returns the layer packed with
+ * PackTextureLayer(), NO_TEXTURE_LAYER only for unsupported channel counts. Call
+ * UpdateTextureArrayMips() once all the layers are in.
+ */
+u32 AddTextureLayer(TextureArrays& arrays, const void* pixels, glm::ivec2 size, u32 channelCount);
+
+void UpdateTextureArrayMips(TextureArrays& arrays);
+
+void BindTextureArrays(const TextureArrays& arrays);
+
+// Array index in the high 16 bits, layer in the low ones, the same as the shaders unpack it
+inline u32 PackTextureLayer(u32 array, u32 layer) { return (array << 16) | layer; }
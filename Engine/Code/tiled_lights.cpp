@@ -0,0 +1,55 @@
+#include "tiled_lights.h"
+
+#define TILED_LIGHTS_INITIAL_CAPACITY 64
+
+void InitTiledLights(TiledLights& tiled, GLuint cullProgram, glm::ivec2 targetSize)
+{
+    tiled.cullProgram = cullProgram;
+
+    tiled.lightCapacity = TILED_LIGHTS_INITIAL_CAPACITY;
+    glGenBuffers(1, &tiled.lightBuffer);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, tiled.lightBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, tiled.lightCapacity * sizeof(GPUTiledLight), NULL, GL_DYNAMIC_DRAW);
+
+    // Enough tiles for the largest render size
+    const glm::ivec2 tileCount = (targetSize + TILED_LIGHTS_TILE_SIZE - 1) / TILED_LIGHTS_TILE_SIZE;
+    const u32 listSize = (TILED_LIGHTS_MAX_PER_TILE + 1) * sizeof(u32);
+    glGenBuffers(1, &tiled.listBuffer);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, tiled.listBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, tileCount.x * tileCount.y * listSize, NULL, GL_DYNAMIC_COPY);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+}
+
+void CullTiledLights(TiledLights& tiled, const GPUTiledLight* lights, u32 lightCount, GLuint depthTexture, glm::ivec2 renderSize)
+{
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, tiled.lightBuffer);
+    if (lightCount > tiled.lightCapacity)
+    {
+        tiled.lightCapacity = glm::max(lightCount, tiled.lightCapacity * 2);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, tiled.lightCapacity * sizeof(GPUTiledLight), NULL, GL_DYNAMIC_DRAW);
+    }
+    if (lightCount > 0)
+        glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, lightCount * sizeof(GPUTiledLight), lights);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+    glUseProgram(tiled.cullProgram);
+    glUniform1i(glGetUniformLocation(tiled.cullProgram, "uDepthTexture"), 0);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, depthTexture);
+    glUniform2i(glGetUniformLocation(tiled.cullProgram, "uRenderSize"), renderSize.x, renderSize.y);
+    glUniform1ui(glGetUniformLocation(tiled.cullProgram, "uLightCount"), lightCount);
+
+    BindTiledLights(tiled);
+
+    // A group per tile
+    const glm::ivec2 tileCount = (renderSize + TILED_LIGHTS_TILE_SIZE - 1) / TILED_LIGHTS_TILE_SIZE;
+    glDispatchCompute(tileCount.x, tileCount.y, 1);
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+    glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+void BindTiledLights(const TiledLights& tiled)
+{
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, TILED_LIGHTS_BINDING, tiled.lightBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, TILE_LIGHT_LISTS_BINDING, tiled.listBuffer);
+}
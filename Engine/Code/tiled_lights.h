@@ -0,0 +1,48 @@
+//
+// tiled_lights.h: Light culling of the Forward+ path. After the depth prepass a compute shader
+// splits the frame in 16x16 pixel tiles, finds the depth range of every tile and keeps the
+// point lights whose sphere touches the frustum of the tile between those depths. The shading
+// pass then only loops over the list of the tile of every pixel.
+//
+
+#pragma once
+
+#include "platform.h"
+#include <glad/glad.h>
+#include "block_layout.h"
+
+#define TILED_LIGHTS_TILE_SIZE     16
+#define TILED_LIGHTS_MAX_PER_TILE  255 // The rest are dropped, a list is its count and this many indices
+#define TILED_LIGHTS_BINDING       6   // Shader storage binding of the TiledLights buffer
+#define TILE_LIGHT_LISTS_BINDING   7   // Shader storage binding of the TileLightLists buffer
+
+// A point light as the shaders read it from uTiledLights, std430
+struct GPUTiledLight
+{
+    STD430(glm::vec4) positionRadius;
+    STD430(glm::vec4) colorIntensity;
+    STD430(glm::vec4) attenuation; // x: linear, y: quadratic, z: index in uLight for its shadow, -1 past them
+};
+
+static_assert(sizeof(GPUTiledLight) == 48, "GPUTiledLight is not the size of TiledLight in the shaders");
+
+struct TiledLights
+{
+    GLuint cullProgram;
+    GLuint lightBuffer;   // GPUTiledLight per point light of the frame
+    u32    lightCapacity;
+    GLuint listBuffer;    // Per tile, row by row, the count and TILED_LIGHTS_MAX_PER_TILE indices
+};
+
+void InitTiledLights(TiledLights& tiled, GLuint cullProgram, glm::ivec2 targetSize);
+
+/**
+ * Uploads the lights and builds the list of every tile of the renderSize corner of depthTexture.
+ * The ViewParams block of the frame must be bound.
+ */
+void CullTiledLights(TiledLights& tiled, const GPUTiledLight* lights, u32 lightCount, GLuint depthTexture, glm::ivec2 renderSize);
+
+/**
+ * Binds the lights and the lists for the shading pass.
+ */
+void BindTiledLights(const TiledLights& tiled);
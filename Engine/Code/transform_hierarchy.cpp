@@ -0,0 +1,139 @@
+#include "transform_hierarchy.h"
+#include "job_system.h"
+
+u32 CreateTransform(TransformHierarchy& hierarchy, u32 parentId, const glm::vec3& position, const glm::quat& rotation, const glm::vec3& scale, EntityHandle entity)
+{
+    const u32 id = hierarchy.idToIndex.size();
+    const u32 index = hierarchy.positions.size();
+    const u32 parent = parentId == TRANSFORM_ROOT ? TRANSFORM_ROOT : hierarchy.idToIndex[parentId];
+
+    hierarchy.positions.push_back(position);
+    hierarchy.rotations.push_back(rotation);
+    hierarchy.scales.push_back(scale);
+    hierarchy.parents.push_back(parent);
+    hierarchy.depths.push_back(parent == TRANSFORM_ROOT ? 0 : hierarchy.depths[parent] + 1);
+    hierarchy.worlds.push_back(glm::mat4(1.0f));
+    hierarchy.dirty.push_back(1);
+    hierarchy.entities.push_back(entity);
+
+    hierarchy.idToIndex.push_back(index);
+    hierarchy.indexToId.push_back(id);
+
+    // Appending keeps the order valid only when the new node is as deep as the deepest one
+    if (hierarchy.levelStarts.empty() || hierarchy.depths[index] + 2 < hierarchy.levelStarts.size())
+        hierarchy.needsSort = true;
+    else if (hierarchy.depths[index] + 2 == hierarchy.levelStarts.size())
+        hierarchy.levelStarts.back() = index + 1;
+    else
+        hierarchy.levelStarts.push_back(index + 1);
+
+    return id;
+}
+
+void SetLocalTransform(TransformHierarchy& hierarchy, u32 id, const glm::vec3& position, const glm::quat& rotation, const glm::vec3& scale)
+{
+    const u32 index = hierarchy.idToIndex[id];
+    hierarchy.positions[index] = position;
+    hierarchy.rotations[index] = rotation;
+    hierarchy.scales[index] = scale;
+    hierarchy.dirty[index] = 1;
+}
+
+const glm::mat4& GetWorldTransform(const TransformHierarchy& hierarchy, u32 id)
+{
+    return hierarchy.worlds[hierarchy.idToIndex[id]];
+}
+
+template <typename T>
+static void Reorder(std::vector<T>& values, const std::vector<u32>& order)
+{
+    std::vector<T> sorted(values.size());
+    for (u32 i = 0; i < order.size(); ++i)
+        sorted[i] = values[order[i]];
+    values.swap(sorted);
+}
+
+// Stable counting sort by depth
+static void SortByDepth(TransformHierarchy& hierarchy)
+{
+    const u32 nodeCount = hierarchy.positions.size();
+
+    u32 maxDepth = 0;
+    for (u32 i = 0; i < nodeCount; ++i)
+        maxDepth = glm::max(maxDepth, hierarchy.depths[i]);
+
+    hierarchy.levelStarts.assign(maxDepth + 2, 0);
+    for (u32 i = 0; i < nodeCount; ++i)
+        hierarchy.levelStarts[hierarchy.depths[i] + 1]++;
+    for (u32 d = 1; d < hierarchy.levelStarts.size(); ++d)
+        hierarchy.levelStarts[d] += hierarchy.levelStarts[d - 1];
+
+    std::vector<u32> order(nodeCount);
+    std::vector<u32> oldToNew(nodeCount);
+    std::vector<u32> cursor(hierarchy.levelStarts.begin(), hierarchy.levelStarts.end() - 1);
+    for (u32 i = 0; i < nodeCount; ++i)
+    {
+        const u32 newIndex = cursor[hierarchy.depths[i]]++;
+        order[newIndex] = i;
+        oldToNew[i] = newIndex;
+    }
+
+    Reorder(hierarchy.positions, order);
+    Reorder(hierarchy.rotations, order);
+    Reorder(hierarchy.scales, order);
+    Reorder(hierarchy.parents, order);
+    Reorder(hierarchy.depths, order);
+    Reorder(hierarchy.worlds, order);
+    Reorder(hierarchy.dirty, order);
+    Reorder(hierarchy.entities, order);
+    Reorder(hierarchy.indexToId, order);
+
+    for (u32 i = 0; i < nodeCount; ++i)
+    {
+        if (hierarchy.parents[i] != TRANSFORM_ROOT)
+            hierarchy.parents[i] = oldToNew[hierarchy.parents[i]];
+        hierarchy.idToIndex[hierarchy.indexToId[i]] = i;
+    }
+
+    hierarchy.needsSort = false;
+}
+
+u32 UpdateTransforms(TransformHierarchy& hierarchy, EntityStore& entities)
+{
+    if (hierarchy.needsSort)
+        SortByDepth(hierarchy);
+
+    std::atomic<u32> updatedCount{ 0 };
+
+    for (u32 level = 0; level + 1 < hierarchy.levelStarts.size(); ++level)
+    {
+        const u32 levelBegin = hierarchy.levelStarts[level];
+        const u32 levelEnd = hierarchy.levelStarts[level + 1];
+
+        ParallelFor(levelEnd - levelBegin, 512, [&](u32 begin, u32 end) {
+            u32 updated = 0;
+            for (u32 i = levelBegin + begin; i < levelBegin + end; ++i)
+            {
+                const u32 parent = hierarchy.parents[i];
+                if (!hierarchy.dirty[i] && (parent == TRANSFORM_ROOT || !hierarchy.dirty[parent]))
+                    continue;
+
+                // Children look at this flag when their level is processed
+                hierarchy.dirty[i] = 1;
+
+                const glm::mat4 local = glm::translate(hierarchy.positions[i]) * glm::mat4_cast(hierarchy.rotations[i]) * glm::scale(hierarchy.scales[i]);
+                hierarchy.worlds[i] = parent == TRANSFORM_ROOT ? local : hierarchy.worlds[parent] * local;
+
+                if (IsEntityAlive(entities, hierarchy.entities[i]))
+                    SetEntityTransform(entities, hierarchy.entities[i], hierarchy.worlds[i]);
+
+                updated++;
+            }
+            updatedCount += updated;
+        });
+    }
+
+    memset(hierarchy.dirty.data(), 0, hierarchy.dirty.size());
+
+    return updatedCount;
+}
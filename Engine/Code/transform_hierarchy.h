@@ -0,0 +1,49 @@
+//
+// transform_hierarchy.h: Parent/child transforms stored by depth, so each level can be updated
+// in parallel once the previous one is done. Only nodes whose local transform changed, and
+// their descendants, recompute the world matrix and push it to the entity that follows them.
+//
+
+#pragma once
+
+#include "platform.h"
+#include "entity_store.h"
+#include <glm/gtc/quaternion.hpp>
+
+#define TRANSFORM_ROOT UINT32_MAX
+
+struct TransformHierarchy
+{
+    // Sorted by depth, a parent is always stored before its children
+    std::vector<glm::vec3>    positions;
+    std::vector<glm::quat>    rotations;
+    std::vector<glm::vec3>    scales;
+    std::vector<u32>          parents; // TRANSFORM_ROOT for roots
+    std::vector<u32>          depths;
+    std::vector<glm::mat4>    worlds;
+    std::vector<u8>           dirty;
+    std::vector<EntityHandle> entities; // Entity following the node, slot UINT32_MAX when none
+    std::vector<u32>          levelStarts;
+
+    // Node ids handed out are stable, the storage order is not
+    std::vector<u32> idToIndex;
+    std::vector<u32> indexToId;
+
+    bool needsSort = false;
+};
+
+/**
+ * Returns the id of the new node. parentId is TRANSFORM_ROOT or the id of an existing node.
+ */
+u32 CreateTransform(TransformHierarchy& hierarchy, u32 parentId, const glm::vec3& position, const glm::quat& rotation, const glm::vec3& scale, EntityHandle entity);
+
+void SetLocalTransform(TransformHierarchy& hierarchy, u32 id, const glm::vec3& position, const glm::quat& rotation, const glm::vec3& scale);
+
+const glm::mat4& GetWorldTransform(const TransformHierarchy& hierarchy, u32 id);
+
+/**
+ * Recomputes the world matrices of the moved subtrees, level by level on the job threads,
+ * and writes them into the transforms and bounds of the entities that follow those nodes.
+ * Returns how many nodes were recomputed.
+ */
+u32 UpdateTransforms(TransformHierarchy& hierarchy, EntityStore& entities);
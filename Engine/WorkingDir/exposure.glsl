@@ -0,0 +1,11 @@
+#ifndef EXPOSURE_GLSL
+#define EXPOSURE_GLSL
+
+// Written on the GPU every frame by EXPOSURE_ADAPT, see exposure.h
+layout(binding = 5, std430) buffer Exposure
+{
+    float adaptedLuminance;
+    float exposure;
+};
+
+#endif
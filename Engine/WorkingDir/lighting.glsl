@@ -0,0 +1,224 @@
+#ifndef LIGHTING_GLSL
+#define LIGHTING_GLSL
+
+// Lighting shared by the forward and the deferred paths. The FEATURE_ flags of the variant
+// decide which light types are handled, whether they cast shadows and whether the point lights
+// come from the Forward+ tile lists, see shader_source.h.
+
+#include "view_params.glsl"
+
+struct Light
+{
+    uint            type;
+    vec3            color;
+    vec3            direction;
+    vec3            position;
+    float           intensity;
+    float           linear;
+    float           quadratic;
+};
+
+layout(binding = 0, std140) uniform GlobalParams
+{
+    uint            uLightCount;
+    Light           uLight[16];
+};
+
+vec3 CalculateDirectionalLight(Light light, vec3 vNormal, vec3 vViewDir) 
+{
+    vec3 lightDirection = normalize(-light.direction);
+    vec3 diffuse = light.color *  max(dot(lightDirection, vNormal), 0.0);
+    return (diffuse + diffuse * pow(max(dot(vNormal, normalize(lightDirection + vViewDir)), 0.0), 0.0) * 0.01) * light.intensity;
+}
+
+vec3 CalculatePointLight(Light light, vec3 vNormal, vec3 vPosition, vec3 vViewDir) 
+{
+    vec3 lightDirection = normalize(light.position - vPosition);
+    float distance = length(light.position - vPosition);
+    float attenuation = 1.0 / (1.0 + light.linear * distance + light.quadratic * distance * distance);      
+	return (light.color * max(dot(vNormal, lightDirection), 0.0) + light.color * pow(max(dot(vNormal, normalize(lightDirection + vViewDir)), 0.0), 14.0)) * light.intensity * attenuation;
+}
+
+#ifdef FEATURE_SHADOWS
+
+layout(binding = 2, std140) uniform ShadowParams
+{
+    mat4            uCascadeViewProjection[4];
+    vec4            uCascadeSplits;     // View depth where every cascade ends
+    vec4            uCascadeTexelSizes; // World units
+    vec3            uCameraForward;
+    int             uShadowLight;       // Index in uLight, -1 when nothing casts shadows
+};
+
+uniform sampler2DArrayShadow uShadowMap;
+
+float CalculateShadow(vec3 position, vec3 normal)
+{
+    float viewDepth = dot(position - uCameraPosition, uCameraForward);
+
+    int cascade = 0;
+    while (cascade < 4 && viewDepth > uCascadeSplits[cascade])
+        ++cascade;
+
+    if (cascade == 4)
+        return 1.0;
+
+    // Offsetting along the normal by about a texel keeps the surface from shadowing itself
+    vec3 offsetPosition = position + normal * uCascadeTexelSizes[cascade] * 1.5;
+    vec4 shadowPosition = uCascadeViewProjection[cascade] * vec4(offsetPosition, 1.0);
+    vec3 coords = shadowPosition.xyz / shadowPosition.w * 0.5 + 0.5;
+
+    vec2 texelSize = 1.0 / vec2(textureSize(uShadowMap, 0).xy);
+    float lit = 0.0;
+    for (int y = -1; y <= 1; ++y)
+        for (int x = -1; x <= 1; ++x)
+            lit += texture(uShadowMap, vec4(coords.xy + vec2(x, y) * texelSize, cascade, coords.z));
+
+    return lit / 9.0;
+}
+
+struct PointShadow
+{
+    vec4            positionRadius;
+    vec4            faceRects[6]; // Origin and size in the atlas, w is 0 until the face is rendered
+};
+
+layout(binding = 3, std140) uniform PointShadowParams
+{
+    ivec4           uLightPointShadow[4]; // Per light, -1 when it has no shadow
+    PointShadow     uPointShadow[32];
+};
+
+uniform sampler2DShadow uPointShadowAtlas;
+
+// Same faces as GL cube maps, and as GetPointShadowFaceViewProjection()
+const vec3 kFaceForward[6] = vec3[](vec3(1, 0, 0), vec3(-1, 0, 0), vec3(0, 1, 0), vec3(0, -1, 0), vec3(0, 0, 1), vec3(0, 0, -1));
+const vec3 kFaceUp[6] = vec3[](vec3(0, -1, 0), vec3(0, -1, 0), vec3(0, 0, 1), vec3(0, 0, -1), vec3(0, -1, 0), vec3(0, -1, 0));
+
+float CalculatePointShadow(int lightIndex, vec3 position, vec3 normal)
+{
+    int shadowIndex = uLightPointShadow[lightIndex / 4][lightIndex % 4];
+    if (shadowIndex < 0)
+        return 1.0;
+
+    vec4 positionRadius = uPointShadow[shadowIndex].positionRadius;
+    vec3 toPosition = position + normal * 0.02 - positionRadius.xyz;
+    vec3 absolute = abs(toPosition);
+
+    int face;
+    if (absolute.x >= absolute.y && absolute.x >= absolute.z)
+        face = toPosition.x > 0.0 ? 0 : 1;
+    else if (absolute.y >= absolute.z)
+        face = toPosition.y > 0.0 ? 2 : 3;
+    else
+        face = toPosition.z > 0.0 ? 4 : 5;
+
+    vec4 rect = uPointShadow[shadowIndex].faceRects[face];
+    if (rect.w == 0.0)
+        return 1.0;
+
+    // Projection of the face, a 90 degree perspective from POINT_SHADOW_NEAR to the radius
+    float distance = dot(toPosition, kFaceForward[face]);
+    vec3 right = cross(kFaceForward[face], kFaceUp[face]);
+    vec2 ndc = vec2(dot(toPosition, right), dot(toPosition, kFaceUp[face])) / distance;
+
+    float nearPlane = 0.05;
+    float farPlane = positionRadius.w;
+    float depth = ((farPlane + nearPlane) / (farPlane - nearPlane) - 2.0 * farPlane * nearPlane / ((farPlane - nearPlane) * distance)) * 0.5 + 0.5;
+
+    // Half a texel inside the tile, so the filtering never reads the neighbour tiles
+    float halfTexel = 0.5 / (rect.z * float(textureSize(uPointShadowAtlas, 0).x));
+    vec2 tileCoords = clamp(ndc * 0.5 + 0.5, halfTexel, 1.0 - halfTexel);
+
+    return texture(uPointShadowAtlas, vec3(rect.xy + tileCoords * rect.z, min(depth, 1.0)));
+}
+
+#endif
+
+vec3 ShadeDirectionalLight(int i, vec3 position, vec3 normal, vec3 viewDir)
+{
+    vec3 color = CalculateDirectionalLight(uLight[i], normal, viewDir);
+#ifdef FEATURE_SHADOWS
+    if (i == uShadowLight)
+        color *= CalculateShadow(position, normalize(normal));
+#endif
+    return color;
+}
+
+// shadowLight is the index in uLight the shadow of the light is looked up with, -1 for none
+vec3 ShadePointLight(Light light, int shadowLight, vec3 position, vec3 normal, vec3 viewDir)
+{
+    vec3 color = CalculatePointLight(light, normal, position, viewDir);
+#ifdef FEATURE_SHADOWS
+    if (shadowLight >= 0)
+        color *= CalculatePointShadow(shadowLight, position, normalize(normal));
+#endif
+    return color;
+}
+
+#ifdef FEATURE_TILED_LIGHTS
+
+#include "tiled_lights.glsl"
+
+// Only the point lights the culling pass left in the list of the tile of the fragment
+vec3 ShadeTilePointLights(vec3 position, vec3 normal, vec3 viewDir)
+{
+    int tilesPerRow = (int(uViewport.x) + TILE_SIZE - 1) / TILE_SIZE;
+    uint listStart = GetTileListStart(ivec2(gl_FragCoord.xy) / TILE_SIZE, tilesPerRow);
+
+    vec3 color = vec3(0.0);
+    uint count = uTileLightLists[listStart];
+    for (uint i = 0u; i < count; ++i)
+    {
+        TiledLight tiledLight = uTiledLights[uTileLightLists[listStart + 1u + i]];
+
+        Light light;
+        light.type = 1u;
+        light.color = tiledLight.colorIntensity.rgb;
+        light.direction = vec3(0.0);
+        light.position = tiledLight.positionRadius.xyz;
+        light.intensity = tiledLight.colorIntensity.w;
+        light.linear = tiledLight.attenuation.x;
+        light.quadratic = tiledLight.attenuation.y;
+        color += ShadePointLight(light, int(tiledLight.attenuation.z), position, normal, viewDir);
+    }
+    return color;
+}
+
+#endif
+
+// Only variants with both light types need to look at the type of every light. The tiled ones
+// take the point lights from the tile lists and only the directional ones from uLight.
+vec3 CalculateLighting(vec3 position, vec3 normal, vec3 viewDir)
+{
+    vec3 color = vec3(0.0);
+#ifdef FEATURE_TILED_LIGHTS
+#ifdef FEATURE_DIRECTIONAL_LIGHTS
+    for (int i = 0; i < uLightCount; ++i)
+    {
+        if (uLight[i].type == 0u)
+            color += ShadeDirectionalLight(i, position, normal, viewDir);
+    }
+#endif
+#ifdef FEATURE_POINT_LIGHTS
+    color += ShadeTilePointLights(position, normal, viewDir);
+#endif
+#elif defined(FEATURE_DIRECTIONAL_LIGHTS) || defined(FEATURE_POINT_LIGHTS)
+    for (int i = 0; i < uLightCount; ++i)
+    {
+#if defined(FEATURE_DIRECTIONAL_LIGHTS) && defined(FEATURE_POINT_LIGHTS)
+        if (uLight[i].type == 0u)
+            color += ShadeDirectionalLight(i, position, normal, viewDir);
+        else
+            color += ShadePointLight(uLight[i], i, position, normal, viewDir);
+#elif defined(FEATURE_DIRECTIONAL_LIGHTS)
+        color += ShadeDirectionalLight(i, position, normal, viewDir);
+#else
+        color += ShadePointLight(uLight[i], i, position, normal, viewDir);
+#endif
+    }
+#endif
+    return color;
+}
+
+#endif
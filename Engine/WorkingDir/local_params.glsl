@@ -0,0 +1,13 @@
+#ifndef LOCAL_PARAMS_GLSL
+#define LOCAL_PARAMS_GLSL
+
+// Per entity, see EntityLocalParams in engine.cpp
+layout(binding = 1, std140) uniform LocalParams
+{
+    mat4 uWorldMatrix;
+    mat4 uWorldViewProjectionMatrix;
+    mat3 uNormalMatrix;
+    mat4 uPreviousWorldMatrix; // Last frame's, uWorldMatrix if it was not drawn then
+};
+
+#endif
@@ -0,0 +1,51 @@
+#ifndef MATERIAL_GLSL
+#define MATERIAL_GLSL
+
+// See GPUMaterial in engine.h
+struct Material
+{
+    vec4 albedo;
+    vec4 emissive;
+    uint albedoTexture;
+    uint emissiveTexture;
+    uint specularTexture;
+    uint normalsTexture;
+    uint bumpTexture;
+    uint padding0;
+    uint padding1;
+    uint padding2;
+};
+
+layout(binding = 4, std430) readonly buffer Materials
+{
+    Material uMaterials[];
+};
+
+// One array per texture size, units 8 to 15
+layout(binding = 8) uniform sampler2DArray uTextureArrays[8];
+
+// The array index has to be a constant, hence the switch. The gradients are taken outside of
+// it, this is not uniform control flow.
+vec4 SampleMaterialTexture(uint packedLayer, vec2 texCoord, vec4 fallback)
+{
+    vec2 dx = dFdx(texCoord);
+    vec2 dy = dFdy(texCoord);
+    if (packedLayer == 0xFFFFFFFFu)
+        return fallback;
+
+    vec3 coords = vec3(texCoord, float(packedLayer & 0xFFFFu));
+    switch (packedLayer >> 16)
+    {
+        case 0u: return textureGrad(uTextureArrays[0], coords, dx, dy);
+        case 1u: return textureGrad(uTextureArrays[1], coords, dx, dy);
+        case 2u: return textureGrad(uTextureArrays[2], coords, dx, dy);
+        case 3u: return textureGrad(uTextureArrays[3], coords, dx, dy);
+        case 4u: return textureGrad(uTextureArrays[4], coords, dx, dy);
+        case 5u: return textureGrad(uTextureArrays[5], coords, dx, dy);
+        case 6u: return textureGrad(uTextureArrays[6], coords, dx, dy);
+        case 7u: return textureGrad(uTextureArrays[7], coords, dx, dy);
+    }
+    return fallback;
+}
+
+#endif
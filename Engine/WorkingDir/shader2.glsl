@@ -8,118 +8,71 @@
 layout(location=0) in vec3 aPosition;
 layout(location=1) in vec3 aNormals;
 layout(location=2) in vec2 aTexCoord;
+layout(location=5) in uint aMaterial; // Per instance, the base instance of the draw
 
+#include "view_params.glsl"
 
-struct Light
-{
-    unsigned int    type;
-    vec3            color;
-    vec3            direction;
-    vec3            position;
-    float           intensity;
-    float           linear;
-    float           quadratic;
-};
-
-
-layout(binding = 0, std140) uniform GlobalParams
-{
-    vec3 uCameraPosition;
-    unsigned int uLightCount;
-    Light uLight[16];
-};
-
-layout(binding = 1, std140) uniform LocalParams
-{
-    uniform mat4 uWorldMatrix;
-    uniform mat4 uWorldViewProjectionMatrix;
-};
+#include "local_params.glsl"
 
 out vec2 vTexCoord;
 out vec4 vPosition;
 out vec3 vNormal;
 out vec3 vViewDir;
+out vec4 vCurrentClip;
+out vec4 vPreviousClip;
+flat out uint vMaterial;
+
+// Same depth as the prepass, which the tiled variant tests against with GL_EQUAL
+invariant gl_Position;
 
 void main()
 {
-    gl_Position = uWorldViewProjectionMatrix * uWorldMatrix * vec4(aPosition, 1.0);
+    gl_Position = uWorldViewProjectionMatrix * vec4(aPosition, 1.0);
 
     vPosition = uWorldMatrix * vec4(aPosition, 1.0);
-    vNormal = normalize(mat3(transpose(inverse(uWorldMatrix))) * aNormals);
+    vCurrentClip = uUnjitteredViewProjectionMatrix * vPosition;
+    vPreviousClip = uPreviousViewProjectionMatrix * uPreviousWorldMatrix * vec4(aPosition, 1.0);
+    vNormal = normalize(uNormalMatrix * aNormals);
     vTexCoord = aTexCoord;
+    vMaterial = aMaterial;
     
     vViewDir = uCameraPosition - vPosition.xyz;
 } 
 
 #elif defined(FRAGMENT) ///////////////////////////////////////////////
 
-struct Light
-{
-    unsigned int    type;
-    vec3            color;
-    vec3            direction;
-    vec3            position;
-    float           intensity;
-    float           linear;
-    float           quadratic;
-};
+#include "lighting.glsl"
+#include "material.glsl"
+
+// Nothing below moves the depth, so occluded fragments are rejected before shading
+layout(early_fragment_tests) in;
 
 in vec2 vTexCoord;
 in vec3 vNormal;
 in vec4 vPosition;
 in vec3 vViewDir;
-
-uniform sampler2D uTexture;
-
-layout(binding = 0, std140) uniform GlobalParams
-{
-    vec3            uCameraPosition;
-    unsigned int    uLightCount;
-    Light           uLight[16];
-};
+in vec4 vCurrentClip;
+in vec4 vPreviousClip;
+flat in uint vMaterial;
 
 layout(location = 0) out vec4 oColor;
 layout(location = 1) out vec4 oNormals;
 layout(location = 2) out vec4 oAlbedo;
 layout(location = 3) out vec4 oPosition;
-
-vec3 CalculateDirectionalLight(Light light, vec3 vNormal, vec3 vViewDir) 
-{
-    vec3 lightDirection = normalize(-light.direction);
-    vec3 diffuse = light.color *  max(dot(lightDirection, vNormal), 0.0);
-    return (diffuse + diffuse * pow(max(dot(vNormal, normalize(lightDirection + vViewDir)), 0.0), 0.0) * 0.01) * light.intensity;
-}
-
-vec3 CalculatePointLight(Light light, vec3 vNormal, vec3 vPosition, vec3 vViewDir) 
-{
-    vec3 lightDirection = normalize(light.position - vPosition);
-    float distance = length(light.position - vPosition);
-    float attenuation = 1.0 / (1.0 + light.linear * distance + light.quadratic * distance * distance);      
-	return (light.color * max(dot(vNormal, lightDirection), 0.0) + light.color * pow(max(dot(vNormal, normalize(lightDirection + vViewDir)), 0.0), 14.0)) * light.intensity * attenuation;
-}
+layout(location = 4) out vec2 oMotion;
 
 void main()
 {
-    vec3 finalColor = vec3(0.0);
-    for (int i = 0; i < uLightCount; ++i)
-    {
-        switch (uLight[i].type)
-        {
-            case 0:
-                finalColor += CalculateDirectionalLight(uLight[i], vNormal, normalize(vViewDir));
-            break;
-            case 1:
-                finalColor += CalculatePointLight(uLight[i], vNormal, vPosition.xyz, normalize(vViewDir));
-            break;
-        }
-    }
+    vec3 finalColor = CalculateLighting(vPosition.xyz, vNormal, normalize(vViewDir));
 
-    oColor = vec4(finalColor, 1.0) + texture(uTexture, vTexCoord) * 0.2;
+    Material material = uMaterials[vMaterial];
+    vec4 albedo = SampleMaterialTexture(material.albedoTexture, vTexCoord, vec4(material.albedo.rgb, 1.0));
+
+    oColor = vec4(finalColor, 1.0) + albedo * 0.2;
     oNormals = vec4(vNormal, 1.0);
-    oAlbedo = texture(uTexture, vTexCoord);
+    oAlbedo = albedo;
     oPosition = vPosition;
-
-    gl_FragDepth = gl_FragCoord.z - 0.1;
+    oMotion = (vCurrentClip.xy / vCurrentClip.w - vPreviousClip.xy / vPreviousClip.w) * 0.5;
 }
 
 #endif
@@ -134,30 +87,33 @@ void main()
 layout(location=0) in vec3 aPosition;
 layout(location=1) in vec3 aNormals;
 layout(location=2) in vec2 aTexCoord;
+layout(location=5) in uint aMaterial; // Per instance, the base instance of the draw
 
-layout(binding = 0, std140) uniform GlobalParams
-{
-    vec3 uCameraPosition;
-};
+#include "view_params.glsl"
 
-layout(binding = 1, std140) uniform LocalParams
-{
-    uniform mat4 uWorldMatrix;
-    uniform mat4 uWorldViewProjectionMatrix;
-};
+#include "local_params.glsl"
 
 out vec2 vTexCoord;
 out vec4 vPosition;
 out vec3 vNormal;
 out vec3 vViewDir;
+out vec4 vCurrentClip;
+out vec4 vPreviousClip;
+flat out uint vMaterial;
+
+// Same depth as the prepass, which the pass can test against with GL_EQUAL
+invariant gl_Position;
 
 void main()
 {
-    gl_Position = uWorldViewProjectionMatrix * uWorldMatrix * vec4(aPosition, 1.0);
+    gl_Position = uWorldViewProjectionMatrix * vec4(aPosition, 1.0);
 
     vPosition = vec4(vec3(uWorldMatrix * vec4(aPosition, 1.0)), 1.0);
-    vNormal = mat3(transpose(inverse(uWorldMatrix))) * aNormals;
+    vCurrentClip = uUnjitteredViewProjectionMatrix * vPosition;
+    vPreviousClip = uPreviousViewProjectionMatrix * uPreviousWorldMatrix * vec4(aPosition, 1.0);
+    vNormal = uNormalMatrix * aNormals;
     vTexCoord = aTexCoord;
+    vMaterial = aMaterial;
     
     vViewDir = uCameraPosition - vPosition.xyz;
 } 
@@ -168,27 +124,31 @@ in vec2 vTexCoord;
 in vec3 vNormal;
 in vec4 vPosition;
 in vec3 vViewDir;
+in vec4 vCurrentClip;
+in vec4 vPreviousClip;
+flat in uint vMaterial;
 
-uniform sampler2D uTexture;
+#include "material.glsl"
 
-layout(binding = 0, std140) uniform GlobalParams
-{
-    vec3            uCameraPosition;
-};
+// Nothing below moves the depth, so occluded fragments are rejected before shading
+layout(early_fragment_tests) in;
 
 layout(location = 0) out vec4 oColor;
 layout(location = 1) out vec4 oNormals;
 layout(location = 2) out vec4 oAlbedo;
 layout(location = 3) out vec4 oPosition;
+layout(location = 4) out vec2 oMotion;
 
 void main() {
 
-	oColor = texture(uTexture, vTexCoord);
+    Material material = uMaterials[vMaterial];
+    vec4 albedo = SampleMaterialTexture(material.albedoTexture, vTexCoord, vec4(material.albedo.rgb, 1.0));
+
+	oColor = albedo;
     oNormals = vec4(vNormal, 1.0);
-    oAlbedo = texture(uTexture, vTexCoord);
+    oAlbedo = albedo;
     oPosition = vPosition;
-
-    gl_FragDepth = gl_FragCoord.z - 0.2;
+    oMotion = (vCurrentClip.xy / vCurrentClip.w - vPreviousClip.xy / vPreviousClip.w) * 0.5;
 }
 
 #endif
@@ -204,24 +164,6 @@ void main() {
 layout(location=0) in vec3 aPosition;
 layout(location=1) in vec2 aTexCoord;
 
-struct Light
-{
-    unsigned int    type;
-    vec3            color;
-    vec3            direction;
-    vec3            position;
-    float           intensity;
-    float           linear;
-    float           quadratic;
-};
-
-layout(binding = 0, std140) uniform GlobalParams
-{
-    vec3            uCameraPosition;
-    unsigned int    uLightCount;
-    Light           uLight[16];
-};
-
 out vec2 vTexCoord;
 
 void main() {
@@ -233,105 +175,1179 @@ void main() {
 
 #elif defined(FRAGMENT) ///////////////////////////////////////////////
 
-struct Light
+#include "lighting.glsl"
+
+uniform sampler2D uPositionTexture;
+uniform sampler2D uNormalsTexture;
+uniform sampler2D uAlbedoTexture;
+uniform sampler2D uDepthTexture;
+uniform sampler2D uOcclusionTexture;      // Half resolution, see ssao.h
+uniform sampler2D uOcclusionDepthTexture; // Its linear depth
+uniform bool uAmbientOcclusion;
+
+in vec2 vTexCoord;
+
+layout(location = 0) out vec4 oColor;
+
+// Bilinear weights of the four closest half resolution texels, times how close their depth is to
+// the pixel's, so the occlusion of a surface does not bleed onto the one behind
+float UpsampleOcclusion(ivec2 texel, float depth)
+{
+    ivec2 size = (ivec2(uViewport.xy) + 1) / 2;
+    vec2 position = (vec2(texel) + 0.5) * 0.5 - 0.5;
+    ivec2 base = ivec2(floor(position));
+    vec2 f = position - vec2(base);
+
+    float sum = 0.0;
+    float weightSum = 0.0;
+    for (int y = 0; y < 2; ++y)
+    {
+        for (int x = 0; x < 2; ++x)
+        {
+            ivec2 source = clamp(base + ivec2(x, y), ivec2(0), size - 1);
+            float sourceDepth = texelFetch(uOcclusionDepthTexture, source, 0).r;
+            float bilinear = (x == 0 ? 1.0 - f.x : f.x) * (y == 0 ? 1.0 - f.y : f.y);
+            float weight = sourceDepth > 0.0 ? bilinear / (0.001 + abs(sourceDepth - depth) / depth) : 0.0;
+            sum += texelFetch(uOcclusionTexture, source, 0).r * weight;
+            weightSum += weight;
+        }
+    }
+    return weightSum > 0.0 ? sum / weightSum : 1.0;
+}
+
+void main() {
+
+	// The G-buffer only fills the corner dynamic resolution rendered to, same as this pass
+	ivec2 texel = ivec2(gl_FragCoord.xy);
+	vec3 position = texelFetch(uPositionTexture, texel, 0).rgb;
+	vec3 normals = texelFetch(uNormalsTexture, texel, 0).rgb;
+	vec3 color = texelFetch(uAlbedoTexture, texel, 0).rgb;
+	float depth = texelFetch(uDepthTexture, texel, 0).r;
+
+	vec3  vViewDir = uCameraPosition - position;
+
+    vec3 finalColor = depth < 1.0 ? CalculateLighting(position, normals, normalize(vViewDir)) : vec3(0.0);
+
+    float ao = 1.0;
+    if (uAmbientOcclusion && depth < 1.0)
+        ao = UpsampleOcclusion(texel, -(uViewMatrix * vec4(position, 1.0)).z);
+
+    oColor = vec4(finalColor, 1.0) + vec4(color * ao, 1) * 0.2;
+
+}
+
+#endif
+#endif
+
+#ifdef SHADOW_DEPTH
+
+#if defined(VERTEX) ///////////////////////////////////////////////////
+
+layout(location=0) in vec3 aPosition;
+
+layout(binding = 1, std140) uniform LocalParams
 {
-    unsigned int    type;
-    vec3            color;
-    vec3            direction;
-    vec3            position;
-    float           intensity;
-    float           linear;
-    float           quadratic;
+    mat4 uWorldViewProjectionMatrix;
 };
 
-vec3 CalculateDirectionalLight(Light light, vec3 vNormal, vec3 vViewDir) 
+void main() {
+	gl_Position = uWorldViewProjectionMatrix * vec4(aPosition, 1.0);
+}
+
+#elif defined(FRAGMENT) ///////////////////////////////////////////////
+
+// Depth only, no color attachments
+void main() {
+}
+
+#endif
+#endif
+
+//////////////
+
+#ifdef DEPTH_PREPASS
+
+#if defined(VERTEX) ///////////////////////////////////////////////////
+
+layout(location=0) in vec3 aPosition;
+
+#include "local_params.glsl"
+
+invariant gl_Position;
+
+void main()
 {
-    vec3 lightDirection = normalize(-light.direction);
-    vec3 diffuse = light.color *  max(dot(lightDirection, vNormal), 0.0);
-    return (diffuse + diffuse * pow(max(dot(vNormal, normalize(lightDirection + vViewDir)), 0.0), 0.0) * 0.01) * light.intensity;
+    gl_Position = uWorldViewProjectionMatrix * vec4(aPosition, 1.0);
 }
 
-vec3 CalculatePointLight(Light light, vec3 vNormal, vec3 vPosition, vec3 vViewDir) 
+#elif defined(FRAGMENT) ///////////////////////////////////////////////
+
+// Depth only, the color writes are masked
+void main()
 {
-    vec3 lightDirection = normalize(light.position - vPosition);
-    float distance = length(light.position - vPosition);
-    float attenuation = 1.0 / (1.0 + light.linear * distance + light.quadratic * distance * distance);      
-	return (light.color * max(dot(vNormal, lightDirection), 0.0) + light.color * pow(max(dot(vNormal, normalize(lightDirection + vViewDir)), 0.0), 14.0)) * light.intensity * attenuation;
 }
 
-uniform sampler2D uPositionTexture;
-uniform sampler2D uNormalsTexture;
-uniform sampler2D uAlbedoTexture;
-uniform sampler2D uDepthTexture;
+#endif
+#endif
 
-layout(binding = 0, std140) uniform GlobalParams
+#ifdef POINT_SHADOW_DEPTH
+
+#if defined(VERTEX) ///////////////////////////////////////////////////
+
+layout(location=0) in vec3 aPosition;
+
+layout(binding = 1, std140) uniform LocalParams
 {
-    vec3            uCameraPosition;
-    unsigned int    uLightCount;
-    Light           uLight[16];
+    mat4 uWorldMatrix;
 };
 
-in vec2 vTexCoord;
+void main() {
+	gl_Position = uWorldMatrix * vec4(aPosition, 1.0);
+}
 
-layout(location = 0) out vec4 oColor;
+#elif defined(GEOMETRY) ///////////////////////////////////////////////
+
+// One invocation per cube face, each sends the triangle to the viewport of its tile
+layout(triangles, invocations = 6) in;
+layout(triangle_strip, max_vertices = 3) out;
+
+uniform mat4 uFaceViewProjection[6];
+uniform int  uFaceMask; // Faces rendered this frame
 
 void main() {
+    if ((uFaceMask & (1 << gl_InvocationID)) == 0)
+        return;
 
-	vec3 position = texture(uPositionTexture, vTexCoord).rgb;
-	vec3 normals = texture(uNormalsTexture, vTexCoord).rgb;
-	vec3 color = texture(uAlbedoTexture, vTexCoord).rgb;
-	float depth = texture(uDepthTexture, vTexCoord).r;
+    vec4 positions[3];
+    for (int i = 0; i < 3; ++i)
+        positions[i] = uFaceViewProjection[gl_InvocationID] * gl_in[i].gl_Position;
 
-	vec3  vViewDir = uCameraPosition - position;
+    // Triangles completely outside one of the side planes never reach the face
+    for (int axis = 0; axis < 2; ++axis)
+    {
+        if (positions[0][axis] < -positions[0].w && positions[1][axis] < -positions[1].w && positions[2][axis] < -positions[2].w)
+            return;
+        if (positions[0][axis] > positions[0].w && positions[1][axis] > positions[1].w && positions[2][axis] > positions[2].w)
+            return;
+    }
 
-    vec3 finalColor = vec3(0.0);
-    for (int i = 0; i < uLightCount; ++i)
+    for (int i = 0; i < 3; ++i)
     {
-        if (depth < 1.0)
-        {
-            switch (uLight[i].type)
-            {
-                case 0:
-                    finalColor += CalculateDirectionalLight(uLight[i], normals, normalize(vViewDir));
-                break;
-                case 1:
-                    finalColor += CalculatePointLight(uLight[i], normals, position, normalize(vViewDir));
-                break;
-            }
-        }
+        gl_Position = positions[i];
+        gl_ViewportIndex = gl_InvocationID;
+        EmitVertex();
     }
+    EndPrimitive();
+}
 
-    oColor = vec4(finalColor, 1.0) + vec4(color, 1) * 0.2;
+#elif defined(FRAGMENT) ///////////////////////////////////////////////
 
+void main() {
 }
 
 #endif
 #endif
 
-#ifdef GIZMOS
+#ifdef DEBUG_DRAW
 
 #if defined(VERTEX) ///////////////////////////////////////////////////
 
-layout(location=0) in vec3 aPosistion;
+layout(location=0) in vec3 aPosition;
+layout(location=1) in vec4 aOrigin; // Per instance, see DebugInstance in debug_draw.h
+layout(location=2) in vec4 aExtent;
+layout(location=3) in vec4 aColor;
+
+uniform mat4 uViewProjection;
 
-uniform mat4 projectionView;
-uniform mat4 model;
+out vec4 vColor;
 
 void main() {
-	gl_Position = projectionView * model * vec4(aPosistion, 1.0);
+	gl_Position = uViewProjection * vec4(aOrigin.xyz + aPosition * aExtent.xyz, 1.0);
+	vColor = aColor;
 }
 
 #elif defined(FRAGMENT) ///////////////////////////////////////////////
 
-layout(location = 0) out vec4 oColor;
+layout(early_fragment_tests) in;
 
-uniform vec3 lightColor;
+in vec4 vColor;
+
+layout(location = 0) out vec4 oColor;
 
 void main() {
-	oColor = vec4(lightColor, 0.6);
-    gl_FragDepth = gl_FragCoord.z - 0.2;
+	oColor = vColor;
+}
+
+#endif
+#endif
+
+///////////////////////////////////////////////
+
+#if defined(DOWNSAMPLE_R32F) || defined(DOWNSAMPLE_RGBA16F)
+
+#if defined(COMPUTE) //////////////////////////////////////////////////
+
+#ifdef DOWNSAMPLE_R32F
+#define OUTPUT_FORMAT r32f
+#else
+#define OUTPUT_FORMAT rgba16f
+#endif
+
+// DownsampleReduction
+#define REDUCTION_MIN     0
+#define REDUCTION_MAX     1
+#define REDUCTION_AVERAGE 2
+
+layout(local_size_x = 256) in;
+
+uniform sampler2D uSource;
+uniform int uSourceLevel;
+uniform ivec2 uSourceSize;
+uniform ivec2 uOutputSize; // Of the first level
+uniform int uLevelCount;
+uniform int uReduction;
+
+// DOWNSAMPLE_LEVELS_PER_DISPATCH levels, the last group reads the ones the others wrote
+layout(binding = 0, OUTPUT_FORMAT) coherent uniform image2D uLevel0;
+layout(binding = 1, OUTPUT_FORMAT) coherent uniform image2D uLevel1;
+layout(binding = 2, OUTPUT_FORMAT) coherent uniform image2D uLevel2;
+layout(binding = 3, OUTPUT_FORMAT) coherent uniform image2D uLevel3;
+layout(binding = 4, OUTPUT_FORMAT) coherent uniform image2D uLevel4;
+layout(binding = 5, OUTPUT_FORMAT) coherent uniform image2D uLevel5;
+layout(binding = 6, OUTPUT_FORMAT) coherent uniform image2D uLevel6;
+layout(binding = 7, OUTPUT_FORMAT) coherent uniform image2D uLevel7;
+
+layout(binding = 0, std430) coherent buffer Counter
+{
+    uint finishedGroups;
+};
+
+shared vec4 sTile[16][16];
+shared bool sLastGroup;
+
+vec4 Reduce(vec4 a, vec4 b, vec4 c, vec4 d)
+{
+    if (uReduction == REDUCTION_MIN)
+        return min(min(a, b), min(c, d));
+    if (uReduction == REDUCTION_MAX)
+        return max(max(a, b), max(c, d));
+    return (a + b + c + d) * 0.25;
+}
+
+ivec2 GetLevelSize(int level)
+{
+    return max(uOutputSize >> level, ivec2(1));
+}
+
+void StoreLevel(int level, ivec2 texel, vec4 value)
+{
+    if (level >= uLevelCount || any(greaterThanEqual(texel, GetLevelSize(level))))
+        return;
+
+    switch (level)
+    {
+    case 0: imageStore(uLevel0, texel, value); break;
+    case 1: imageStore(uLevel1, texel, value); break;
+    case 2: imageStore(uLevel2, texel, value); break;
+    case 3: imageStore(uLevel3, texel, value); break;
+    case 4: imageStore(uLevel4, texel, value); break;
+    case 5: imageStore(uLevel5, texel, value); break;
+    case 6: imageStore(uLevel6, texel, value); break;
+    case 7: imageStore(uLevel7, texel, value); break;
+    }
+}
+
+// Only the levels the last group reduces from
+vec4 LoadLevel(int level, ivec2 texel)
+{
+    texel = min(texel, GetLevelSize(level) - 1);
+    switch (level)
+    {
+    case 5: return imageLoad(uLevel5, texel);
+    case 6: return imageLoad(uLevel6, texel);
+    }
+    return vec4(0.0);
+}
+
+vec4 LoadSource(ivec2 texel)
+{
+    return texelFetch(uSource, min(texel, uSourceSize - 1), uSourceLevel);
+}
+
+void main()
+{
+    int thread = int(gl_LocalInvocationIndex);
+    ivec2 local = ivec2(thread % 16, thread / 16);
+    ivec2 group = ivec2(gl_WorkGroupID.xy);
+
+    // Every thread reduces 4x4 texels of the source to 2x2 of the first level, and those to one
+    // of the second
+    vec4 quad[4];
+    for (int i = 0; i < 4; ++i)
+    {
+        ivec2 texel = group * 32 + local * 2 + ivec2(i & 1, i >> 1);
+        ivec2 source = texel * 2;
+        quad[i] = Reduce(LoadSource(source), LoadSource(source + ivec2(1, 0)), LoadSource(source + ivec2(0, 1)), LoadSource(source + ivec2(1, 1)));
+        StoreLevel(0, texel, quad[i]);
+    }
+
+    vec4 value = Reduce(quad[0], quad[1], quad[2], quad[3]);
+    StoreLevel(1, group * 16 + local, value);
+    sTile[local.y][local.x] = value;
+    barrier();
+
+    // The next four in shared memory, with a quarter of the threads every time
+    for (int level = 2; level < 6; ++level)
+    {
+        int size = 32 >> level;
+        ivec2 texel = ivec2(thread % size, thread / size);
+        bool inLevel = thread < size * size;
+        if (inLevel)
+        {
+            ivec2 above = texel * 2;
+            value = Reduce(sTile[above.y][above.x], sTile[above.y][above.x + 1], sTile[above.y + 1][above.x], sTile[above.y + 1][above.x + 1]);
+        }
+        barrier();
+
+        if (inLevel)
+        {
+            sTile[texel.y][texel.x] = value;
+            StoreLevel(level, group * size + texel, value);
+        }
+        barrier();
+    }
+
+    if (uLevelCount <= 6)
+        return;
+
+    // The group that finishes last sees the sixth level of every other and reduces the rest
+    memoryBarrierImage();
+    barrier();
+    if (thread == 0)
+        sLastGroup = atomicAdd(finishedGroups, 1u) == gl_NumWorkGroups.x * gl_NumWorkGroups.y - 1u;
+    barrier();
+    if (!sLastGroup)
+        return;
+
+    for (int level = 6; level < uLevelCount; ++level)
+    {
+        ivec2 size = GetLevelSize(level);
+        for (int i = thread; i < size.x * size.y; i += 256)
+        {
+            ivec2 above = ivec2(i % size.x, i / size.x) * 2;
+            StoreLevel(level, ivec2(i % size.x, i / size.x),
+                       Reduce(LoadLevel(level - 1, above), LoadLevel(level - 1, above + ivec2(1, 0)), LoadLevel(level - 1, above + ivec2(0, 1)), LoadLevel(level - 1, above + ivec2(1, 1))));
+        }
+        memoryBarrierImage();
+        barrier();
+    }
+
+    // Ready for the next dispatch
+    if (thread == 0)
+        finishedGroups = 0u;
+}
+
+#endif
+#endif
+
+///////////////////////////////////////////////
+
+#ifdef OCCLUSION_CULLING
+
+#if defined(COMPUTE) //////////////////////////////////////////////////
+
+layout(local_size_x = 64) in;
+
+struct CullInstance
+{
+    vec4 boundsMin;
+    vec4 boundsMax;
+    uint slot;
+    uint firstDraw;
+    uint drawCount;
+    uint padding;
+};
+
+struct DrawCommand
+{
+    uint count;
+    uint instanceCount;
+    uint firstIndex;
+    uint baseVertex;
+    uint baseInstance;
+};
+
+layout(binding = 0, std430) readonly buffer Instances
+{
+    CullInstance instances[];
+};
+
+layout(binding = 1, std430) buffer Draws
+{
+    DrawCommand draws[];
+};
+
+layout(binding = 2, std430) buffer Visibility
+{
+    uint visibility[];
+};
+
+uniform mat4 uViewProjection;
+uniform uint uPhase;
+uniform uint uInstanceCount;
+uniform uint uDrawCount;
+uniform ivec2 uHiZSize;
+uniform int uHiZMipCount;
+uniform vec2 uViewportScale; // Part of the Hi-Z the frame covers, dynamic resolution renders to a corner
+uniform sampler2D uHiZTexture;
+
+bool IsOccluded(vec3 boundsMin, vec3 boundsMax)
+{
+    vec2 uvMin = vec2(1.0);
+    vec2 uvMax = vec2(0.0);
+    float closestDepth = 1.0;
+
+    for (int i = 0; i < 8; ++i)
+    {
+        vec3 corner = vec3((i & 1) != 0 ? boundsMax.x : boundsMin.x,
+                           (i & 2) != 0 ? boundsMax.y : boundsMin.y,
+                           (i & 4) != 0 ? boundsMax.z : boundsMin.z);
+        vec4 clip = uViewProjection * vec4(corner, 1.0);
+
+        // Crossing the near plane, the projected rectangle is meaningless
+        if (clip.w <= 0.0)
+            return false;
+
+        vec3 ndc = clip.xyz / clip.w;
+        uvMin = min(uvMin, ndc.xy * 0.5 + 0.5);
+        uvMax = max(uvMax, ndc.xy * 0.5 + 0.5);
+        closestDepth = min(closestDepth, ndc.z * 0.5 + 0.5);
+    }
+
+    uvMin = clamp(uvMin, 0.0, 1.0) * uViewportScale;
+    uvMax = clamp(uvMax, 0.0, 1.0) * uViewportScale;
+
+    // Level where the rectangle covers at most 2x2 texels
+    vec2 sizeInTexels = (uvMax - uvMin) * vec2(uHiZSize);
+    int level = int(ceil(log2(max(max(sizeInTexels.x, sizeInTexels.y), 1.0))));
+    level = clamp(level, 0, uHiZMipCount - 1);
+
+    ivec2 levelSize = textureSize(uHiZTexture, level);
+    ivec2 texelMin = clamp(ivec2(uvMin * vec2(levelSize)), ivec2(0), levelSize - 1);
+    ivec2 texelMax = clamp(ivec2(uvMax * vec2(levelSize)), ivec2(0), levelSize - 1);
+
+    float sceneDepth = max(max(texelFetch(uHiZTexture, texelMin, level).r,
+                               texelFetch(uHiZTexture, ivec2(texelMax.x, texelMin.y), level).r),
+                           max(texelFetch(uHiZTexture, ivec2(texelMin.x, texelMax.y), level).r,
+                               texelFetch(uHiZTexture, texelMax, level).r));
+
+    return closestDepth > sceneDepth;
+}
+
+void main()
+{
+    uint instanceIdx = gl_GlobalInvocationID.x;
+    if (instanceIdx >= uInstanceCount)
+        return;
+
+    CullInstance instance = instances[instanceIdx];
+    uint lastFrameVisible = visibility[instance.slot];
+    uint draw = 0u;
+
+    if (uPhase == 0u)
+    {
+        draw = lastFrameVisible;
+    }
+    else
+    {
+        uint visible = IsOccluded(instance.boundsMin.xyz, instance.boundsMax.xyz) ? 0u : 1u;
+        visibility[instance.slot] = visible;
+
+        // The first phase already drew it
+        draw = visible != 0u && lastFrameVisible == 0u ? 1u : 0u;
+    }
+
+    for (uint i = 0u; i < instance.drawCount; ++i)
+        draws[uPhase * uDrawCount + instance.firstDraw + i].instanceCount = draw;
 }
 
 #endif
 #endif
 
+
+///////////////////////////////////////////////
+
+#ifdef UPSCALE
+
+#if defined(VERTEX) ///////////////////////////////////////////////////
+
+layout(location=0) in vec3 aPosition;
+layout(location=1) in vec2 aTexCoord;
+
+out vec2 vTexCoord;
+
+void main()
+{
+    gl_Position = vec4(aPosition, 1.0);
+    vTexCoord = aTexCoord;
+}
+
+#elif defined(FRAGMENT) ///////////////////////////////////////////////
+
+#include "exposure.glsl"
+
+uniform sampler2D uColorTexture;
+uniform vec2 uSourceSize; // Pixels of uColorTexture the frame was rendered to, from its corner
+uniform float uSharpness;
+
+in vec2 vTexCoord;
+
+layout(location = 0) out vec4 oColor;
+
+// Fit of the ACES filmic curve by Krzysztof Narkowicz, HDR to [0, 1]
+vec3 Tonemap(vec3 color)
+{
+    return clamp((color * (2.51 * color + 0.03)) / (color * (2.43 * color + 0.59) + 0.14), 0.0, 1.0);
+}
+
+void main()
+{
+    vec2 texelSize = 1.0 / vec2(textureSize(uColorTexture, 0));
+
+    // Bilinear taps must not reach the texels outside the rendered corner
+    vec2 uvMin = 0.5 * texelSize;
+    vec2 uvMax = (uSourceSize - 0.5) * texelSize;
+    vec2 uv = clamp(vTexCoord * uSourceSize * texelSize, uvMin, uvMax);
+
+    vec3 center = texture(uColorTexture, uv).rgb;
+    vec3 left   = texture(uColorTexture, clamp(uv - vec2(texelSize.x, 0.0), uvMin, uvMax)).rgb;
+    vec3 right  = texture(uColorTexture, clamp(uv + vec2(texelSize.x, 0.0), uvMin, uvMax)).rgb;
+    vec3 down   = texture(uColorTexture, clamp(uv - vec2(0.0, texelSize.y), uvMin, uvMax)).rgb;
+    vec3 up     = texture(uColorTexture, clamp(uv + vec2(0.0, texelSize.y), uvMin, uvMax)).rgb;
+
+    // Unsharp mask with the cross of source texels around, kept inside their range so edges do not ring
+    vec3 sharpened = center + uSharpness * (4.0 * center - left - right - down - up);
+    vec3 minColor = min(center, min(min(left, right), min(down, up)));
+    vec3 maxColor = max(center, max(max(left, right), max(down, up)));
+
+    vec3 color = clamp(sharpened, minColor, maxColor);
+
+    oColor = vec4(Tonemap(color * exposure), 1.0);
+}
+
+#endif
+#endif
+
+///////////////////////////////////////////////
+
+#ifdef TEMPORAL_AA
+
+#if defined(VERTEX) ///////////////////////////////////////////////////
+
+layout(location=0) in vec3 aPosition;
+layout(location=1) in vec2 aTexCoord;
+
+out vec2 vTexCoord;
+
+void main()
+{
+    gl_Position = vec4(aPosition, 1.0);
+    vTexCoord = aTexCoord;
+}
+
+#elif defined(FRAGMENT) ///////////////////////////////////////////////
+
+#include "view_params.glsl"
+
+uniform sampler2D uColorTexture;
+uniform sampler2D uDepthTexture;
+uniform sampler2D uMotionTexture;
+uniform sampler2D uHistoryTexture;
+uniform bool uHistoryValid;
+uniform float uFeedback;
+
+in vec2 vTexCoord;
+
+layout(location = 0) out vec4 oColor;
+
+void main()
+{
+    // The frame was rendered to the uViewport.xy corner of the scene textures
+    vec2 renderSize = uViewport.xy;
+    vec2 texelSize = 1.0 / vec2(textureSize(uColorTexture, 0));
+    ivec2 centerTexel = ivec2(min(vTexCoord * renderSize, renderSize - 1.0));
+
+    // The colors around the pixel bound what the history can still be, and the closest surface
+    // around it gives the motion, so edges move with the object in front
+    vec3 minColor = vec3(1e9);
+    vec3 maxColor = vec3(-1e9);
+    float closestDepth = 1.0;
+    ivec2 closestTexel = centerTexel;
+    for (int y = -1; y <= 1; ++y)
+    {
+        for (int x = -1; x <= 1; ++x)
+        {
+            ivec2 texel = clamp(centerTexel + ivec2(x, y), ivec2(0), ivec2(renderSize) - 1);
+            vec3 color = texelFetch(uColorTexture, texel, 0).rgb;
+            minColor = min(minColor, color);
+            maxColor = max(maxColor, color);
+
+            float depth = texelFetch(uDepthTexture, texel, 0).r;
+            if (depth < closestDepth)
+            {
+                closestDepth = depth;
+                closestTexel = texel;
+            }
+        }
+    }
+
+    // Undo the jitter, the image moved uJitter.xy this frame
+    vec2 currentUv = clamp((vTexCoord + uJitter.xy) * renderSize * texelSize, 0.5 * texelSize, (renderSize - 0.5) * texelSize);
+    vec3 current = texture(uColorTexture, currentUv).rgb;
+
+    vec2 motion;
+    if (closestDepth < 1.0)
+    {
+        motion = texelFetch(uMotionTexture, closestTexel, 0).xy;
+    }
+    else
+    {
+        // Nothing was drawn, only the camera moved the far plane
+        vec2 ndc = vTexCoord * 2.0 - 1.0 + 2.0 * uJitter.xy;
+        vec4 position = uInverseViewProjectionMatrix * vec4(ndc, 1.0, 1.0);
+        vec4 previousClip = uPreviousViewProjectionMatrix * vec4(position.xyz / position.w, 1.0);
+        motion = vTexCoord - (previousClip.xy / previousClip.w * 0.5 + 0.5);
+    }
+
+    vec2 historyUv = vTexCoord - motion;
+    if (!uHistoryValid || any(lessThan(historyUv, vec2(0.0))) || any(greaterThan(historyUv, vec2(1.0))))
+    {
+        oColor = vec4(current, 1.0);
+        return;
+    }
+
+    vec3 history = clamp(texture(uHistoryTexture, historyUv).rgb, minColor, maxColor);
+    oColor = vec4(mix(current, history, uFeedback), 1.0);
+}
+
+#endif
+#endif
+
+///////////////////////////////////////////////
+
+#ifdef SSAO_DOWNSAMPLE
+
+#if defined(COMPUTE) //////////////////////////////////////////////////
+
+layout(local_size_x = 8, local_size_y = 8) in;
+
+#include "view_params.glsl"
+
+uniform sampler2D uDepthTexture;
+uniform sampler2D uNormalsTexture;
+uniform ivec2 uSize;
+
+layout(binding = 0, r32f) uniform writeonly image2D uDepthOutput;
+layout(binding = 1, rgba8) uniform writeonly image2D uNormalsOutput;
+
+void main()
+{
+    ivec2 texel = ivec2(gl_GlobalInvocationID.xy);
+    if (texel.x >= uSize.x || texel.y >= uSize.y)
+        return;
+
+    // The closest of the 2x2 block, so thin geometry in front is not lost. The depth buffer
+    // holds the rasterized depth, so the view depth comes straight from it.
+    ivec2 renderSize = ivec2(uViewport.xy);
+    float closestDepth = 1.0;
+    ivec2 closestTexel = texel * 2;
+    for (int y = 0; y < 2; ++y)
+    {
+        for (int x = 0; x < 2; ++x)
+        {
+            ivec2 source = min(texel * 2 + ivec2(x, y), renderSize - 1);
+            float depth = texelFetch(uDepthTexture, source, 0).r;
+            if (depth < closestDepth)
+            {
+                closestDepth = depth;
+                closestTexel = source;
+            }
+        }
+    }
+
+    if (closestDepth >= 1.0)
+    {
+        imageStore(uDepthOutput, texel, vec4(0.0));
+        imageStore(uNormalsOutput, texel, vec4(0.5, 0.5, 1.0, 0.0));
+        return;
+    }
+
+    vec3 normal = normalize(mat3(uViewMatrix) * texelFetch(uNormalsTexture, closestTexel, 0).xyz);
+    imageStore(uDepthOutput, texel, vec4(GetViewDepth(closestDepth)));
+    imageStore(uNormalsOutput, texel, vec4(normal * 0.5 + 0.5, 0.0));
+}
+
+#endif
+#endif
+
+///////////////////////////////////////////////
+
+#ifdef SSAO
+
+#if defined(COMPUTE) //////////////////////////////////////////////////
+
+#define GROUP_SIZE   16 // SSAO_GROUP_SIZE
+#define TILE_BORDER  8  // SSAO_TILE_BORDER
+#define TILE_SIZE    (GROUP_SIZE + 2 * TILE_BORDER)
+#define SAMPLE_COUNT 12 // SSAO_SAMPLE_COUNT
+
+layout(local_size_x = GROUP_SIZE, local_size_y = GROUP_SIZE) in;
+
+#include "view_params.glsl"
+
+uniform sampler2D uDepthTexture;
+uniform sampler2D uNormalsTexture;
+uniform ivec2 uSize;
+uniform float uRadius;
+uniform float uIntensity;
+
+layout(binding = 0, r8) uniform writeonly image2D uOutput;
+
+// View space positions of the group and TILE_BORDER texels around it, w is 0 where nothing was
+// drawn. Every sample of the group reads from here instead of the textures.
+shared vec4 sPositions[TILE_SIZE][TILE_SIZE];
+
+vec3 GetViewPosition(ivec2 texel, float depth)
+{
+    // Every half resolution texel covers 2x2 pixels of the render size. The third column of the
+    // projection holds the jitter.
+    vec2 ndc = (vec2(texel * 2) + 1.0) / uViewport.xy * 2.0 - 1.0;
+    vec2 xy = (ndc + vec2(uProjectionMatrix[2][0], uProjectionMatrix[2][1])) * depth / vec2(uProjectionMatrix[0][0], uProjectionMatrix[1][1]);
+    return vec3(xy, -depth);
+}
+
+void main()
+{
+    ivec2 tileOrigin = ivec2(gl_WorkGroupID.xy) * GROUP_SIZE - TILE_BORDER;
+    for (int i = int(gl_LocalInvocationIndex); i < TILE_SIZE * TILE_SIZE; i += GROUP_SIZE * GROUP_SIZE)
+    {
+        ivec2 tileTexel = ivec2(i % TILE_SIZE, i / TILE_SIZE);
+        ivec2 texel = clamp(tileOrigin + tileTexel, ivec2(0), uSize - 1);
+        float depth = texelFetch(uDepthTexture, texel, 0).r;
+        sPositions[tileTexel.y][tileTexel.x] = depth > 0.0 ? vec4(GetViewPosition(texel, depth), 1.0) : vec4(0.0);
+    }
+    barrier();
+
+    ivec2 texel = ivec2(gl_GlobalInvocationID.xy);
+    if (texel.x >= uSize.x || texel.y >= uSize.y)
+        return;
+
+    ivec2 center = ivec2(gl_LocalInvocationID.xy) + TILE_BORDER;
+    vec4 position = sPositions[center.y][center.x];
+    if (position.w == 0.0)
+    {
+        imageStore(uOutput, texel, vec4(1.0));
+        return;
+    }
+
+    vec3 normal = texelFetch(uNormalsTexture, texel, 0).xyz * 2.0 - 1.0;
+
+    // The radius on screen, limited to what the tile holds
+    float depth = -position.z;
+    float radiusPixels = clamp(uRadius * uProjectionMatrix[1][1] * 0.5 * float(uSize.y) / depth, 1.0, float(TILE_BORDER));
+
+    // A spiral rotated by a different angle in every pixel, the blur averages the noise out
+    float rotation = 6.2831853 * fract(52.9829189 * fract(dot(vec2(texel), vec2(0.06711056, 0.00583715))));
+
+    float occlusion = 0.0;
+    for (int i = 0; i < SAMPLE_COUNT; ++i)
+    {
+        float t = (float(i) + 0.5) / float(SAMPLE_COUNT);
+        float angle = rotation + float(i) * 2.3999632; // Golden angle
+        ivec2 offset = ivec2(round(vec2(cos(angle), sin(angle)) * sqrt(t) * radiusPixels));
+
+        vec4 samplePosition = sPositions[center.y + offset.y][center.x + offset.x];
+        if (samplePosition.w == 0.0)
+            continue;
+
+        // Points above the surface occlude it, less the further away they are
+        vec3 v = samplePosition.xyz - position.xyz;
+        float distanceSq = dot(v, v);
+        float cosine = dot(v, normal) * inversesqrt(distanceSq + 0.0001);
+        occlusion += max(cosine - 0.1, 0.0) * max(1.0 - distanceSq / (uRadius * uRadius), 0.0);
+    }
+
+    float ao = clamp(1.0 - uIntensity * occlusion / float(SAMPLE_COUNT), 0.0, 1.0);
+    imageStore(uOutput, texel, vec4(ao));
+}
+
+#endif
+#endif
+
+///////////////////////////////////////////////
+
+#ifdef SSAO_BLUR
+
+#if defined(COMPUTE) //////////////////////////////////////////////////
+
+#define GROUP_SIZE  64 // SSAO_BLUR_GROUP_SIZE
+#define BLUR_RADIUS 4
+
+layout(local_size_x = GROUP_SIZE) in;
+
+uniform sampler2D uOcclusionTexture;
+uniform sampler2D uDepthTexture;
+uniform ivec2 uSize;
+uniform ivec2 uDirection; // (1, 0) blurs rows, (0, 1) columns
+
+layout(binding = 0, r8) uniform writeonly image2D uOutput;
+
+// Occlusion and depth of the segment and BLUR_RADIUS texels at both ends
+shared vec2 sSamples[GROUP_SIZE + 2 * BLUR_RADIUS];
+
+ivec2 GetTexel(int along)
+{
+    int line = int(gl_WorkGroupID.y);
+    return uDirection.x != 0 ? ivec2(along, line) : ivec2(line, along);
+}
+
+void main()
+{
+    int length = uDirection.x != 0 ? uSize.x : uSize.y;
+    int segmentStart = int(gl_WorkGroupID.x) * GROUP_SIZE;
+    for (int i = int(gl_LocalInvocationIndex); i < GROUP_SIZE + 2 * BLUR_RADIUS; i += GROUP_SIZE)
+    {
+        ivec2 texel = GetTexel(clamp(segmentStart - BLUR_RADIUS + i, 0, length - 1));
+        sSamples[i] = vec2(texelFetch(uOcclusionTexture, texel, 0).r, texelFetch(uDepthTexture, texel, 0).r);
+    }
+    barrier();
+
+    int along = segmentStart + int(gl_LocalInvocationIndex);
+    if (along >= length)
+        return;
+
+    int center = int(gl_LocalInvocationIndex) + BLUR_RADIUS;
+    float depth = sSamples[center].y;
+    if (depth == 0.0)
+    {
+        imageStore(uOutput, GetTexel(along), vec4(1.0));
+        return;
+    }
+
+    // Gaussian, minus the samples of other surfaces, more than 10% away in depth
+    float sum = 0.0;
+    float weightSum = 0.0;
+    for (int offset = -BLUR_RADIUS; offset <= BLUR_RADIUS; ++offset)
+    {
+        vec2 s = sSamples[center + offset];
+        float weight = exp(-float(offset * offset) / 8.0) * max(1.0 - abs(s.y - depth) / (0.1 * depth), 0.0);
+        sum += s.x * weight;
+        weightSum += weight;
+    }
+
+    imageStore(uOutput, GetTexel(along), vec4(sum / weightSum));
+}
+
+#endif
+#endif
+
+///////////////////////////////////////////////
+
+#ifdef BLOOM_PREFILTER
+
+#if defined(COMPUTE) //////////////////////////////////////////////////
+
+layout(local_size_x = 8, local_size_y = 8) in;
+
+uniform sampler2D uColorTexture;
+uniform ivec2 uRenderSize;
+uniform ivec2 uSize;
+uniform float uThreshold;
+
+layout(binding = 0, rgba16f) uniform writeonly image2D uOutput;
+
+void main()
+{
+    ivec2 texel = ivec2(gl_GlobalInvocationID.xy);
+    if (texel.x >= uSize.x || texel.y >= uSize.y)
+        return;
+
+    vec3 color = vec3(0.0);
+    for (int i = 0; i < 4; ++i)
+        color += texelFetch(uColorTexture, min(texel * 2 + ivec2(i & 1, i >> 1), uRenderSize - 1), 0).rgb;
+    color *= 0.25;
+
+    // Soft threshold, the bloom fades in over a knee below it instead of popping
+    float brightness = max(color.r, max(color.g, color.b));
+    float knee = uThreshold * 0.5;
+    float soft = clamp(brightness - uThreshold + knee, 0.0, 2.0 * knee);
+    soft = soft * soft / (4.0 * knee + 0.0001);
+    float contribution = max(soft, brightness - uThreshold) / max(brightness, 0.0001);
+
+    imageStore(uOutput, texel, vec4(color * contribution, 1.0));
+}
+
+#endif
+#endif
+
+///////////////////////////////////////////////
+
+#ifdef BLOOM_COMPOSITE
+
+#if defined(VERTEX) ///////////////////////////////////////////////////
+
+layout(location=0) in vec3 aPosition;
+layout(location=1) in vec2 aTexCoord;
+
+void main()
+{
+    gl_Position = vec4(aPosition, 1.0);
+}
+
+#elif defined(FRAGMENT) ///////////////////////////////////////////////
+
+#include "view_params.glsl"
+
+uniform sampler2D uBloomTexture;
+uniform ivec2 uBloomSize; // Of the part of level 0 the frame wrote
+uniform int uLevelCount;
+uniform float uIntensity;
+
+layout(location = 0) out vec4 oColor;
+
+void main()
+{
+    // Added to the frame, every level bilinearly upsampled from the part of it the frame covers
+    vec2 uv = gl_FragCoord.xy / uViewport.xy;
+    vec3 bloom = vec3(0.0);
+    for (int level = 0; level < uLevelCount; ++level)
+    {
+        vec2 levelSize = vec2(max(uBloomSize >> level, ivec2(1)));
+        vec2 allocatedSize = vec2(textureSize(uBloomTexture, level));
+        vec2 levelUv = clamp(uv * levelSize, vec2(0.5), levelSize - 0.5) / allocatedSize;
+        bloom += textureLod(uBloomTexture, levelUv, float(level)).rgb;
+    }
+
+    oColor = vec4(bloom * uIntensity / float(uLevelCount), 0.0);
+}
+
+#endif
+#endif
+
+///////////////////////////////////////////////
+
+#ifdef EXPOSURE_HISTOGRAM
+
+#if defined(COMPUTE) //////////////////////////////////////////////////
+
+#define BIN_COUNT 256 // EXPOSURE_HISTOGRAM_BINS
+
+layout(local_size_x = 16, local_size_y = 16) in;
+
+uniform sampler2D uColorTexture;
+uniform ivec2 uRenderSize;
+uniform ivec2 uSize; // Pixels sampled, every other one of the render size
+uniform float uMinLogLuminance;
+uniform float uLogLuminanceRange;
+
+layout(binding = 0, std430) buffer Histogram
+{
+    uint bins[BIN_COUNT];
+};
+
+shared uint sBins[BIN_COUNT];
+
+void main()
+{
+    // The group counts in shared memory and adds its counts to the buffer once per bin
+    uint thread = gl_LocalInvocationIndex;
+    sBins[thread] = 0u;
+    barrier();
+
+    ivec2 texel = ivec2(gl_GlobalInvocationID.xy);
+    if (texel.x < uSize.x && texel.y < uSize.y)
+    {
+        vec3 color = texelFetch(uColorTexture, min(texel * 2, uRenderSize - 1), 0).rgb;
+        float luminance = dot(color, vec3(0.2126, 0.7152, 0.0722));
+
+        uint bin = 0u;
+        if (luminance > 0.0001)
+        {
+            float t = clamp((log2(luminance) - uMinLogLuminance) / uLogLuminanceRange, 0.0, 1.0);
+            bin = uint(t * float(BIN_COUNT - 2)) + 1u;
+        }
+        atomicAdd(sBins[bin], 1u);
+    }
+    barrier();
+
+    if (sBins[thread] != 0u)
+        atomicAdd(bins[thread], sBins[thread]);
+}
+
+#endif
+#endif
+
+///////////////////////////////////////////////
+
+#ifdef EXPOSURE_ADAPT
+
+#if defined(COMPUTE) //////////////////////////////////////////////////
+
+#define BIN_COUNT 256 // EXPOSURE_HISTOGRAM_BINS
+
+layout(local_size_x = BIN_COUNT) in;
+
+#include "exposure.glsl"
+
+uniform float uPixelCount;
+uniform float uMinLogLuminance;
+uniform float uLogLuminanceRange;
+uniform float uAdaptation;   // Fraction of the way to the measured luminance this frame
+uniform float uCompensation; // Exposure multiplier
+
+layout(binding = 0, std430) buffer Histogram
+{
+    uint bins[BIN_COUNT];
+};
+
+shared float sWeightedBins[BIN_COUNT];
+shared uint sBlackPixels;
+
+const float MIDDLE_GREY = 0.18;
+
+void main()
+{
+    uint thread = gl_LocalInvocationIndex;
+    uint count = bins[thread];
+    sWeightedBins[thread] = float(count) * float(thread);
+    if (thread == 0u)
+        sBlackPixels = count;
+
+    // Empty for the next frame
+    bins[thread] = 0u;
+    barrier();
+
+    for (uint stride = BIN_COUNT / 2; stride > 0u; stride >>= 1)
+    {
+        if (thread < stride)
+            sWeightedBins[thread] += sWeightedBins[thread + stride];
+        barrier();
+    }
+
+    if (thread != 0u)
+        return;
+
+    // The average bin is the average log luminance, the geometric mean of the luminance
+    float litPixels = max(uPixelCount - float(sBlackPixels), 1.0);
+    float averageBin = sWeightedBins[0] / litPixels;
+    float luminance = exp2((averageBin - 1.0) / float(BIN_COUNT - 2) * uLogLuminanceRange + uMinLogLuminance);
+
+    float adapted = adaptedLuminance > 0.0 ? mix(adaptedLuminance, luminance, uAdaptation) : luminance;
+    adaptedLuminance = adapted;
+    exposure = uCompensation * MIDDLE_GREY / adapted;
+}
+
+#endif
+#endif
+
+///////////////////////////////////////////////
+
+#ifdef LIGHT_CULLING
+
+#if defined(COMPUTE) //////////////////////////////////////////////////
+
+#include "view_params.glsl"
+#include "tiled_lights.glsl"
+
+// A group per tile, a thread per pixel and then per light
+layout(local_size_x = TILE_SIZE, local_size_y = TILE_SIZE) in;
+
+uniform sampler2D uDepthTexture;
+uniform ivec2 uRenderSize;
+uniform uint uLightCount;
+
+shared uint sMinDepth;
+shared uint sMaxDepth;
+shared uint sLightCount;
+shared uint sLights[MAX_LIGHTS_PER_TILE];
+
+vec3 GetFarPoint(vec2 ndc)
+{
+    vec4 position = uInverseProjectionMatrix * vec4(ndc, 1.0, 1.0);
+    return position.xyz / position.w;
+}
+
+void main()
+{
+    uint thread = gl_LocalInvocationIndex;
+    if (thread == 0u)
+    {
+        sMinDepth = 0xFFFFFFFFu;
+        sMaxDepth = 0u;
+        sLightCount = 0u;
+    }
+    barrier();
+
+    // Depths are positive, so their bits sort like them. Where nothing was drawn there is no
+    // surface to light.
+    ivec2 texel = ivec2(gl_GlobalInvocationID.xy);
+    if (texel.x < uRenderSize.x && texel.y < uRenderSize.y)
+    {
+        float depth = texelFetch(uDepthTexture, texel, 0).r;
+        if (depth < 1.0)
+        {
+            atomicMin(sMinDepth, floatBitsToUint(depth));
+            atomicMax(sMaxDepth, floatBitsToUint(depth));
+        }
+    }
+    barrier();
+
+    bool empty = sMinDepth > sMaxDepth;
+    float nearDepth = empty ? 0.0 : GetViewDepth(uintBitsToFloat(sMinDepth));
+    float farDepth = empty ? 0.0 : GetViewDepth(uintBitsToFloat(sMaxDepth));
+
+    // Side planes of the tile, through the eye, facing inwards
+    vec2 ndcMin = vec2(gl_WorkGroupID.xy) * float(TILE_SIZE) / vec2(uRenderSize) * 2.0 - 1.0;
+    vec2 ndcMax = vec2(gl_WorkGroupID.xy + 1u) * float(TILE_SIZE) / vec2(uRenderSize) * 2.0 - 1.0;
+    vec3 bottomLeft = GetFarPoint(ndcMin);
+    vec3 bottomRight = GetFarPoint(vec2(ndcMax.x, ndcMin.y));
+    vec3 topLeft = GetFarPoint(vec2(ndcMin.x, ndcMax.y));
+    vec3 topRight = GetFarPoint(ndcMax);
+
+    vec3 planes[4] = vec3[](
+        normalize(cross(bottomLeft, topLeft)),
+        normalize(cross(topRight, bottomRight)),
+        normalize(cross(bottomRight, bottomLeft)),
+        normalize(cross(topLeft, topRight)));
+
+    uint lightCount = empty ? 0u : uLightCount;
+    for (uint i = thread; i < lightCount; i += uint(TILE_SIZE * TILE_SIZE))
+    {
+        vec4 positionRadius = uTiledLights[i].positionRadius;
+        vec3 center = (uViewMatrix * vec4(positionRadius.xyz, 1.0)).xyz;
+        float radius = positionRadius.w;
+
+        bool touches = -center.z + radius > nearDepth && -center.z - radius < farDepth;
+        for (int p = 0; p < 4 && touches; ++p)
+            touches = dot(planes[p], center) > -radius;
+
+        if (touches)
+        {
+            uint slot = atomicAdd(sLightCount, 1u);
+            if (slot < uint(MAX_LIGHTS_PER_TILE))
+                sLights[slot] = i;
+        }
+    }
+    barrier();
+
+    uint listStart = GetTileListStart(ivec2(gl_WorkGroupID.xy), int(gl_NumWorkGroups.x));
+    uint count = min(sLightCount, uint(MAX_LIGHTS_PER_TILE));
+    if (thread == 0u)
+        uTileLightLists[listStart] = count;
+
+    for (uint i = thread; i < count; i += uint(TILE_SIZE * TILE_SIZE))
+        uTileLightLists[listStart + 1u + i] = sLights[i];
+}
+
+#endif
+#endif
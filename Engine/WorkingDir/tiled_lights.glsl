@@ -0,0 +1,32 @@
+#ifndef TILED_LIGHTS_GLSL
+#define TILED_LIGHTS_GLSL
+
+// Point lights of the Forward+ path and the list of every tile, see tiled_lights.h
+
+#define TILE_SIZE           16  // TILED_LIGHTS_TILE_SIZE
+#define MAX_LIGHTS_PER_TILE 255 // TILED_LIGHTS_MAX_PER_TILE
+
+struct TiledLight
+{
+    vec4 positionRadius;
+    vec4 colorIntensity;
+    vec4 attenuation; // x: linear, y: quadratic, z: index in uLight for its shadow, -1 past them
+};
+
+layout(binding = 6, std430) readonly buffer TiledLights
+{
+    TiledLight uTiledLights[];
+};
+
+// Per tile, row by row: the light count, then MAX_LIGHTS_PER_TILE indices in uTiledLights
+layout(binding = 7, std430) buffer TileLightLists
+{
+    uint uTileLightLists[];
+};
+
+uint GetTileListStart(ivec2 tile, int tilesPerRow)
+{
+    return uint(tile.y * tilesPerRow + tile.x) * uint(MAX_LIGHTS_PER_TILE + 1);
+}
+
+#endif
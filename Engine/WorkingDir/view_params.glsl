@@ -0,0 +1,29 @@
+#ifndef VIEW_PARAMS_GLSL
+#define VIEW_PARAMS_GLSL
+
+// Written once per frame, see ViewParams in engine.h
+layout(binding = 4, std140) uniform ViewParams
+{
+    mat4 uViewMatrix;
+    mat4 uProjectionMatrix;
+    mat4 uViewProjectionMatrix;
+    mat4 uInverseViewMatrix;
+    mat4 uInverseProjectionMatrix;
+    mat4 uInverseViewProjectionMatrix;
+    vec3 uCameraPosition;
+    vec4 uViewport; // Width, height, and one over them
+
+    // Motion vectors compare where a point is with where it was, both without the jitter
+    mat4 uUnjitteredViewProjectionMatrix;
+    mat4 uPreviousViewProjectionMatrix;
+    vec4 uJitter; // xy: offset of the image this frame, in uv
+};
+
+// Distance in front of the camera of a depth buffer value
+float GetViewDepth(float depth)
+{
+    vec4 position = uInverseProjectionMatrix * vec4(0.0, 0.0, depth * 2.0 - 1.0, 1.0);
+    return -position.z / position.w;
+}
+
+#endif